@@ -0,0 +1,528 @@
+/** @file main.cpp
+*
+* @brief Headless benchmark that renders scenarios offscreen and writes frame
+*   timing statistics as JSON
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/14/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+
+#include "OffscreenPresentationEngine.h"
+#include "GraphicsDevice.h"
+#include "Renderer.h"
+#include "SubmitQueue.h"
+
+/**
+ * Parameters of one benchmark run
+ */
+struct Scenario {
+    std::string name;
+    SceneWorkload workload;
+    uint32_t width = 1024;
+    uint32_t height = 768;
+    uint32_t frames_in_flight = 3;
+};
+
+/**
+ * Summary of a series of timings in milliseconds
+ */
+struct TimingStats {
+    double mean = 0.0;
+    double p50 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+    size_t count = 0;
+};
+
+struct ScenarioResult {
+    Scenario scenario;
+    std::string device_name;
+    TimingStats cpu_ms;
+    TimingStats gpu_ms;
+    TimingStats frame_ms;
+
+    /**
+     * Frames written and dropped by frame capture, if enabled
+     */
+    uint64_t captured_frames = 0;
+    uint64_t dropped_frames = 0;
+
+    /**
+     * Peak device memory allocated from device local heaps
+     */
+    uint64_t device_local_peak_bytes = 0;
+
+    /**
+     * Size of one vertex in the layout chosen for the scene
+     */
+    uint32_t vertex_stride = 0;
+
+    /**
+     * Whether materials were bound through descriptor indexing
+     */
+    bool bindless = false;
+};
+
+/**
+ * Frame capture applied to every scenario, to measure its overhead
+ */
+struct CaptureSettings {
+    const char* directory = nullptr;
+    ImageFileFormat format = ImageFileFormat::Raw;
+};
+
+static Scenario makeScenario(const char* name, uint32_t triangles, uint32_t draws, uint32_t instances,
+    uint32_t width, uint32_t height, uint32_t frames_in_flight) {
+    Scenario scenario;
+    scenario.name = name;
+    scenario.workload.triangle_count = triangles;
+    scenario.workload.draw_count = draws;
+    scenario.workload.instance_count = instances;
+    scenario.width = width;
+    scenario.height = height;
+    scenario.frames_in_flight = frames_in_flight;
+    return scenario;
+}
+
+/**
+ * Built-in scenarios, each stressing one dimension. Sizes are kept small enough to run on CPU devices
+ */
+static std::vector<Scenario> getBuiltinScenarios() {
+    std::vector<Scenario> scenarios;
+    scenarios.push_back(makeScenario("baseline", 3, 1, 1, 1024, 768, 3));
+    scenarios.push_back(makeScenario("triangles", 100000, 1, 1, 1024, 768, 3));
+
+    // Same geometry without vertex quantization, to measure what the smaller vertices save in vertex fetch
+    Scenario float_vertices = makeScenario("triangles_float_vertices", 100000, 1, 1, 1024, 768, 3);
+    float_vertices.workload.full_precision_vertices = true;
+    scenarios.push_back(float_vertices);
+    scenarios.push_back(makeScenario("draws", 10000, 2000, 1, 1024, 768, 3));
+    scenarios.push_back(makeScenario("instances", 1000, 10, 100, 1024, 768, 3));
+
+    // Same instances all drawn at full detail, to measure what LOD selection saves
+    Scenario no_lod = makeScenario("instances_no_lod", 1000, 10, 100, 1024, 768, 3);
+    no_lod.workload.lod = false;
+    scenarios.push_back(no_lod);
+
+    // Most instances are hidden behind the first few, so these measure what each occlusion test saves
+    Scenario no_occlusion = makeScenario("instances_no_occlusion", 1000, 10, 100, 1024, 768, 3);
+    no_occlusion.workload.occlusion = OcclusionMode::None;
+    scenarios.push_back(no_occlusion);
+    Scenario cpu_occlusion = makeScenario("instances_cpu_occlusion", 1000, 10, 100, 1024, 768, 3);
+    cpu_occlusion.workload.occlusion = OcclusionMode::Cpu;
+    scenarios.push_back(cpu_occlusion);
+
+    // Draws cycle through textured materials, all from one bound set
+    Scenario materials = makeScenario("materials", 1000, 10, 100, 1024, 768, 3);
+    materials.workload.material_count = 8;
+    scenarios.push_back(materials);
+    scenarios.push_back(makeScenario("resolution", 3, 1, 1, 2560, 1440, 3));
+    scenarios.push_back(makeScenario("single_frame_in_flight", 10000, 100, 1, 1024, 768, 1));
+    return scenarios;
+}
+
+static const char* getOcclusionName(OcclusionMode mode) {
+    switch (mode) {
+    case OcclusionMode::Gpu:
+        return "gpu";
+    case OcclusionMode::Cpu:
+        return "cpu";
+    default:
+        return "none";
+    }
+}
+
+static TimingStats computeStats(std::vector<double> samples) {
+    TimingStats stats;
+    stats.count = samples.size();
+    if (samples.empty()) {
+        return stats;
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    double sum = 0.0;
+    for (double sample : samples) {
+        sum += sample;
+    }
+    stats.mean = sum / samples.size();
+
+    // Nearest rank percentiles
+    auto percentile = [&samples](double p) {
+        size_t rank = static_cast<size_t>(p * samples.size() + 0.5);
+        return samples[std::min(std::max(rank, static_cast<size_t>(1)), samples.size()) - 1];
+    };
+    stats.p50 = percentile(0.50);
+    stats.p99 = percentile(0.99);
+    stats.max = samples.back();
+    return stats;
+}
+
+static double getTime() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static ScenarioResult runScenario(const Scenario& scenario, uint32_t warmup_frames, uint32_t measured_frames,
+    const CaptureSettings& capture, bool submit_thread, bool verbose) {
+    ScenarioResult result;
+    result.scenario = scenario;
+
+    std::cout << "Running scenario " << scenario.name << std::endl;
+
+    OffscreenPresentationEngine* present = new OffscreenPresentationEngine(scenario.width, scenario.height,
+        scenario.frames_in_flight, nullptr, "vrbench");
+    GraphicsDevice* graphics_device = nullptr;
+    Renderer* renderer = nullptr;
+
+    std::vector<double> cpu_samples;
+    std::vector<double> gpu_samples;
+    std::vector<double> frame_samples;
+
+    try {
+        graphics_device = new GraphicsDevice(present, nullptr, verbose);
+        result.device_name = graphics_device->getDeviceProperties().deviceName;
+
+        // Measure the workload itself: full resolution, no foveation
+        renderer = new Renderer(graphics_device, present, nullptr, nullptr);
+        renderer->setShaderCode(GraphicsDevice::getShaderCode("vert.spv"),
+            GraphicsDevice::getShaderCode("frag.spv"));
+        renderer->setWorkload(scenario.workload);
+        renderer->setFoveation(getUnfoveated());
+        renderer->setDynamicResolution(false);
+        if (capture.directory) {
+            renderer->enableCapture(capture.directory, capture.format);
+        }
+        renderer->createCommandBuffer();
+        result.vertex_stride = renderer->getVertexFormat().stride;
+        result.bindless = renderer->getMaterialTable()->isBindless();
+
+        // CPU time then only covers building and queuing the frame, not its submission
+        if (submit_thread) {
+            graphics_device->getSubmitQueue()->start();
+        }
+
+        uint32_t total_frames = warmup_frames + measured_frames;
+        uint32_t frame = 0;
+        double last_submit = 0.0;
+
+        while (frame < total_frames) {
+            double start = getTime();
+            bool submitted = renderer->drawFrame();
+            double end = getTime();
+
+            // Not submitted means the next image is still in flight, so just try again
+            if (!submitted) {
+                continue;
+            }
+
+            if (frame >= warmup_frames) {
+                cpu_samples.push_back(end - start);
+                if (last_submit > 0.0) {
+                    frame_samples.push_back(end - last_submit);
+                }
+
+                // Timings are of the frame that last used this image, so they lag by the frames in flight
+                double gpu_ms;
+                if (renderer->getLastGpuTime(&gpu_ms)) {
+                    gpu_samples.push_back(gpu_ms);
+                }
+            }
+
+            last_submit = end;
+            frame++;
+        }
+
+        graphics_device->getSubmitQueue()->stop();
+        vkDeviceWaitIdle(graphics_device->device());
+
+        // Frames still being encoded are written before the renderer is destroyed, but aren't counted
+        if (renderer->getFrameCapture()) {
+            result.captured_frames = renderer->getFrameCapture()->getWrittenCount();
+            result.dropped_frames = renderer->getFrameCapture()->getDroppedCount();
+        }
+
+        MemoryStats memory_stats = graphics_device->getMemoryTelemetry()->getStats();
+        for (uint32_t i = 0; i < memory_stats.heap_count; i++) {
+            if (memory_stats.heaps[i].device_local) {
+                result.device_local_peak_bytes += memory_stats.heaps[i].counters.peak_bytes;
+            }
+        }
+    }
+    catch (...) {
+        if (graphics_device) {
+            graphics_device->getSubmitQueue()->stop();
+            vkDeviceWaitIdle(graphics_device->device());
+        }
+        delete renderer;
+        delete present;
+        delete graphics_device;
+        throw;
+    }
+
+    delete renderer;
+    delete present;
+    delete graphics_device;
+
+    result.cpu_ms = computeStats(cpu_samples);
+    result.gpu_ms = computeStats(gpu_samples);
+    result.frame_ms = computeStats(frame_samples);
+    return result;
+}
+
+static void writeStats(std::ostream& out, const char* name, const TimingStats& stats) {
+    out << "      \"" << name << "\": { \"mean\": " << stats.mean << ", \"p50\": " << stats.p50 << ", \"p99\": "
+        << stats.p99 << ", \"max\": " << stats.max << ", \"samples\": " << stats.count << " }";
+}
+
+static void writeResults(std::ostream& out, const std::vector<ScenarioResult>& results, uint32_t warmup_frames,
+    uint32_t measured_frames, const CaptureSettings& capture, bool submit_thread) {
+    out << "{\n";
+    out << "  \"warmup_frames\": " << warmup_frames << ",\n";
+    out << "  \"measured_frames\": " << measured_frames << ",\n";
+    out << "  \"submit_thread\": " << (submit_thread ? "true" : "false") << ",\n";
+    if (capture.directory) {
+        out << "  \"capture\": \"" << getImageFileExtension(capture.format) << "\",\n";
+    }
+    else {
+        out << "  \"capture\": null,\n";
+    }
+    out << "  \"scenarios\": [\n";
+
+    for (size_t i = 0; i < results.size(); i++) {
+        const ScenarioResult& result = results[i];
+        const Scenario& scenario = result.scenario;
+
+        out << "    {\n";
+        out << "      \"name\": \"" << scenario.name << "\",\n";
+        out << "      \"device\": \"" << result.device_name << "\",\n";
+        out << "      \"triangles\": " << scenario.workload.triangle_count << ",\n";
+        out << "      \"draws\": " << scenario.workload.draw_count << ",\n";
+        out << "      \"instances\": " << scenario.workload.instance_count << ",\n";
+        out << "      \"vertex_stride\": " << result.vertex_stride << ",\n";
+        out << "      \"lod\": " << (scenario.workload.lod ? "true" : "false") << ",\n";
+        out << "      \"occlusion\": \"" << getOcclusionName(scenario.workload.occlusion) << "\",\n";
+        out << "      \"materials\": " << scenario.workload.material_count << ",\n";
+        out << "      \"bindless\": " << (result.bindless ? "true" : "false") << ",\n";
+        out << "      \"width\": " << scenario.width << ",\n";
+        out << "      \"height\": " << scenario.height << ",\n";
+        out << "      \"frames_in_flight\": " << scenario.frames_in_flight << ",\n";
+        writeStats(out, "cpu_ms", result.cpu_ms);
+        out << ",\n";
+        writeStats(out, "gpu_ms", result.gpu_ms);
+        out << ",\n";
+        writeStats(out, "frame_ms", result.frame_ms);
+        out << ",\n";
+        out << "      \"device_local_peak_bytes\": " << result.device_local_peak_bytes;
+        if (capture.directory) {
+            out << ",\n";
+            out << "      \"captured_frames\": " << result.captured_frames << ",\n";
+            out << "      \"dropped_frames\": " << result.dropped_frames;
+        }
+        out << "\n    }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+
+    out << "  ]\n";
+    out << "}\n";
+}
+
+static void printUsage() {
+    std::cout << "usage: vrbench [options]\n"
+        "  --scenario NAME        run a built-in scenario, may be repeated (default: all)\n"
+        "  --list                 list built-in scenarios\n"
+        "  --triangles N          run a custom scenario with N triangles\n"
+        "  --draws N              custom scenario draw calls per eye\n"
+        "  --instances N          custom scenario instances per draw\n"
+        "  --width N, --height N  custom scenario resolution\n"
+        "  --frames-in-flight N   custom scenario frames in flight\n"
+        "  --float-vertices       custom scenario keeps 32-bit float vertices instead of quantizing them\n"
+        "  --no-lod               custom scenario draws every instance at full detail\n"
+        "  --occlusion MODE       custom scenario occlusion culling: none, gpu or cpu (default gpu)\n"
+        "  --materials N          custom scenario materials the draws cycle through (default 1)\n"
+        "  --warmup N             frames to render before measuring (default 60)\n"
+        "  --frames N             frames to measure (default 300)\n"
+        "  --output FILE          JSON results file (default vrbench.json)\n"
+        "  --capture DIR          capture every frame to DIR to measure capture overhead\n"
+        "  --capture-format FMT   raw, png or qoi (default raw)\n"
+        "  --submit-thread        submit and present frames on a dedicated thread\n"
+        "  --verbose              print Vulkan enumeration\n"
+        "Shaders are read from the working directory." << std::endl;
+}
+
+int main(int argc, char** argv) {
+    std::vector<Scenario> builtin = getBuiltinScenarios();
+    std::vector<Scenario> scenarios;
+    Scenario custom = makeScenario("custom", 3, 1, 1, 1024, 768, 3);
+    bool use_custom = false;
+    uint32_t warmup_frames = 60;
+    uint32_t measured_frames = 300;
+    const char* output = "vrbench.json";
+    bool verbose = false;
+    bool submit_thread = false;
+    CaptureSettings capture;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        uint32_t number = value ? static_cast<uint32_t>(strtoul(value, nullptr, 10)) : 0;
+
+        if (strcmp(arg, "--list") == 0) {
+            for (const Scenario& scenario : builtin) {
+                std::cout << scenario.name << std::endl;
+            }
+            return EXIT_SUCCESS;
+        }
+        else if (strcmp(arg, "--verbose") == 0) {
+            verbose = true;
+            continue;
+        }
+        else if (strcmp(arg, "--submit-thread") == 0) {
+            submit_thread = true;
+            continue;
+        }
+        else if (strcmp(arg, "--float-vertices") == 0) {
+            custom.workload.full_precision_vertices = true;
+            use_custom = true;
+            continue;
+        }
+        else if (strcmp(arg, "--no-lod") == 0) {
+            custom.workload.lod = false;
+            use_custom = true;
+            continue;
+        }
+        else if (strcmp(arg, "--help") == 0) {
+            printUsage();
+            return EXIT_SUCCESS;
+        }
+        else if (value == nullptr) {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+
+        if (strcmp(arg, "--scenario") == 0) {
+            auto match = std::find_if(builtin.begin(), builtin.end(), [value](const Scenario& scenario) {
+                return scenario.name == value;
+            });
+            if (match == builtin.end()) {
+                std::cerr << "Unknown scenario " << value << std::endl;
+                return EXIT_FAILURE;
+            }
+            scenarios.push_back(*match);
+        }
+        else if (strcmp(arg, "--occlusion") == 0) {
+            if (strcmp(value, "none") == 0) {
+                custom.workload.occlusion = OcclusionMode::None;
+            }
+            else if (strcmp(value, "gpu") == 0) {
+                custom.workload.occlusion = OcclusionMode::Gpu;
+            }
+            else if (strcmp(value, "cpu") == 0) {
+                custom.workload.occlusion = OcclusionMode::Cpu;
+            }
+            else {
+                std::cerr << "Unknown occlusion mode " << value << std::endl;
+                return EXIT_FAILURE;
+            }
+            use_custom = true;
+        }
+        else if (strcmp(arg, "--materials") == 0) {
+            custom.workload.material_count = number;
+            use_custom = true;
+        }
+        else if (strcmp(arg, "--triangles") == 0) {
+            custom.workload.triangle_count = number;
+            use_custom = true;
+        }
+        else if (strcmp(arg, "--draws") == 0) {
+            custom.workload.draw_count = number;
+            use_custom = true;
+        }
+        else if (strcmp(arg, "--instances") == 0) {
+            custom.workload.instance_count = number;
+            use_custom = true;
+        }
+        else if (strcmp(arg, "--width") == 0) {
+            custom.width = number;
+            use_custom = true;
+        }
+        else if (strcmp(arg, "--height") == 0) {
+            custom.height = number;
+            use_custom = true;
+        }
+        else if (strcmp(arg, "--frames-in-flight") == 0) {
+            custom.frames_in_flight = number;
+            use_custom = true;
+        }
+        else if (strcmp(arg, "--warmup") == 0) {
+            warmup_frames = number;
+        }
+        else if (strcmp(arg, "--frames") == 0) {
+            measured_frames = number;
+        }
+        else if (strcmp(arg, "--output") == 0) {
+            output = value;
+        }
+        else if (strcmp(arg, "--capture") == 0) {
+            capture.directory = value;
+        }
+        else if (strcmp(arg, "--capture-format") == 0) {
+            if (!parseImageFileFormat(value, &capture.format)) {
+                std::cerr << "Unknown capture format " << value << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+        i++;
+    }
+
+    if (use_custom) {
+        scenarios.push_back(custom);
+    }
+    if (scenarios.empty()) {
+        scenarios = builtin;
+    }
+
+    std::vector<ScenarioResult> results;
+    try {
+        for (const Scenario& scenario : scenarios) {
+            results.push_back(runScenario(scenario, warmup_frames, measured_frames, capture, submit_thread,
+                verbose));
+        }
+    }
+    catch (const std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::ofstream file(output);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open " << output << std::endl;
+        return EXIT_FAILURE;
+    }
+    writeResults(file, results, warmup_frames, measured_frames, capture, submit_thread);
+
+    for (const ScenarioResult& result : results) {
+        std::cout << result.scenario.name << ": cpu " << result.cpu_ms.mean << " ms, gpu " << result.gpu_ms.mean
+            << " ms, frame p99 " << result.frame_ms.p99 << " ms" << std::endl;
+    }
+    std::cout << "Results written to " << output << std::endl;
+
+    return EXIT_SUCCESS;
+}
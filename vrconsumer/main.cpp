@@ -0,0 +1,200 @@
+/** @file main.cpp
+*
+* @brief Sample consumer that reads frames exported by vrtest through shared
+*   memory and reports frame rate, latency and skipped frames
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/18/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "FrameExportProtocol.h"
+#include "ImageEncoder.h"
+
+static uint64_t getTimeNs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+/**
+ * Map the producer's shared memory, waiting for it to be created and initialized
+ */
+static FrameExportHeader* openExport(const char* name, size_t* size) {
+    while (true) {
+        // Waiting registers in the header, so the mapping must be writable
+        int fd = shm_open(name, O_RDWR, 0);
+        if (fd >= 0) {
+            struct stat st;
+            if (fstat(fd, &st) == 0 && st.st_size > FRAME_EXPORT_ALIGNMENT) {
+                *size = static_cast<size_t>(st.st_size);
+                void* mapped = mmap(nullptr, *size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                close(fd);
+                if (mapped == MAP_FAILED) {
+                    return nullptr;
+                }
+
+                FrameExportHeader* header = static_cast<FrameExportHeader*>(mapped);
+                if (header->magic == FRAME_EXPORT_MAGIC) {
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    return header;
+                }
+                munmap(mapped, *size);
+            }
+            else {
+                close(fd);
+            }
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+}
+
+/**
+ * Copy the frame out of a slot
+ * @return false if the producer overwrote the slot while it was read
+ */
+static bool readSlot(FrameExportSlot* slot, size_t frame_size, std::vector<uint8_t>* pixels,
+    uint64_t* frame_number, uint64_t* publish_time_ns) {
+    uint32_t sequence = slot->sequence.load(std::memory_order_acquire);
+    if (sequence & 1) {
+        return false;
+    }
+
+    *frame_number = slot->frame_number;
+    *publish_time_ns = slot->publish_time_ns;
+    memcpy(pixels->data(), getFrameExportPixels(slot), frame_size);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot->sequence.load(std::memory_order_relaxed) == sequence;
+}
+
+static void printUsage() {
+    std::cout << "usage: vrconsumer [options]\n"
+        "  --name NAME        shared memory object (default /vrtest_frames)\n"
+        "  --snapshot FILE    write the first frame received as a PNG\n"
+        "  --frames N         exit after N frames (default: until the producer exits)" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    const char* name = "/vrtest_frames";
+    const char* snapshot = nullptr;
+    uint64_t frame_limit = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--name") == 0 && i + 1 < argc) {
+            name = argv[++i];
+        }
+        else if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc) {
+            snapshot = argv[++i];
+        }
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frame_limit = strtoull(argv[++i], nullptr, 10);
+        }
+        else {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::cout << "Waiting for " << name << std::endl;
+    size_t shm_size = 0;
+    FrameExportHeader* header = openExport(name, &shm_size);
+    if (!header) {
+        std::cerr << "Failed to map " << name << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (header->version != FRAME_EXPORT_VERSION) {
+        std::cerr << "Unsupported frame export version " << header->version << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "Connected: " << header->width << " x " << header->height << ", " << header->slot_count
+        << " slots" << std::endl;
+
+    size_t frame_size = static_cast<size_t>(header->row_pitch) * header->height;
+    std::vector<uint8_t> pixels(frame_size);
+
+    uint32_t counter = header->frame_counter.load(std::memory_order_acquire);
+    uint64_t last_frame = 0;
+    uint64_t received = 0;
+    uint64_t skipped = 0;
+    uint64_t torn = 0;
+    double latency_sum_ms = 0.0;
+    double latency_max_ms = 0.0;
+    uint64_t report_start = getTimeNs();
+    uint64_t report_frames = 0;
+
+    while (frame_limit == 0 || received < frame_limit) {
+        if (!waitForFrameExport(header, counter, 500)) {
+            if (!header->producer_alive.load(std::memory_order_acquire)) {
+                break;
+            }
+            continue;
+        }
+        counter = header->frame_counter.load(std::memory_order_acquire);
+        if (!header->producer_alive.load(std::memory_order_acquire)) {
+            break;
+        }
+
+        // If the newest frame is overwritten while being read the producer has moved on, so wait for the newer
+        // frame instead
+        FrameExportSlot* slot = getFrameExportSlot(header, header->latest_slot.load(std::memory_order_acquire));
+        uint64_t frame_number;
+        uint64_t publish_time_ns;
+        if (!readSlot(slot, frame_size, &pixels, &frame_number, &publish_time_ns)) {
+            torn++;
+            continue;
+        }
+        if (frame_number <= last_frame) {
+            continue;
+        }
+
+        uint64_t now = getTimeNs();
+        double latency_ms = (now - publish_time_ns) / 1000000.0;
+        latency_sum_ms += latency_ms;
+        latency_max_ms = latency_ms > latency_max_ms ? latency_ms : latency_max_ms;
+
+        if (last_frame > 0) {
+            skipped += frame_number - last_frame - 1;
+        }
+        last_frame = frame_number;
+        received++;
+        report_frames++;
+
+        if (snapshot && received == 1) {
+            std::vector<uint8_t> encoded;
+            encodeImage(ImageFileFormat::Png, pixels.data(), header->width, header->height, true, &encoded);
+            std::ofstream file(snapshot, std::ios::binary);
+            file.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+            std::cout << "Wrote " << snapshot << std::endl;
+        }
+
+        if (now - report_start >= 1000000000ull) {
+            std::cout << report_frames * 1e9 / (now - report_start) << " fps, latency mean "
+                << latency_sum_ms / report_frames << " ms max " << latency_max_ms << " ms, skipped " << skipped
+                << ", torn reads " << torn << std::endl;
+            report_start = now;
+            report_frames = 0;
+            latency_sum_ms = 0.0;
+            latency_max_ms = 0.0;
+        }
+    }
+
+    std::cout << "Received " << received << " frames, skipped " << skipped << std::endl;
+    munmap(header, shm_size);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,560 @@
+/** @file main.cpp
+*
+* @brief CPU micro-benchmarks of engine systems that don't need a device, such
+*   as job scheduling overhead, scaling over thread counts and SIMD math
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/26/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "JobSystem.h"
+#include "TransformHierarchy.h"
+#include "Common.h"
+
+/**
+ * One micro-benchmark
+ */
+struct MicroBenchmark {
+    const char* name;
+    const char* description;
+
+    /**
+     * Run once per thread count, or only on one thread for single threaded code
+     */
+    bool threaded;
+
+    /**
+     * Benchmark the speedup is measured against, or nullptr for this benchmark on the first thread count
+     */
+    const char* baseline;
+
+    /**
+     * Run the benchmark once
+     * @param jobs job system to run on
+     * @param items number of jobs or elements to process
+     * @param elapsed_ns [output] time taken, excluding setup
+     * @return items actually processed, which may be rounded from the requested count
+     */
+    std::function<uint32_t(JobSystem& jobs, uint32_t items, uint64_t* elapsed_ns)> run;
+};
+
+struct MicroResult {
+    const char* name;
+    uint32_t threads;
+    uint32_t items;
+
+    /**
+     * Best time over all repetitions
+     */
+    double ms;
+    double ns_per_item;
+
+    /**
+     * Time per item of the baseline divided by this time per item, or 0 if the baseline wasn't run
+     */
+    double speedup;
+};
+
+static uint64_t getTimeNs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+/**
+ * Keep results alive so the compiler can't remove the work
+ */
+static volatile float sink;
+
+/**
+ * Arithmetic standing in for per-element work such as transforming or culling an object
+ */
+static float computeElement(float x) {
+    for (uint32_t i = 0; i < 32; i++) {
+        x = x * 0.999f + sqrtf(x * x + 1.0f) * 0.001f;
+    }
+    return x;
+}
+
+/**
+ * Start jobs from the main thread and wait for them, measuring the cost of scheduling one job
+ */
+static uint32_t runEmptyJobs(JobSystem& jobs, uint32_t items, uint64_t* elapsed_ns) {
+    uint64_t start = getTimeNs();
+    JobCounter counter;
+    for (uint32_t i = 0; i < items; i++) {
+        jobs.run([]() {}, &counter);
+    }
+    jobs.wait(&counter);
+    *elapsed_ns = getTimeNs() - start;
+    return items;
+}
+
+static void spawnTree(JobSystem& jobs, JobCounter* counter, uint32_t depth) {
+    if (depth == 0) {
+        return;
+    }
+    jobs.run([&jobs, counter, depth]() { spawnTree(jobs, counter, depth - 1); }, counter);
+    jobs.run([&jobs, counter, depth]() { spawnTree(jobs, counter, depth - 1); }, counter);
+}
+
+/**
+ * Jobs recursively start two children, so work starts on one deque and has to be stolen to spread
+ */
+static uint32_t runSpawnTree(JobSystem& jobs, uint32_t items, uint64_t* elapsed_ns) {
+    uint32_t depth = 1;
+    while ((2u << depth) - 2 < items && depth < 24) {
+        depth++;
+    }
+
+    uint64_t start = getTimeNs();
+    JobCounter counter;
+    spawnTree(jobs, &counter, depth);
+    jobs.wait(&counter);
+    *elapsed_ns = getTimeNs() - start;
+    return (2u << depth) - 2;
+}
+
+/**
+ * Jobs that each depend on the previous one through a counter, measuring the latency of releasing a continuation
+ */
+static uint32_t runContinuationChain(JobSystem& jobs, uint32_t items, uint64_t* elapsed_ns) {
+    const uint32_t chain_length = 256;
+    uint32_t chains = MAX(items / chain_length, 1u);
+
+    JobCounter* counters = new JobCounter[chain_length];
+    uint64_t start = getTimeNs();
+    for (uint32_t c = 0; c < chains; c++) {
+        jobs.run([]() {}, &counters[0]);
+        for (uint32_t i = 1; i < chain_length; i++) {
+            jobs.runAfter(&counters[i - 1], []() {}, &counters[i]);
+        }
+        jobs.wait(&counters[chain_length - 1]);
+    }
+    *elapsed_ns = getTimeNs() - start;
+    delete[] counters;
+
+    return chains * chain_length;
+}
+
+/**
+ * Element-wise work split into batches, measuring how compute bound work scales with threads
+ */
+static uint32_t runParallelFor(JobSystem& jobs, uint32_t items, uint64_t* elapsed_ns) {
+    std::vector<float> values(items);
+    for (uint32_t i = 0; i < items; i++) {
+        values[i] = static_cast<float>(i);
+    }
+
+    uint64_t start = getTimeNs();
+    jobs.parallelFor(items, 1024, [&values](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            values[i] = computeElement(values[i]);
+        }
+    });
+    *elapsed_ns = getTimeNs() - start;
+
+    sink = values[items / 2];
+    return items;
+}
+
+/**
+ * Nodes in the math benchmarks: enough to spill out of L1 and L2 like a real scene, without measuring memory
+ *  bandwidth alone. Larger item counts repeat the pass
+ */
+#define MATH_NODE_COUNT 16384
+
+/**
+ * Deterministic rotation, translation and scale of a benchmark node
+ */
+static void getNodeTransform(uint32_t node, float* position, float* rotation, float* scale) {
+    float angle = 0.001f * node;
+    position[0] = 0.01f * (node % 97);
+    position[1] = 0.02f * (node % 13);
+    position[2] = 0.5f;
+    rotation[0] = 0.0f;
+    rotation[1] = sinf(angle * 0.5f);
+    rotation[2] = 0.0f;
+    rotation[3] = cosf(angle * 0.5f);
+    scale[0] = scale[1] = scale[2] = 1.0f + 0.001f * (node % 7);
+}
+
+/**
+ * Parent of a benchmark node: nodes form a tree four children wide, which keeps parents before children
+ */
+static int32_t getNodeParent(uint32_t node) {
+    return node == 0 ? -1 : static_cast<int32_t>((node - 1) / 4);
+}
+
+static void multiplyScalar(const float* a, const float* b, float* out) {
+    for (uint32_t col = 0; col < 4; col++) {
+        for (uint32_t row = 0; row < 4; row++) {
+            out[col * 4 + row] = a[row] * b[col * 4] + a[4 + row] * b[col * 4 + 1] + a[8 + row] * b[col * 4 + 2] +
+                a[12 + row] * b[col * 4 + 3];
+        }
+    }
+}
+
+static void composeScalar(const float* t, const float* q, const float* s, float* out) {
+    float x = q[0], y = q[1], z = q[2], w = q[3];
+    out[0] = (1.0f - 2.0f * (y * y + z * z)) * s[0];
+    out[1] = 2.0f * (x * y + w * z) * s[0];
+    out[2] = 2.0f * (x * z - w * y) * s[0];
+    out[3] = 0.0f;
+    out[4] = 2.0f * (x * y - w * z) * s[1];
+    out[5] = (1.0f - 2.0f * (x * x + z * z)) * s[1];
+    out[6] = 2.0f * (y * z + w * x) * s[1];
+    out[7] = 0.0f;
+    out[8] = 2.0f * (x * z + w * y) * s[2];
+    out[9] = 2.0f * (y * z - w * x) * s[2];
+    out[10] = (1.0f - 2.0f * (x * x + y * y)) * s[2];
+    out[11] = 0.0f;
+    out[12] = t[0];
+    out[13] = t[1];
+    out[14] = t[2];
+    out[15] = 1.0f;
+}
+
+/**
+ * Multiply arrays of matrices with plain float loops
+ */
+static uint32_t runMat4Scalar(JobSystem&, uint32_t items, uint64_t* elapsed_ns) {
+    uint32_t count = MIN(items, static_cast<uint32_t>(MATH_NODE_COUNT));
+    uint32_t passes = MAX(items / count, 1u);
+    std::vector<float> a(count * 16), b(count * 16), out(count * 16);
+    for (uint32_t i = 0; i < count; i++) {
+        float t[3], q[4], s[3];
+        getNodeTransform(i, t, q, s);
+        composeScalar(t, q, s, &a[i * 16]);
+        composeScalar(s, q, t, &b[i * 16]);
+    }
+
+    uint64_t start = getTimeNs();
+    for (uint32_t pass = 0; pass < passes; pass++) {
+        for (uint32_t i = 0; i < count; i++) {
+            multiplyScalar(&a[i * 16], &b[i * 16], &out[i * 16]);
+        }
+        a.swap(out);
+    }
+    *elapsed_ns = getTimeNs() - start;
+
+    sink = a[count * 8];
+    return passes * count;
+}
+
+/**
+ * Multiply arrays of matrices with Mat4
+ */
+static uint32_t runMat4Simd(JobSystem&, uint32_t items, uint64_t* elapsed_ns) {
+    uint32_t count = MIN(items, static_cast<uint32_t>(MATH_NODE_COUNT));
+    uint32_t passes = MAX(items / count, 1u);
+    std::vector<Mat4> a(count), b(count), out(count);
+    for (uint32_t i = 0; i < count; i++) {
+        float t[3], q[4], s[3];
+        getNodeTransform(i, t, q, s);
+        a[i] = mat4FromTRS(vec3(t[0], t[1], t[2]), quat(q[0], q[1], q[2], q[3]), vec3(s[0], s[1], s[2]));
+        b[i] = mat4FromTRS(vec3(s[0], s[1], s[2]), quat(q[0], q[1], q[2], q[3]), vec3(t[0], t[1], t[2]));
+    }
+
+    uint64_t start = getTimeNs();
+    for (uint32_t pass = 0; pass < passes; pass++) {
+        for (uint32_t i = 0; i < count; i++) {
+            out[i] = a[i] * b[i];
+        }
+        a.swap(out);
+    }
+    *elapsed_ns = getTimeNs() - start;
+
+    sink = float4GetLane<0>(a[count / 2].cols[3]);
+    return passes * count;
+}
+
+/**
+ * Node of the scalar transform baseline: each node keeps its own components and matrices together
+ */
+struct ScalarTransformNode {
+    float position[3];
+    float rotation[4];
+    float scale[3];
+    int32_t parent;
+    float world[16];
+};
+
+/**
+ * Update world matrices of a hierarchy stored as an array of node structs with scalar math, and copy them to
+ *  an output buffer, as an engine without SIMD or component arrays would
+ */
+static uint32_t runTransformScalar(JobSystem&, uint32_t items, uint64_t* elapsed_ns) {
+    uint32_t count = MIN(items, static_cast<uint32_t>(MATH_NODE_COUNT));
+    uint32_t passes = MAX(items / count, 1u);
+    std::vector<ScalarTransformNode> nodes(count);
+    std::vector<float> output(count * 16);
+    for (uint32_t i = 0; i < count; i++) {
+        getNodeTransform(i, nodes[i].position, nodes[i].rotation, nodes[i].scale);
+        nodes[i].parent = getNodeParent(i);
+    }
+
+    uint64_t start = getTimeNs();
+    for (uint32_t pass = 0; pass < passes; pass++) {
+        for (uint32_t i = 0; i < count; i++) {
+            ScalarTransformNode& node = nodes[i];
+            float local[16];
+            composeScalar(node.position, node.rotation, node.scale, local);
+            if (node.parent < 0) {
+                memcpy(node.world, local, sizeof(local));
+            }
+            else {
+                multiplyScalar(nodes[node.parent].world, local, node.world);
+            }
+            memcpy(&output[i * 16], node.world, sizeof(node.world));
+        }
+    }
+    *elapsed_ns = getTimeNs() - start;
+
+    sink = output[count * 8];
+    return passes * count;
+}
+
+/**
+ * Update the same hierarchy with TransformHierarchy, streaming into an output buffer
+ */
+static uint32_t runTransformSoa(JobSystem&, uint32_t items, uint64_t* elapsed_ns) {
+    uint32_t count = MIN(items, static_cast<uint32_t>(MATH_NODE_COUNT));
+    uint32_t passes = MAX(items / count, 1u);
+    TransformHierarchy transforms(count);
+    std::vector<Mat4> output(count);
+    for (uint32_t i = 0; i < count; i++) {
+        float t[3], q[4], s[3];
+        getNodeTransform(i, t, q, s);
+        uint32_t node = transforms.addNode(getNodeParent(i));
+        transforms.setLocalPosition(node, vec3(t[0], t[1], t[2]));
+        transforms.setLocalRotation(node, quat(q[0], q[1], q[2], q[3]));
+        transforms.setLocalScale(node, vec3(s[0], s[1], s[2]));
+    }
+
+    uint64_t start = getTimeNs();
+    for (uint32_t pass = 0; pass < passes; pass++) {
+        transforms.update(reinterpret_cast<float*>(output.data()));
+    }
+    *elapsed_ns = getTimeNs() - start;
+
+    sink = float4GetLane<0>(output[count / 2].cols[3]);
+    return passes * count;
+}
+
+static std::vector<MicroBenchmark> getBenchmarks() {
+    std::vector<MicroBenchmark> benchmarks;
+    benchmarks.push_back({ "empty_jobs", "schedule and run empty jobs from the main thread", true, nullptr,
+        runEmptyJobs });
+    benchmarks.push_back({ "spawn_tree", "binary tree of jobs started from jobs", true, nullptr, runSpawnTree });
+    benchmarks.push_back({ "continuation_chain", "chains of jobs started with runAfter", true, nullptr,
+        runContinuationChain });
+    benchmarks.push_back({ "parallel_for", "compute bound parallelFor in batches of 1024", true, nullptr,
+        runParallelFor });
+    benchmarks.push_back({ "mat4_mul_scalar", "4x4 matrix products with float loops", false, nullptr,
+        runMat4Scalar });
+    benchmarks.push_back({ "mat4_mul_simd", "4x4 matrix products with Mat4", false, "mat4_mul_scalar",
+        runMat4Simd });
+    benchmarks.push_back({ "transform_scalar", "hierarchy update over an array of node structs", false, nullptr,
+        runTransformScalar });
+    benchmarks.push_back({ "transform_soa", "hierarchy update with TransformHierarchy", false, "transform_scalar",
+        runTransformSoa });
+    return benchmarks;
+}
+
+static std::vector<uint32_t> parseThreadCounts(const char* value) {
+    std::vector<uint32_t> counts;
+    const char* p = value;
+    while (*p) {
+        char* end;
+        uint32_t count = static_cast<uint32_t>(strtoul(p, &end, 10));
+        if (end == p) {
+            break;
+        }
+        if (count > 0) {
+            counts.push_back(count);
+        }
+        p = *end == ',' ? end + 1 : end;
+    }
+    return counts;
+}
+
+static void writeResults(std::ostream& out, const std::vector<MicroResult>& results, uint32_t repeat) {
+    out << "{\n";
+    out << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n";
+    out << "  \"repeat\": " << repeat << ",\n";
+    out << "  \"results\": [\n";
+
+    for (size_t i = 0; i < results.size(); i++) {
+        const MicroResult& result = results[i];
+        out << "    {\n";
+        out << "      \"name\": \"" << result.name << "\",\n";
+        out << "      \"threads\": " << result.threads << ",\n";
+        out << "      \"items\": " << result.items << ",\n";
+        out << "      \"ms\": " << result.ms << ",\n";
+        out << "      \"ns_per_item\": " << result.ns_per_item << ",\n";
+        out << "      \"speedup\": " << result.speedup << "\n";
+        out << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+
+    out << "  ]\n";
+    out << "}\n";
+}
+
+static void printUsage() {
+    std::cout << "usage: vrmicrobench [options]\n"
+        "  --benchmark NAME       run one benchmark, may be repeated (default: all)\n"
+        "  --list                 list benchmarks\n"
+        "  --threads N,N,...      thread counts to run threaded benchmarks on (default 1,4,8,16,32,64)\n"
+        "  --items N              jobs or elements per run (default 1000000)\n"
+        "  --repeat N             runs per thread count, the best is reported (default 5)\n"
+        "  --output FILE          also write results as JSON" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    std::vector<MicroBenchmark> all = getBenchmarks();
+    std::vector<MicroBenchmark> benchmarks;
+    std::vector<uint32_t> thread_counts = { 1, 4, 8, 16, 32, 64 };
+    uint32_t items = 1000000;
+    uint32_t repeat = 5;
+    const char* output = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        uint32_t number = value ? static_cast<uint32_t>(strtoul(value, nullptr, 10)) : 0;
+
+        if (strcmp(arg, "--list") == 0) {
+            for (const MicroBenchmark& benchmark : all) {
+                std::cout << std::left << std::setw(24) << benchmark.name << benchmark.description << std::endl;
+            }
+            return EXIT_SUCCESS;
+        }
+        else if (strcmp(arg, "--help") == 0) {
+            printUsage();
+            return EXIT_SUCCESS;
+        }
+        else if (value == nullptr) {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+
+        if (strcmp(arg, "--benchmark") == 0) {
+            auto match = std::find_if(all.begin(), all.end(), [value](const MicroBenchmark& benchmark) {
+                return strcmp(benchmark.name, value) == 0;
+            });
+            if (match == all.end()) {
+                std::cerr << "Unknown benchmark " << value << std::endl;
+                return EXIT_FAILURE;
+            }
+            benchmarks.push_back(*match);
+        }
+        else if (strcmp(arg, "--threads") == 0) {
+            thread_counts = parseThreadCounts(value);
+        }
+        else if (strcmp(arg, "--items") == 0) {
+            items = number;
+        }
+        else if (strcmp(arg, "--repeat") == 0) {
+            repeat = number;
+        }
+        else if (strcmp(arg, "--output") == 0) {
+            output = value;
+        }
+        else {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+        i++;
+    }
+
+    if (benchmarks.empty()) {
+        benchmarks = all;
+    }
+    if (thread_counts.empty() || items == 0 || repeat == 0) {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    uint32_t hardware_threads = std::thread::hardware_concurrency();
+    std::cout << "Hardware threads: " << hardware_threads << std::endl;
+    if (*std::max_element(thread_counts.begin(), thread_counts.end()) > hardware_threads) {
+        std::cout << "Thread counts above the hardware thread count are oversubscribed" << std::endl;
+    }
+
+    std::cout << std::left << std::setw(24) << "Benchmark" << std::right << std::setw(10) << "Threads"
+        << std::setw(12) << "Items" << std::setw(12) << "ms" << std::setw(14) << "ns/item"
+        << std::setw(10) << "Speedup" << std::endl;
+
+    std::vector<MicroResult> results;
+    for (const MicroBenchmark& benchmark : benchmarks) {
+        std::vector<uint32_t> counts = benchmark.threaded ? thread_counts : std::vector<uint32_t>(1, 1);
+        for (uint32_t threads : counts) {
+            JobSystem jobs(threads);
+
+            MicroResult result;
+            result.name = benchmark.name;
+            result.threads = threads;
+            result.items = 0;
+            result.ms = 0.0;
+
+            // Warm up caches, the job rings and every worker before timing
+            uint64_t elapsed_ns;
+            benchmark.run(jobs, MIN(items, 4096u), &elapsed_ns);
+
+            for (uint32_t r = 0; r < repeat; r++) {
+                result.items = benchmark.run(jobs, items, &elapsed_ns);
+                double ms = elapsed_ns / 1e6;
+                if (r == 0 || ms < result.ms) {
+                    result.ms = ms;
+                }
+            }
+            result.ns_per_item = result.ms * 1e6 / result.items;
+
+            // Compare against the named baseline, or this benchmark's first thread count
+            const char* baseline = benchmark.baseline ? benchmark.baseline : benchmark.name;
+            auto match = std::find_if(results.begin(), results.end(), [baseline](const MicroResult& other) {
+                return strcmp(other.name, baseline) == 0;
+            });
+            if (match != results.end()) {
+                result.speedup = match->ns_per_item / result.ns_per_item;
+            }
+            else {
+                result.speedup = benchmark.baseline ? 0.0 : 1.0;
+            }
+            results.push_back(result);
+
+            std::cout << std::left << std::setw(24) << result.name << std::right << std::setw(10) << result.threads
+                << std::setw(12) << result.items << std::fixed << std::setprecision(3) << std::setw(12) << result.ms
+                << std::setw(14) << result.ns_per_item << std::setprecision(2) << std::setw(10) << result.speedup
+                << std::defaultfloat << std::endl;
+        }
+    }
+
+    if (output) {
+        std::ofstream file(output);
+        if (!file.is_open()) {
+            std::cerr << "Failed to open " << output << std::endl;
+            return EXIT_FAILURE;
+        }
+        writeResults(file, results, repeat);
+        std::cout << "Results written to " << output << std::endl;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,517 @@
+/** @file main.cpp
+*
+* @brief Build tool that embeds SPIR-V shaders in a generated header as code
+*   arrays, with reflection data of their vertex inputs, descriptors and push
+*   constants
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			01/11/2018
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * SPIR-V opcodes, decorations, storage classes and execution models read by the reflection
+ */
+enum SpvOp {
+    OP_ENTRY_POINT = 15,
+    OP_TYPE_BOOL = 20,
+    OP_TYPE_INT = 21,
+    OP_TYPE_FLOAT = 22,
+    OP_TYPE_VECTOR = 23,
+    OP_TYPE_MATRIX = 24,
+    OP_TYPE_IMAGE = 25,
+    OP_TYPE_SAMPLER = 26,
+    OP_TYPE_SAMPLED_IMAGE = 27,
+    OP_TYPE_ARRAY = 28,
+    OP_TYPE_RUNTIME_ARRAY = 29,
+    OP_TYPE_STRUCT = 30,
+    OP_TYPE_POINTER = 32,
+    OP_CONSTANT = 43,
+    OP_SPEC_CONSTANT = 50,
+    OP_VARIABLE = 59,
+    OP_DECORATE = 71,
+    OP_MEMBER_DECORATE = 72
+};
+
+enum SpvDecoration {
+    DECORATION_BLOCK = 2,
+    DECORATION_BUFFER_BLOCK = 3,
+    DECORATION_ARRAY_STRIDE = 6,
+    DECORATION_MATRIX_STRIDE = 7,
+    DECORATION_BUILT_IN = 11,
+    DECORATION_LOCATION = 30,
+    DECORATION_BINDING = 33,
+    DECORATION_DESCRIPTOR_SET = 34,
+    DECORATION_OFFSET = 35
+};
+
+enum SpvStorageClass {
+    STORAGE_UNIFORM_CONSTANT = 0,
+    STORAGE_INPUT = 1,
+    STORAGE_UNIFORM = 2,
+    STORAGE_PUSH_CONSTANT = 9,
+    STORAGE_STORAGE_BUFFER = 12
+};
+
+#define SPIRV_MAGIC 0x07230203u
+#define SPIRV_HEADER_WORDS 5
+#define SPIRV_DIM_BUFFER 5
+#define NO_VALUE 0xffffffffu
+
+struct SpvType {
+    uint32_t op = 0;
+
+    /**
+     * Operands of the type instruction after the result ID
+     */
+    std::vector<uint32_t> operands;
+};
+
+/**
+ * Decorations of an ID or a struct member, NO_VALUE when absent
+ */
+struct SpvDecorations {
+    uint32_t location = NO_VALUE;
+    uint32_t binding = NO_VALUE;
+    uint32_t set = NO_VALUE;
+    uint32_t offset = NO_VALUE;
+    uint32_t array_stride = NO_VALUE;
+    uint32_t matrix_stride = NO_VALUE;
+    bool block = false;
+    bool buffer_block = false;
+    bool built_in = false;
+};
+
+struct SpvVariable {
+    uint32_t id;
+    uint32_t pointer_type;
+    uint32_t storage_class;
+};
+
+struct ShaderInput {
+    uint32_t location;
+    std::string format;
+};
+
+struct ShaderBinding {
+    uint32_t set;
+    uint32_t binding;
+    std::string type;
+    uint32_t count;
+};
+
+/**
+ * A shader read from SPIR-V and what the header says about it
+ */
+struct Shader {
+    std::string name;
+    std::string identifier;
+    std::vector<uint32_t> code;
+
+    std::string stage;
+    std::vector<ShaderInput> inputs;
+    std::vector<ShaderBinding> bindings;
+    uint32_t push_constant_size = 0;
+};
+
+/**
+ * IDs of one module
+ */
+class Module {
+private:
+    std::map<uint32_t, SpvType> types;
+    std::map<uint32_t, uint32_t> constants;
+    std::map<uint32_t, SpvDecorations> decorations;
+    std::map<uint32_t, std::map<uint32_t, SpvDecorations>> member_decorations;
+    std::vector<SpvVariable> variables;
+    uint32_t execution_model = NO_VALUE;
+
+    const SpvType& getType(uint32_t id) {
+        auto it = types.find(id);
+        if (it == types.end()) {
+            throw std::runtime_error("Reference to undefined type");
+        }
+        return it->second;
+    }
+
+    /**
+     * Size of a type in a block, from its layout decorations
+     */
+    uint32_t getSize(uint32_t type_id, uint32_t matrix_stride) {
+        const SpvType& type = getType(type_id);
+        switch (type.op) {
+        case OP_TYPE_BOOL:
+            return 4;
+        case OP_TYPE_INT:
+        case OP_TYPE_FLOAT:
+            return type.operands[0] / 8;
+        case OP_TYPE_VECTOR:
+            return getSize(type.operands[0], NO_VALUE) * type.operands[1];
+        case OP_TYPE_MATRIX:
+            if (matrix_stride != NO_VALUE) {
+                return matrix_stride * type.operands[1];
+            }
+            return getSize(type.operands[0], NO_VALUE) * type.operands[1];
+        case OP_TYPE_ARRAY:
+            return decorations[type_id].array_stride * constants[type.operands[1]];
+        case OP_TYPE_STRUCT:
+            return getStructSize(type_id);
+        default:
+            return 0;
+        }
+    }
+
+    uint32_t getStructSize(uint32_t type_id) {
+        const SpvType& type = getType(type_id);
+        uint32_t size = 0;
+        for (uint32_t member = 0; member < type.operands.size(); member++) {
+            const SpvDecorations& member_decoration = member_decorations[type_id][member];
+            if (member_decoration.offset == NO_VALUE) {
+                continue;
+            }
+            uint32_t end = member_decoration.offset +
+                getSize(type.operands[member], member_decoration.matrix_stride);
+            size = std::max(size, end);
+        }
+        return size;
+    }
+
+    /**
+     * Vulkan format of a 32-bit scalar or vector type
+     */
+    std::string getFormat(uint32_t type_id) {
+        const SpvType& type = getType(type_id);
+        uint32_t components = 1;
+        const SpvType* scalar = &type;
+        if (type.op == OP_TYPE_VECTOR) {
+            components = type.operands[1];
+            scalar = &getType(type.operands[0]);
+        }
+
+        const char* suffix;
+        if (scalar->op == OP_TYPE_FLOAT && scalar->operands[0] == 32) {
+            suffix = "SFLOAT";
+        }
+        else if (scalar->op == OP_TYPE_INT && scalar->operands[0] == 32) {
+            suffix = scalar->operands[1] ? "SINT" : "UINT";
+        }
+        else {
+            throw std::runtime_error("Vertex input of unsupported type");
+        }
+
+        static const char* channels[4] = { "R32", "R32G32", "R32G32B32", "R32G32B32A32" };
+        return std::string("VK_FORMAT_") + channels[components - 1] + "_" + suffix;
+    }
+
+    void reflectInput(const SpvVariable& variable, Shader* shader) {
+        const SpvDecorations& decoration = decorations[variable.id];
+        if (decoration.built_in || decoration.location == NO_VALUE) {
+            return;
+        }
+
+        // A matrix takes one location per column
+        uint32_t type_id = getType(variable.pointer_type).operands[1];
+        const SpvType& type = getType(type_id);
+        uint32_t columns = 1;
+        if (type.op == OP_TYPE_MATRIX) {
+            columns = type.operands[1];
+            type_id = type.operands[0];
+        }
+
+        for (uint32_t column = 0; column < columns; column++) {
+            ShaderInput input;
+            input.location = decoration.location + column;
+            input.format = getFormat(type_id);
+            shader->inputs.push_back(input);
+        }
+    }
+
+    void reflectBinding(const SpvVariable& variable, Shader* shader) {
+        const SpvDecorations& decoration = decorations[variable.id];
+        if (decoration.binding == NO_VALUE) {
+            return;
+        }
+
+        // Arrays of descriptors, possibly sized by a specialization constant
+        uint32_t type_id = getType(variable.pointer_type).operands[1];
+        uint32_t count = 1;
+        while (true) {
+            const SpvType& type = getType(type_id);
+            if (type.op == OP_TYPE_ARRAY) {
+                count *= constants[type.operands[1]];
+            }
+            else if (type.op == OP_TYPE_RUNTIME_ARRAY) {
+                count = 0;
+            }
+            else {
+                break;
+            }
+            type_id = type.operands[0];
+        }
+
+        const SpvType& type = getType(type_id);
+        const char* descriptor_type = nullptr;
+        if (variable.storage_class == STORAGE_STORAGE_BUFFER) {
+            descriptor_type = "VK_DESCRIPTOR_TYPE_STORAGE_BUFFER";
+        }
+        else if (variable.storage_class == STORAGE_UNIFORM) {
+            descriptor_type = decorations[type_id].buffer_block ? "VK_DESCRIPTOR_TYPE_STORAGE_BUFFER" :
+                "VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER";
+        }
+        else if (type.op == OP_TYPE_SAMPLED_IMAGE) {
+            descriptor_type = "VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER";
+        }
+        else if (type.op == OP_TYPE_SAMPLER) {
+            descriptor_type = "VK_DESCRIPTOR_TYPE_SAMPLER";
+        }
+        else if (type.op == OP_TYPE_IMAGE) {
+            // Operands: sampled type, dim, depth, arrayed, multisampled, sampled (1) or storage (2), format
+            bool texel_buffer = type.operands[1] == SPIRV_DIM_BUFFER;
+            if (type.operands[5] == 2) {
+                descriptor_type = texel_buffer ? "VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER" :
+                    "VK_DESCRIPTOR_TYPE_STORAGE_IMAGE";
+            }
+            else {
+                descriptor_type = texel_buffer ? "VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER" :
+                    "VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE";
+            }
+        }
+        else {
+            throw std::runtime_error("Descriptor of unsupported type");
+        }
+
+        ShaderBinding binding;
+        binding.set = decoration.set == NO_VALUE ? 0 : decoration.set;
+        binding.binding = decoration.binding;
+        binding.type = descriptor_type;
+        binding.count = count;
+        shader->bindings.push_back(binding);
+    }
+
+public:
+    /**
+     * Read the IDs of a module
+     */
+    void parse(const std::vector<uint32_t>& code) {
+        if (code.size() < SPIRV_HEADER_WORDS || code[0] != SPIRV_MAGIC) {
+            throw std::runtime_error("Not a SPIR-V module");
+        }
+
+        size_t i = SPIRV_HEADER_WORDS;
+        while (i < code.size()) {
+            uint32_t word_count = code[i] >> 16;
+            uint32_t op = code[i] & 0xffff;
+            if (word_count == 0 || i + word_count > code.size()) {
+                throw std::runtime_error("Truncated SPIR-V instruction");
+            }
+            const uint32_t* operands = &code[i + 1];
+
+            if (op == OP_ENTRY_POINT) {
+                execution_model = operands[0];
+            }
+            else if (op >= OP_TYPE_BOOL && op <= OP_TYPE_POINTER) {
+                SpvType& type = types[operands[0]];
+                type.op = op;
+                type.operands.assign(operands + 1, operands + word_count - 1);
+            }
+            else if (op == OP_CONSTANT || op == OP_SPEC_CONSTANT) {
+                // Only 32-bit integer constants size arrays, so the low word is enough
+                constants[operands[1]] = word_count > 3 ? operands[2] : 0;
+            }
+            else if (op == OP_VARIABLE) {
+                SpvVariable variable;
+                variable.pointer_type = operands[0];
+                variable.id = operands[1];
+                variable.storage_class = operands[2];
+                variables.push_back(variable);
+            }
+            else if (op == OP_DECORATE || op == OP_MEMBER_DECORATE) {
+                SpvDecorations& decoration = op == OP_DECORATE ? decorations[operands[0]] :
+                    member_decorations[operands[0]][operands[1]];
+                const uint32_t* args = op == OP_DECORATE ? operands + 1 : operands + 2;
+                uint32_t arg_count = word_count - (op == OP_DECORATE ? 2 : 3);
+                uint32_t value = arg_count > 1 ? args[1] : 0;
+
+                switch (args[0]) {
+                case DECORATION_BLOCK: decoration.block = true; break;
+                case DECORATION_BUFFER_BLOCK: decoration.buffer_block = true; break;
+                case DECORATION_ARRAY_STRIDE: decoration.array_stride = value; break;
+                case DECORATION_MATRIX_STRIDE: decoration.matrix_stride = value; break;
+                case DECORATION_BUILT_IN: decoration.built_in = true; break;
+                case DECORATION_LOCATION: decoration.location = value; break;
+                case DECORATION_BINDING: decoration.binding = value; break;
+                case DECORATION_DESCRIPTOR_SET: decoration.set = value; break;
+                case DECORATION_OFFSET: decoration.offset = value; break;
+                default: break;
+                }
+            }
+
+            i += word_count;
+        }
+    }
+
+    /**
+     * Fill in the shader's stage and interface
+     */
+    void reflect(Shader* shader) {
+        switch (execution_model) {
+        case 0: shader->stage = "VK_SHADER_STAGE_VERTEX_BIT"; break;
+        case 4: shader->stage = "VK_SHADER_STAGE_FRAGMENT_BIT"; break;
+        case 5: shader->stage = "VK_SHADER_STAGE_COMPUTE_BIT"; break;
+        default: throw std::runtime_error("Unsupported shader stage");
+        }
+
+        for (const auto& variable : variables) {
+            if (variable.storage_class == STORAGE_INPUT && execution_model == 0) {
+                reflectInput(variable, shader);
+            }
+            else if (variable.storage_class == STORAGE_UNIFORM_CONSTANT || variable.storage_class == STORAGE_UNIFORM ||
+                variable.storage_class == STORAGE_STORAGE_BUFFER) {
+                reflectBinding(variable, shader);
+            }
+            else if (variable.storage_class == STORAGE_PUSH_CONSTANT) {
+                uint32_t block = getType(variable.pointer_type).operands[1];
+                shader->push_constant_size = std::max(shader->push_constant_size, getStructSize(block));
+            }
+        }
+
+        std::sort(shader->inputs.begin(), shader->inputs.end(), [](const ShaderInput& a, const ShaderInput& b) {
+            return a.location < b.location;
+        });
+        std::sort(shader->bindings.begin(), shader->bindings.end(),
+            [](const ShaderBinding& a, const ShaderBinding& b) {
+            return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+        });
+    }
+};
+
+static std::vector<uint32_t> readSpirv(const std::string& path) {
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open " + path);
+    }
+
+    size_t size = static_cast<size_t>(file.tellg());
+    if (size % 4 != 0) {
+        throw std::runtime_error(path + " is not a whole number of words");
+    }
+
+    std::vector<uint32_t> code(size / 4);
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(code.data()), size);
+    return code;
+}
+
+/**
+ * Name the app loads a shader by (the file name) and a C identifier derived from it
+ */
+static void nameShader(const std::string& path, Shader* shader) {
+    size_t separator = path.find_last_of("/\\");
+    shader->name = separator == std::string::npos ? path : path.substr(separator + 1);
+
+    shader->identifier = shader->name;
+    for (char& c : shader->identifier) {
+        if (!isalnum(static_cast<unsigned char>(c))) {
+            c = '_';
+        }
+    }
+}
+
+static void writeHeader(std::ostream& out, const std::vector<Shader>& shaders) {
+    out << "/** @file EmbeddedShaders.h\n";
+    out << "*\n";
+    out << "* @brief SPIR-V and reflection data of the shaders built with the app.\n";
+    out << "*   Generated by vrshaderembed, do not edit\n";
+    out << "*/\n";
+    out << "#pragma once\n\n";
+    out << "#include \"ShaderReflection.h\"\n\n";
+
+    for (const auto& shader : shaders) {
+        out << "static constexpr uint32_t " << shader.identifier << "_code[] = {";
+        for (size_t i = 0; i < shader.code.size(); i++) {
+            out << (i % 8 == 0 ? "\n    " : " ");
+            out << "0x" << std::hex;
+            out.width(8);
+            out.fill('0');
+            out << shader.code[i] << std::dec << ",";
+        }
+        out << "\n};\n";
+
+        if (!shader.inputs.empty()) {
+            out << "static constexpr ShaderInputReflection " << shader.identifier << "_inputs[] = {\n";
+            for (const auto& input : shader.inputs) {
+                out << "    { " << input.location << ", " << input.format << " },\n";
+            }
+            out << "};\n";
+        }
+
+        if (!shader.bindings.empty()) {
+            out << "static constexpr ShaderBindingReflection " << shader.identifier << "_bindings[] = {\n";
+            for (const auto& binding : shader.bindings) {
+                out << "    { " << binding.set << ", " << binding.binding << ", " << binding.type << ", " <<
+                    binding.count << " },\n";
+            }
+            out << "};\n";
+        }
+        out << "\n";
+    }
+
+    out << "static const EmbeddedShader embedded_shaders[] = {\n";
+    for (const auto& shader : shaders) {
+        std::string inputs = shader.inputs.empty() ? "nullptr" : shader.identifier + "_inputs";
+        std::string bindings = shader.bindings.empty() ? "nullptr" : shader.identifier + "_bindings";
+
+        out << "    { \"" << shader.name << "\", " << shader.identifier << "_code, sizeof(" << shader.identifier <<
+            "_code),\n";
+        out << "        { " << shader.stage << ", " << inputs << ", " << shader.inputs.size() << ", " << bindings <<
+            ", " << shader.bindings.size() << ", " << shader.push_constant_size << " } },\n";
+    }
+    out << "};\n";
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: vrshaderembed HEADER SHADER.spv..." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<Shader> shaders;
+    for (int i = 2; i < argc; i++) {
+        Shader shader;
+        nameShader(argv[i], &shader);
+
+        try {
+            shader.code = readSpirv(argv[i]);
+
+            Module module;
+            module.parse(shader.code);
+            module.reflect(&shader);
+        }
+        catch (const std::runtime_error& e) {
+            std::cerr << argv[i] << ": " << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+        shaders.push_back(shader);
+    }
+
+    std::ofstream out(argv[1], std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "Failed to write " << argv[1] << std::endl;
+        return EXIT_FAILURE;
+    }
+    writeHeader(out, shaders);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,561 @@
+/** @file BlockDecoder.cpp
+*
+* @brief Defines block layout of compressed texture formats and CPU decoders
+*   used when the device can't sample a format
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/22/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include <stdexcept>
+#include <string.h>
+
+#include "BlockDecoder.h"
+#include "Common.h"
+
+/**
+ * Intensity modifiers of ETC1 and ETC2 individual and differential blocks, indexed by table codeword
+ */
+static const int etc_modifiers[8][4] = {
+    { 2, 8, -2, -8 }, { 5, 17, -5, -17 }, { 9, 29, -9, -29 }, { 13, 42, -13, -42 },
+    { 18, 60, -18, -60 }, { 24, 80, -24, -80 }, { 33, 106, -33, -106 }, { 47, 183, -47, -183 }
+};
+
+/**
+ * Paint color distances of ETC2 T and H blocks
+ */
+static const int etc_distances[8] = { 3, 6, 11, 16, 23, 32, 41, 64 };
+
+/**
+ * Alpha modifiers of EAC blocks, indexed by table index
+ */
+static const int eac_modifiers[16][8] = {
+    { -3, -6, -9, -15, 2, 5, 8, 14 }, { -3, -7, -10, -13, 2, 6, 9, 12 },
+    { -2, -5, -8, -13, 1, 4, 7, 12 }, { -2, -4, -6, -13, 1, 3, 5, 12 },
+    { -3, -6, -8, -12, 2, 5, 7, 11 }, { -3, -7, -9, -11, 2, 6, 8, 10 },
+    { -4, -7, -8, -11, 3, 6, 7, 10 }, { -3, -5, -8, -11, 2, 4, 7, 10 },
+    { -2, -6, -8, -10, 1, 5, 7, 9 }, { -2, -5, -8, -10, 1, 4, 7, 9 },
+    { -2, -4, -8, -10, 1, 3, 7, 9 }, { -2, -5, -7, -10, 1, 4, 6, 9 },
+    { -3, -4, -7, -10, 2, 3, 6, 9 }, { -1, -2, -3, -10, 0, 1, 2, 9 },
+    { -4, -6, -8, -9, 3, 5, 7, 8 }, { -3, -5, -7, -9, 2, 4, 6, 8 }
+};
+
+static uint8_t clamp255(int value) {
+    return static_cast<uint8_t>(MIN(MAX(value, 0), 255));
+}
+
+static uint64_t readBigEndian64(const uint8_t* data) {
+    uint64_t value = 0;
+    for (uint32_t i = 0; i < 8; i++) {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+static uint64_t readLittleEndian64(const uint8_t* data) {
+    uint64_t value = 0;
+    for (uint32_t i = 0; i < 8; i++) {
+        value |= static_cast<uint64_t>(data[i]) << (i * 8);
+    }
+    return value;
+}
+
+static uint32_t getBits(uint64_t value, uint32_t high, uint32_t low) {
+    return static_cast<uint32_t>((value >> low) & ((1ull << (high - low + 1)) - 1));
+}
+
+bool getFormatBlockInfo(VkFormat format, FormatBlockInfo* info) {
+    info->width = 4;
+    info->height = 4;
+
+    switch (format) {
+    case VK_FORMAT_R8_UNORM:
+    case VK_FORMAT_R8_SRGB:
+        *info = { 1, 1, 1 };
+        return true;
+    case VK_FORMAT_R8G8_UNORM:
+    case VK_FORMAT_R8G8_SRGB:
+        *info = { 1, 1, 2 };
+        return true;
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+        *info = { 1, 1, 4 };
+        return true;
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+        *info = { 1, 1, 8 };
+        return true;
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+    case VK_FORMAT_BC4_UNORM_BLOCK:
+    case VK_FORMAT_BC4_SNORM_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK:
+    case VK_FORMAT_EAC_R11_UNORM_BLOCK:
+    case VK_FORMAT_EAC_R11_SNORM_BLOCK:
+        info->bytes = 8;
+        return true;
+    case VK_FORMAT_BC2_UNORM_BLOCK:
+    case VK_FORMAT_BC2_SRGB_BLOCK:
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+    case VK_FORMAT_BC5_SNORM_BLOCK:
+    case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+    case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+    case VK_FORMAT_EAC_R11G11_UNORM_BLOCK:
+    case VK_FORMAT_EAC_R11G11_SNORM_BLOCK:
+        info->bytes = 16;
+        return true;
+    default:
+        break;
+    }
+
+    // Every ASTC block is 128 bits; only the footprint varies. The enums come in UNORM/SRGB pairs
+    static const uint8_t astc_footprints[14][2] = {
+        { 4, 4 }, { 5, 4 }, { 5, 5 }, { 6, 5 }, { 6, 6 }, { 8, 5 }, { 8, 6 }, { 8, 8 },
+        { 10, 5 }, { 10, 6 }, { 10, 8 }, { 10, 10 }, { 12, 10 }, { 12, 12 }
+    };
+    if (format >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK) {
+        uint32_t footprint = (format - VK_FORMAT_ASTC_4x4_UNORM_BLOCK) / 2;
+        info->width = astc_footprints[footprint][0];
+        info->height = astc_footprints[footprint][1];
+        info->bytes = 16;
+        return true;
+    }
+
+    return false;
+}
+
+uint64_t getFormatLevelSize(VkFormat format, uint32_t width, uint32_t height) {
+    FormatBlockInfo info;
+    if (!getFormatBlockInfo(format, &info)) {
+        throw std::runtime_error("Unknown texture format");
+    }
+
+    uint64_t blocks_x = (width + info.width - 1) / info.width;
+    uint64_t blocks_y = (height + info.height - 1) / info.height;
+    return blocks_x * blocks_y * info.bytes;
+}
+
+bool canDecodeFormat(VkFormat format) {
+    switch (format) {
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+    case VK_FORMAT_BC2_UNORM_BLOCK:
+    case VK_FORMAT_BC2_SRGB_BLOCK:
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+    case VK_FORMAT_BC4_UNORM_BLOCK:
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+        return true;
+    default:
+        return false;
+    }
+}
+
+VkFormat getDecodedFormat(VkFormat format) {
+    switch (format) {
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+    case VK_FORMAT_BC2_SRGB_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+        return VK_FORMAT_R8G8B8A8_SRGB;
+    default:
+        return VK_FORMAT_R8G8B8A8_UNORM;
+    }
+}
+
+/**
+ * Decode the color half of a BC1, BC2 or BC3 block. BC2 and BC3 always use four colors
+ */
+static void decodeBc1Color(const uint8_t* block, bool allow_transparent, uint8_t texels[16][4]) {
+    uint32_t c0 = block[0] | (block[1] << 8);
+    uint32_t c1 = block[2] | (block[3] << 8);
+    uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | (static_cast<uint32_t>(block[7]) << 24);
+
+    int colors[4][4];
+    uint32_t endpoints[2] = { c0, c1 };
+    for (uint32_t i = 0; i < 2; i++) {
+        uint32_t r = (endpoints[i] >> 11) & 0x1f;
+        uint32_t g = (endpoints[i] >> 5) & 0x3f;
+        uint32_t b = endpoints[i] & 0x1f;
+        colors[i][0] = (r << 3) | (r >> 2);
+        colors[i][1] = (g << 2) | (g >> 4);
+        colors[i][2] = (b << 3) | (b >> 2);
+        colors[i][3] = 255;
+    }
+
+    for (uint32_t c = 0; c < 3; c++) {
+        if (c0 > c1 || !allow_transparent) {
+            colors[2][c] = (2 * colors[0][c] + colors[1][c]) / 3;
+            colors[3][c] = (colors[0][c] + 2 * colors[1][c]) / 3;
+        }
+        else {
+            colors[2][c] = (colors[0][c] + colors[1][c]) / 2;
+            colors[3][c] = 0;
+        }
+    }
+    colors[2][3] = 255;
+    colors[3][3] = (c0 > c1 || !allow_transparent) ? 255 : 0;
+
+    for (uint32_t i = 0; i < 16; i++) {
+        const int* color = colors[(indices >> (i * 2)) & 3];
+        texels[i][0] = static_cast<uint8_t>(color[0]);
+        texels[i][1] = static_cast<uint8_t>(color[1]);
+        texels[i][2] = static_cast<uint8_t>(color[2]);
+        texels[i][3] = static_cast<uint8_t>(color[3]);
+    }
+}
+
+/**
+ * Decode a BC4 block, also used for BC3 alpha and each BC5 channel
+ */
+static void decodeBc4(const uint8_t* block, uint8_t values[16]) {
+    int endpoints[8];
+    endpoints[0] = block[0];
+    endpoints[1] = block[1];
+    if (endpoints[0] > endpoints[1]) {
+        for (int i = 1; i < 7; i++) {
+            endpoints[i + 1] = ((7 - i) * endpoints[0] + i * endpoints[1]) / 7;
+        }
+    }
+    else {
+        for (int i = 1; i < 5; i++) {
+            endpoints[i + 1] = ((5 - i) * endpoints[0] + i * endpoints[1]) / 5;
+        }
+        endpoints[6] = 0;
+        endpoints[7] = 255;
+    }
+
+    uint64_t indices = 0;
+    for (uint32_t i = 0; i < 6; i++) {
+        indices |= static_cast<uint64_t>(block[2 + i]) << (i * 8);
+    }
+    for (uint32_t i = 0; i < 16; i++) {
+        values[i] = static_cast<uint8_t>(endpoints[(indices >> (i * 3)) & 7]);
+    }
+}
+
+/**
+ * Decode an ETC2 RGB block. With punchthrough alpha, a clear opaque bit replaces individual mode and makes
+ *  one index transparent
+ */
+static void decodeEtc2Color(const uint8_t* block, bool punchthrough, uint8_t texels[16][4]) {
+    uint64_t bits = readBigEndian64(block);
+    bool diff = getBits(bits, 33, 33) != 0;
+    bool opaque = !punchthrough || diff;
+
+    // Pixel indices are stored column major: texel (x, y) uses bit x * 4 + y of each half
+    uint32_t msbs = getBits(bits, 31, 16);
+    uint32_t lsbs = getBits(bits, 15, 0);
+    auto pixel_index = [msbs, lsbs](uint32_t x, uint32_t y) {
+        uint32_t bit = x * 4 + y;
+        return (((msbs >> bit) & 1) << 1) | ((lsbs >> bit) & 1);
+    };
+    auto set_texel = [&texels](uint32_t x, uint32_t y, int r, int g, int b, int a) {
+        uint8_t* texel = texels[y * 4 + x];
+        texel[0] = clamp255(r);
+        texel[1] = clamp255(g);
+        texel[2] = clamp255(b);
+        texel[3] = static_cast<uint8_t>(a);
+    };
+
+    int base[2][3];
+    if (!diff && !punchthrough) {
+        // Individual mode: two 4-bit colors
+        for (uint32_t c = 0; c < 3; c++) {
+            int first = getBits(bits, 63 - c * 8, 60 - c * 8);
+            int second = getBits(bits, 59 - c * 8, 56 - c * 8);
+            base[0][c] = first * 17;
+            base[1][c] = second * 17;
+        }
+    }
+    else {
+        // Differential mode, unless a channel's delta overflows, which selects T, H or planar mode
+        int components[3];
+        int deltas[3];
+        for (uint32_t c = 0; c < 3; c++) {
+            components[c] = getBits(bits, 63 - c * 8, 59 - c * 8);
+            int delta = getBits(bits, 58 - c * 8, 56 - c * 8);
+            deltas[c] = delta >= 4 ? delta - 8 : delta;
+        }
+
+        if (components[0] + deltas[0] < 0 || components[0] + deltas[0] > 31) {
+            // T mode
+            int c1[3] = {
+                static_cast<int>((getBits(bits, 60, 59) << 2) | getBits(bits, 57, 56)),
+                static_cast<int>(getBits(bits, 55, 52)),
+                static_cast<int>(getBits(bits, 51, 48))
+            };
+            int c2[3] = {
+                static_cast<int>(getBits(bits, 47, 44)),
+                static_cast<int>(getBits(bits, 43, 40)),
+                static_cast<int>(getBits(bits, 39, 36))
+            };
+            int distance = etc_distances[(getBits(bits, 35, 34) << 1) | getBits(bits, 32, 32)];
+
+            int paint[4][3];
+            for (uint32_t c = 0; c < 3; c++) {
+                paint[0][c] = c1[c] * 17;
+                paint[1][c] = c2[c] * 17 + distance;
+                paint[2][c] = c2[c] * 17;
+                paint[3][c] = c2[c] * 17 - distance;
+            }
+
+            for (uint32_t x = 0; x < 4; x++) {
+                for (uint32_t y = 0; y < 4; y++) {
+                    uint32_t index = pixel_index(x, y);
+                    if (!opaque && index == 2) {
+                        set_texel(x, y, 0, 0, 0, 0);
+                    }
+                    else {
+                        set_texel(x, y, paint[index][0], paint[index][1], paint[index][2], 255);
+                    }
+                }
+            }
+            return;
+        }
+
+        if (components[1] + deltas[1] < 0 || components[1] + deltas[1] > 31) {
+            // H mode
+            int c1[3] = {
+                static_cast<int>(getBits(bits, 62, 59)),
+                static_cast<int>((getBits(bits, 58, 56) << 1) | getBits(bits, 52, 52)),
+                static_cast<int>((getBits(bits, 51, 51) << 3) | getBits(bits, 49, 47))
+            };
+            int c2[3] = {
+                static_cast<int>(getBits(bits, 46, 43)),
+                static_cast<int>(getBits(bits, 42, 39)),
+                static_cast<int>(getBits(bits, 38, 35))
+            };
+
+            // The low bit of the distance index is implied by the order of the two colors
+            uint32_t packed1 = (c1[0] << 8) | (c1[1] << 4) | c1[2];
+            uint32_t packed2 = (c2[0] << 8) | (c2[1] << 4) | c2[2];
+            uint32_t distance_index = (getBits(bits, 34, 34) << 2) | (getBits(bits, 32, 32) << 1) |
+                (packed1 >= packed2 ? 1 : 0);
+            int distance = etc_distances[distance_index];
+
+            int paint[4][3];
+            for (uint32_t c = 0; c < 3; c++) {
+                paint[0][c] = c1[c] * 17 + distance;
+                paint[1][c] = c1[c] * 17 - distance;
+                paint[2][c] = c2[c] * 17 + distance;
+                paint[3][c] = c2[c] * 17 - distance;
+            }
+
+            for (uint32_t x = 0; x < 4; x++) {
+                for (uint32_t y = 0; y < 4; y++) {
+                    uint32_t index = pixel_index(x, y);
+                    if (!opaque && index == 2) {
+                        set_texel(x, y, 0, 0, 0, 0);
+                    }
+                    else {
+                        set_texel(x, y, paint[index][0], paint[index][1], paint[index][2], 255);
+                    }
+                }
+            }
+            return;
+        }
+
+        if (components[2] + deltas[2] < 0 || components[2] + deltas[2] > 31) {
+            // Planar mode: a gradient from three colors, never transparent
+            int ro = getBits(bits, 62, 57);
+            int go = (getBits(bits, 56, 56) << 6) | getBits(bits, 54, 49);
+            int bo = (getBits(bits, 48, 48) << 5) | (getBits(bits, 44, 43) << 3) | getBits(bits, 41, 39);
+            int rh = (getBits(bits, 38, 34) << 1) | getBits(bits, 32, 32);
+            int gh = getBits(bits, 31, 25);
+            int bh = getBits(bits, 24, 19);
+            int rv = getBits(bits, 18, 13);
+            int gv = getBits(bits, 12, 6);
+            int bv = getBits(bits, 5, 0);
+
+            int origin[3] = { (ro << 2) | (ro >> 4), (go << 1) | (go >> 6), (bo << 2) | (bo >> 4) };
+            int horizontal[3] = { (rh << 2) | (rh >> 4), (gh << 1) | (gh >> 6), (bh << 2) | (bh >> 4) };
+            int vertical[3] = { (rv << 2) | (rv >> 4), (gv << 1) | (gv >> 6), (bv << 2) | (bv >> 4) };
+
+            for (uint32_t x = 0; x < 4; x++) {
+                for (uint32_t y = 0; y < 4; y++) {
+                    int color[3];
+                    for (uint32_t c = 0; c < 3; c++) {
+                        color[c] = (x * (horizontal[c] - origin[c]) + y * (vertical[c] - origin[c]) +
+                            4 * origin[c] + 2) >> 2;
+                    }
+                    set_texel(x, y, color[0], color[1], color[2], 255);
+                }
+            }
+            return;
+        }
+
+        for (uint32_t c = 0; c < 3; c++) {
+            int first = components[c];
+            int second = components[c] + deltas[c];
+            base[0][c] = (first << 3) | (first >> 2);
+            base[1][c] = (second << 3) | (second >> 2);
+        }
+    }
+
+    // Individual and differential modes split the block into two 2x4 or 4x2 halves
+    bool flip = getBits(bits, 32, 32) != 0;
+    uint32_t tables[2] = { getBits(bits, 39, 37), getBits(bits, 36, 34) };
+
+    for (uint32_t x = 0; x < 4; x++) {
+        for (uint32_t y = 0; y < 4; y++) {
+            uint32_t half = flip ? (y >= 2 ? 1 : 0) : (x >= 2 ? 1 : 0);
+            uint32_t index = pixel_index(x, y);
+
+            // Without the opaque bit, index 2 is transparent and index 0 has no modifier
+            if (!opaque && index == 2) {
+                set_texel(x, y, 0, 0, 0, 0);
+                continue;
+            }
+            int modifier = (!opaque && index == 0) ? 0 : etc_modifiers[tables[half]][index];
+            set_texel(x, y, base[half][0] + modifier, base[half][1] + modifier, base[half][2] + modifier, 255);
+        }
+    }
+}
+
+/**
+ * Decode the alpha half of an ETC2 RGBA8 block
+ */
+static void decodeEacAlpha(const uint8_t* block, uint8_t values[16]) {
+    uint64_t bits = readBigEndian64(block);
+    int base = getBits(bits, 63, 56);
+    int multiplier = getBits(bits, 55, 52);
+    const int* modifiers = eac_modifiers[getBits(bits, 51, 48)];
+
+    // Three bits per texel, column major, first texel in the highest bits
+    for (uint32_t x = 0; x < 4; x++) {
+        for (uint32_t y = 0; y < 4; y++) {
+            uint32_t bit = 45 - (x * 4 + y) * 3;
+            values[y * 4 + x] = clamp255(base + modifiers[getBits(bits, bit + 2, bit)] * multiplier);
+        }
+    }
+}
+
+/**
+ * Decode one block to 4x4 RGBA texels in row major order
+ */
+static void decodeBlock(VkFormat format, const uint8_t* block, uint8_t texels[16][4]) {
+    uint8_t channel[16];
+
+    switch (format) {
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        decodeBc1Color(block, true, texels);
+        for (uint32_t i = 0; i < 16; i++) {
+            texels[i][3] = 255;
+        }
+        break;
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        decodeBc1Color(block, true, texels);
+        break;
+    case VK_FORMAT_BC2_UNORM_BLOCK:
+    case VK_FORMAT_BC2_SRGB_BLOCK: {
+        decodeBc1Color(block + 8, false, texels);
+        uint64_t alpha = readLittleEndian64(block);
+        for (uint32_t i = 0; i < 16; i++) {
+            texels[i][3] = static_cast<uint8_t>(((alpha >> (i * 4)) & 0xf) * 17);
+        }
+        break;
+    }
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+        decodeBc1Color(block + 8, false, texels);
+        decodeBc4(block, channel);
+        for (uint32_t i = 0; i < 16; i++) {
+            texels[i][3] = channel[i];
+        }
+        break;
+    case VK_FORMAT_BC4_UNORM_BLOCK:
+        decodeBc4(block, channel);
+        for (uint32_t i = 0; i < 16; i++) {
+            texels[i][0] = channel[i];
+            texels[i][1] = 0;
+            texels[i][2] = 0;
+            texels[i][3] = 255;
+        }
+        break;
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+        decodeBc4(block, channel);
+        for (uint32_t i = 0; i < 16; i++) {
+            texels[i][0] = channel[i];
+            texels[i][2] = 0;
+            texels[i][3] = 255;
+        }
+        decodeBc4(block + 8, channel);
+        for (uint32_t i = 0; i < 16; i++) {
+            texels[i][1] = channel[i];
+        }
+        break;
+    case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+        decodeEtc2Color(block, false, texels);
+        break;
+    case VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK:
+        decodeEtc2Color(block, true, texels);
+        break;
+    case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+    case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+        decodeEtc2Color(block + 8, false, texels);
+        decodeEacAlpha(block, channel);
+        for (uint32_t i = 0; i < 16; i++) {
+            texels[i][3] = channel[i];
+        }
+        break;
+    default:
+        throw std::runtime_error("Texture format can't be decoded");
+    }
+}
+
+void decodeBlocks(VkFormat format, const uint8_t* data, uint32_t width, uint32_t height, uint8_t* rgba) {
+    FormatBlockInfo info;
+    if (!canDecodeFormat(format) || !getFormatBlockInfo(format, &info)) {
+        throw std::runtime_error("Texture format can't be decoded");
+    }
+
+    uint32_t blocks_x = (width + 3) / 4;
+    uint32_t blocks_y = (height + 3) / 4;
+    uint8_t texels[16][4];
+
+    for (uint32_t by = 0; by < blocks_y; by++) {
+        for (uint32_t bx = 0; bx < blocks_x; bx++) {
+            decodeBlock(format, data, texels);
+            data += info.bytes;
+
+            // Edge blocks are padded past the level's extent
+            uint32_t copy_width = MIN(4u, width - bx * 4);
+            uint32_t copy_height = MIN(4u, height - by * 4);
+            for (uint32_t y = 0; y < copy_height; y++) {
+                uint8_t* row = rgba + ((static_cast<size_t>(by) * 4 + y) * width + bx * 4) * 4;
+                memcpy(row, texels[y * 4], copy_width * 4);
+            }
+        }
+    }
+}
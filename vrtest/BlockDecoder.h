@@ -0,0 +1,58 @@
+/** @file BlockDecoder.h
+*
+* @brief Defines block layout of compressed texture formats and CPU decoders
+*   used when the device can't sample a format
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/22/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+
+/**
+ * Size of a format's texel blocks. Uncompressed formats have 1x1 blocks
+ */
+struct FormatBlockInfo {
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytes;
+};
+
+/**
+ * Get the block layout of a format
+ * @param format format of texture data
+ * @param info [output] block dimensions and size
+ * @return false if the format is not a known color format
+ */
+bool getFormatBlockInfo(VkFormat format, FormatBlockInfo* info);
+
+/**
+ * Get the size of one level of a format's data, tightly packed
+ */
+uint64_t getFormatLevelSize(VkFormat format, uint32_t width, uint32_t height);
+
+/**
+ * Check whether blocks of a format can be decoded on the CPU. BC1-5 and ETC2 are supported
+ */
+bool canDecodeFormat(VkFormat format);
+
+/**
+ * Get the format decoded data is in: R8G8B8A8, keeping the source's sRGB encoding
+ */
+VkFormat getDecodedFormat(VkFormat format);
+
+/**
+ * Decode a level of block compressed data to RGBA8. Single and two channel formats decode to red and green
+ *  with blue 0 and alpha 255, matching how the device samples them
+ * @param format format of the data, which must pass canDecodeFormat
+ * @param data tightly packed blocks
+ * @param width level width in texels
+ * @param height level height in texels
+ * @param rgba [output] width * height * 4 bytes
+ */
+void decodeBlocks(VkFormat format, const uint8_t* data, uint32_t width, uint32_t height, uint8_t* rgba);
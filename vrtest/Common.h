@@ -12,3 +12,8 @@
 
 #define MAX(a, b) ((a > b) ? (a) : (b))
 #define MIN(a, b) ((a < b) ? (a) : (b))
+
+/**
+ * Bytes to pad between data written by different threads so they don't share a cache line
+ */
+#define CACHE_LINE_SIZE 64
@@ -0,0 +1,67 @@
+/** @file DynamicResolution.cpp
+*
+* @brief Defines controller that picks the render resolution scale from
+*   measured GPU frame time
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/12/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include <math.h>
+
+#include "DynamicResolution.h"
+#include "Common.h"
+
+DynamicResolution::DynamicResolution(double budget_ms, float min_scale, float max_scale) {
+    this->budget_ms = budget_ms;
+    this->min_scale = min_scale;
+    this->max_scale = max_scale;
+    this->step = 0.05f;
+    this->scale = max_scale;
+}
+
+bool DynamicResolution::update(double gpu_ms) {
+    // React quickly to overruns, which drop frames, and slowly to headroom
+    if (average_ms == 0.0) {
+        average_ms = gpu_ms;
+    }
+    else {
+        double weight = gpu_ms > average_ms ? 0.3 : 0.05;
+        average_ms += (gpu_ms - average_ms) * weight;
+    }
+
+    if (cooldown > 0) {
+        cooldown--;
+        return false;
+    }
+
+    float target = scale;
+    if (average_ms > budget_ms * 0.95) {
+        // Aim below the budget so the next frame has some headroom
+        target = scale * static_cast<float>(sqrt(budget_ms * 0.85 / average_ms));
+        target = floorf(target / step) * step;
+    }
+    else if (average_ms < budget_ms * 0.75) {
+        target = scale + step;
+    }
+
+    target = MIN(MAX(target, min_scale), max_scale);
+    if (fabsf(target - scale) < step * 0.5f) {
+        return false;
+    }
+
+    scale = target;
+    cooldown = 8;
+    return true;
+}
+
+float DynamicResolution::getScale() {
+    return scale;
+}
+
+double DynamicResolution::getAverageTime() {
+    return average_ms;
+}
@@ -0,0 +1,72 @@
+/** @file DynamicResolution.h
+*
+* @brief Defines controller that picks the render resolution scale from
+*   measured GPU frame time
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/12/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Scales resolution on both axes. GPU cost is treated as proportional to pixel count (scale squared), so
+ *  the scale needed to hit the budget is estimated from the square root of the time ratio. The scale is
+ *  quantized so small timing noise doesn't force command buffers to be re-recorded every frame
+ */
+class DynamicResolution {
+private:
+    /**
+     * Target GPU time per frame in milliseconds
+     */
+    double budget_ms;
+
+    float min_scale;
+    float max_scale;
+
+    /**
+     * Scale granularity
+     */
+    float step;
+
+    float scale;
+
+    /**
+     * Smoothed GPU time
+     */
+    double average_ms = 0.0;
+
+    /**
+     * Frames to wait after a change before changing again, so measurements reflect the new scale
+     */
+    uint32_t cooldown = 0;
+
+public:
+    /**
+     * @param budget_ms target GPU time per frame, e.g. slightly under the refresh interval
+     * @param min_scale smallest allowed scale
+     * @param max_scale largest allowed scale. The render target is allocated at this size
+     */
+    DynamicResolution(double budget_ms, float min_scale = 0.5f, float max_scale = 1.0f);
+
+    /**
+     * Feed the GPU time of a completed frame
+     * @param gpu_ms measured GPU time in milliseconds
+     * @return true if the scale changed
+     */
+    bool update(double gpu_ms);
+
+    /**
+     * Get the current resolution scale
+     */
+    float getScale();
+
+    /**
+     * Get the smoothed GPU time in milliseconds
+     */
+    double getAverageTime();
+};
@@ -0,0 +1,362 @@
+/** @file ExportPresentationEngine.cpp
+*
+* @brief Defines presentation engine that exports rendered frames to another
+*   process through a shared memory ring
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/18/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "ExportPresentationEngine.h"
+#include "Common.h"
+
+ExportPresentationEngine::ExportPresentationEngine(uint32_t resolution_x, uint32_t resolution_y,
+    uint32_t image_count, uint32_t ring_slots, VkAllocationCallbacks* p_allocs, const char* app_name,
+    const char* shm_name)
+    : OffscreenPresentationEngine(resolution_x, resolution_y, image_count, p_allocs, app_name) {
+
+    this->shm_name = shm_name;
+    this->ring_slots = MAX(ring_slots, 2u);
+    this->frame_size = static_cast<VkDeviceSize>(sc_extent.width) * sc_extent.height * 4;
+
+    createSharedMemory();
+}
+
+ExportPresentationEngine::~ExportPresentationEngine() {
+    if (command_pool) {
+        for (uint32_t i = 0; i < sc_image_count; i++) {
+            if (copy_pending[i]) {
+                vkWaitForFences(device, 1, &(copy_fences[i]), VK_TRUE, UINT64_MAX);
+            }
+            vkDestroyFence(device, copy_fences[i], p_allocs);
+            vkDestroySemaphore(device, render_done[i], p_allocs);
+            vkDestroyBuffer(device, staging_buffers[i], p_allocs);
+        }
+        vkUnmapMemory(device, staging_mem);
+        memory_telemetry->freeMemory(staging_mem);
+        vkDestroyCommandPool(device, command_pool, p_allocs);
+    }
+
+    if (shm_header) {
+        shm_header->producer_alive.store(0, std::memory_order_release);
+        shm_header->frame_counter.fetch_add(1, std::memory_order_release);
+        wakeFrameExportConsumers(shm_header);
+        munmap(shm_header, shm_size);
+        shm_unlink(shm_name.c_str());
+    }
+
+    delete[] copy_buffers;
+    delete[] render_done;
+    delete[] copy_fences;
+    delete[] copy_pending;
+    delete[] staging_buffers;
+}
+
+void ExportPresentationEngine::createSharedMemory() {
+    uint64_t slot_stride = FRAME_EXPORT_PIXEL_OFFSET + frame_size;
+    slot_stride = (slot_stride + FRAME_EXPORT_ALIGNMENT - 1) / FRAME_EXPORT_ALIGNMENT * FRAME_EXPORT_ALIGNMENT;
+    shm_size = static_cast<size_t>(FRAME_EXPORT_ALIGNMENT + slot_stride * ring_slots);
+
+    // Start from a fresh object so a consumer of a previous run can't see a half initialized header
+    shm_unlink(shm_name.c_str());
+    int fd = shm_open(shm_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to create frame export shared memory");
+    }
+    if (ftruncate(fd, static_cast<off_t>(shm_size)) != 0) {
+        close(fd);
+        shm_unlink(shm_name.c_str());
+        throw std::runtime_error("Failed to size frame export shared memory");
+    }
+
+    void* mapped = mmap(nullptr, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        shm_unlink(shm_name.c_str());
+        throw std::runtime_error("Failed to map frame export shared memory");
+    }
+
+    // New pages are zeroed, so every slot sequence starts even and empty
+    shm_header = static_cast<FrameExportHeader*>(mapped);
+    shm_header->version = FRAME_EXPORT_VERSION;
+    shm_header->width = sc_extent.width;
+    shm_header->height = sc_extent.height;
+    shm_header->row_pitch = sc_extent.width * 4;
+    shm_header->format = static_cast<uint32_t>(sc_format);
+    shm_header->slot_count = ring_slots;
+    shm_header->slot_offset = FRAME_EXPORT_ALIGNMENT;
+    shm_header->slot_stride = slot_stride;
+    shm_header->producer_alive.store(1, std::memory_order_relaxed);
+
+    // Consumers check the magic last, so the rest of the header is visible once it is
+    std::atomic_thread_fence(std::memory_order_release);
+    shm_header->magic = FRAME_EXPORT_MAGIC;
+
+    std::cout << "Exporting frames to shared memory " << shm_name << std::endl;
+    std::cout << "\tRing slots: " << ring_slots << std::endl;
+    std::cout << "\tSize: " << shm_size << " bytes" << std::endl;
+}
+
+void ExportPresentationEngine::createSwapchain(VkPhysicalDevice physical_device, VkDevice device,
+    int gfx_queue_family, int present_queue_family) {
+    OffscreenPresentationEngine::createSwapchain(physical_device, device, gfx_queue_family, present_queue_family);
+
+    createStaging(physical_device);
+    createCopyCommands(present_queue_family);
+}
+
+void ExportPresentationEngine::createStaging(VkPhysicalDevice physical_device) {
+    VkBufferCreateInfo buffer_ci = {};
+    buffer_ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_ci.flags = 0;
+    buffer_ci.size = frame_size;
+    buffer_ci.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    buffer_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    staging_buffers = new VkBuffer[sc_image_count];
+    for (uint32_t i = 0; i < sc_image_count; i++) {
+        if (vkCreateBuffer(device, &buffer_ci, p_allocs, &(staging_buffers[i])) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create frame export staging buffer");
+        }
+    }
+
+    VkMemoryRequirements mem_req;
+    vkGetBufferMemoryRequirements(device, staging_buffers[0], &mem_req);
+
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(physical_device, &props);
+    atom_size = props.limits.nonCoherentAtomSize;
+    VkDeviceSize alignment = MAX(mem_req.alignment, atom_size);
+    staging_stride = (mem_req.size + alignment - 1) / alignment * alignment;
+
+    // The CPU reads every byte, so prefer cached memory
+    VkPhysicalDeviceMemoryProperties mem_props;
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &mem_props);
+
+    uint32_t mem_type = UINT32_MAX;
+    for (uint32_t type = 0; type < mem_props.memoryTypeCount; type++) {
+        VkMemoryPropertyFlags flags = mem_props.memoryTypes[type].propertyFlags;
+        if ((mem_req.memoryTypeBits & (1 << type)) == 0 || (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) == 0) {
+            continue;
+        }
+        if (mem_type == UINT32_MAX || (flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) != 0) {
+            mem_type = type;
+            if ((flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) != 0) {
+                break;
+            }
+        }
+    }
+    if (mem_type == UINT32_MAX) {
+        throw std::runtime_error("Failed to find host visible memory for frame export");
+    }
+    staging_coherent = (mem_props.memoryTypes[mem_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+    VkMemoryAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize = staging_stride * sc_image_count;
+    alloc_info.memoryTypeIndex = mem_type;
+
+    if (memory_telemetry->allocateMemory(alloc_info, MEMORY_CATEGORY_STAGING, &staging_mem) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate frame export staging memory");
+    }
+    for (uint32_t i = 0; i < sc_image_count; i++) {
+        if (vkBindBufferMemory(device, staging_buffers[i], staging_mem, staging_stride * i) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to bind frame export staging memory");
+        }
+    }
+
+    void* mapped;
+    if (vkMapMemory(device, staging_mem, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to map frame export staging memory");
+    }
+    staging_mapped = static_cast<uint8_t*>(mapped);
+}
+
+void ExportPresentationEngine::createCopyCommands(int queue_family) {
+    VkCommandPoolCreateInfo pool_ci = {};
+    pool_ci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_ci.flags = 0;
+    pool_ci.queueFamilyIndex = static_cast<uint32_t>(queue_family);
+
+    if (vkCreateCommandPool(device, &pool_ci, p_allocs, &command_pool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create frame export command pool");
+    }
+
+    copy_buffers = new VkCommandBuffer[sc_image_count];
+    render_done = new VkSemaphore[sc_image_count];
+    copy_fences = new VkFence[sc_image_count];
+    copy_pending = new bool[sc_image_count];
+
+    VkCommandBufferAllocateInfo buffer_ai = {};
+    buffer_ai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    buffer_ai.commandPool = command_pool;
+    buffer_ai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    buffer_ai.commandBufferCount = sc_image_count;
+
+    if (vkAllocateCommandBuffers(device, &buffer_ai, copy_buffers) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate frame export command buffers");
+    }
+
+    VkSemaphoreCreateInfo semaphore_ci = {};
+    semaphore_ci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    VkFenceCreateInfo fence_ci = {};
+    fence_ci.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fence_ci.flags = 0;
+
+    for (uint32_t i = 0; i < sc_image_count; i++) {
+        copy_pending[i] = false;
+        if (vkCreateSemaphore(device, &semaphore_ci, p_allocs, &(render_done[i])) != VK_SUCCESS ||
+            vkCreateFence(device, &fence_ci, p_allocs, &(copy_fences[i])) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create frame export synchronization objects");
+        }
+
+        // The copies never change, so record them once
+        VkCommandBufferBeginInfo begin_info = {};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = 0;
+
+        if (vkBeginCommandBuffer(copy_buffers[i], &begin_info) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to begin frame export command buffer");
+        }
+
+        VkBufferImageCopy region = {};
+        region.bufferOffset = 0;
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = { 0, 0, 0 };
+        region.imageExtent = { sc_extent.width, sc_extent.height, 1 };
+
+        vkCmdCopyImageToBuffer(copy_buffers[i], sc_images[i], getPresentLayout(), staging_buffers[i], 1, &region);
+
+        VkBufferMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = staging_buffers[i];
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+
+        vkCmdPipelineBarrier(copy_buffers[i], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0,
+            nullptr, 1, &barrier, 0, nullptr);
+
+        if (vkEndCommandBuffer(copy_buffers[i]) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to end frame export command buffer");
+        }
+    }
+}
+
+void ExportPresentationEngine::pollEvents() {
+    // Copies are published when the next image is acquired, on the thread that renders. Events may be polled
+    // from another thread, so nothing here may touch per-image state
+}
+
+int ExportPresentationEngine::getNextSwapchainImage(VkSemaphore** wait_sem, VkSemaphore** signal_sem) {
+    publishCompleted();
+
+    // The image is still being copied out
+    if (copy_pending[next_image]) {
+        return -1;
+    }
+
+    uint32_t index = next_image;
+    next_image = (next_image + 1) % sc_image_count;
+
+    *wait_sem = nullptr;
+    *signal_sem = &(render_done[index]);
+    return static_cast<int>(index);
+}
+
+void ExportPresentationEngine::presentSwapchainImage(int image_index, VkQueue present_queue) {
+    uint32_t index = static_cast<uint32_t>(image_index);
+
+    VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.waitSemaphoreCount = 1;
+    submit_info.pWaitSemaphores = &(render_done[index]);
+    submit_info.pWaitDstStageMask = &wait_stage;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &(copy_buffers[index]);
+    submit_info.signalSemaphoreCount = 0;
+    submit_info.pSignalSemaphores = nullptr;
+
+    vkResetFences(device, 1, &(copy_fences[index]));
+    if (vkQueueSubmit(present_queue, 1, &submit_info, copy_fences[index]) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit frame export copy");
+    }
+    copy_pending[index] = true;
+
+    OffscreenPresentationEngine::presentSwapchainImage(image_index, present_queue);
+}
+
+void ExportPresentationEngine::publishCompleted() {
+    // Images are acquired and presented round robin, so the oldest pending copy is the first after the last
+    // acquired image. Images acquired but not presented yet have no copy pending
+    for (uint32_t i = 0; i < sc_image_count; i++) {
+        uint32_t index = (next_image + i) % sc_image_count;
+        if (!copy_pending[index]) {
+            continue;
+        }
+        if (vkGetFenceStatus(device, copy_fences[index]) != VK_SUCCESS) {
+            break;
+        }
+
+        publish(index);
+        copy_pending[index] = false;
+    }
+}
+
+void ExportPresentationEngine::publish(uint32_t image_index) {
+    if (!staging_coherent) {
+        VkMappedMemoryRange range = {};
+        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.memory = staging_mem;
+        range.offset = staging_stride * image_index;
+        range.size = (frame_size + atom_size - 1) / atom_size * atom_size;
+        vkInvalidateMappedMemoryRanges(device, 1, &range);
+    }
+
+    uint64_t frame_number = ++published_frames;
+    uint32_t slot_index = static_cast<uint32_t>(frame_number % ring_slots);
+    FrameExportSlot* slot = getFrameExportSlot(shm_header, slot_index);
+
+    // Odd sequence tells readers the slot is being written
+    uint32_t sequence = slot->sequence.load(std::memory_order_relaxed);
+    slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot->frame_number = frame_number;
+    slot->publish_time_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+    memcpy(getFrameExportPixels(slot), staging_mapped + staging_stride * image_index,
+        static_cast<size_t>(frame_size));
+
+    slot->sequence.store(sequence + 2, std::memory_order_release);
+
+    shm_header->latest_slot.store(slot_index, std::memory_order_release);
+    shm_header->frame_counter.fetch_add(1, std::memory_order_seq_cst);
+    wakeFrameExportConsumers(shm_header);
+}
+
+uint64_t ExportPresentationEngine::getPublishedCount() {
+    return published_frames;
+}
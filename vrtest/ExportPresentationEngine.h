@@ -0,0 +1,117 @@
+/** @file ExportPresentationEngine.h
+*
+* @brief Defines presentation engine that exports rendered frames to another
+*   process through a shared memory ring
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/18/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <string>
+
+#include "OffscreenPresentationEngine.h"
+#include "FrameExportProtocol.h"
+
+/**
+ * Renders to offscreen images like OffscreenPresentationEngine. Presenting an image submits a copy into a host
+ *  visible staging buffer, and once that copy retires the frame is written into the next slot of a POSIX
+ *  shared memory ring (see FrameExportProtocol.h) and waiting consumers are woken with a futex. Frames are
+ *  published in order, and an image isn't handed out again until its export has been published
+ */
+class ExportPresentationEngine : public OffscreenPresentationEngine {
+private:
+    /**
+     * Name of the shared memory object, e.g. "/vrtest_frames"
+     */
+    std::string shm_name;
+
+    /**
+     * Mapped shared memory
+     */
+    FrameExportHeader* shm_header = nullptr;
+    size_t shm_size = 0;
+    uint32_t ring_slots;
+
+    /**
+     * Number of the last frame published
+     */
+    uint64_t published_frames = 0;
+
+    /**
+     * Command buffers copying each image to its staging buffer, and the queue family they run on
+     */
+    VkCommandPool command_pool = VK_NULL_HANDLE;
+    VkCommandBuffer* copy_buffers = nullptr;
+
+    /**
+     * Per-image semaphores signaled by rendering and waited on by the copy, and fences signaled by the copy
+     */
+    VkSemaphore* render_done = nullptr;
+    VkFence* copy_fences = nullptr;
+
+    /**
+     * Whether each image's copy has been submitted and not yet published
+     */
+    bool* copy_pending = nullptr;
+
+    /**
+     * Host visible staging buffer of each image, in one persistently mapped allocation
+     */
+    VkBuffer* staging_buffers = nullptr;
+    VkDeviceMemory staging_mem = VK_NULL_HANDLE;
+    uint8_t* staging_mapped = nullptr;
+    VkDeviceSize frame_size;
+    VkDeviceSize staging_stride;
+    bool staging_coherent;
+    VkDeviceSize atom_size;
+
+    void createSharedMemory();
+    void createStaging(VkPhysicalDevice physical_device);
+    void createCopyCommands(int queue_family);
+
+    /**
+     * Publish frames whose copies have retired, oldest first
+     */
+    void publishCompleted();
+
+    /**
+     * Write a staged image into the next ring slot and wake consumers
+     */
+    void publish(uint32_t image_index);
+
+public:
+    /**
+     * @param resolution_x: Image width
+     * @param resolution_y: Image height
+     * @param image_count: Number of images, which bounds the frames in flight
+     * @param ring_slots: Number of frames the shared memory ring holds
+     * @param p_allocs: Allocation callbacks used for Vulkan calls, or nullptr
+     * @param app_name: Name of the application
+     * @param shm_name: Name of the shared memory object to create. Replaces any existing object
+     */
+    ExportPresentationEngine(uint32_t resolution_x, uint32_t resolution_y, uint32_t image_count,
+        uint32_t ring_slots, VkAllocationCallbacks* p_allocs, const char* app_name, const char* shm_name);
+
+    /**
+     * Destructor. Marks the producer as gone and removes the shared memory object; consumers that still have
+     *  it mapped keep their mapping
+     */
+    ~ExportPresentationEngine();
+
+    void pollEvents();
+    void createSwapchain(VkPhysicalDevice physical_device, VkDevice device, int gfx_queue_family,
+        int present_queue_family);
+    int getNextSwapchainImage(VkSemaphore** wait_sem, VkSemaphore** signal_sem);
+    void presentSwapchainImage(int image_index, VkQueue present_queue);
+
+    /**
+     * Get the number of frames published to the ring
+     */
+    uint64_t getPublishedCount();
+};
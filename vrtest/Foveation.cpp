@@ -0,0 +1,62 @@
+/** @file Foveation.cpp
+*
+* @brief Defines radial foveation rings used to render the periphery of each
+*   eye at reduced resolution
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/12/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include <math.h>
+
+#include "Foveation.h"
+#include "Common.h"
+
+FoveationConfig getDefaultFoveation() {
+    FoveationConfig config = {};
+    config.ring_count = 3;
+    config.rings[0] = { 0.25f, 1.0f };
+    config.rings[1] = { 0.5f, 0.6f };
+    config.rings[2] = { 0.0f, 0.35f };
+
+    for (uint32_t eye = 0; eye < 2; eye++) {
+        config.center[eye][0] = 0.5f;
+        config.center[eye][1] = 0.5f;
+    }
+
+    config.blend_width = 0.04f;
+    return config;
+}
+
+FoveationConfig getUnfoveated() {
+    FoveationConfig config = getDefaultFoveation();
+    config.ring_count = 1;
+    config.rings[0] = { 0.0f, 1.0f };
+    return config;
+}
+
+VkRect2D getFoveationScissor(const FoveationConfig& config, uint32_t eye, uint32_t ring, const VkRect2D& viewport) {
+    if (ring + 1 >= config.ring_count) {
+        return viewport;
+    }
+
+    // Radius is in units of eye height, so it spans the same number of pixels on both axes
+    float width = static_cast<float>(viewport.extent.width);
+    float height = static_cast<float>(viewport.extent.height);
+    float radius = config.rings[ring].radius * height;
+    float center_x = config.center[eye][0] * width;
+    float center_y = config.center[eye][1] * height;
+
+    int32_t x0 = static_cast<int32_t>(MAX(floorf(center_x - radius), 0.0f));
+    int32_t y0 = static_cast<int32_t>(MAX(floorf(center_y - radius), 0.0f));
+    int32_t x1 = static_cast<int32_t>(MIN(ceilf(center_x + radius), width));
+    int32_t y1 = static_cast<int32_t>(MIN(ceilf(center_y + radius), height));
+
+    VkRect2D scissor;
+    scissor.offset = { viewport.offset.x + x0, viewport.offset.y + y0 };
+    scissor.extent = { static_cast<uint32_t>(MAX(x1 - x0, 0)), static_cast<uint32_t>(MAX(y1 - y0, 0)) };
+    return scissor;
+}
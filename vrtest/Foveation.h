@@ -0,0 +1,65 @@
+/** @file Foveation.h
+*
+* @brief Defines radial foveation rings used to render the periphery of each
+*   eye at reduced resolution
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/12/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+
+#define MAX_FOVEATION_RINGS 3
+
+/**
+ * A ring extends from the previous ring's radius out to its own radius and is rendered at a fraction of full
+ *  resolution. Radii are measured from the eye's center in units of the eye's height
+ */
+struct FoveationRing {
+    float radius;
+    float scale;
+};
+
+/**
+ * Rings ordered from the inset outwards. The last ring's radius is ignored: it covers the rest of the eye
+ */
+struct FoveationConfig {
+    uint32_t ring_count;
+    FoveationRing rings[MAX_FOVEATION_RINGS];
+
+    /**
+     * Center of each eye's rings in eye-local coordinates (0 to 1), e.g. the lens center
+     */
+    float center[2][2];
+
+    /**
+     * Width of the band over which adjacent rings are blended, in the same units as the radii
+     */
+    float blend_width;
+};
+
+/**
+ * Full resolution inset, a 60% resolution middle ring and a 35% resolution periphery, centered in each eye
+ */
+FoveationConfig getDefaultFoveation();
+
+/**
+ * Single full resolution ring, i.e. foveation disabled
+ */
+FoveationConfig getUnfoveated();
+
+/**
+ * Compute the area of an eye's viewport a ring must render: the bounding box of its outer circle. The
+ *  outermost ring renders the whole viewport
+ * @param config foveation configuration
+ * @param eye eye index, 0 for left
+ * @param ring ring index
+ * @param viewport eye's viewport in the ring's render target
+ * @return scissor rectangle clamped to the viewport
+ */
+VkRect2D getFoveationScissor(const FoveationConfig& config, uint32_t eye, uint32_t ring, const VkRect2D& viewport);
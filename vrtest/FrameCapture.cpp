@@ -0,0 +1,266 @@
+/** @file FrameCapture.cpp
+*
+* @brief Defines class that reads rendered frames back to the host and writes
+*   them to image files on a background thread
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/16/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <stdio.h>
+#include <string.h>
+
+#include "FrameCapture.h"
+#include "Common.h"
+
+/**
+ * Frames that can be queued for encoding, on top of one per slot
+ */
+#define CAPTURE_QUEUE_DEPTH 4
+
+FrameCapture::FrameCapture(GraphicsDevice* graphics_device, VkAllocationCallbacks* p_allocs, uint32_t slot_count,
+    VkExtent2D extent, VkFormat format, const char* directory, ImageFileFormat file_format)
+    : free_frames(slot_count + CAPTURE_QUEUE_DEPTH), encode_queue(slot_count + CAPTURE_QUEUE_DEPTH),
+    stopping(false), written_count(0) {
+
+    this->graphics_device = graphics_device;
+    this->p_allocs = p_allocs;
+    this->slot_count = slot_count;
+    this->extent = extent;
+    this->directory = directory;
+    this->file_format = file_format;
+
+    switch (format) {
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+        bgra = true;
+        break;
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+        bgra = false;
+        break;
+    default:
+        throw std::runtime_error("Unsupported capture format");
+    }
+
+    slot_size = static_cast<VkDeviceSize>(extent.width) * extent.height * 4;
+    createBuffers();
+
+    slot_frames = new uint64_t[slot_count];
+    memset(slot_frames, 0, sizeof(uint64_t) * slot_count);
+
+    // Allocate every frame up front so capturing doesn't allocate per frame
+    for (uint32_t i = 0; i < slot_count + CAPTURE_QUEUE_DEPTH; i++) {
+        CapturedFrame* frame = new CapturedFrame();
+        frame->pixels.resize(static_cast<size_t>(slot_size));
+        frames.push_back(frame);
+        free_frames.push(frame);
+    }
+
+    encoder = std::thread(&FrameCapture::encodeLoop, this);
+}
+
+FrameCapture::~FrameCapture() {
+    stopping.store(true);
+    encoder.join();
+
+    if (dropped_count > 0) {
+        std::cout << "Frame capture dropped " << dropped_count << " frames" << std::endl;
+    }
+
+    VkDevice device = graphics_device->device();
+    vkUnmapMemory(device, buffer_mem);
+    for (uint32_t i = 0; i < slot_count; i++) {
+        vkDestroyBuffer(device, buffers[i], p_allocs);
+    }
+    graphics_device->getMemoryTelemetry()->freeMemory(buffer_mem);
+
+    for (CapturedFrame* frame : frames) {
+        delete frame;
+    }
+
+    delete[] buffers;
+    delete[] slot_frames;
+}
+
+void FrameCapture::createBuffers() {
+    VkDevice device = graphics_device->device();
+
+    VkBufferCreateInfo buffer_ci = {};
+    buffer_ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_ci.flags = 0;
+    buffer_ci.size = slot_size;
+    buffer_ci.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    buffer_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    buffers = new VkBuffer[slot_count];
+    for (uint32_t i = 0; i < slot_count; i++) {
+        if (vkCreateBuffer(device, &buffer_ci, p_allocs, &(buffers[i])) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create capture readback buffer");
+        }
+    }
+
+    VkMemoryRequirements mem_req;
+    vkGetBufferMemoryRequirements(device, buffers[0], &mem_req);
+
+    // Slots are invalidated separately, so align them to the non-coherent atom size too
+    atom_size = graphics_device->getDeviceProperties().limits.nonCoherentAtomSize;
+    VkDeviceSize alignment = MAX(mem_req.alignment, atom_size);
+    slot_stride = (mem_req.size + alignment - 1) / alignment * alignment;
+
+    // Prefer cached memory, falling back to any host visible memory
+    VkPhysicalDeviceMemoryProperties mem_props;
+    vkGetPhysicalDeviceMemoryProperties(graphics_device->getPhysicalDevice(), &mem_props);
+
+    uint32_t mem_type = UINT32_MAX;
+    for (uint32_t type = 0; type < mem_props.memoryTypeCount; type++) {
+        VkMemoryPropertyFlags flags = mem_props.memoryTypes[type].propertyFlags;
+        if ((mem_req.memoryTypeBits & (1 << type)) == 0 || (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) == 0) {
+            continue;
+        }
+        if (mem_type == UINT32_MAX || (flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) != 0) {
+            mem_type = type;
+            if ((flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) != 0) {
+                break;
+            }
+        }
+    }
+    if (mem_type == UINT32_MAX) {
+        throw std::runtime_error("Failed to find host visible memory for capture");
+    }
+    coherent = (mem_props.memoryTypes[mem_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+    VkMemoryAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize = slot_stride * slot_count;
+    alloc_info.memoryTypeIndex = mem_type;
+
+    if (graphics_device->getMemoryTelemetry()->allocateMemory(alloc_info, MEMORY_CATEGORY_STAGING, &buffer_mem) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate capture readback memory");
+    }
+
+    for (uint32_t i = 0; i < slot_count; i++) {
+        if (vkBindBufferMemory(device, buffers[i], buffer_mem, slot_stride * i) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to bind capture readback memory");
+        }
+    }
+
+    void* mapped_data;
+    if (vkMapMemory(device, buffer_mem, 0, VK_WHOLE_SIZE, 0, &mapped_data) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to map capture readback memory");
+    }
+    mapped = static_cast<uint8_t*>(mapped_data);
+}
+
+const VkBuffer* FrameCapture::getBuffers() {
+    return buffers;
+}
+
+VkDeviceSize FrameCapture::getBufferSize() {
+    return slot_size;
+}
+
+void FrameCapture::recordCopy(VkCommandBuffer cmd, uint32_t slot, VkImage image) {
+    VkBufferImageCopy region = {};
+    region.bufferOffset = 0;
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = { 0, 0, 0 };
+    region.imageExtent = { extent.width, extent.height, 1 };
+
+    vkCmdCopyImageToBuffer(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffers[slot], 1, &region);
+
+    // Make the copy visible to host reads once the frame's fence has signaled
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = buffers[slot];
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1,
+        &barrier, 0, nullptr);
+}
+
+void FrameCapture::collect(uint32_t slot) {
+    uint64_t number = slot_frames[slot];
+    slot_frames[slot] = next_frame++;
+
+    if (number == 0) {
+        return;
+    }
+
+    CapturedFrame* frame;
+    if (!free_frames.pop(&frame)) {
+        dropped_count++;
+        return;
+    }
+
+    if (!coherent) {
+        VkMappedMemoryRange range = {};
+        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.memory = buffer_mem;
+        range.offset = slot_stride * slot;
+        range.size = (slot_size + atom_size - 1) / atom_size * atom_size;
+        vkInvalidateMappedMemoryRanges(graphics_device->device(), 1, &range);
+    }
+
+    // Copy out so the slot can be reused by the next submission while the frame is encoded
+    memcpy(frame->pixels.data(), mapped + slot_stride * slot, static_cast<size_t>(slot_size));
+    frame->number = number;
+    encode_queue.push(frame);
+}
+
+void FrameCapture::encodeLoop() {
+    std::vector<uint8_t> encoded;
+    char filename[64];
+
+    while (true) {
+        CapturedFrame* frame;
+        if (!encode_queue.pop(&frame)) {
+            if (stopping.load()) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        encodeImage(file_format, frame->pixels.data(), extent.width, extent.height, bgra, &encoded);
+
+        snprintf(filename, sizeof(filename), "frame_%06llu.%s", static_cast<unsigned long long>(frame->number),
+            getImageFileExtension(file_format));
+        std::ofstream file(directory + "/" + filename, std::ios::binary);
+        if (file.is_open()) {
+            file.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+            written_count++;
+        }
+        else {
+            std::cerr << "Failed to write capture " << filename << std::endl;
+        }
+
+        free_frames.push(frame);
+    }
+}
+
+uint64_t FrameCapture::getWrittenCount() {
+    return written_count.load();
+}
+
+uint64_t FrameCapture::getDroppedCount() {
+    return dropped_count;
+}
@@ -0,0 +1,150 @@
+/** @file FrameCapture.h
+*
+* @brief Defines class that reads rendered frames back to the host and writes
+*   them to image files on a background thread
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/16/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "GraphicsDevice.h"
+#include "ImageEncoder.h"
+#include "SpscQueue.h"
+
+/**
+ * Each frame's command buffer copies the final image into that frame's slot of a host visible readback ring.
+ *  A slot is only read once its frame has retired, which the renderer already waits for before reusing the
+ *  slot, so reading back never stalls the GPU. Pixels are copied out of the slot and passed to an encoder
+ *  thread through lock-free queues. If the encoder falls behind, frames are dropped rather than blocking
+ */
+class FrameCapture {
+private:
+    /**
+     * Frame pixels on their way to or from the encoder thread
+     */
+    struct CapturedFrame {
+        uint64_t number;
+        std::vector<uint8_t> pixels;
+    };
+
+    GraphicsDevice* graphics_device;
+    VkAllocationCallbacks* p_allocs;
+
+    /**
+     * Number of readback slots, one per frame index
+     */
+    uint32_t slot_count;
+
+    /**
+     * Captured image dimensions and whether its pixels are BGRA
+     */
+    VkExtent2D extent;
+    bool bgra;
+
+    /**
+     * Readback buffer of each slot, all bound to one persistently mapped allocation
+     */
+    VkBuffer* buffers = nullptr;
+    VkDeviceMemory buffer_mem = VK_NULL_HANDLE;
+    uint8_t* mapped = nullptr;
+    VkDeviceSize slot_size;
+    VkDeviceSize slot_stride;
+
+    /**
+     * Whether the memory is host coherent. Cached memory is preferred since reads from uncached memory are
+     *  slow, and needs invalidating
+     */
+    bool coherent;
+    VkDeviceSize atom_size;
+
+    /**
+     * Frame number held by each slot, or 0 if the slot holds nothing to capture
+     */
+    uint64_t* slot_frames = nullptr;
+    uint64_t next_frame = 1;
+
+    /**
+     * Output location and format
+     */
+    std::string directory;
+    ImageFileFormat file_format;
+
+    /**
+     * Frames in the pool, free frames returned by the encoder, and frames waiting to be encoded
+     */
+    std::vector<CapturedFrame*> frames;
+    SpscQueue<CapturedFrame*> free_frames;
+    SpscQueue<CapturedFrame*> encode_queue;
+
+    std::thread encoder;
+    std::atomic<bool> stopping;
+
+    std::atomic<uint64_t> written_count;
+    uint64_t dropped_count = 0;
+
+    void createBuffers();
+    void encodeLoop();
+
+public:
+    /**
+     * @param graphics_device device to create readback buffers with
+     * @param p_allocs allocation callbacks passed to Vulkan calls
+     * @param slot_count number of frame indexes
+     * @param extent dimensions of the captured image
+     * @param format format of the captured image. Must be an 8-bit RGBA or BGRA format
+     * @param directory existing directory files are written to
+     * @param file_format format of written files
+     */
+    FrameCapture(GraphicsDevice* graphics_device, VkAllocationCallbacks* p_allocs, uint32_t slot_count,
+        VkExtent2D extent, VkFormat format, const char* directory, ImageFileFormat file_format);
+
+    /**
+     * Finishes writing queued frames. Frames still in flight on the GPU are not written
+     */
+    ~FrameCapture();
+
+    /**
+     * Get the readback buffers, one per slot, e.g. to import them into a frame graph
+     */
+    const VkBuffer* getBuffers();
+
+    /**
+     * Get the size of each readback buffer
+     */
+    VkDeviceSize getBufferSize();
+
+    /**
+     * Record the copy of a frame's image into its slot. The image must be in TRANSFER_SRC_OPTIMAL layout
+     * @param cmd command buffer of the frame
+     * @param slot frame index
+     * @param image image to capture
+     */
+    void recordCopy(VkCommandBuffer cmd, uint32_t slot, VkImage image);
+
+    /**
+     * Hand the frame a slot holds to the encoder and claim the slot for the frame about to be submitted. Call
+     *  after the slot's previous submission has retired and before it is submitted again
+     * @param slot frame index
+     */
+    void collect(uint32_t slot);
+
+    /**
+     * Get the number of frames written to files
+     */
+    uint64_t getWrittenCount();
+
+    /**
+     * Get the number of frames dropped because the encoder fell behind
+     */
+    uint64_t getDroppedCount();
+};
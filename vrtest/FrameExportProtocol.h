@@ -0,0 +1,151 @@
+/** @file FrameExportProtocol.h
+*
+* @brief Defines the shared memory layout and handshake used to export
+*   rendered frames to another process
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/18/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+#ifdef __linux__
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#define FRAME_EXPORT_MAGIC 0x58465256u
+#define FRAME_EXPORT_VERSION 1
+
+/**
+ * Offsets within the shared memory object are aligned to this
+ */
+#define FRAME_EXPORT_ALIGNMENT 4096
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) && ATOMIC_INT_LOCK_FREE == 2,
+    "Frame export needs address-free 32-bit atomics");
+
+/**
+ * Start of the shared memory object. Written once by the producer before any frame is published, except for
+ *  the atomics
+ */
+struct FrameExportHeader {
+    uint32_t magic;
+    uint32_t version;
+
+    /**
+     * Frame layout. Rows are tightly packed 8-bit pixels of the given VkFormat
+     */
+    uint32_t width;
+    uint32_t height;
+    uint32_t row_pitch;
+    uint32_t format;
+
+    /**
+     * Ring of slots frames are written to in turn
+     */
+    uint32_t slot_count;
+    uint32_t slot_offset;
+    uint64_t slot_stride;
+
+    /**
+     * Number of frames published. Incremented after each frame and used as the futex word consumers wait on
+     */
+    std::atomic<uint32_t> frame_counter;
+
+    /**
+     * Slot holding the most recently published frame
+     */
+    std::atomic<uint32_t> latest_slot;
+
+    /**
+     * Number of consumers blocked on frame_counter, so the producer only makes the wake syscall when needed
+     */
+    std::atomic<uint32_t> waiters;
+
+    /**
+     * Nonzero while the producer is running
+     */
+    std::atomic<uint32_t> producer_alive;
+};
+
+/**
+ * Start of each slot, followed by the pixels at FRAME_EXPORT_PIXEL_OFFSET. The sequence is a seqlock: odd
+ *  while the producer writes the slot, so a reader copies the pixels and then checks that the sequence is
+ *  even and unchanged. The producer never waits for consumers; a slow reader retries or skips ahead
+ */
+struct FrameExportSlot {
+    std::atomic<uint32_t> sequence;
+    uint32_t reserved;
+
+    /**
+     * Number of the frame in the slot, starting at 1
+     */
+    uint64_t frame_number;
+
+    /**
+     * Time the frame was published, in nanoseconds of the monotonic clock
+     */
+    uint64_t publish_time_ns;
+};
+
+#define FRAME_EXPORT_PIXEL_OFFSET 64
+
+static_assert(sizeof(FrameExportSlot) <= FRAME_EXPORT_PIXEL_OFFSET, "Frame export slot header too large");
+
+/**
+ * Get a slot of the ring
+ */
+inline FrameExportSlot* getFrameExportSlot(FrameExportHeader* header, uint32_t slot_index) {
+    uint64_t offset = header->slot_offset + header->slot_stride * slot_index;
+    return reinterpret_cast<FrameExportSlot*>(reinterpret_cast<uint8_t*>(header) + offset);
+}
+
+/**
+ * Get the pixels of a slot
+ */
+inline uint8_t* getFrameExportPixels(FrameExportSlot* slot) {
+    return reinterpret_cast<uint8_t*>(slot) + FRAME_EXPORT_PIXEL_OFFSET;
+}
+
+#ifdef __linux__
+/**
+ * Wake consumers waiting for a frame. Call after incrementing frame_counter. The futex is not private since
+ *  it is shared between processes
+ */
+inline void wakeFrameExportConsumers(FrameExportHeader* header) {
+    if (header->waiters.load(std::memory_order_seq_cst) > 0) {
+        syscall(SYS_futex, &header->frame_counter, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+    }
+}
+
+/**
+ * Block until frame_counter differs from a value or a timeout passes
+ * @param header mapped shared memory
+ * @param counter last frame_counter value seen
+ * @param timeout_ms maximum time to wait
+ * @return true if the counter changed
+ */
+inline bool waitForFrameExport(FrameExportHeader* header, uint32_t counter, uint32_t timeout_ms) {
+    header->waiters.fetch_add(1, std::memory_order_seq_cst);
+
+    // The kernel compares the word before sleeping, so a frame published after the load isn't missed
+    timespec timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+    if (header->frame_counter.load(std::memory_order_seq_cst) == counter) {
+        syscall(SYS_futex, &header->frame_counter, FUTEX_WAIT, counter, &timeout, nullptr, 0);
+    }
+
+    header->waiters.fetch_sub(1, std::memory_order_seq_cst);
+    return header->frame_counter.load(std::memory_order_acquire) != counter;
+}
+#endif
@@ -0,0 +1,1093 @@
+/** @file FrameGraph.cpp
+*
+* @brief Defines a frame graph that orders render passes by the resources they
+*   read and write, derives synchronization and aliases transient memory
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/02/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include <stdexcept>
+#include <algorithm>
+#include <iostream>
+
+#include "FrameGraph.h"
+#include "Common.h"
+
+/**
+ * Pipeline stages, access masks, layout and creation usage implied by a FrameGraphUsage
+ */
+struct UsageInfo {
+    VkPipelineStageFlags stages;
+    VkAccessFlags read_access;
+    VkAccessFlags write_access;
+    VkImageLayout layout;
+    VkImageUsageFlags image_usage;
+    VkBufferUsageFlags buffer_usage;
+    bool attachment;
+};
+
+static UsageInfo getUsageInfo(FrameGraphUsage usage) {
+    switch (usage) {
+    case FrameGraphUsage::ColorAttachment:
+        return { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT,
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, 0, true };
+    case FrameGraphUsage::DepthStencilAttachment:
+        return { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 0, true };
+    case FrameGraphUsage::DepthStencilReadOnly:
+        return { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT, 0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 0, true };
+    case FrameGraphUsage::InputAttachment:
+        return { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_INPUT_ATTACHMENT_READ_BIT, 0,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT, 0, true };
+    case FrameGraphUsage::SampledFragment:
+        return { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, 0,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT, 0, false };
+    case FrameGraphUsage::SampledCompute:
+        return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, 0,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT, 0, false };
+    case FrameGraphUsage::StorageImageCompute:
+        return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT, 0, false };
+    case FrameGraphUsage::StorageBufferCompute:
+        return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED, 0, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, false };
+    case FrameGraphUsage::UniformBuffer:
+        return { VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_UNIFORM_READ_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED,
+            0, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, false };
+    case FrameGraphUsage::VertexBuffer:
+        return { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, 0,
+            VK_IMAGE_LAYOUT_UNDEFINED, 0, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, false };
+    case FrameGraphUsage::IndexBuffer:
+        return { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT, 0,
+            VK_IMAGE_LAYOUT_UNDEFINED, 0, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, false };
+    case FrameGraphUsage::IndirectBuffer:
+        return { VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, 0,
+            VK_IMAGE_LAYOUT_UNDEFINED, 0, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, false };
+    case FrameGraphUsage::TransferSrc:
+        return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, 0,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT, false };
+    case FrameGraphUsage::TransferDst:
+        return { VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT, false };
+    }
+
+    throw std::runtime_error("Unknown frame graph usage");
+}
+
+FrameGraph::FrameGraph(GraphicsDevice* graphics_device, VkAllocationCallbacks* p_allocs) {
+    this->graphics_device = graphics_device;
+    this->p_allocs = p_allocs;
+}
+
+FrameGraph::~FrameGraph() {
+    destroyCompiled();
+}
+
+FrameGraphResource FrameGraph::addResource(const Resource& resource) {
+    if (compiled) {
+        throw std::runtime_error("Cannot add resources to a compiled frame graph");
+    }
+
+    resources.push_back(resource);
+    return static_cast<FrameGraphResource>(resources.size() - 1);
+}
+
+FrameGraphResource FrameGraph::importImage(const char* name, VkFormat format, VkExtent2D extent,
+    VkImageAspectFlags aspect, uint32_t count, const VkImage* images, const VkImageView* views,
+    VkImageLayout initial_layout, VkImageLayout final_layout, VkPipelineStageFlags initial_stages) {
+
+    Resource resource;
+    resource.name = name;
+    resource.is_image = true;
+    resource.imported = true;
+    resource.format = format;
+    resource.extent = extent;
+    resource.aspect = aspect;
+    resource.images.assign(images, images + count);
+    if (views) {
+        resource.views.assign(views, views + count);
+    }
+    resource.initial_layout = initial_layout;
+    resource.final_layout = final_layout;
+    resource.initial_stages = initial_stages;
+
+    return addResource(resource);
+}
+
+FrameGraphResource FrameGraph::importBuffer(const char* name, VkDeviceSize size, uint32_t count,
+    const VkBuffer* buffers) {
+
+    Resource resource;
+    resource.name = name;
+    resource.is_image = false;
+    resource.imported = true;
+    resource.size = size;
+    resource.buffers.assign(buffers, buffers + count);
+
+    return addResource(resource);
+}
+
+FrameGraphResource FrameGraph::createImage(const char* name, VkFormat format, VkExtent2D extent,
+    VkImageAspectFlags aspect) {
+
+    Resource resource;
+    resource.name = name;
+    resource.is_image = true;
+    resource.imported = false;
+    resource.format = format;
+    resource.extent = extent;
+    resource.aspect = aspect;
+
+    return addResource(resource);
+}
+
+FrameGraphResource FrameGraph::createBuffer(const char* name, VkDeviceSize size) {
+    Resource resource;
+    resource.name = name;
+    resource.is_image = false;
+    resource.imported = false;
+    resource.size = size;
+
+    return addResource(resource);
+}
+
+FrameGraphPass FrameGraph::addPass(const char* name, FrameGraphPassType type, FrameGraphRecordFn record) {
+    if (compiled) {
+        throw std::runtime_error("Cannot add passes to a compiled frame graph");
+    }
+
+    Pass pass;
+    pass.name = name;
+    pass.type = type;
+    pass.record = record;
+    passes.push_back(pass);
+
+    return static_cast<FrameGraphPass>(passes.size() - 1);
+}
+
+void FrameGraph::read(FrameGraphPass pass, FrameGraphResource resource, FrameGraphUsage usage) {
+    Access access = {};
+    access.resource = resource;
+    access.usage = usage;
+    access.write = false;
+    access.clear = false;
+    passes[pass].accesses.push_back(access);
+}
+
+void FrameGraph::write(FrameGraphPass pass, FrameGraphResource resource, FrameGraphUsage usage) {
+    Access access = {};
+    access.resource = resource;
+    access.usage = usage;
+    access.write = true;
+    access.clear = false;
+    passes[pass].accesses.push_back(access);
+}
+
+void FrameGraph::clear(FrameGraphPass pass, FrameGraphResource resource, FrameGraphUsage usage, VkClearValue value) {
+    Access access = {};
+    access.resource = resource;
+    access.usage = usage;
+    access.write = true;
+    access.clear = true;
+    access.clear_value = value;
+    passes[pass].accesses.push_back(access);
+}
+
+void FrameGraph::setSideEffects(FrameGraphPass pass) {
+    passes[pass].side_effects = true;
+}
+
+void FrameGraph::markOutput(FrameGraphResource resource) {
+    resources[resource].output = true;
+}
+
+void FrameGraph::compile() {
+    if (compiled) {
+        throw std::runtime_error("Frame graph already compiled");
+    }
+
+    cullPasses();
+    computeLifetimes();
+    buildGroups();
+    createTransients();
+    deriveBarriers();
+    createRenderPasses();
+
+    compiled = true;
+}
+
+void FrameGraph::cullPasses() {
+    // Count readers of each resource and outputs of each pass
+    for (FrameGraphPass p = 0; p < passes.size(); p++) {
+        for (const auto& access : passes[p].accesses) {
+            if (access.write) {
+                passes[p].ref_count++;
+                resources[access.resource].writers.push_back(p);
+            }
+            else {
+                resources[access.resource].ref_count++;
+            }
+        }
+    }
+
+    // Flood from unreferenced resources back through their writers
+    std::vector<FrameGraphResource> unreferenced;
+    for (FrameGraphResource r = 0; r < resources.size(); r++) {
+        if (resources[r].ref_count == 0 && !resources[r].output) {
+            unreferenced.push_back(r);
+        }
+    }
+
+    auto cull = [&](Pass& pass) {
+        pass.culled = true;
+        for (const auto& access : pass.accesses) {
+            if (!access.write) {
+                Resource& read_resource = resources[access.resource];
+                read_resource.ref_count--;
+                if (read_resource.ref_count == 0 && !read_resource.output) {
+                    unreferenced.push_back(access.resource);
+                }
+            }
+        }
+    };
+
+    for (auto& pass : passes) {
+        if (pass.ref_count == 0 && !pass.side_effects) {
+            cull(pass);
+        }
+    }
+
+    while (!unreferenced.empty()) {
+        FrameGraphResource r = unreferenced.back();
+        unreferenced.pop_back();
+
+        for (FrameGraphPass writer : resources[r].writers) {
+            Pass& pass = passes[writer];
+            if (pass.culled || pass.ref_count == 0) {
+                continue;
+            }
+
+            pass.ref_count--;
+            if (pass.ref_count == 0 && !pass.side_effects) {
+                cull(pass);
+            }
+        }
+    }
+
+    // Execution order is declaration order of surviving passes
+    for (FrameGraphPass p = 0; p < passes.size(); p++) {
+        if (!passes[p].culled) {
+            order.push_back(p);
+        }
+        else if (graphics_device->isVerbose()) {
+            std::cout << "Frame graph culled pass " << passes[p].name << '\n';
+        }
+    }
+}
+
+void FrameGraph::computeLifetimes() {
+    for (int i = 0; i < static_cast<int>(order.size()); i++) {
+        const Pass& pass = passes[order[i]];
+        for (const auto& access : pass.accesses) {
+            Resource& resource = resources[access.resource];
+            UsageInfo info = getUsageInfo(access.usage);
+
+            if (resource.first_use < 0) {
+                resource.first_use = i;
+            }
+            resource.last_use = i;
+            resource.image_usage |= info.image_usage;
+            resource.buffer_usage |= info.buffer_usage;
+        }
+    }
+}
+
+VkExtent2D FrameGraph::getAttachmentExtent(const Pass& pass) {
+    for (const auto& access : pass.accesses) {
+        if (getUsageInfo(access.usage).attachment) {
+            return resources[access.resource].extent;
+        }
+    }
+
+    throw std::runtime_error("Graphics pass " + pass.name + " has no attachments");
+}
+
+bool FrameGraph::canMerge(const Group& group, const Pass& pass) {
+    if (!group.is_render_pass || pass.type != FrameGraphPassType::Graphics || group.passes.size() >= 32) {
+        return false;
+    }
+
+    VkExtent2D extent = getAttachmentExtent(pass);
+    if (extent.width != group.extent.width || extent.height != group.extent.height) {
+        return false;
+    }
+
+    for (const auto& access : pass.accesses) {
+        bool is_attachment = getUsageInfo(access.usage).attachment;
+
+        for (FrameGraphPass grouped : group.passes) {
+            for (const auto& prior : passes[grouped].accesses) {
+                if (prior.resource != access.resource) {
+                    continue;
+                }
+
+                // Results of earlier subpasses may only be consumed as attachments, and anything used as an
+                // attachment in the render pass can't also be sampled within it
+                bool prior_attachment = getUsageInfo(prior.usage).attachment;
+                if (!is_attachment && (prior.write || prior_attachment)) {
+                    return false;
+                }
+                if (is_attachment && !prior_attachment) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+void FrameGraph::buildGroups() {
+    for (uint32_t i = 0; i < order.size(); i++) {
+        Pass& pass = passes[order[i]];
+
+        if (groups.empty() || !canMerge(groups.back(), pass)) {
+            Group group;
+            group.is_render_pass = pass.type == FrameGraphPassType::Graphics;
+            if (group.is_render_pass) {
+                group.extent = getAttachmentExtent(pass);
+            }
+            groups.push_back(group);
+        }
+
+        Group& group = groups.back();
+        pass.group = static_cast<uint32_t>(groups.size() - 1);
+        pass.subpass = static_cast<uint32_t>(group.passes.size());
+        group.passes.push_back(order[i]);
+    }
+}
+
+void FrameGraph::createTransients() {
+    VkDevice device = graphics_device->device();
+    std::vector<FrameGraphResource> transients;
+
+    // Create transient objects unbound so their memory requirements can be gathered
+    for (FrameGraphResource r = 0; r < resources.size(); r++) {
+        Resource& resource = resources[r];
+        if (resource.imported || resource.first_use < 0) {
+            continue;
+        }
+
+        if (resource.is_image) {
+            VkImageCreateInfo image_ci = {};
+            image_ci.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            image_ci.flags = 0;
+            image_ci.imageType = VK_IMAGE_TYPE_2D;
+            image_ci.format = resource.format;
+            image_ci.extent = { resource.extent.width, resource.extent.height, 1 };
+            image_ci.mipLevels = 1;
+            image_ci.arrayLayers = 1;
+            image_ci.samples = VK_SAMPLE_COUNT_1_BIT;
+            image_ci.tiling = VK_IMAGE_TILING_OPTIMAL;
+            image_ci.usage = resource.image_usage;
+            image_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            image_ci.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+            // Images only ever used as attachments never need to hit memory
+            const VkImageUsageFlags attachment_usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+            if ((resource.image_usage & ~attachment_usage) == 0) {
+                image_ci.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+            }
+
+            VkImage image;
+            if (vkCreateImage(device, &image_ci, p_allocs, &image) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create transient image " + resource.name);
+            }
+            resource.images.push_back(image);
+            vkGetImageMemoryRequirements(device, image, &resource.mem_req);
+        }
+        else {
+            VkBufferCreateInfo buffer_ci = {};
+            buffer_ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            buffer_ci.flags = 0;
+            buffer_ci.size = resource.size;
+            buffer_ci.usage = resource.buffer_usage;
+            buffer_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+            VkBuffer buffer;
+            if (vkCreateBuffer(device, &buffer_ci, p_allocs, &buffer) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create transient buffer " + resource.name);
+            }
+            resource.buffers.push_back(buffer);
+            vkGetBufferMemoryRequirements(device, buffer, &resource.mem_req);
+        }
+
+        unaliased_size += resource.mem_req.size;
+        transients.push_back(r);
+    }
+
+    // Place largest resources first so smaller ones fill in behind them
+    std::sort(transients.begin(), transients.end(), [this](FrameGraphResource a, FrameGraphResource b) {
+        return resources[a].mem_req.size > resources[b].mem_req.size;
+    });
+
+    for (FrameGraphResource r : transients) {
+        Resource& resource = resources[r];
+
+        for (uint32_t s = 0; s < alias_slots.size() && resource.alias_slot < 0; s++) {
+            AliasSlot& slot = alias_slots[s];
+            if ((slot.type_bits & resource.mem_req.memoryTypeBits) == 0) {
+                continue;
+            }
+
+            bool overlaps = false;
+            for (FrameGraphResource other : slot.resources) {
+                if (resource.first_use <= resources[other].last_use && resources[other].first_use <= resource.last_use) {
+                    overlaps = true;
+                    break;
+                }
+            }
+
+            if (!overlaps) {
+                slot.resources.push_back(r);
+                slot.type_bits &= resource.mem_req.memoryTypeBits;
+                slot.size = MAX(slot.size, resource.mem_req.size);
+                slot.alignment = MAX(slot.alignment, resource.mem_req.alignment);
+                resource.alias_slot = static_cast<int>(s);
+            }
+        }
+
+        if (resource.alias_slot < 0) {
+            AliasSlot slot;
+            slot.resources.push_back(r);
+            slot.type_bits = resource.mem_req.memoryTypeBits;
+            slot.size = resource.mem_req.size;
+            slot.alignment = resource.mem_req.alignment;
+            slot.offset = 0;
+            slot.memory_index = 0;
+            resource.alias_slot = static_cast<int>(alias_slots.size());
+            alias_slots.push_back(slot);
+        }
+    }
+
+    // Pack slots sharing a memory type into one allocation. Slots are padded to the buffer/image granularity
+    // so linear and optimal resources in neighbouring slots never share a page
+    VkDeviceSize granularity = graphics_device->getDeviceProperties().limits.bufferImageGranularity;
+    std::vector<uint32_t> memory_types;
+    std::vector<VkDeviceSize> memory_sizes;
+
+    for (auto& slot : alias_slots) {
+        uint32_t type = graphics_device->findMemType(slot.type_bits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        uint32_t index = 0;
+        while (index < memory_types.size() && memory_types[index] != type) {
+            index++;
+        }
+        if (index == memory_types.size()) {
+            memory_types.push_back(type);
+            memory_sizes.push_back(0);
+        }
+
+        VkDeviceSize alignment = MAX(slot.alignment, granularity);
+        slot.offset = (memory_sizes[index] + alignment - 1) / alignment * alignment;
+        slot.memory_index = index;
+        memory_sizes[index] = slot.offset + slot.size;
+    }
+
+    for (uint32_t i = 0; i < memory_types.size(); i++) {
+        VkMemoryAllocateInfo alloc_info = {};
+        alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        alloc_info.allocationSize = memory_sizes[i];
+        alloc_info.memoryTypeIndex = memory_types[i];
+
+        VkDeviceMemory memory;
+        if (graphics_device->getMemoryTelemetry()->allocateMemory(alloc_info, MEMORY_CATEGORY_ATTACHMENT, &memory) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate frame graph transient memory");
+        }
+        transient_memory.push_back(memory);
+        aliased_size += memory_sizes[i];
+    }
+
+    // Bind and create views
+    for (FrameGraphResource r : transients) {
+        Resource& resource = resources[r];
+        const AliasSlot& slot = alias_slots[resource.alias_slot];
+        VkDeviceMemory memory = transient_memory[slot.memory_index];
+
+        if (resource.is_image) {
+            if (vkBindImageMemory(device, resource.images[0], memory, slot.offset) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to bind memory to transient image " + resource.name);
+            }
+
+            VkImageViewCreateInfo view_ci = {};
+            view_ci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            view_ci.flags = 0;
+            view_ci.image = resource.images[0];
+            view_ci.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            view_ci.format = resource.format;
+            view_ci.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+            view_ci.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+            view_ci.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+            view_ci.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+            view_ci.subresourceRange.aspectMask = resource.aspect;
+            view_ci.subresourceRange.baseMipLevel = 0;
+            view_ci.subresourceRange.levelCount = 1;
+            view_ci.subresourceRange.baseArrayLayer = 0;
+            view_ci.subresourceRange.layerCount = 1;
+
+            VkImageView view;
+            if (vkCreateImageView(device, &view_ci, p_allocs, &view) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create view for transient image " + resource.name);
+            }
+            resource.views.push_back(view);
+        }
+        else {
+            if (vkBindBufferMemory(device, resource.buffers[0], memory, slot.offset) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to bind memory to transient buffer " + resource.name);
+            }
+        }
+    }
+}
+
+bool FrameGraph::resolveHazard(SyncState& state, FrameGraphUsage usage, bool write, bool is_image,
+    VkPipelineStageFlags* src_stages, VkAccessFlags* src_access, VkImageLayout* old_layout) {
+
+    UsageInfo info = getUsageInfo(usage);
+    VkAccessFlags dst_access = write ? (info.read_access | info.write_access) : info.read_access;
+    bool layout_change = is_image && state.layout != info.layout;
+
+    *old_layout = state.layout;
+
+    if (write || layout_change) {
+        // Writes and layout transitions wait for every earlier read and write
+        *src_stages = state.write_stages | state.read_stages;
+        *src_access = state.write_access;
+        bool needed = *src_stages != 0 || layout_change;
+        if (*src_stages == 0) {
+            *src_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        }
+
+        state.layout = is_image ? info.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+        state.write_stages = info.stages;
+        state.write_access = write ? info.write_access : 0;
+        state.read_stages = write ? 0 : info.stages;
+        state.visible_stages = write ? 0 : info.stages;
+        state.visible_access = write ? 0 : dst_access;
+        state.has_contents = state.has_contents || write;
+        return needed;
+    }
+
+    // Reads only wait for the last write, and only once per stage/access combination
+    state.read_stages |= info.stages;
+    if (state.write_stages == 0) {
+        return false;
+    }
+    if ((state.visible_stages & info.stages) == info.stages && (state.visible_access & dst_access) == dst_access) {
+        return false;
+    }
+
+    *src_stages = state.write_stages;
+    *src_access = state.write_access;
+    state.visible_stages |= info.stages;
+    state.visible_access |= dst_access;
+    return true;
+}
+
+void FrameGraph::deriveBarriers() {
+    std::vector<SyncState> states(resources.size());
+    std::vector<int> slot_occupant(alias_slots.size(), -1);
+
+    // Transient memory is shared by every frame in flight, so the first occupant of a slot must also wait for
+    // the previous frame's uses of anything in the slot
+    std::vector<VkPipelineStageFlags> slot_stages(alias_slots.size(), 0);
+    std::vector<VkAccessFlags> slot_write_access(alias_slots.size(), 0);
+    for (const auto& pass : passes) {
+        if (pass.culled) {
+            continue;
+        }
+        for (const auto& access : pass.accesses) {
+            int slot = resources[access.resource].alias_slot;
+            if (!resources[access.resource].imported && slot >= 0) {
+                UsageInfo info = getUsageInfo(access.usage);
+                slot_stages[slot] |= info.stages;
+                slot_write_access[slot] |= access.write ? info.write_access : 0;
+            }
+        }
+    }
+
+    for (FrameGraphResource r = 0; r < resources.size(); r++) {
+        if (resources[r].imported) {
+            states[r].layout = resources[r].initial_layout;
+            states[r].write_stages = resources[r].initial_stages;
+            states[r].has_contents = resources[r].initial_layout != VK_IMAGE_LAYOUT_UNDEFINED;
+        }
+    }
+
+    int position = 0;
+    for (uint32_t g = 0; g < groups.size(); g++) {
+        Group& group = groups[g];
+
+        // Index of each resource in the render pass attachment list, and subpasses that touched it
+        std::vector<int> attachment_index(resources.size(), -1);
+        std::vector<uint32_t> subpass_mask(resources.size(), 0);
+
+        for (uint32_t s = 0; s < group.passes.size(); s++, position++) {
+            Pass& pass = passes[group.passes[s]];
+
+            for (const auto& access : pass.accesses) {
+                Resource& resource = resources[access.resource];
+                SyncState& state = states[access.resource];
+                UsageInfo info = getUsageInfo(access.usage);
+                VkAccessFlags dst_access = access.write ? (info.read_access | info.write_access) : info.read_access;
+
+                // First use of aliased memory waits for the previous occupant to be finished with it
+                if (resource.alias_slot >= 0 && resource.first_use == position) {
+                    int previous = slot_occupant[resource.alias_slot];
+                    if (previous >= 0) {
+                        state.write_stages = states[previous].write_stages | states[previous].read_stages;
+                        state.write_access = states[previous].write_access;
+                    }
+                    else {
+                        state.write_stages = slot_stages[resource.alias_slot];
+                        state.write_access = slot_write_access[resource.alias_slot];
+                    }
+                    slot_occupant[resource.alias_slot] = static_cast<int>(access.resource);
+                }
+
+                bool had_contents = state.has_contents;
+                VkPipelineStageFlags src_stages = 0;
+                VkAccessFlags src_access = 0;
+                VkImageLayout old_layout;
+                bool needed = resolveHazard(state, access.usage, access.write, resource.is_image, &src_stages,
+                    &src_access, &old_layout);
+
+                if (group.is_render_pass && info.attachment) {
+                    if (attachment_index[access.resource] < 0) {
+                        // First use in this render pass: the attachment description takes care of the layout
+                        // transition and an external dependency orders it against earlier work
+                        VkAttachmentDescription desc = {};
+                        desc.flags = 0;
+                        desc.format = resource.format;
+                        desc.samples = VK_SAMPLE_COUNT_1_BIT;
+                        if (access.clear) {
+                            desc.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+                        }
+                        else if (had_contents) {
+                            desc.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+                        }
+                        else {
+                            desc.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                        }
+                        desc.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+                        desc.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                        desc.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+                        desc.initialLayout = desc.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD ?
+                            old_layout : VK_IMAGE_LAYOUT_UNDEFINED;
+                        desc.finalLayout = info.layout;
+
+                        VkClearValue clear_value = {};
+                        if (access.clear) {
+                            clear_value = access.clear_value;
+                        }
+
+                        attachment_index[access.resource] = static_cast<int>(group.attachments.size());
+                        group.attachments.push_back(access.resource);
+                        group.attachment_descs.push_back(desc);
+                        group.clear_values.push_back(clear_value);
+
+                        if (needed) {
+                            VkSubpassDependency dependency = {};
+                            dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+                            dependency.dstSubpass = s;
+                            dependency.srcStageMask = src_stages;
+                            dependency.dstStageMask = info.stages;
+                            dependency.srcAccessMask = src_access;
+                            dependency.dstAccessMask = dst_access;
+                            dependency.dependencyFlags = 0;
+                            group.dependencies.push_back(dependency);
+                        }
+                    }
+                    else {
+                        VkAttachmentDescription& desc = group.attachment_descs[attachment_index[access.resource]];
+                        desc.finalLayout = info.layout;
+
+                        if (needed) {
+                            for (uint32_t src = 0; src < s; src++) {
+                                if (subpass_mask[access.resource] & (1u << src)) {
+                                    VkSubpassDependency dependency = {};
+                                    dependency.srcSubpass = src;
+                                    dependency.dstSubpass = s;
+                                    dependency.srcStageMask = src_stages;
+                                    dependency.dstStageMask = info.stages;
+                                    dependency.srcAccessMask = src_access;
+                                    dependency.dstAccessMask = dst_access;
+                                    dependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+                                    group.dependencies.push_back(dependency);
+                                }
+                            }
+                        }
+                    }
+
+                    subpass_mask[access.resource] |= 1u << s;
+                }
+                else if (needed) {
+                    BarrierTemplate barrier;
+                    barrier.resource = access.resource;
+                    barrier.src_access = src_access;
+                    barrier.dst_access = dst_access;
+                    barrier.old_layout = resource.is_image ? old_layout : VK_IMAGE_LAYOUT_UNDEFINED;
+                    barrier.new_layout = resource.is_image ? info.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+
+                    // Contents that will be overwritten don't need preserving through the transition
+                    if (access.write && !had_contents) {
+                        barrier.old_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+                    }
+
+                    group.pre_barriers.src_stages |= src_stages;
+                    group.pre_barriers.dst_stages |= info.stages;
+                    group.pre_barriers.barriers.push_back(barrier);
+                }
+            }
+        }
+
+        // Attachments needed after the render pass are stored, and imports whose last use is here go straight
+        // to their final layout
+        for (uint32_t a = 0; a < group.attachments.size(); a++) {
+            Resource& resource = resources[group.attachments[a]];
+            VkAttachmentDescription& desc = group.attachment_descs[a];
+
+            if (resource.last_use >= position || resource.output) {
+                desc.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+            }
+
+            if (resource.imported && resource.last_use < position &&
+                resource.final_layout != VK_IMAGE_LAYOUT_UNDEFINED) {
+
+                desc.finalLayout = resource.final_layout;
+                states[group.attachments[a]].layout = resource.final_layout;
+            }
+        }
+    }
+
+    // Transition any imports not already in their final layout
+    for (FrameGraphResource r = 0; r < resources.size(); r++) {
+        const Resource& resource = resources[r];
+        const SyncState& state = states[r];
+
+        if (!resource.imported || !resource.is_image || resource.final_layout == VK_IMAGE_LAYOUT_UNDEFINED ||
+            state.layout == resource.final_layout) {
+            continue;
+        }
+
+        BarrierTemplate barrier;
+        barrier.resource = r;
+        barrier.src_access = state.write_access;
+        barrier.dst_access = 0;
+        barrier.old_layout = state.layout;
+        barrier.new_layout = resource.final_layout;
+
+        VkPipelineStageFlags src_stages = state.write_stages | state.read_stages;
+        if (src_stages == 0) {
+            src_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        }
+        final_barriers.src_stages |= src_stages;
+        final_barriers.dst_stages |= VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+        final_barriers.barriers.push_back(barrier);
+    }
+}
+
+void FrameGraph::createRenderPasses() {
+    VkDevice device = graphics_device->device();
+
+    for (auto& group : groups) {
+        if (!group.is_render_pass) {
+            continue;
+        }
+
+        // Attachment references for each subpass. Storage is reserved up front so pointers stay valid
+        uint32_t subpass_count = static_cast<uint32_t>(group.passes.size());
+        std::vector<std::vector<VkAttachmentReference>> color_refs(subpass_count);
+        std::vector<std::vector<VkAttachmentReference>> input_refs(subpass_count);
+        std::vector<std::vector<uint32_t>> preserve_refs(subpass_count);
+        std::vector<VkAttachmentReference> depth_refs(subpass_count);
+        std::vector<VkSubpassDescription> subpasses(subpass_count);
+
+        for (uint32_t s = 0; s < subpass_count; s++) {
+            const Pass& pass = passes[group.passes[s]];
+            bool has_depth = false;
+            std::vector<bool> used(group.attachments.size(), false);
+
+            for (const auto& access : pass.accesses) {
+                UsageInfo info = getUsageInfo(access.usage);
+                if (!info.attachment) {
+                    continue;
+                }
+
+                uint32_t index = static_cast<uint32_t>(std::find(group.attachments.begin(), group.attachments.end(),
+                    access.resource) - group.attachments.begin());
+                VkAttachmentReference ref = { index, info.layout };
+                used[index] = true;
+
+                switch (access.usage) {
+                case FrameGraphUsage::ColorAttachment:
+                    color_refs[s].push_back(ref);
+                    break;
+                case FrameGraphUsage::DepthStencilAttachment:
+                case FrameGraphUsage::DepthStencilReadOnly:
+                    depth_refs[s] = ref;
+                    has_depth = true;
+                    break;
+                case FrameGraphUsage::InputAttachment:
+                    input_refs[s].push_back(ref);
+                    break;
+                default:
+                    break;
+                }
+            }
+
+            // Preserve attachments used both before and after this subpass
+            for (uint32_t a = 0; a < group.attachments.size(); a++) {
+                if (used[a]) {
+                    continue;
+                }
+
+                bool used_before = false;
+                bool used_after = false;
+                for (uint32_t other = 0; other < subpass_count; other++) {
+                    for (const auto& access : passes[group.passes[other]].accesses) {
+                        if (access.resource == group.attachments[a] && getUsageInfo(access.usage).attachment) {
+                            used_before = used_before || other < s;
+                            used_after = used_after || other > s;
+                        }
+                    }
+                }
+                if (used_before && used_after) {
+                    preserve_refs[s].push_back(a);
+                }
+            }
+
+            VkSubpassDescription& subpass = subpasses[s];
+            subpass.flags = 0;
+            subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+            subpass.inputAttachmentCount = static_cast<uint32_t>(input_refs[s].size());
+            subpass.pInputAttachments = input_refs[s].data();
+            subpass.colorAttachmentCount = static_cast<uint32_t>(color_refs[s].size());
+            subpass.pColorAttachments = color_refs[s].data();
+            subpass.pResolveAttachments = nullptr;
+            subpass.pDepthStencilAttachment = has_depth ? &(depth_refs[s]) : nullptr;
+            subpass.preserveAttachmentCount = static_cast<uint32_t>(preserve_refs[s].size());
+            subpass.pPreserveAttachments = preserve_refs[s].data();
+        }
+
+        VkRenderPassCreateInfo render_pass_ci = {};
+        render_pass_ci.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        render_pass_ci.flags = 0;
+        render_pass_ci.attachmentCount = static_cast<uint32_t>(group.attachment_descs.size());
+        render_pass_ci.pAttachments = group.attachment_descs.data();
+        render_pass_ci.subpassCount = subpass_count;
+        render_pass_ci.pSubpasses = subpasses.data();
+        render_pass_ci.dependencyCount = static_cast<uint32_t>(group.dependencies.size());
+        render_pass_ci.pDependencies = group.dependencies.data();
+
+        if (vkCreateRenderPass(device, &render_pass_ci, p_allocs, &group.render_pass) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create render pass");
+        }
+
+        // One framebuffer per frame index of the imported attachments
+        uint32_t framebuffer_count = 1;
+        for (FrameGraphResource r : group.attachments) {
+            framebuffer_count = MAX(framebuffer_count, static_cast<uint32_t>(resources[r].views.size()));
+        }
+
+        std::vector<VkImageView> views(group.attachments.size());
+        group.framebuffers.resize(framebuffer_count);
+        for (uint32_t f = 0; f < framebuffer_count; f++) {
+            for (uint32_t a = 0; a < group.attachments.size(); a++) {
+                const Resource& resource = resources[group.attachments[a]];
+                views[a] = resource.views[f % resource.views.size()];
+            }
+
+            VkFramebufferCreateInfo framebuffer_ci = {};
+            framebuffer_ci.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            framebuffer_ci.flags = 0;
+            framebuffer_ci.renderPass = group.render_pass;
+            framebuffer_ci.attachmentCount = static_cast<uint32_t>(views.size());
+            framebuffer_ci.pAttachments = views.data();
+            framebuffer_ci.width = group.extent.width;
+            framebuffer_ci.height = group.extent.height;
+            framebuffer_ci.layers = 1;
+
+            if (vkCreateFramebuffer(device, &framebuffer_ci, p_allocs, &(group.framebuffers[f])) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create framebuffer");
+            }
+        }
+    }
+}
+
+void FrameGraph::recordBarriers(VkCommandBuffer cmd, const BarrierBatch& batch, uint32_t frame_index) {
+    if (batch.barriers.empty()) {
+        return;
+    }
+
+    std::vector<VkImageMemoryBarrier> image_barriers;
+    std::vector<VkBufferMemoryBarrier> buffer_barriers;
+
+    for (const auto& barrier : batch.barriers) {
+        const Resource& resource = resources[barrier.resource];
+
+        if (resource.is_image) {
+            VkImageMemoryBarrier image_barrier = {};
+            image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            image_barrier.srcAccessMask = barrier.src_access;
+            image_barrier.dstAccessMask = barrier.dst_access;
+            image_barrier.oldLayout = barrier.old_layout;
+            image_barrier.newLayout = barrier.new_layout;
+            image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            image_barrier.image = resource.images[frame_index % resource.images.size()];
+            image_barrier.subresourceRange.aspectMask = resource.aspect;
+            image_barrier.subresourceRange.baseMipLevel = 0;
+            image_barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+            image_barrier.subresourceRange.baseArrayLayer = 0;
+            image_barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+            image_barriers.push_back(image_barrier);
+        }
+        else {
+            VkBufferMemoryBarrier buffer_barrier = {};
+            buffer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            buffer_barrier.srcAccessMask = barrier.src_access;
+            buffer_barrier.dstAccessMask = barrier.dst_access;
+            buffer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            buffer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            buffer_barrier.buffer = resource.buffers[frame_index % resource.buffers.size()];
+            buffer_barrier.offset = 0;
+            buffer_barrier.size = VK_WHOLE_SIZE;
+            buffer_barriers.push_back(buffer_barrier);
+        }
+    }
+
+    vkCmdPipelineBarrier(cmd, batch.src_stages, batch.dst_stages, 0, 0, nullptr,
+        static_cast<uint32_t>(buffer_barriers.size()), buffer_barriers.data(),
+        static_cast<uint32_t>(image_barriers.size()), image_barriers.data());
+}
+
+void FrameGraph::execute(VkCommandBuffer cmd, uint32_t frame_index) {
+    if (!compiled) {
+        throw std::runtime_error("Frame graph must be compiled before execution");
+    }
+
+    for (const auto& group : groups) {
+        recordBarriers(cmd, group.pre_barriers, frame_index);
+
+        if (group.is_render_pass) {
+            VkRenderPassBeginInfo rp_begin_info = {};
+            rp_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            rp_begin_info.renderPass = group.render_pass;
+            rp_begin_info.framebuffer = group.framebuffers[frame_index % group.framebuffers.size()];
+            rp_begin_info.renderArea.offset = { 0, 0 };
+            rp_begin_info.renderArea.extent = group.extent;
+            rp_begin_info.clearValueCount = static_cast<uint32_t>(group.clear_values.size());
+            rp_begin_info.pClearValues = group.clear_values.data();
+
+            vkCmdBeginRenderPass(cmd, &rp_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+            for (uint32_t s = 0; s < group.passes.size(); s++) {
+                if (s > 0) {
+                    vkCmdNextSubpass(cmd, VK_SUBPASS_CONTENTS_INLINE);
+                }
+                passes[group.passes[s]].record(cmd, frame_index);
+            }
+            vkCmdEndRenderPass(cmd);
+        }
+        else {
+            for (FrameGraphPass p : group.passes) {
+                passes[p].record(cmd, frame_index);
+            }
+        }
+    }
+
+    recordBarriers(cmd, final_barriers, frame_index);
+}
+
+void FrameGraph::destroyCompiled() {
+    VkDevice device = graphics_device->device();
+
+    for (auto& group : groups) {
+        for (auto framebuffer : group.framebuffers) {
+            vkDestroyFramebuffer(device, framebuffer, p_allocs);
+        }
+        if (group.render_pass != VK_NULL_HANDLE) {
+            vkDestroyRenderPass(device, group.render_pass, p_allocs);
+        }
+    }
+
+    for (auto& resource : resources) {
+        if (resource.imported) {
+            continue;
+        }
+
+        for (auto view : resource.views) {
+            vkDestroyImageView(device, view, p_allocs);
+        }
+        for (auto image : resource.images) {
+            vkDestroyImage(device, image, p_allocs);
+        }
+        for (auto buffer : resource.buffers) {
+            vkDestroyBuffer(device, buffer, p_allocs);
+        }
+    }
+
+    for (auto memory : transient_memory) {
+        graphics_device->getMemoryTelemetry()->freeMemory(memory);
+    }
+
+    groups.clear();
+    transient_memory.clear();
+}
+
+VkRenderPass FrameGraph::getRenderPass(FrameGraphPass pass) {
+    return groups[passes[pass].group].render_pass;
+}
+
+uint32_t FrameGraph::getSubpass(FrameGraphPass pass) {
+    return passes[pass].subpass;
+}
+
+bool FrameGraph::isCulled(FrameGraphPass pass) {
+    return passes[pass].culled;
+}
+
+VkImageView FrameGraph::getImageView(FrameGraphResource resource, uint32_t frame_index) {
+    const Resource& res = resources[resource];
+    return res.views[frame_index % res.views.size()];
+}
+
+VkImage FrameGraph::getImage(FrameGraphResource resource, uint32_t frame_index) {
+    const Resource& res = resources[resource];
+    return res.images[frame_index % res.images.size()];
+}
+
+VkBuffer FrameGraph::getBuffer(FrameGraphResource resource, uint32_t frame_index) {
+    const Resource& res = resources[resource];
+    return res.buffers[frame_index % res.buffers.size()];
+}
+
+VkDeviceSize FrameGraph::getTransientMemorySize() {
+    return aliased_size;
+}
+
+VkDeviceSize FrameGraph::getUnaliasedMemorySize() {
+    return unaliased_size;
+}
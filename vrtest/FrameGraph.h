@@ -0,0 +1,364 @@
+/** @file FrameGraph.h
+*
+* @brief Defines a frame graph that orders render passes by the resources they
+*   read and write, derives synchronization and aliases transient memory
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/02/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <string>
+#include <functional>
+
+#include "GraphicsDevice.h"
+
+/**
+ * Handles to resources and passes declared on a frame graph
+ */
+typedef uint32_t FrameGraphResource;
+typedef uint32_t FrameGraphPass;
+
+/**
+ * Type of work done by a pass. Only graphics passes are placed in render passes
+ */
+enum class FrameGraphPassType {
+    Graphics,
+    Compute,
+    Transfer
+};
+
+/**
+ * Ways a pass can use a resource. Each usage maps to pipeline stages, access flags, an image layout and
+ *  the resource usage flags needed at creation time
+ */
+enum class FrameGraphUsage {
+    ColorAttachment,
+    DepthStencilAttachment,
+    DepthStencilReadOnly,
+    InputAttachment,
+    SampledFragment,
+    SampledCompute,
+    StorageImageCompute,
+    StorageBufferCompute,
+    UniformBuffer,
+    VertexBuffer,
+    IndexBuffer,
+    IndirectBuffer,
+    TransferSrc,
+    TransferDst
+};
+
+/**
+ * Function called to record the commands of a pass
+ * @param cmd command buffer being recorded, inside the pass's subpass for graphics passes
+ * @param frame_index index of the imported resource set being rendered (swapchain image index)
+ */
+typedef std::function<void(VkCommandBuffer cmd, uint32_t frame_index)> FrameGraphRecordFn;
+
+class FrameGraph {
+private:
+    /**
+     * Usage of a resource by a single pass
+     */
+    struct Access {
+        FrameGraphResource resource;
+        FrameGraphUsage usage;
+        bool write;
+        bool clear;
+        VkClearValue clear_value;
+    };
+
+    /**
+     * Declared pass and its compiled placement
+     */
+    struct Pass {
+        std::string name;
+        FrameGraphPassType type;
+        FrameGraphRecordFn record;
+        std::vector<Access> accesses;
+        bool side_effects = false;
+        bool culled = false;
+        uint32_t ref_count = 0;
+        uint32_t group = 0;
+        uint32_t subpass = 0;
+    };
+
+    /**
+     * Declared image or buffer. Imported resources may have one handle per frame index
+     */
+    struct Resource {
+        std::string name;
+        bool is_image;
+        bool imported;
+        bool output = false;
+
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        VkExtent2D extent = {};
+        VkImageAspectFlags aspect = 0;
+        std::vector<VkImage> images;
+        std::vector<VkImageView> views;
+        VkImageLayout initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkImageLayout final_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags initial_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+
+        VkDeviceSize size = 0;
+        std::vector<VkBuffer> buffers;
+
+        VkImageUsageFlags image_usage = 0;
+        VkBufferUsageFlags buffer_usage = 0;
+        uint32_t ref_count = 0;
+        std::vector<FrameGraphPass> writers;
+        int first_use = -1;
+        int last_use = -1;
+        int alias_slot = -1;
+        VkMemoryRequirements mem_req = {};
+    };
+
+    /**
+     * Synchronization state of a resource (or a transient alias slot) while walking the passes
+     */
+    struct SyncState {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags write_stages = 0;
+        VkAccessFlags write_access = 0;
+        VkPipelineStageFlags read_stages = 0;
+        VkPipelineStageFlags visible_stages = 0;
+        VkAccessFlags visible_access = 0;
+        bool has_contents = false;
+    };
+
+    /**
+     * Barrier on one resource, resolved to a handle for the frame index at execute time
+     */
+    struct BarrierTemplate {
+        FrameGraphResource resource;
+        VkAccessFlags src_access;
+        VkAccessFlags dst_access;
+        VkImageLayout old_layout;
+        VkImageLayout new_layout;
+    };
+
+    /**
+     * Batch of barriers recorded with a single vkCmdPipelineBarrier
+     */
+    struct BarrierBatch {
+        VkPipelineStageFlags src_stages = 0;
+        VkPipelineStageFlags dst_stages = 0;
+        std::vector<BarrierTemplate> barriers;
+    };
+
+    /**
+     * Set of consecutive passes executed together. Graphics groups become one render pass with a subpass
+     *  per pass
+     */
+    struct Group {
+        std::vector<FrameGraphPass> passes;
+        bool is_render_pass = false;
+        VkRenderPass render_pass = VK_NULL_HANDLE;
+        std::vector<VkFramebuffer> framebuffers;
+        VkExtent2D extent = {};
+        std::vector<FrameGraphResource> attachments;
+        std::vector<VkAttachmentDescription> attachment_descs;
+        std::vector<VkSubpassDependency> dependencies;
+        std::vector<VkClearValue> clear_values;
+        BarrierBatch pre_barriers;
+    };
+
+    /**
+     * Memory shared by transient resources with non-overlapping lifetimes
+     */
+    struct AliasSlot {
+        std::vector<FrameGraphResource> resources;
+        uint32_t type_bits;
+        VkDeviceSize size;
+        VkDeviceSize alignment;
+        VkDeviceSize offset;
+        uint32_t memory_index;
+    };
+
+    GraphicsDevice* graphics_device;
+    VkAllocationCallbacks* p_allocs;
+
+    std::vector<Pass> passes;
+    std::vector<Resource> resources;
+    std::vector<FrameGraphPass> order;
+    std::vector<Group> groups;
+    std::vector<AliasSlot> alias_slots;
+    std::vector<VkDeviceMemory> transient_memory;
+    BarrierBatch final_barriers;
+
+    /**
+     * Total bytes of transient memory before and after aliasing
+     */
+    VkDeviceSize unaliased_size = 0;
+    VkDeviceSize aliased_size = 0;
+
+    bool compiled = false;
+
+    void cullPasses();
+    void computeLifetimes();
+    void buildGroups();
+    void createTransients();
+    void deriveBarriers();
+    void createRenderPasses();
+    void recordBarriers(VkCommandBuffer cmd, const BarrierBatch& batch, uint32_t frame_index);
+    void destroyCompiled();
+
+    bool canMerge(const Group& group, const Pass& pass);
+    FrameGraphResource addResource(const Resource& resource);
+    VkExtent2D getAttachmentExtent(const Pass& pass);
+
+    static bool resolveHazard(SyncState& state, FrameGraphUsage usage, bool write, bool is_image,
+        VkPipelineStageFlags* src_stages, VkAccessFlags* src_access, VkImageLayout* old_layout);
+
+public:
+    /**
+     * Create an empty frame graph
+     * @param graphics_device device used to create render passes and transient resources
+     * @param p_allocs allocation callbacks passed to Vulkan calls
+     */
+    FrameGraph(GraphicsDevice* graphics_device, VkAllocationCallbacks* p_allocs);
+
+    /**
+     * Destroys all compiled objects and transient resources
+     */
+    ~FrameGraph();
+
+    /**
+     * Import images owned outside the graph
+     * @param name debug name of the resource
+     * @param format pixel format of the images
+     * @param extent dimensions of the images
+     * @param aspect image aspects covered by barriers
+     * @param count number of images, one per frame index (1 if shared by all frames)
+     * @param images array of image handles
+     * @param views array of image views, used for attachments
+     * @param initial_layout layout the image is in when the frame starts
+     * @param final_layout layout to leave the image in at the end of the frame, or UNDEFINED for don't care
+     * @param initial_stages pipeline stages that must complete before first use (e.g. semaphore wait stage)
+     * @return handle to the resource
+     */
+    FrameGraphResource importImage(const char* name, VkFormat format, VkExtent2D extent, VkImageAspectFlags aspect,
+        uint32_t count, const VkImage* images, const VkImageView* views, VkImageLayout initial_layout,
+        VkImageLayout final_layout, VkPipelineStageFlags initial_stages);
+
+    /**
+     * Import buffers owned outside the graph
+     * @param name debug name of the resource
+     * @param size size of the buffers in bytes
+     * @param count number of buffers, one per frame index
+     * @param buffers array of buffer handles
+     * @return handle to the resource
+     */
+    FrameGraphResource importBuffer(const char* name, VkDeviceSize size, uint32_t count, const VkBuffer* buffers);
+
+    /**
+     * Declare a transient image created and owned by the graph. Its memory may be aliased
+     * @param name debug name of the resource
+     * @param format pixel format
+     * @param extent image dimensions
+     * @param aspect image aspects of the format
+     * @return handle to the resource
+     */
+    FrameGraphResource createImage(const char* name, VkFormat format, VkExtent2D extent, VkImageAspectFlags aspect);
+
+    /**
+     * Declare a transient buffer created and owned by the graph. Its memory may be aliased
+     * @param name debug name of the resource
+     * @param size buffer size in bytes
+     * @return handle to the resource
+     */
+    FrameGraphResource createBuffer(const char* name, VkDeviceSize size);
+
+    /**
+     * Add a pass. Passes execute in the order they are added
+     * @param name debug name of the pass
+     * @param type kind of work the pass records
+     * @param record function recording the pass commands
+     * @return handle to the pass
+     */
+    FrameGraphPass addPass(const char* name, FrameGraphPassType type, FrameGraphRecordFn record);
+
+    /**
+     * Declare that a pass reads a resource
+     */
+    void read(FrameGraphPass pass, FrameGraphResource resource, FrameGraphUsage usage);
+
+    /**
+     * Declare that a pass writes a resource
+     */
+    void write(FrameGraphPass pass, FrameGraphResource resource, FrameGraphUsage usage);
+
+    /**
+     * Declare that a pass writes an attachment, clearing it first
+     */
+    void clear(FrameGraphPass pass, FrameGraphResource resource, FrameGraphUsage usage, VkClearValue value);
+
+    /**
+     * Mark a pass as having effects outside the graph so it is never culled
+     */
+    void setSideEffects(FrameGraphPass pass);
+
+    /**
+     * Mark a resource as consumed outside the graph. Passes that do not contribute to an output are culled
+     */
+    void markOutput(FrameGraphResource resource);
+
+    /**
+     * Cull passes, allocate transient resources, derive barriers and create render passes
+     */
+    void compile();
+
+    /**
+     * Record all passes and barriers for one frame
+     * @param cmd command buffer in the recording state
+     * @param frame_index index used to select imported resources
+     */
+    void execute(VkCommandBuffer cmd, uint32_t frame_index);
+
+    /**
+     * Get the render pass a graphics pass was placed in. Only valid after compile
+     */
+    VkRenderPass getRenderPass(FrameGraphPass pass);
+
+    /**
+     * Get the subpass index of a graphics pass within its render pass. Only valid after compile
+     */
+    uint32_t getSubpass(FrameGraphPass pass);
+
+    /**
+     * Returns true if the pass was culled during compile
+     */
+    bool isCulled(FrameGraphPass pass);
+
+    /**
+     * Get the image view of a resource for a frame index
+     */
+    VkImageView getImageView(FrameGraphResource resource, uint32_t frame_index);
+
+    /**
+     * Get the image handle of a resource for a frame index
+     */
+    VkImage getImage(FrameGraphResource resource, uint32_t frame_index);
+
+    /**
+     * Get the buffer handle of a resource for a frame index
+     */
+    VkBuffer getBuffer(FrameGraphResource resource, uint32_t frame_index);
+
+    /**
+     * Get the device memory used by transient resources after aliasing
+     */
+    VkDeviceSize getTransientMemorySize();
+
+    /**
+     * Get the device memory transient resources would use without aliasing
+     */
+    VkDeviceSize getUnaliasedMemorySize();
+};
@@ -0,0 +1,132 @@
+/** @file FramePacer.cpp
+*
+* @brief Defines controller that delays the start of each frame to the latest
+*   time it can still make its display deadline
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/14/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <math.h>
+
+#include "FramePacer.h"
+#include "Pose.h"
+#include "Common.h"
+
+FramePacer::FramePacer(double nominal_interval, double margin) {
+    this->nominal_interval = nominal_interval;
+    this->refresh_interval = nominal_interval;
+    this->margin = margin;
+}
+
+void FramePacer::addSample(double* samples, uint32_t* count, double value) {
+    samples[*count % FRAME_PACER_HISTORY] = value;
+    (*count)++;
+}
+
+double FramePacer::getPercentile(const double* samples, uint32_t count, double percentile, double fallback) {
+    uint32_t size = MIN(count, static_cast<uint32_t>(FRAME_PACER_HISTORY));
+    if (size == 0) {
+        return fallback;
+    }
+
+    double sorted[FRAME_PACER_HISTORY];
+    std::copy(samples, samples + size, sorted);
+    uint32_t index = MIN(static_cast<uint32_t>(size * percentile), size - 1);
+    std::nth_element(sorted, sorted + index, sorted + size);
+    return sorted[index];
+}
+
+void FramePacer::addPresentTime(double present_time) {
+    if (present_time <= last_present_time) {
+        return;
+    }
+
+    if (last_present_time > 0.0) {
+        // A frame that missed vsyncs spans several intervals, so divide by the number of intervals it covered
+        double delta = present_time - last_present_time;
+        double vsyncs = floor(delta / refresh_interval + 0.5);
+        if (vsyncs >= 1.0 && vsyncs <= 8.0) {
+            addSample(intervals, &interval_count, delta / vsyncs);
+
+            // Median rejects compositor hiccups. Stay near the nominal rate until enough samples exist
+            if (interval_count >= 8) {
+                refresh_interval = getPercentile(intervals, interval_count, 0.5, nominal_interval);
+            }
+        }
+    }
+
+    last_present_time = present_time;
+}
+
+void FramePacer::addGpuTime(double gpu_ms) {
+    addSample(gpu_costs, &gpu_count, gpu_ms / 1000.0);
+}
+
+double FramePacer::waitForFrameStart() {
+    double now = getPoseTime();
+    double cost = getFrameCost() + margin;
+
+    // Align to the measured vsync phase if there is one, otherwise keep frames on the grid of previous targets
+    double phase = last_present_time > 0.0 ? last_present_time : target_present_time;
+    if (phase <= 0.0) {
+        phase = now;
+    }
+
+    // Earliest vsync the frame can make if started now
+    double vsyncs = ceil((now + cost - phase) / refresh_interval);
+    double target = phase + MAX(vsyncs, 1.0) * refresh_interval;
+
+    // Never target a vsync already targeted, which would start frames faster than they are displayed
+    while (target < target_present_time + refresh_interval * 0.5) {
+        target += refresh_interval;
+    }
+
+    double start = target - cost;
+    if (start > now) {
+        // Sleep is coarse on some platforms, so wake early and spin the rest
+        double sleep_time = start - now - 0.001;
+        if (sleep_time > 0.0) {
+            std::this_thread::sleep_for(std::chrono::duration<double>(sleep_time));
+        }
+        while (getPoseTime() < start) {
+            std::this_thread::yield();
+        }
+    }
+
+    frame_start = getPoseTime();
+    target_present_time = target;
+    return target;
+}
+
+void FramePacer::endFrame(bool submitted) {
+    if (!submitted) {
+        // Retry the same deadline immediately
+        target_present_time -= refresh_interval;
+        return;
+    }
+
+    addSample(cpu_costs, &cpu_count, getPoseTime() - frame_start);
+}
+
+double FramePacer::getRefreshInterval() {
+    return refresh_interval;
+}
+
+double FramePacer::getTargetPresentTime() {
+    return target_present_time;
+}
+
+double FramePacer::getFrameCost() {
+    // High percentiles so occasional slow frames still make their deadline. Until measured, assume the frame
+    // takes most of an interval, which paces without adding latency risk
+    double cpu = getPercentile(cpu_costs, cpu_count, 0.9, refresh_interval * 0.25);
+    double gpu = getPercentile(gpu_costs, gpu_count, 0.9, refresh_interval * 0.5);
+    return MIN(cpu + gpu, refresh_interval * 4.0);
+}
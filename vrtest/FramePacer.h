@@ -0,0 +1,119 @@
+/** @file FramePacer.h
+*
+* @brief Defines controller that delays the start of each frame to the latest
+*   time it can still make its display deadline
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/14/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <stdint.h>
+
+#define FRAME_PACER_HISTORY 32
+
+/**
+ * Estimates the display refresh interval and phase from present timing and the cost of a frame from recent CPU
+ *  and GPU times. Each frame is started as late as possible while still finishing before the vsync it targets,
+ *  so input and poses are sampled closer to display and frame start times don't jitter with the acquire loop.
+ *  All times are in seconds in the getPoseTime() clock
+ */
+class FramePacer {
+private:
+    /**
+     * Refresh interval reported by the display, used until enough present times are measured
+     */
+    double nominal_interval;
+
+    /**
+     * Estimated refresh interval
+     */
+    double refresh_interval;
+
+    /**
+     * Extra time reserved on top of the estimated frame cost to absorb scheduling jitter
+     */
+    double margin;
+
+    /**
+     * Most recent measured display time, or 0 if none. Defines the vsync phase
+     */
+    double last_present_time = 0.0;
+
+    /**
+     * Ring buffers of recent refresh intervals and frame costs
+     */
+    double intervals[FRAME_PACER_HISTORY];
+    double cpu_costs[FRAME_PACER_HISTORY];
+    double gpu_costs[FRAME_PACER_HISTORY];
+    uint32_t interval_count = 0;
+    uint32_t cpu_count = 0;
+    uint32_t gpu_count = 0;
+
+    /**
+     * Start time and targeted display time of the current frame
+     */
+    double frame_start = 0.0;
+    double target_present_time = 0.0;
+
+    /**
+     * Append a sample to a ring buffer
+     */
+    static void addSample(double* samples, uint32_t* count, double value);
+
+    /**
+     * Get a percentile of the samples in a ring buffer, or the fallback if it is empty
+     */
+    static double getPercentile(const double* samples, uint32_t count, double percentile, double fallback);
+
+public:
+    /**
+     * @param nominal_interval refresh interval reported by the display in seconds, e.g. from the video mode
+     * @param margin extra time in seconds reserved before each deadline
+     */
+    FramePacer(double nominal_interval, double margin = 0.001);
+
+    /**
+     * Feed the time a frame was actually displayed. Frames that missed a vsync are accounted for, so every
+     *  displayed frame can be fed
+     * @param present_time time the frame reached the display
+     */
+    void addPresentTime(double present_time);
+
+    /**
+     * Feed the measured GPU time of a completed frame
+     * @param gpu_ms GPU time in milliseconds
+     */
+    void addGpuTime(double gpu_ms);
+
+    /**
+     * Sleep until the latest safe start time of the next frame. Input should be sampled after this returns
+     * @return the display time the frame targets
+     */
+    double waitForFrameStart();
+
+    /**
+     * Mark the end of the CPU work of the frame started by waitForFrameStart
+     * @param submitted whether the frame was submitted. Frames that weren't are retried without sleeping and
+     *  their CPU time isn't counted
+     */
+    void endFrame(bool submitted);
+
+    /**
+     * Get the estimated refresh interval in seconds
+     */
+    double getRefreshInterval();
+
+    /**
+     * Get the display time targeted by the current frame
+     */
+    double getTargetPresentTime();
+
+    /**
+     * Get the estimated CPU plus GPU cost of a frame in seconds, excluding the margin
+     */
+    double getFrameCost();
+};
@@ -0,0 +1,264 @@
+/** @file FrameSync.cpp
+*
+* @brief Defines class that tracks completion of queue submissions, using a
+*   timeline semaphore where available and per-slot fences otherwise
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/08/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "FrameSync.h"
+#include "Common.h"
+
+FrameSync::FrameSync(GraphicsDevice* graphics_device, VkAllocationCallbacks* p_allocs, uint32_t slot_count,
+    bool allow_timeline)
+{
+    this->graphics_device = graphics_device;
+    this->p_allocs = p_allocs;
+    this->slot_count = slot_count;
+
+    slot_values = new uint64_t[slot_count];
+    for (uint32_t i = 0; i < slot_count; i++) {
+        slot_values[i] = 0;
+    }
+
+    backend = FrameSyncBackend::Fence;
+#ifdef VK_VERSION_1_2
+    if (allow_timeline && graphics_device->supportsTimelineSemaphores()) {
+        backend = FrameSyncBackend::Timeline;
+    }
+#endif
+
+    if (backend == FrameSyncBackend::Timeline) {
+        createTimeline();
+        std::cout << "Frame sync using timeline semaphore" << std::endl;
+    }
+    else {
+        createFences();
+        std::cout << "Frame sync using fences" << std::endl;
+    }
+}
+
+FrameSync::~FrameSync() {
+    VkDevice device = graphics_device->device();
+
+    if (slot_fences) {
+        for (uint32_t i = 0; i < slot_count; i++) {
+            vkDestroyFence(device, slot_fences[i], p_allocs);
+        }
+        delete[] slot_fences;
+    }
+
+    if (timeline != VK_NULL_HANDLE) {
+        vkDestroySemaphore(device, timeline, p_allocs);
+    }
+
+    delete[] slot_values;
+}
+
+void FrameSync::createFences() {
+    slot_fences = new VkFence[slot_count];
+
+    // Created signaled so the first wait on each slot returns immediately
+    VkFenceCreateInfo fence_ci = {};
+    fence_ci.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fence_ci.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    for (uint32_t i = 0; i < slot_count; i++) {
+        if (vkCreateFence(graphics_device->device(), &fence_ci, p_allocs, &(slot_fences[i])) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create fence");
+        }
+    }
+}
+
+void FrameSync::createTimeline() {
+#ifdef VK_VERSION_1_2
+    VkDevice device = graphics_device->device();
+
+    VkSemaphoreTypeCreateInfo type_ci = {};
+    type_ci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    type_ci.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    type_ci.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphore_ci = {};
+    semaphore_ci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphore_ci.pNext = &type_ci;
+    semaphore_ci.flags = 0;
+
+    if (vkCreateSemaphore(device, &semaphore_ci, p_allocs, &timeline) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create timeline semaphore");
+    }
+
+    // Entry points are only exported under the name matching how the feature was enabled
+    bool khr = graphics_device->usesTimelineSemaphoreExtension();
+    wait_semaphores = (PFN_vkWaitSemaphoresKHR)vkGetDeviceProcAddr(device,
+        khr ? "vkWaitSemaphoresKHR" : "vkWaitSemaphores");
+    get_counter_value = (PFN_vkGetSemaphoreCounterValueKHR)vkGetDeviceProcAddr(device,
+        khr ? "vkGetSemaphoreCounterValueKHR" : "vkGetSemaphoreCounterValue");
+
+    if (wait_semaphores == nullptr || get_counter_value == nullptr) {
+        throw std::runtime_error("Failed to load timeline semaphore functions");
+    }
+#endif
+}
+
+FrameSyncBackend FrameSync::getBackend() {
+    return backend;
+}
+
+bool FrameSync::waitSlot(uint32_t slot, uint64_t timeout) {
+    if (backend == FrameSyncBackend::Timeline) {
+        return waitValue(slot_values[slot], timeout);
+    }
+
+    VkResult fence_result = vkWaitForFences(graphics_device->device(), 1, &(slot_fences[slot]), VK_TRUE, timeout);
+    if (fence_result == VK_TIMEOUT) {
+        return false;
+    }
+    else if (fence_result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to wait for command buffer fence");
+    }
+
+    completed_value = MAX(completed_value, slot_values[slot]);
+    return true;
+}
+
+uint64_t FrameSync::submit(VkQueue queue, const VkSubmitInfo& submit_info, uint32_t slot) {
+    uint64_t value = reserve(slot);
+    submitReserved(queue, submit_info, slot, value);
+    return value;
+}
+
+uint64_t FrameSync::reserve(uint32_t slot) {
+    uint64_t value = submitted_value + 1;
+
+    if (backend == FrameSyncBackend::Fence) {
+        // Reset with the reservation so the slot doesn't read as retired before the submission is made. Reserve
+        // right before submitting so a failure in between can't leave it unsignaled forever
+        if (vkResetFences(graphics_device->device(), 1, &(slot_fences[slot])) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to reset command buffer fence");
+        }
+    }
+
+    submitted_value = value;
+    slot_values[slot] = value;
+    return value;
+}
+
+void FrameSync::submitReserved(VkQueue queue, const VkSubmitInfo& submit_info, uint32_t slot, uint64_t value) {
+    if (backend == FrameSyncBackend::Fence) {
+        if (vkQueueSubmit(queue, 1, &submit_info, slot_fences[slot]) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to submit command buffer to queue");
+        }
+        return;
+    }
+
+#ifdef VK_VERSION_1_2
+    // Signal the timeline alongside the caller's binary semaphores. Values for binary semaphores are ignored
+    std::vector<VkSemaphore> signal_sems(submit_info.pSignalSemaphores,
+        submit_info.pSignalSemaphores + submit_info.signalSemaphoreCount);
+    signal_sems.push_back(timeline);
+
+    std::vector<uint64_t> signal_values(signal_sems.size(), 0);
+    signal_values.back() = value;
+    std::vector<uint64_t> wait_values(submit_info.waitSemaphoreCount, 0);
+
+    VkTimelineSemaphoreSubmitInfo timeline_info = {};
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.pNext = submit_info.pNext;
+    timeline_info.waitSemaphoreValueCount = static_cast<uint32_t>(wait_values.size());
+    timeline_info.pWaitSemaphoreValues = wait_values.data();
+    timeline_info.signalSemaphoreValueCount = static_cast<uint32_t>(signal_values.size());
+    timeline_info.pSignalSemaphoreValues = signal_values.data();
+
+    VkSubmitInfo timeline_submit = submit_info;
+    timeline_submit.pNext = &timeline_info;
+    timeline_submit.signalSemaphoreCount = static_cast<uint32_t>(signal_sems.size());
+    timeline_submit.pSignalSemaphores = signal_sems.data();
+
+    if (vkQueueSubmit(queue, 1, &timeline_submit, VK_NULL_HANDLE) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit command buffer to queue");
+    }
+#endif
+}
+
+bool FrameSync::waitValue(uint64_t value, uint64_t timeout) {
+    if (value <= completed_value) {
+        return true;
+    }
+
+    if (backend == FrameSyncBackend::Timeline) {
+#ifdef VK_VERSION_1_2
+        // Waiting on a value that hasn't been submitted yet is allowed and simply blocks until it is signaled
+        VkSemaphoreWaitInfo wait_info = {};
+        wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        wait_info.flags = 0;
+        wait_info.semaphoreCount = 1;
+        wait_info.pSemaphores = &timeline;
+        wait_info.pValues = &value;
+
+        VkResult wait_result = wait_semaphores(graphics_device->device(), &wait_info, timeout);
+        if (wait_result == VK_TIMEOUT) {
+            return false;
+        }
+        else if (wait_result != VK_SUCCESS) {
+            throw std::runtime_error("Failed to wait for timeline semaphore");
+        }
+
+        completed_value = value;
+#endif
+        return true;
+    }
+
+    if (value > submitted_value) {
+        throw std::runtime_error("Fence frame sync can't wait for a submission that hasn't been made");
+    }
+
+    // A slot is only reused after its previous submission retired, so if no slot holds the value it is done
+    for (uint32_t i = 0; i < slot_count; i++) {
+        if (slot_values[i] == value) {
+            return waitSlot(i, timeout);
+        }
+    }
+
+    completed_value = value;
+    return true;
+}
+
+uint64_t FrameSync::getCompletedValue() {
+    if (backend == FrameSyncBackend::Timeline) {
+#ifdef VK_VERSION_1_2
+        uint64_t value;
+        if (get_counter_value(graphics_device->device(), timeline, &value) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to get timeline semaphore value");
+        }
+        completed_value = MAX(completed_value, value);
+#endif
+        return completed_value;
+    }
+
+    // The queue retires submissions in order, so the newest signaled fence gives the completed value
+    for (uint32_t i = 0; i < slot_count; i++) {
+        if (slot_values[i] > completed_value &&
+            vkGetFenceStatus(graphics_device->device(), slot_fences[i]) == VK_SUCCESS) {
+            completed_value = slot_values[i];
+        }
+    }
+
+    return completed_value;
+}
+
+uint64_t FrameSync::getSubmittedValue() {
+    return submitted_value;
+}
+
+VkSemaphore FrameSync::getTimelineSemaphore() {
+    return timeline;
+}
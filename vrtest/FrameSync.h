@@ -0,0 +1,158 @@
+/** @file FrameSync.h
+*
+* @brief Defines class that tracks completion of queue submissions, using a
+*   timeline semaphore where available and per-slot fences otherwise
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/08/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+
+#include "GraphicsDevice.h"
+
+enum class FrameSyncBackend {
+    Fence,
+    Timeline
+};
+
+/**
+ * Every submission made through FrameSync is assigned the next value of a monotonically increasing counter.
+ *  A submission also occupies a slot (e.g. the swapchain image whose command buffer it runs) which can't be
+ *  reused until that submission retires. With the timeline backend the counter is the payload of a single
+ *  timeline semaphore signaled by the queue, so retirement is a counter compare and other queues can wait on
+ *  any value without extra objects. The fence backend keeps a fence per slot and derives the counter from it.
+ *  Swapchain acquire/present still use the binary semaphores owned by the presentation engine since WSI
+ *  doesn't accept timeline semaphores
+ */
+class FrameSync {
+private:
+    GraphicsDevice* graphics_device;
+    VkAllocationCallbacks* p_allocs;
+
+    FrameSyncBackend backend;
+
+    /**
+     * Number of slots
+     */
+    uint32_t slot_count;
+
+    /**
+     * Counter value of the last submission in each slot, or 0 if the slot was never used
+     */
+    uint64_t* slot_values;
+
+    /**
+     * Value of the last submission, or of the last reservation if it is newer
+     */
+    uint64_t submitted_value = 0;
+
+    /**
+     * Highest value known to have retired
+     */
+    uint64_t completed_value = 0;
+
+    /**
+     * Fence backend: fence per slot, signaled when the slot's last submission retires
+     */
+    VkFence* slot_fences = nullptr;
+
+    /**
+     * Timeline backend: semaphore whose payload is the value of the last retired submission
+     */
+    VkSemaphore timeline = VK_NULL_HANDLE;
+
+#ifdef VK_VERSION_1_2
+    PFN_vkWaitSemaphoresKHR wait_semaphores = nullptr;
+    PFN_vkGetSemaphoreCounterValueKHR get_counter_value = nullptr;
+#endif
+
+    void createFences();
+    void createTimeline();
+
+public:
+    /**
+     * Create synchronization objects, choosing the timeline backend if the device supports it
+     * @param graphics_device device to create objects on
+     * @param p_allocs allocation callbacks to use for vulkan calls
+     * @param slot_count number of slots, e.g. the swapchain length
+     * @param allow_timeline set false to force the fence backend
+     */
+    FrameSync(GraphicsDevice* graphics_device, VkAllocationCallbacks* p_allocs, uint32_t slot_count,
+        bool allow_timeline = true);
+
+    /**
+     * Destroys synchronization objects. Submissions must have retired
+     */
+    ~FrameSync();
+
+    /**
+     * Get the backend in use
+     */
+    FrameSyncBackend getBackend();
+
+    /**
+     * Wait for the last submission in a slot to retire
+     * @param slot slot to wait for
+     * @param timeout timeout in nanoseconds
+     * @return true if the slot is free, false if the timeout expired
+     */
+    bool waitSlot(uint32_t slot, uint64_t timeout);
+
+    /**
+     * Submit work to a queue and assign it the next counter value. Signal semaphores and chained structures
+     *  of the submit info are preserved
+     * @param queue queue to submit to
+     * @param submit_info description of the submission. Must not use timeline semaphores of its own
+     * @param slot slot occupied by the submission, which must have been waited on with waitSlot
+     * @return counter value of the submission
+     */
+    uint64_t submit(VkQueue queue, const VkSubmitInfo& submit_info, uint32_t slot);
+
+    /**
+     * Assign the next counter value to a slot ahead of its submission, so the submission can be made later or on
+     *  another thread. Until it is made, waits on the value block and it doesn't count as retired
+     * @param slot slot the submission will occupy, which must have been waited on with waitSlot
+     * @return counter value to pass to submitReserved
+     */
+    uint64_t reserve(uint32_t slot);
+
+    /**
+     * Make a submission reserved with reserve. Only uses the slot's own synchronization objects, so it may run on
+     *  another thread than the other methods as long as it follows the reserve
+     * @param queue queue to submit to
+     * @param submit_info description of the submission, as for submit
+     * @param slot slot passed to reserve
+     * @param value counter value returned by reserve
+     */
+    void submitReserved(VkQueue queue, const VkSubmitInfo& submit_info, uint32_t slot, uint64_t value);
+
+    /**
+     * Wait until a submission has retired
+     * @param value counter value returned by submit
+     * @param timeout timeout in nanoseconds
+     * @return true if the submission retired, false if the timeout expired
+     */
+    bool waitValue(uint64_t value, uint64_t timeout);
+
+    /**
+     * Get the value of the newest submission that has retired, without blocking
+     */
+    uint64_t getCompletedValue();
+
+    /**
+     * Get the value of the newest submission
+     */
+    uint64_t getSubmittedValue();
+
+    /**
+     * Get the timeline semaphore so submissions to other queues can wait on a counter value. Returns
+     *  VK_NULL_HANDLE with the fence backend
+     */
+    VkSemaphore getTimelineSemaphore();
+};
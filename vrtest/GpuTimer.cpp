@@ -0,0 +1,98 @@
+/** @file GpuTimer.cpp
+*
+* @brief Defines class that measures GPU execution time of command buffers
+*   with timestamp queries
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/12/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "GpuTimer.h"
+
+GpuTimer::GpuTimer(GraphicsDevice* graphics_device, VkAllocationCallbacks* p_allocs, uint32_t slot_count) {
+    this->graphics_device = graphics_device;
+    this->p_allocs = p_allocs;
+    this->slot_count = slot_count;
+
+    const VkPhysicalDeviceProperties& props = graphics_device->getDeviceProperties();
+    timestamp_period = props.limits.timestampPeriod;
+
+    // Timestamps are only usable if the graphics queue family has valid bits
+    uint32_t queue_family_count;
+    vkGetPhysicalDeviceQueueFamilyProperties(graphics_device->getPhysicalDevice(), &queue_family_count, nullptr);
+    std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(graphics_device->getPhysicalDevice(), &queue_family_count,
+        queue_families.data());
+
+    uint32_t valid_bits = queue_families[graphics_device->getGraphicsQueueFamily()].timestampValidBits;
+    if (valid_bits == 0) {
+        std::cout << "Graphics queue does not support timestamps, GPU timing disabled" << std::endl;
+        return;
+    }
+    valid_mask = valid_bits >= 64 ? ~0ULL : (1ULL << valid_bits) - 1;
+
+    VkQueryPoolCreateInfo pool_ci = {};
+    pool_ci.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    pool_ci.flags = 0;
+    pool_ci.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    pool_ci.queryCount = slot_count * 2;
+    pool_ci.pipelineStatistics = 0;
+
+    if (vkCreateQueryPool(graphics_device->device(), &pool_ci, p_allocs, &query_pool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create timestamp query pool");
+    }
+
+    supported = true;
+}
+
+GpuTimer::~GpuTimer() {
+    if (query_pool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(graphics_device->device(), query_pool, p_allocs);
+    }
+}
+
+bool GpuTimer::isSupported() {
+    return supported;
+}
+
+void GpuTimer::begin(VkCommandBuffer cmd, uint32_t slot) {
+    if (!supported) {
+        return;
+    }
+
+    vkCmdResetQueryPool(cmd, query_pool, slot * 2, 2);
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool, slot * 2);
+}
+
+void GpuTimer::end(VkCommandBuffer cmd, uint32_t slot) {
+    if (!supported) {
+        return;
+    }
+
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool, slot * 2 + 1);
+}
+
+bool GpuTimer::getElapsed(uint32_t slot, double* elapsed_ms) {
+    if (!supported) {
+        return false;
+    }
+
+    // No wait flag: queries that were never submitted report VK_NOT_READY
+    uint64_t timestamps[2];
+    VkResult result = vkGetQueryPoolResults(graphics_device->device(), query_pool, slot * 2, 2,
+        sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS) {
+        return false;
+    }
+
+    uint64_t ticks = (timestamps[1] - timestamps[0]) & valid_mask;
+    *elapsed_ms = ticks * timestamp_period / 1000000.0;
+    return true;
+}
@@ -0,0 +1,80 @@
+/** @file GpuTimer.h
+*
+* @brief Defines class that measures GPU execution time of command buffers
+*   with timestamp queries
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/12/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+
+#include "GraphicsDevice.h"
+
+/**
+ * Two timestamp queries per slot bracket the work recorded for that slot. Results are read back once the
+ *  slot's submission has retired, so reading never stalls
+ */
+class GpuTimer {
+private:
+    GraphicsDevice* graphics_device;
+    VkAllocationCallbacks* p_allocs;
+
+    uint32_t slot_count;
+
+    /**
+     * Query pool with a begin and end timestamp per slot
+     */
+    VkQueryPool query_pool = VK_NULL_HANDLE;
+
+    /**
+     * Nanoseconds per timestamp tick
+     */
+    double timestamp_period;
+
+    /**
+     * Mask of valid timestamp bits on the graphics queue
+     */
+    uint64_t valid_mask;
+
+    bool supported = false;
+
+public:
+    /**
+     * Create the query pool
+     * @param graphics_device device to create queries on
+     * @param p_allocs allocation callbacks to use for vulkan calls
+     * @param slot_count number of slots, e.g. the swapchain length
+     */
+    GpuTimer(GraphicsDevice* graphics_device, VkAllocationCallbacks* p_allocs, uint32_t slot_count);
+
+    ~GpuTimer();
+
+    /**
+     * Returns false if the graphics queue doesn't support timestamps, in which case the timer records nothing
+     */
+    bool isSupported();
+
+    /**
+     * Record the start timestamp of a slot. Must be recorded outside a render pass
+     */
+    void begin(VkCommandBuffer cmd, uint32_t slot);
+
+    /**
+     * Record the end timestamp of a slot
+     */
+    void end(VkCommandBuffer cmd, uint32_t slot);
+
+    /**
+     * Read the elapsed time of a slot's last retired submission without waiting
+     * @param slot slot to read
+     * @param elapsed_ms [output] GPU time between the timestamps in milliseconds
+     * @return true if a result was available
+     */
+    bool getElapsed(uint32_t slot, double* elapsed_ms);
+};
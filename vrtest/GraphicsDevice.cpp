@@ -15,8 +15,17 @@
 #include <iostream>
 #include <stdexcept>
 #include <fstream>
+#include <string.h>
 
 #include "GraphicsDevice.h"
+#include "FrameSync.h"
+#include "SubmitQueue.h"
+#include "Common.h"
+
+#ifdef VRTEST_EMBEDDED_SHADERS
+// Generated at build time from the shader outputs by vrshaderembed
+#include "EmbeddedShaders.h"
+#endif
 
 VkResult CreateDebugReportCallbackEXT(VkInstance instance, const VkDebugReportCallbackCreateInfoEXT* pCreateInfo,
     const VkAllocationCallbacks* pAllocator, VkDebugReportCallbackEXT* pCallback) {
@@ -39,16 +48,26 @@ void DestroyDebugReportCallbackEXT(VkInstance instance, VkDebugReportCallbackEXT
     }
 }
 
-GraphicsDevice::GraphicsDevice(PresentationEngine* presentation_engine, VkAllocationCallbacks* p_allocs) {
+GraphicsDevice::GraphicsDevice(PresentationEngine* presentation_engine, VkAllocationCallbacks* p_allocs, bool verbose,
+    StartupProfiler* profiler) {
     this->present = presentation_engine;
     this->p_allocs = p_allocs;
+    this->verbose = verbose;
+    this->profiler = profiler;
+
+    uint32_t pe_dev_extension_count = 0;
+    const char** pe_dev_extensions = present->getRequiredDeviceExtensions(&pe_dev_extension_count);
+    dev_extensions.assign(pe_dev_extensions, pe_dev_extensions + pe_dev_extension_count);
+
     initVulkan();
 }
 
 GraphicsDevice::~GraphicsDevice() {
+    delete submit_queue;
     vkDestroyImageView(m_device, ds_buffer_view, p_allocs);
     vkDestroyImage(m_device, ds_buffer, p_allocs);
-    vkFreeMemory(m_device, ds_buffer_mem, p_allocs);
+    memory_telemetry->freeMemory(ds_buffer_mem);
+    delete memory_telemetry;
     vkDestroyDevice(m_device, p_allocs);
 #ifdef DEBUG
     DestroyDebugReportCallbackEXT(instance, debug_callback, p_allocs);
@@ -57,13 +76,25 @@ GraphicsDevice::~GraphicsDevice() {
 }
 
 void GraphicsDevice::initVulkan() {
-    createInstance();
+    {
+        ScopedPhase phase(profiler, "instance creation");
+        createInstance();
 #ifdef DEBUG
-    enableDebugCallback();
+        enableDebugCallback();
 #endif
-    selectDevice();
-    createDeviceAndQueues();
-    createDepthBuffer();
+    }
+    {
+        ScopedPhase phase(profiler, "device selection");
+        selectDevice();
+    }
+    {
+        ScopedPhase phase(profiler, "device and swapchain creation");
+        createDeviceAndQueues();
+    }
+    {
+        ScopedPhase phase(profiler, "depth buffer creation");
+        createDepthBuffer();
+    }
 }
 
 void GraphicsDevice::createInstance() {
@@ -76,6 +107,25 @@ void GraphicsDevice::createInstance() {
     app_info.engineVersion = VK_MAKE_VERSION(0, 1, 1);
     app_info.apiVersion = VK_API_VERSION_1_0;
 
+#ifdef VK_VERSION_1_2
+    // Use the newest API the loader supports, up to 1.2, so timeline semaphores and
+    // vkGetPhysicalDeviceFeatures2 are available where possible
+    auto enumerate_version = (PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(nullptr,
+        "vkEnumerateInstanceVersion");
+    uint32_t loader_version = VK_API_VERSION_1_0;
+    if (enumerate_version != nullptr) {
+        enumerate_version(&loader_version);
+    }
+
+    if (loader_version >= VK_API_VERSION_1_2) {
+        app_info.apiVersion = VK_API_VERSION_1_2;
+    }
+    else if (loader_version >= VK_API_VERSION_1_1) {
+        app_info.apiVersion = VK_API_VERSION_1_1;
+    }
+#endif
+    instance_version = app_info.apiVersion;
+
     // Vulkan instance create info
     VkInstanceCreateInfo inst_ci = {};
     inst_ci.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -104,34 +154,36 @@ void GraphicsDevice::createInstance() {
     inst_ci.enabledExtensionCount = static_cast<uint32_t>(requested_extensions.size());
     inst_ci.ppEnabledExtensionNames = requested_extensions.data();
 
-    // Enumerate available extensions for information purposes
-    uint32_t extension_count;
-    vkEnumerateInstanceExtensionProperties(nullptr, &extension_count, nullptr);
-    std::vector<VkExtensionProperties> extensions(extension_count);
-    vkEnumerateInstanceExtensionProperties(nullptr, &extension_count, extensions.data());
-    std::cout << "available Vulkan extensions:" << std::endl;
-    for (const auto& extension : extensions) {
-        std::cout << "\t" << extension.extensionName << std::endl;
-    }
+    // Enumerate available extensions and layers for information purposes
+    if (verbose) {
+        uint32_t extension_count;
+        vkEnumerateInstanceExtensionProperties(nullptr, &extension_count, nullptr);
+        std::vector<VkExtensionProperties> extensions(extension_count);
+        vkEnumerateInstanceExtensionProperties(nullptr, &extension_count, extensions.data());
+        std::cout << "available Vulkan extensions:\n";
+        for (const auto& extension : extensions) {
+            std::cout << "\t" << extension.extensionName << '\n';
+        }
 
-    std::cout << "required extensions for VR test:" << std::endl;
-    for (unsigned int i = 0; i < requested_extensions.size(); i++) {
-        std::cout << "\t" << requested_extensions[i] << std::endl;
-    }
+        std::cout << "required extensions for VR test:\n";
+        for (unsigned int i = 0; i < requested_extensions.size(); i++) {
+            std::cout << "\t" << requested_extensions[i] << '\n';
+        }
 
-    // Enumerate available layers for information purposes
-    uint32_t layer_count;
-    vkEnumerateInstanceLayerProperties(&layer_count, nullptr);
-    std::vector<VkLayerProperties> layers(layer_count);
-    vkEnumerateInstanceLayerProperties(&layer_count, layers.data());
-    std::cout << "Available Vulkan instance layers:" << std::endl;
-    for (const auto& layer : layers) {
-        std::cout << "\t" << layer.layerName << std::endl;
-    }
+        uint32_t layer_count;
+        vkEnumerateInstanceLayerProperties(&layer_count, nullptr);
+        std::vector<VkLayerProperties> layers(layer_count);
+        vkEnumerateInstanceLayerProperties(&layer_count, layers.data());
+        std::cout << "Available Vulkan instance layers:\n";
+        for (const auto& layer : layers) {
+            std::cout << "\t" << layer.layerName << '\n';
+        }
 
-    std::cout << "required layers for VR test:" << std::endl;
-    for (unsigned int i = 0; i < inst_ci.enabledLayerCount; i++) {
-        std::cout << "\t" << inst_ci.ppEnabledLayerNames[i] << std::endl;
+        std::cout << "required layers for VR test:\n";
+        for (unsigned int i = 0; i < inst_ci.enabledLayerCount; i++) {
+            std::cout << "\t" << inst_ci.ppEnabledLayerNames[i] << '\n';
+        }
+        std::cout.flush();
     }
 
     // Create vulkan instance
@@ -141,8 +193,6 @@ void GraphicsDevice::createInstance() {
 }
 
 void GraphicsDevice::selectDevice() {
-    VkPhysicalDeviceProperties device_props;
-
     // Enumerate available devices
     uint32_t device_count;
     vkEnumeratePhysicalDevices(instance, &device_count, nullptr);
@@ -150,21 +200,27 @@ void GraphicsDevice::selectDevice() {
     vkEnumeratePhysicalDevices(instance, &device_count, physical_devices.data());
 
     // Print requested extensions for information purposes
-    std::cout << "Requested device extensions: " << std::endl;
-    for (const auto& extension : dev_extensions)
-    {
-        std::cout << "\t" << extension << std::endl;
+    if (verbose) {
+        std::cout << "Requested device extensions: \n";
+        for (const auto& extension : dev_extensions)
+        {
+            std::cout << "\t" << extension << '\n';
+        }
+        std::cout << "Vulkan physical devices:\n";
     }
 
     // Find a graphics device
     bool found_device = false;
-    std::cout << "Vulkan physical devices:" << std::endl;
     for (unsigned int i = 0; i < device_count; i++) {
         vkGetPhysicalDeviceProperties(physical_devices[i], &device_props);
-        std::cout << "\t" << device_props.deviceName << std::endl;
+        if (verbose) {
+            std::cout << "\t" << device_props.deviceName << '\n';
+        }
 
+        // CPU devices are slow but allow headless runs, e.g. benchmarks in CI
         if (device_props.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU ||
-            device_props.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
+            device_props.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU ||
+            device_props.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU) {
             // Check for all required device extensions
             uint32_t extension_count;
             vkEnumerateDeviceExtensionProperties(physical_devices[i], nullptr, &extension_count, nullptr);
@@ -172,13 +228,19 @@ void GraphicsDevice::selectDevice() {
             vkEnumerateDeviceExtensionProperties(physical_devices[i], nullptr, &extension_count, supported_extensions.data());
 
             std::set<std::string> req_extensions(dev_extensions.begin(), dev_extensions.end());
-            std::cout << "Device supported extensions: " << std::endl;
+            if (verbose) {
+                std::cout << "Device supported extensions: \n";
+            }
             for (const auto& extension : supported_extensions) {
-                std::cout << "\t" << extension.extensionName << std::endl;
+                if (verbose) {
+                    std::cout << "\t" << extension.extensionName << '\n';
+                }
                 req_extensions.erase(extension.extensionName);
             }
 
-            if (req_extensions.empty()) {
+            // Any GPU is preferred over a CPU device
+            bool is_cpu = device_props.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU;
+            if (req_extensions.empty() && (!found_device || !is_cpu)) {
                 found_device = true;
                 physical_device = physical_devices[i];
             }
@@ -207,13 +269,20 @@ void GraphicsDevice::selectDevice() {
         }
 
         // check queue for surface presentation support
-        VkBool32 present_support = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, i, pe_surface, &present_support);
-        if (present_support && present_queue_family < 0) {
-            present_queue_family = i;
+        if (pe_surface != VK_NULL_HANDLE) {
+            VkBool32 present_support = false;
+            vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, i, pe_surface, &present_support);
+            if (present_support && present_queue_family < 0) {
+                present_queue_family = i;
+            }
         }
     }
 
+    // Without a surface, "presenting" is done by the graphics queue
+    if (pe_surface == VK_NULL_HANDLE) {
+        present_queue_family = gfx_queue_family;
+    }
+
     if (gfx_queue_family < 0) {
         throw std::runtime_error("Device has no graphics queue family");
     }
@@ -227,6 +296,156 @@ void GraphicsDevice::selectDevice() {
 
     // Get memory properties
     vkGetPhysicalDeviceMemoryProperties(physical_device, &mem_props);
+
+    queryTimelineSupport();
+    queryDisplayTimingSupport();
+    queryMemoryBudgetSupport();
+    queryDescriptorIndexingSupport();
+}
+
+void GraphicsDevice::queryTimelineSupport() {
+#ifdef VK_VERSION_1_2
+    // Feature queries need vkGetPhysicalDeviceFeatures2, which is core in 1.1
+    if (instance_version < VK_API_VERSION_1_1) {
+        return;
+    }
+
+    bool core = instance_version >= VK_API_VERSION_1_2 && device_props.apiVersion >= VK_API_VERSION_1_2;
+    if (!core) {
+        uint32_t extension_count;
+        vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extension_count, nullptr);
+        std::vector<VkExtensionProperties> supported_extensions(extension_count);
+        vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extension_count, supported_extensions.data());
+
+        bool found = false;
+        for (const auto& extension : supported_extensions) {
+            if (strcmp(extension.extensionName, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME) == 0) {
+                found = true;
+            }
+        }
+        if (!found) {
+            return;
+        }
+    }
+
+    auto get_features2 = (PFN_vkGetPhysicalDeviceFeatures2)vkGetInstanceProcAddr(instance,
+        "vkGetPhysicalDeviceFeatures2");
+    if (get_features2 == nullptr) {
+        return;
+    }
+
+    VkPhysicalDeviceTimelineSemaphoreFeatures timeline_features = {};
+    timeline_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+
+    VkPhysicalDeviceFeatures2 features = {};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &timeline_features;
+    get_features2(physical_device, &features);
+
+    timeline_semaphores = timeline_features.timelineSemaphore == VK_TRUE;
+    timeline_semaphores_khr = timeline_semaphores && !core;
+#endif
+}
+
+void GraphicsDevice::queryDisplayTimingSupport() {
+#ifdef VK_GOOGLE_display_timing
+    uint32_t extension_count;
+    vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extension_count, nullptr);
+    std::vector<VkExtensionProperties> supported_extensions(extension_count);
+    vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extension_count, supported_extensions.data());
+
+    for (const auto& extension : supported_extensions) {
+        if (strcmp(extension.extensionName, VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME) == 0) {
+            display_timing = true;
+        }
+    }
+#endif
+}
+
+void GraphicsDevice::queryMemoryBudgetSupport() {
+#if defined(VK_EXT_memory_budget) && defined(VK_VERSION_1_1)
+    // Budgets are queried with vkGetPhysicalDeviceMemoryProperties2, which is core in 1.1
+    if (instance_version < VK_API_VERSION_1_1) {
+        return;
+    }
+
+    uint32_t extension_count;
+    vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extension_count, nullptr);
+    std::vector<VkExtensionProperties> supported_extensions(extension_count);
+    vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extension_count, supported_extensions.data());
+
+    for (const auto& extension : supported_extensions) {
+        if (strcmp(extension.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0) {
+            memory_budget = true;
+        }
+    }
+#endif
+}
+
+void GraphicsDevice::queryDescriptorIndexingSupport() {
+#if defined(VK_EXT_descriptor_indexing) && defined(VK_VERSION_1_1)
+    // Feature and limit queries need vkGetPhysicalDeviceFeatures2 and vkGetPhysicalDeviceProperties2, which are
+    // core in 1.1
+    if (instance_version < VK_API_VERSION_1_1) {
+        return;
+    }
+
+    bool core = instance_version >= VK_API_VERSION_1_2 && device_props.apiVersion >= VK_API_VERSION_1_2;
+    if (!core) {
+        uint32_t extension_count;
+        vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extension_count, nullptr);
+        std::vector<VkExtensionProperties> supported_extensions(extension_count);
+        vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extension_count, supported_extensions.data());
+
+        // The extension depends on VK_KHR_maintenance3, which is only core from 1.1
+        bool found = false;
+        bool maintenance3 = device_props.apiVersion >= VK_API_VERSION_1_1;
+        for (const auto& extension : supported_extensions) {
+            if (strcmp(extension.extensionName, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) == 0) {
+                found = true;
+            }
+            if (strcmp(extension.extensionName, VK_KHR_MAINTENANCE3_EXTENSION_NAME) == 0 &&
+                device_props.apiVersion < VK_API_VERSION_1_1) {
+                maintenance3 = true;
+                descriptor_indexing_maintenance3 = true;
+            }
+        }
+        if (!found || !maintenance3) {
+            return;
+        }
+    }
+
+    auto get_features2 = (PFN_vkGetPhysicalDeviceFeatures2)vkGetInstanceProcAddr(instance,
+        "vkGetPhysicalDeviceFeatures2");
+    auto get_properties2 = (PFN_vkGetPhysicalDeviceProperties2)vkGetInstanceProcAddr(instance,
+        "vkGetPhysicalDeviceProperties2");
+    if (get_features2 == nullptr || get_properties2 == nullptr) {
+        return;
+    }
+
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexing_features = {};
+    indexing_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+
+    VkPhysicalDeviceFeatures2 features = {};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &indexing_features;
+    get_features2(physical_device, &features);
+
+    VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexing_props = {};
+    indexing_props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+
+    VkPhysicalDeviceProperties2 properties = {};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &indexing_props;
+    get_properties2(physical_device, &properties);
+
+    // Only texture arrays are bound this way, so only those features are needed
+    descriptor_indexing = indexing_features.descriptorBindingPartiallyBound == VK_TRUE &&
+        indexing_features.descriptorBindingSampledImageUpdateAfterBind == VK_TRUE;
+    descriptor_indexing_maintenance3 = descriptor_indexing && descriptor_indexing_maintenance3;
+    max_bindless_textures = descriptor_indexing ? MIN(indexing_props.maxPerStageDescriptorUpdateAfterBindSamplers,
+        indexing_props.maxPerStageDescriptorUpdateAfterBindSampledImages) : 0;
+#endif
 }
 
 void GraphicsDevice::createDeviceAndQueues() {
@@ -250,8 +469,18 @@ void GraphicsDevice::createDeviceAndQueues() {
         queue_cis.push_back(present_queue_ci);
     }
 
-    // Device features: TODO
+    // Device features: compressed texture formats, whichever families the device has
+    VkPhysicalDeviceFeatures supported_features;
+    vkGetPhysicalDeviceFeatures(physical_device, &supported_features);
+
     VkPhysicalDeviceFeatures dev_features = {};
+    dev_features.textureCompressionBC = supported_features.textureCompressionBC;
+    dev_features.textureCompressionETC2 = supported_features.textureCompressionETC2;
+    dev_features.textureCompressionASTC_LDR = supported_features.textureCompressionASTC_LDR;
+
+    // Materials select their textures from an array by index
+    dev_features.shaderSampledImageArrayDynamicIndexing = supported_features.shaderSampledImageArrayDynamicIndexing;
+    texture_array_indexing = supported_features.shaderSampledImageArrayDynamicIndexing == VK_TRUE;
 
     // Create logical device
     VkDeviceCreateInfo device_ci = {};
@@ -267,8 +496,54 @@ void GraphicsDevice::createDeviceAndQueues() {
     device_ci.ppEnabledLayerNames = nullptr;
 #endif
 
-    device_ci.enabledExtensionCount = static_cast<uint32_t>(dev_extensions.size());
-    device_ci.ppEnabledExtensionNames = dev_extensions.data();
+    std::vector<const char*> enabled_extensions(dev_extensions.begin(), dev_extensions.end());
+
+#ifdef VK_VERSION_1_2
+    VkPhysicalDeviceTimelineSemaphoreFeatures timeline_features = {};
+    timeline_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    timeline_features.timelineSemaphore = VK_TRUE;
+
+    if (timeline_semaphores) {
+        device_ci.pNext = &timeline_features;
+        if (timeline_semaphores_khr) {
+            enabled_extensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+        }
+    }
+#endif
+
+#ifdef VK_GOOGLE_display_timing
+    if (display_timing) {
+        enabled_extensions.push_back(VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME);
+    }
+#endif
+
+#ifdef VK_EXT_memory_budget
+    if (memory_budget) {
+        enabled_extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
+#endif
+
+#if defined(VK_EXT_descriptor_indexing) && defined(VK_VERSION_1_1)
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexing_features = {};
+    indexing_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+    indexing_features.descriptorBindingPartiallyBound = VK_TRUE;
+    indexing_features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+
+    if (descriptor_indexing) {
+        indexing_features.pNext = const_cast<void*>(device_ci.pNext);
+        device_ci.pNext = &indexing_features;
+        bool core = instance_version >= VK_API_VERSION_1_2 && device_props.apiVersion >= VK_API_VERSION_1_2;
+        if (!core) {
+            enabled_extensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+        }
+        if (descriptor_indexing_maintenance3) {
+            enabled_extensions.push_back(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+        }
+    }
+#endif
+
+    device_ci.enabledExtensionCount = static_cast<uint32_t>(enabled_extensions.size());
+    device_ci.ppEnabledExtensionNames = enabled_extensions.data();
     device_ci.pEnabledFeatures = &dev_features;
 
     if (vkCreateDevice(physical_device, &device_ci, p_allocs, &m_device) != VK_SUCCESS) {
@@ -281,8 +556,16 @@ void GraphicsDevice::createDeviceAndQueues() {
     vkGetDeviceQueue(m_device, gfx_queue_family, 0, &gfx_queue);
     vkGetDeviceQueue(m_device, present_queue_family, 0, &present_queue);
 
+    memory_telemetry = new MemoryTelemetry(instance, physical_device, m_device, p_allocs, memory_budget);
+    present->setMemoryTelemetry(memory_telemetry);
+
     // Create swapchain
+    if (display_timing) {
+        present->enableDisplayTiming();
+    }
     present->createSwapchain(physical_device, m_device, gfx_queue_family, present_queue_family);
+
+    submit_queue = new SubmitQueue(present, gfx_queue, present_queue);
 }
 
 void GraphicsDevice::createDepthBuffer() {
@@ -323,6 +606,10 @@ void GraphicsDevice::createDepthBuffer() {
     image_ci.samples = VK_SAMPLE_COUNT_1_BIT;
     image_ci.tiling = VK_IMAGE_TILING_OPTIMAL;
     image_ci.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    // Sampled so occlusion culling can build its depth pyramid from it, where the format allows
+    if (format_props.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) {
+        image_ci.usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+    }
     image_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     image_ci.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
@@ -339,7 +626,7 @@ void GraphicsDevice::createDepthBuffer() {
     alloc_info.allocationSize = mem_req.size;
     alloc_info.memoryTypeIndex = findMemType(mem_req.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-    if (vkAllocateMemory(m_device, &alloc_info, p_allocs, &ds_buffer_mem) != VK_SUCCESS) {
+    if (memory_telemetry->allocateMemory(alloc_info, MEMORY_CATEGORY_ATTACHMENT, &ds_buffer_mem) != VK_SUCCESS) {
         throw std::runtime_error("Failed to allocate device memory for depth/stencil buffer");
     }
 
@@ -369,51 +656,71 @@ void GraphicsDevice::createDepthBuffer() {
     }
 }
 
-bool GraphicsDevice::submitRenderCommandBuffer(VkCommandBuffer* command_buffers, VkFence* fences) {
-    VkSemaphore* wait_sem;
-    VkSemaphore* signal_sem;
-    int sc_index = present->getNextSwapchainImage(&wait_sem, &signal_sem);
+bool GraphicsDevice::submitRenderCommandBuffer(VkCommandBuffer* command_buffers, FrameSync* frame_sync,
+    const std::function<void(uint32_t)>& pre_submit) {
+    // The image stays held by the submit queue if the frame isn't submitted, so the next call renders to it
+    int sc_index = submit_queue->acquireImage();
     if (sc_index < 0) {
         // swapchain not ready
         return false;
     }
 
     // Wait for last submission of the command buffer to complete
-    VkResult fence_result = vkWaitForFences(m_device, 1, &(fences[sc_index]), VK_TRUE, 1000000);
-    if (fence_result == VK_TIMEOUT) {
+    if (!frame_sync->waitSlot(static_cast<uint32_t>(sc_index), 1000000)) {
         // Can't re-sumbit command buffer yet
         return false;
     }
-    else if (fence_result != VK_SUCCESS) {
-        throw std::runtime_error("Failed to wait for command buffer fence");
-    }
-    if (vkResetFences(m_device, 1, &(fences[sc_index])) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to reset command buffer fence");
+
+    if (pre_submit) {
+        pre_submit(static_cast<uint32_t>(sc_index));
     }
 
-    // Submit render command buffer to queue
-    VkPipelineStageFlags wait_flags = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    // Submit render command buffer to queue, together with what was added for the frame
+    submit_queue->submitFrame(command_buffers[sc_index], frame_sync, static_cast<uint32_t>(sc_index));
 
-    VkSubmitInfo submit_info = {};
-    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit_info.waitSemaphoreCount = 1;
-    submit_info.pWaitSemaphores = wait_sem;
-    submit_info.pWaitDstStageMask = &wait_flags;
-    submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &(command_buffers[sc_index]);
-    submit_info.signalSemaphoreCount = 1;
-    submit_info.pSignalSemaphores = signal_sem;
+    return true;
+}
+
+#ifdef VRTEST_EMBEDDED_SHADERS
+static const EmbeddedShader* findEmbeddedShader(const char* filename) {
+    for (const auto& shader : embedded_shaders) {
+        if (strcmp(shader.name, filename) == 0) {
+            return &shader;
+        }
+    }
+    return nullptr;
+}
+#else
+static const EmbeddedShader* findEmbeddedShader(const char*) {
+    return nullptr;
+}
+#endif
 
-    if (vkQueueSubmit(gfx_queue, 1, &submit_info, fences[sc_index]) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to submit command buffer to queue");
+VkShaderModule GraphicsDevice::loadShader(const char* filename) {
+    const EmbeddedShader* shader = findEmbeddedShader(filename);
+    if (shader) {
+        return createShaderModule(shader->code, shader->code_size);
     }
 
-    present->presentSwapchainImage(sc_index, present_queue);
+    std::vector<char> code = readShaderFile(filename);
+    return createShaderModule(reinterpret_cast<const uint32_t*>(code.data()), code.size());
+}
 
-    return true;
+std::vector<char> GraphicsDevice::getShaderCode(const char* filename) {
+    const EmbeddedShader* shader = findEmbeddedShader(filename);
+    if (shader) {
+        const char* bytes = reinterpret_cast<const char*>(shader->code);
+        return std::vector<char>(bytes, bytes + shader->code_size);
+    }
+    return readShaderFile(filename);
 }
 
-VkShaderModule GraphicsDevice::loadShader(const char* filename) {
+const ShaderReflection* GraphicsDevice::getShaderReflection(const char* filename) {
+    const EmbeddedShader* shader = findEmbeddedShader(filename);
+    return shader ? &shader->reflection : nullptr;
+}
+
+std::vector<char> GraphicsDevice::readShaderFile(const char* filename) {
     // Open source file
     std::ifstream shader_file(filename, std::ios::ate | std::ios::binary);
 
@@ -423,26 +730,26 @@ VkShaderModule GraphicsDevice::loadShader(const char* filename) {
 
     // Load code into buffer
     size_t code_size = static_cast<size_t>(shader_file.tellg());
-    char* code = new char[code_size];
+    std::vector<char> code(code_size);
     shader_file.seekg(0);
-    shader_file.read(code, code_size);
+    shader_file.read(code.data(), code_size);
     shader_file.close();
 
-    // Create shader module
+    return code;
+}
+
+VkShaderModule GraphicsDevice::createShaderModule(const uint32_t* code, size_t code_size) {
     VkShaderModuleCreateInfo shader_ci = {};
     shader_ci.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
     shader_ci.flags = 0;
     shader_ci.codeSize = code_size;
-    shader_ci.pCode = reinterpret_cast<const uint32_t*>(code);
+    shader_ci.pCode = code;
 
     VkShaderModule shader;
     if (vkCreateShaderModule(m_device, &shader_ci, p_allocs, &shader) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create shader module");
     }
 
-    // Release buffer
-    delete[] code;
-
     return shader;
 }
 
@@ -450,6 +757,10 @@ VkDevice GraphicsDevice::device() {
     return m_device;
 }
 
+VkPhysicalDevice GraphicsDevice::getPhysicalDevice() {
+    return physical_device;
+}
+
 VkFormat GraphicsDevice::getDepthStencilFormat() {
     return ds_format;
 }
@@ -458,10 +769,22 @@ VkImageView GraphicsDevice::getDepthStencilView() {
     return ds_buffer_view;
 }
 
+VkImage GraphicsDevice::getDepthStencilImage() {
+    return ds_buffer;
+}
+
 uint32_t GraphicsDevice::getGraphicsQueueFamily() {
     return gfx_queue_family;
 }
 
+VkQueue GraphicsDevice::getGraphicsQueue() {
+    return gfx_queue;
+}
+
+SubmitQueue* GraphicsDevice::getSubmitQueue() {
+    return submit_queue;
+}
+
 uint32_t GraphicsDevice::getPresentationQueueFamily() {
     return present_queue_family;
 }
@@ -476,6 +799,67 @@ uint32_t GraphicsDevice::findMemType(uint32_t type_bits, VkMemoryPropertyFlagBit
     throw std::runtime_error("Failed to find memory type");
 }
 
+const VkPhysicalDeviceProperties& GraphicsDevice::getDeviceProperties() {
+    return device_props;
+}
+
+bool GraphicsDevice::isVerbose() {
+    return verbose;
+}
+
+bool GraphicsDevice::supportsTimelineSemaphores() {
+    return timeline_semaphores;
+}
+
+bool GraphicsDevice::usesTimelineSemaphoreExtension() {
+    return timeline_semaphores_khr;
+}
+
+bool GraphicsDevice::supportsDisplayTiming() {
+    return display_timing;
+}
+
+bool GraphicsDevice::supportsMemoryBudget() {
+    return memory_budget;
+}
+
+bool GraphicsDevice::supportsDescriptorIndexing() {
+    return descriptor_indexing;
+}
+
+uint32_t GraphicsDevice::getMaxBindlessTextures() {
+    return max_bindless_textures;
+}
+
+bool GraphicsDevice::supportsTextureArrayIndexing() {
+    return texture_array_indexing;
+}
+
+bool GraphicsDevice::supportsSampledFormat(VkFormat format) {
+    VkFormatProperties format_props;
+    vkGetPhysicalDeviceFormatProperties(physical_device, format, &format_props);
+    return (format_props.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+}
+
+MemoryTelemetry* GraphicsDevice::getMemoryTelemetry() {
+    return memory_telemetry;
+}
+
+void GraphicsDevice::getDeviceLocalBudget(VkDeviceSize* budget, VkDeviceSize* usage) {
+    VkDeviceSize budgets[VK_MAX_MEMORY_HEAPS];
+    VkDeviceSize usages[VK_MAX_MEMORY_HEAPS];
+    memory_telemetry->queryHeapBudgets(budgets, usages);
+
+    *budget = 0;
+    *usage = 0;
+    for (uint32_t i = 0; i < mem_props.memoryHeapCount; i++) {
+        if (mem_props.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+            *budget += budgets[i];
+            *usage += usages[i];
+        }
+    }
+}
+
 void GraphicsDevice::enableDebugCallback() {
     VkDebugReportCallbackCreateInfoEXT debug_ci;
     debug_ci.sType = VK_STRUCTURE_TYPE_DEBUG_REPORT_CALLBACK_CREATE_INFO_EXT;
@@ -487,14 +871,14 @@ void GraphicsDevice::enableDebugCallback() {
     }
 }
 
-VKAPI_ATTR VkBool32 VKAPI_CALL GraphicsDevice::debugCallback(VkDebugReportFlagsEXT flags,
-    VkDebugReportObjectTypeEXT objType,
-    uint64_t obj,
-    size_t location,
-    int32_t code,
-    const char* layerPrefix,
+VKAPI_ATTR VkBool32 VKAPI_CALL GraphicsDevice::debugCallback(VkDebugReportFlagsEXT /*flags*/,
+    VkDebugReportObjectTypeEXT /*objType*/,
+    uint64_t /*obj*/,
+    size_t /*location*/,
+    int32_t /*code*/,
+    const char* /*layerPrefix*/,
     const char* msg,
-    void* userData) {
+    void* /*userData*/) {
 
     std::cerr << "[VULKAN VALIDATION]: " << msg << std::endl;
     return VK_FALSE;
@@ -13,8 +13,15 @@
 
 #include <vulkan/vulkan.h>
 #include <vector>
+#include <functional>
 
+#include "MemoryTelemetry.h"
 #include "PresentationEngine.h"
+#include "ShaderReflection.h"
+#include "StartupProfiler.h"
+
+class FrameSync;
+class SubmitQueue;
 
 class GraphicsDevice {
 private:
@@ -24,11 +31,9 @@ private:
     const char* validation_layer = "VK_LAYER_LUNARG_standard_validation";
 
     /**
-     * List of required Vulkan device extension
+     * List of required Vulkan device extension, as reported by the presentation engine
      */
-    const std::vector<const char*> dev_extensions = {
-        VK_KHR_SWAPCHAIN_EXTENSION_NAME
-    };
+    std::vector<const char*> dev_extensions;
 
     /**
      * Presentation engine used for displaying rendered frames
@@ -40,6 +45,16 @@ private:
      */
     VkAllocationCallbacks* p_allocs = nullptr;
 
+    /**
+     * Print available extensions, layers and devices during initialization
+     */
+    bool verbose = false;
+
+    /**
+     * Profiler timing initialization phases, or nullptr
+     */
+    StartupProfiler* profiler = nullptr;
+
     /**
      * Vulkan instance used for rendering
      */
@@ -92,6 +107,56 @@ private:
     */
     VkPhysicalDeviceMemoryProperties mem_props;
 
+    /**
+    * Properties and limits of the chosen device
+    */
+    VkPhysicalDeviceProperties device_props;
+
+    /**
+    * API version the instance was created with
+    */
+    uint32_t instance_version = VK_API_VERSION_1_0;
+
+    /**
+    * Whether timeline semaphores are enabled on the device, and whether that is through
+    * VK_KHR_timeline_semaphore rather than core Vulkan 1.2
+    */
+    bool timeline_semaphores = false;
+    bool timeline_semaphores_khr = false;
+
+    /**
+    * Whether VK_GOOGLE_display_timing is enabled, which reports when presents reach the display
+    */
+    bool display_timing = false;
+
+    /**
+    * Whether VK_EXT_memory_budget is enabled, which reports per-heap budgets that account for other processes
+    */
+    bool memory_budget = false;
+
+    /**
+    * Whether VK_EXT_descriptor_indexing is enabled for partially bound, update-after-bind texture arrays, whether
+    * VK_KHR_maintenance3 had to be enabled with it, and how many textures such an array may hold
+    */
+    bool descriptor_indexing = false;
+    bool descriptor_indexing_maintenance3 = false;
+    uint32_t max_bindless_textures = 0;
+
+    /**
+    * Whether shaders may index texture arrays with dynamically uniform expressions
+    */
+    bool texture_array_indexing = false;
+
+    /**
+     * Tracks every device memory allocation, created with the logical device
+     */
+    MemoryTelemetry* memory_telemetry = nullptr;
+
+    /**
+     * Batches each frame's submission and owns acquire and present, created with the swapchain
+     */
+    SubmitQueue* submit_queue = nullptr;
+
     /**
     * Debug callback for validation messages
     */
@@ -100,11 +165,15 @@ private:
     void initVulkan();
     void createInstance();
     void selectDevice();
+    void queryTimelineSupport();
+    void queryDisplayTimingSupport();
+    void queryMemoryBudgetSupport();
+    void queryDescriptorIndexingSupport();
     void createDeviceAndQueues();
     void createDepthBuffer();
 
     void enableDebugCallback();
-    static VKAPI_ATTR VkBool32 VKAPI_CALL GraphicsDevice::debugCallback(VkDebugReportFlagsEXT flags,
+    static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugReportFlagsEXT flags,
         VkDebugReportObjectTypeEXT objType, uint64_t obj, size_t location, int32_t code,
         const char* layerPrefix, const char* msg, void* userData);
 
@@ -113,8 +182,11 @@ public:
      * Initialize vulkan device for graphics using the specified presentation engine
      * @param presentation_engine: the presentation image to use for swapchain creation
      * @param p_allocs: pointer to allocation callbacks to use for vulkan calls
+     * @param verbose: print available extensions, layers and devices, and other diagnostics
+     * @param profiler: profiler to record initialization phases with, or nullptr
      */
-    GraphicsDevice(PresentationEngine* presentation_engine, VkAllocationCallbacks* p_allocs);
+    GraphicsDevice(PresentationEngine* presentation_engine, VkAllocationCallbacks* p_allocs, bool verbose = false,
+        StartupProfiler* profiler = nullptr);
 
     /**
      * Destructor
@@ -122,12 +194,16 @@ public:
     ~GraphicsDevice();
 
     /**
-     * Submit a graphics command buffer that renders to the swapchain
+     * Submit a graphics command buffer that renders to the swapchain, in one batch with the work added to the
+     *  submit queue for the frame. With the submit thread running, the batch is submitted and presented there
      * @param command_buffers array of command buffers to submit with one per swapchain image
-     * @param fence array of fences corresponding to each command buffer to wait on before submission
+     * @param frame_sync tracks completion of each command buffer, with one slot per swapchain image
+     * @param pre_submit called with the swapchain image index once its command buffer is no longer in use and
+     *  before it is submitted, e.g. to re-record it or add work to the frame's batch. May be empty
      * @return true if the command buffer was submitted, or false if not
      */
-    bool submitRenderCommandBuffer(VkCommandBuffer* command_buffers, VkFence* fences);
+    bool submitRenderCommandBuffer(VkCommandBuffer* command_buffers, FrameSync* frame_sync,
+        const std::function<void(uint32_t)>& pre_submit = nullptr);
 
     /**
      * Return a handle to the logical device
@@ -135,6 +211,12 @@ public:
      */
     VkDevice device();
 
+    /**
+     * Return the physical device chosen for rendering
+     * @returns the vulkan physical device
+     */
+    VkPhysicalDevice getPhysicalDevice();
+
     /**
      * Gets the depth/stencil buffer format
      * @return pixel format of depth/stencil buffer
@@ -148,18 +230,66 @@ public:
     VkImageView getDepthStencilView();
 
     /**
-     * Creates a shader module from a SPIR-V file
-     * @param filename Name of file containing shader code
+     * Get depth stencil buffer image
+     * @return vulkan image handle of the depth/stencil buffer
+     */
+    VkImage getDepthStencilImage();
+
+    /**
+     * Creates a shader module from a shader built with the app
+     * @param filename Name of the SPIR-V file the shader was compiled to
      * @return shader module
      */
     VkShaderModule loadShader(const char* filename);
 
+    /**
+     * Gets the SPIR-V of a shader built with the app: embedded in the binary when built with
+     *  VRTEST_EMBEDDED_SHADERS, otherwise read from the working directory. Does not touch the device so may run on
+     *  any thread
+     * @param filename Name of the SPIR-V file the shader was compiled to
+     * @return shader code
+     */
+    static std::vector<char> getShaderCode(const char* filename);
+
+    /**
+     * Gets the reflection data of an embedded shader
+     * @param filename Name of the SPIR-V file the shader was compiled to
+     * @return reflection data, or nullptr if shaders aren't embedded or none has the name
+     */
+    static const ShaderReflection* getShaderReflection(const char* filename);
+
+    /**
+     * Reads a SPIR-V file into memory. Does not touch the device so may run on any thread
+     * @param filename Name of file containing shader code
+     * @return file contents
+     */
+    static std::vector<char> readShaderFile(const char* filename);
+
+    /**
+     * Creates a shader module from SPIR-V code in memory
+     * @param code SPIR-V words
+     * @param code_size size of the code in bytes
+     * @return shader module
+     */
+    VkShaderModule createShaderModule(const uint32_t* code, size_t code_size);
+
     /**
      * Gets graphics queue family
      * @return index of graphics queue family
      */
     uint32_t getGraphicsQueueFamily();
 
+    /**
+     * Gets the graphics queue. Submissions must come from the thread that submits frames, and not be made while
+     *  the submit thread runs; add work to the frame's batch through the submit queue instead
+     */
+    VkQueue getGraphicsQueue();
+
+    /**
+     * Gets the queue frames are submitted and presented through
+     */
+    SubmitQueue* getSubmitQueue();
+
     /**
     * Gets presentation queue family
     * @return index of presentation queue family
@@ -173,4 +303,71 @@ public:
      * @return index of first matching memory type
      */
     uint32_t findMemType(uint32_t type_bits, VkMemoryPropertyFlagBits props);
+
+    /**
+     * Gets properties and limits of the physical device
+     * @return device properties
+     */
+    const VkPhysicalDeviceProperties& getDeviceProperties();
+
+    /**
+     * Check whether diagnostics should be printed
+     */
+    bool isVerbose();
+
+    /**
+     * Check whether timeline semaphores were enabled, either through Vulkan 1.2 or VK_KHR_timeline_semaphore
+     */
+    bool supportsTimelineSemaphores();
+
+    /**
+     * Check whether timeline semaphore entry points must be loaded with the KHR suffix
+     */
+    bool usesTimelineSemaphoreExtension();
+
+    /**
+     * Whether presents report their actual display times through VK_GOOGLE_display_timing
+     */
+    bool supportsDisplayTiming();
+
+    /**
+     * Whether heap budgets are reported through VK_EXT_memory_budget
+     */
+    bool supportsMemoryBudget();
+
+    /**
+     * Whether texture arrays can be partially bound and updated after being bound, through
+     *  VK_EXT_descriptor_indexing
+     */
+    bool supportsDescriptorIndexing();
+
+    /**
+     * Get the most textures a shader stage may access through update-after-bind descriptors, or 0 without
+     *  descriptor indexing
+     */
+    uint32_t getMaxBindlessTextures();
+
+    /**
+     * Whether shaders may index arrays of textures with dynamically uniform expressions, such as push constants
+     */
+    bool supportsTextureArrayIndexing();
+
+    /**
+     * Check whether optimally tiled images of a format can be sampled. Block compressed format families are
+     *  enabled whenever the device supports them
+     */
+    bool supportsSampledFormat(VkFormat format);
+
+    /**
+     * Get the telemetry device memory must be allocated and freed through
+     */
+    MemoryTelemetry* getMemoryTelemetry();
+
+    /**
+     * Get the budget and current usage of device local memory, summed over device local heaps. Without
+     *  VK_EXT_memory_budget the budget is the heap size and usage is what was allocated through the telemetry
+     * @param budget [output] bytes this process can allocate before allocations may fail or degrade
+     * @param usage [output] bytes this process has allocated
+     */
+    void getDeviceLocalBudget(VkDeviceSize* budget, VkDeviceSize* usage);
 };
@@ -0,0 +1,418 @@
+/** @file HostAllocator.cpp
+*
+* @brief Defines pooled host memory allocator exposed to Vulkan through
+*   VkAllocationCallbacks
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/04/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <iomanip>
+
+#include "HostAllocator.h"
+#include "Common.h"
+
+/**
+ * Smallest pool block and number of power of two pools above it (32 bytes to 4KB)
+ */
+#define POOL_MIN_BLOCK 32
+#define POOL_COUNT 8
+
+/**
+ * Bytes carved from the system allocator at a time for pools and arenas
+ */
+#define POOL_CHUNK_SIZE (64 * 1024)
+#define ARENA_CHUNK_SIZE (256 * 1024)
+
+/**
+ * Size class markers for allocations that don't come from a pool
+ */
+#define SIZE_CLASS_LARGE 0xFFFF
+#define SIZE_CLASS_ARENA 0xFFFE
+
+/**
+ * Alignment guaranteed by the header placement without padding
+ */
+#define BASE_ALIGNMENT 16
+
+static const char* scope_names[HOST_ALLOC_SCOPE_COUNT] = {
+    "command", "object", "cache", "device", "instance"
+};
+
+HostAllocator::HostAllocator(uint32_t frames_in_flight) {
+    static_assert(sizeof(Header) == BASE_ALIGNMENT, "Allocation header must preserve base alignment");
+
+    pool_count = POOL_COUNT;
+    pools = new Pool[pool_count];
+    for (uint32_t i = 0; i < pool_count; i++) {
+        pools[i].block_size = static_cast<size_t>(POOL_MIN_BLOCK) << i;
+    }
+
+    arena_count = MAX(frames_in_flight, 1u);
+    arenas = new Arena[arena_count];
+    current_arena = 0;
+
+    for (uint32_t i = 0; i < HOST_ALLOC_SCOPE_COUNT; i++) {
+        counters[i].alloc_calls = 0;
+        counters[i].realloc_calls = 0;
+        counters[i].free_calls = 0;
+        counters[i].bytes_allocated = 0;
+        counters[i].live_bytes = 0;
+        counters[i].peak_bytes = 0;
+        counters[i].internal_bytes = 0;
+    }
+    frame_start = getStats();
+
+    callbacks.pUserData = this;
+    callbacks.pfnAllocation = allocationCallback;
+    callbacks.pfnReallocation = reallocationCallback;
+    callbacks.pfnFree = freeCallback;
+    callbacks.pfnInternalAllocation = internalAllocationCallback;
+    callbacks.pfnInternalFree = internalFreeCallback;
+}
+
+HostAllocator::~HostAllocator() {
+    for (uint32_t i = 0; i < pool_count; i++) {
+        for (void* chunk : pools[i].chunks) {
+            free(chunk);
+        }
+    }
+
+    for (uint32_t i = 0; i < arena_count; i++) {
+        for (uint8_t* chunk : arenas[i].chunks) {
+            free(chunk);
+        }
+    }
+
+    delete[] pools;
+    delete[] arenas;
+}
+
+VkAllocationCallbacks* HostAllocator::getCallbacks() {
+    return &callbacks;
+}
+
+size_t HostAllocator::blockSizeNeeded(size_t size, size_t alignment) {
+    // Alignments beyond the base need room to slide the user pointer forward
+    size_t padding = alignment > BASE_ALIGNMENT ? alignment - BASE_ALIGNMENT : 0;
+    return size + sizeof(Header) + padding;
+}
+
+HostAllocator::Header* HostAllocator::getHeader(void* memory) {
+    return reinterpret_cast<Header*>(static_cast<uint8_t*>(memory) - sizeof(Header));
+}
+
+void* HostAllocator::allocate(size_t size, size_t alignment, VkSystemAllocationScope scope) {
+    if (size == 0) {
+        return nullptr;
+    }
+
+    alignment = MAX(alignment, static_cast<size_t>(1));
+    size_t needed = blockSizeNeeded(size, alignment);
+    uint16_t size_class = SIZE_CLASS_LARGE;
+    uint8_t arena = 0;
+    uint8_t* raw = nullptr;
+
+    if (scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND && needed <= ARENA_CHUNK_SIZE) {
+        // Command scope memory only lives for the duration of a call, so a bump allocator suffices
+        arena = static_cast<uint8_t>(current_arena.load());
+        raw = allocateArena(arena, needed);
+        size_class = SIZE_CLASS_ARENA;
+    }
+    else {
+        for (uint32_t i = 0; i < pool_count; i++) {
+            if (needed <= pools[i].block_size) {
+                raw = static_cast<uint8_t*>(allocatePool(i));
+                size_class = static_cast<uint16_t>(i);
+                break;
+            }
+        }
+    }
+
+    if (size_class == SIZE_CLASS_LARGE) {
+        raw = static_cast<uint8_t*>(malloc(needed));
+    }
+
+    if (!raw) {
+        return nullptr;
+    }
+
+    // Place the user pointer after the header at the requested alignment
+    uintptr_t user = reinterpret_cast<uintptr_t>(raw) + sizeof(Header);
+    user = (user + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+
+    Header* header = getHeader(reinterpret_cast<void*>(user));
+    header->offset = static_cast<uint32_t>(user - reinterpret_cast<uintptr_t>(raw));
+    header->size_class = size_class;
+    header->scope = static_cast<uint8_t>(scope);
+    header->arena = arena;
+    header->size = size;
+
+    countAlloc(scope, size);
+    return reinterpret_cast<void*>(user);
+}
+
+void* HostAllocator::reallocate(void* original, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+    if (!original) {
+        return allocate(size, alignment, scope);
+    }
+    if (size == 0) {
+        release(original);
+        return nullptr;
+    }
+
+    Header* header = getHeader(original);
+    size_t old_size = static_cast<size_t>(header->size);
+    size_t needed = size + header->offset;
+    bool in_place = false;
+
+    // Grow or shrink inside the existing block when it is large enough
+    if (header->size_class < pool_count) {
+        in_place = needed <= pools[header->size_class].block_size;
+    }
+    else if (header->size_class == SIZE_CLASS_ARENA) {
+        Arena& arena = arenas[header->arena];
+        uint8_t* raw = static_cast<uint8_t*>(original) - header->offset;
+
+        std::lock_guard<std::mutex> guard(arena.lock);
+        if (raw == arena.last_alloc && (raw - arena.chunks[arena.chunk_index]) + needed <= ARENA_CHUNK_SIZE) {
+            arena.used = (raw - arena.chunks[arena.chunk_index]) +
+                ((needed + BASE_ALIGNMENT - 1) & ~static_cast<size_t>(BASE_ALIGNMENT - 1));
+            in_place = true;
+        }
+    }
+
+    uint32_t scope_index = header->scope;
+    counters[scope_index].realloc_calls++;
+
+    if (in_place) {
+        header->size = size;
+        countFree(scope_index, old_size);
+        countAlloc(scope_index, size);
+        counters[scope_index].alloc_calls--;
+        counters[scope_index].free_calls--;
+        return original;
+    }
+
+    void* memory = allocate(size, alignment, static_cast<VkSystemAllocationScope>(scope_index));
+    if (!memory) {
+        return nullptr;
+    }
+    counters[scope_index].alloc_calls--;
+
+    memcpy(memory, original, MIN(old_size, size));
+    release(original);
+    counters[scope_index].free_calls--;
+
+    return memory;
+}
+
+void HostAllocator::release(void* memory) {
+    if (!memory) {
+        return;
+    }
+
+    Header* header = getHeader(memory);
+    uint8_t* raw = static_cast<uint8_t*>(memory) - header->offset;
+    countFree(header->scope, static_cast<size_t>(header->size));
+
+    if (header->size_class < pool_count) {
+        releasePool(header->size_class, raw);
+    }
+    else if (header->size_class == SIZE_CLASS_ARENA) {
+        releaseArena(header->arena, raw);
+    }
+    else {
+        free(raw);
+    }
+}
+
+void* HostAllocator::allocatePool(uint32_t size_class) {
+    Pool& pool = pools[size_class];
+    std::lock_guard<std::mutex> guard(pool.lock);
+
+    if (!pool.free_list) {
+        // Carve a new chunk into blocks and thread them onto the free list
+        uint8_t* chunk = static_cast<uint8_t*>(malloc(POOL_CHUNK_SIZE));
+        if (!chunk) {
+            return nullptr;
+        }
+        pool.chunks.push_back(chunk);
+
+        size_t block_count = POOL_CHUNK_SIZE / pool.block_size;
+        for (size_t i = 0; i < block_count; i++) {
+            void* block = chunk + i * pool.block_size;
+            *static_cast<void**>(block) = pool.free_list;
+            pool.free_list = block;
+        }
+    }
+
+    void* block = pool.free_list;
+    pool.free_list = *static_cast<void**>(block);
+    return block;
+}
+
+void HostAllocator::releasePool(uint32_t size_class, void* block) {
+    Pool& pool = pools[size_class];
+    std::lock_guard<std::mutex> guard(pool.lock);
+
+    *static_cast<void**>(block) = pool.free_list;
+    pool.free_list = block;
+}
+
+uint8_t* HostAllocator::allocateArena(uint32_t arena_index, size_t size) {
+    Arena& arena = arenas[arena_index];
+    size = (size + BASE_ALIGNMENT - 1) & ~static_cast<size_t>(BASE_ALIGNMENT - 1);
+
+    std::lock_guard<std::mutex> guard(arena.lock);
+
+    if (arena.chunks.empty() || arena.used + size > ARENA_CHUNK_SIZE) {
+        if (!arena.chunks.empty()) {
+            arena.chunk_index++;
+        }
+        if (arena.chunk_index == arena.chunks.size()) {
+            uint8_t* chunk = static_cast<uint8_t*>(malloc(ARENA_CHUNK_SIZE));
+            if (!chunk) {
+                return nullptr;
+            }
+            arena.chunks.push_back(chunk);
+        }
+        arena.used = 0;
+    }
+
+    uint8_t* raw = arena.chunks[arena.chunk_index] + arena.used;
+    arena.used += size;
+    arena.live_count++;
+    arena.last_alloc = raw;
+
+    return raw;
+}
+
+void HostAllocator::releaseArena(uint32_t arena_index, uint8_t* raw) {
+    Arena& arena = arenas[arena_index];
+    std::lock_guard<std::mutex> guard(arena.lock);
+
+    arena.live_count--;
+
+    // Pop the most recent allocation so scratch alloc/free pairs don't consume the arena
+    if (raw == arena.last_alloc) {
+        arena.used = raw - arena.chunks[arena.chunk_index];
+        arena.last_alloc = nullptr;
+    }
+
+    if (arena.live_count == 0 && arena_index != current_arena.load()) {
+        arena.chunk_index = 0;
+        arena.used = 0;
+    }
+}
+
+void HostAllocator::countAlloc(uint32_t scope, size_t size) {
+    ScopeCounters& counter = counters[scope];
+    counter.alloc_calls++;
+    counter.bytes_allocated += size;
+    uint64_t live = (counter.live_bytes += size);
+
+    uint64_t peak = counter.peak_bytes.load();
+    while (live > peak && !counter.peak_bytes.compare_exchange_weak(peak, live)) {
+    }
+}
+
+void HostAllocator::countFree(uint32_t scope, size_t size) {
+    counters[scope].free_calls++;
+    counters[scope].live_bytes -= size;
+}
+
+void HostAllocator::beginFrame() {
+    uint32_t next = (current_arena.load() + 1) % arena_count;
+
+    {
+        Arena& arena = arenas[next];
+        std::lock_guard<std::mutex> guard(arena.lock);
+        if (arena.live_count == 0) {
+            arena.chunk_index = 0;
+            arena.used = 0;
+            arena.last_alloc = nullptr;
+        }
+    }
+
+    current_arena = next;
+    frame_start = getStats();
+}
+
+HostAllocStats HostAllocator::getStats() {
+    HostAllocStats stats;
+    for (uint32_t i = 0; i < HOST_ALLOC_SCOPE_COUNT; i++) {
+        stats.scopes[i].alloc_calls = counters[i].alloc_calls.load();
+        stats.scopes[i].realloc_calls = counters[i].realloc_calls.load();
+        stats.scopes[i].free_calls = counters[i].free_calls.load();
+        stats.scopes[i].bytes_allocated = counters[i].bytes_allocated.load();
+        stats.scopes[i].live_bytes = counters[i].live_bytes.load();
+        stats.scopes[i].peak_bytes = counters[i].peak_bytes.load();
+        stats.scopes[i].internal_bytes = counters[i].internal_bytes.load();
+    }
+
+    return stats;
+}
+
+HostAllocStats HostAllocator::getFrameStats() {
+    HostAllocStats stats = getStats();
+    for (uint32_t i = 0; i < HOST_ALLOC_SCOPE_COUNT; i++) {
+        stats.scopes[i].alloc_calls -= frame_start.scopes[i].alloc_calls;
+        stats.scopes[i].realloc_calls -= frame_start.scopes[i].realloc_calls;
+        stats.scopes[i].free_calls -= frame_start.scopes[i].free_calls;
+        stats.scopes[i].bytes_allocated -= frame_start.scopes[i].bytes_allocated;
+    }
+
+    return stats;
+}
+
+void HostAllocator::printStats(std::ostream& out) {
+    HostAllocStats stats = getStats();
+
+    out << "Host allocations by scope:\n";
+    out << std::setw(10) << "scope" << std::setw(10) << "allocs" << std::setw(10) << "reallocs"
+        << std::setw(10) << "frees" << std::setw(14) << "bytes" << std::setw(12) << "live"
+        << std::setw(12) << "peak" << std::setw(12) << "internal" << '\n';
+
+    for (uint32_t i = 0; i < HOST_ALLOC_SCOPE_COUNT; i++) {
+        const HostAllocScopeStats& scope = stats.scopes[i];
+        out << std::setw(10) << scope_names[i] << std::setw(10) << scope.alloc_calls
+            << std::setw(10) << scope.realloc_calls << std::setw(10) << scope.free_calls
+            << std::setw(14) << scope.bytes_allocated << std::setw(12) << scope.live_bytes
+            << std::setw(12) << scope.peak_bytes << std::setw(12) << scope.internal_bytes << '\n';
+    }
+    out.flush();
+}
+
+VKAPI_ATTR void* VKAPI_CALL HostAllocator::allocationCallback(void* user_data, size_t size, size_t alignment,
+    VkSystemAllocationScope scope) {
+
+    return static_cast<HostAllocator*>(user_data)->allocate(size, alignment, scope);
+}
+
+VKAPI_ATTR void* VKAPI_CALL HostAllocator::reallocationCallback(void* user_data, void* original, size_t size,
+    size_t alignment, VkSystemAllocationScope scope) {
+
+    return static_cast<HostAllocator*>(user_data)->reallocate(original, size, alignment, scope);
+}
+
+VKAPI_ATTR void VKAPI_CALL HostAllocator::freeCallback(void* user_data, void* memory) {
+    static_cast<HostAllocator*>(user_data)->release(memory);
+}
+
+VKAPI_ATTR void VKAPI_CALL HostAllocator::internalAllocationCallback(void* user_data, size_t size,
+    VkInternalAllocationType /*type*/, VkSystemAllocationScope scope) {
+
+    static_cast<HostAllocator*>(user_data)->counters[scope].internal_bytes += size;
+}
+
+VKAPI_ATTR void VKAPI_CALL HostAllocator::internalFreeCallback(void* user_data, size_t size,
+    VkInternalAllocationType /*type*/, VkSystemAllocationScope scope) {
+
+    static_cast<HostAllocator*>(user_data)->counters[scope].internal_bytes -= size;
+}
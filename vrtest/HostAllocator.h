@@ -0,0 +1,177 @@
+/** @file HostAllocator.h
+*
+* @brief Defines pooled host memory allocator exposed to Vulkan through
+*   VkAllocationCallbacks
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/04/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <ostream>
+
+/**
+ * Number of Vulkan allocation scopes tracked (COMMAND through INSTANCE)
+ */
+#define HOST_ALLOC_SCOPE_COUNT 5
+
+/**
+ * Snapshot of allocation counters for one scope
+ */
+struct HostAllocScopeStats {
+    uint64_t alloc_calls;
+    uint64_t realloc_calls;
+    uint64_t free_calls;
+    uint64_t bytes_allocated;
+    uint64_t live_bytes;
+    uint64_t peak_bytes;
+    uint64_t internal_bytes;
+};
+
+/**
+ * Snapshot of allocation counters for all scopes
+ */
+struct HostAllocStats {
+    HostAllocScopeStats scopes[HOST_ALLOC_SCOPE_COUNT];
+};
+
+class HostAllocator {
+private:
+    /**
+     * Header stored directly in front of every pointer handed to Vulkan
+     */
+    struct Header {
+        uint32_t offset;
+        uint16_t size_class;
+        uint8_t scope;
+        uint8_t arena;
+        uint64_t size;
+    };
+
+    /**
+     * Fixed size block pool. Free blocks are linked through their first bytes
+     */
+    struct Pool {
+        std::mutex lock;
+        size_t block_size;
+        void* free_list = nullptr;
+        std::vector<void*> chunks;
+    };
+
+    /**
+     * Bump allocator for command scope allocations, reset once per frame
+     */
+    struct Arena {
+        std::mutex lock;
+        std::vector<uint8_t*> chunks;
+        size_t chunk_index = 0;
+        size_t used = 0;
+        uint32_t live_count = 0;
+        uint8_t* last_alloc = nullptr;
+    };
+
+    /**
+     * Live counters for one scope
+     */
+    struct ScopeCounters {
+        std::atomic<uint64_t> alloc_calls;
+        std::atomic<uint64_t> realloc_calls;
+        std::atomic<uint64_t> free_calls;
+        std::atomic<uint64_t> bytes_allocated;
+        std::atomic<uint64_t> live_bytes;
+        std::atomic<uint64_t> peak_bytes;
+        std::atomic<uint64_t> internal_bytes;
+    };
+
+    /**
+     * Callbacks handed to Vulkan, pointing back at this allocator
+     */
+    VkAllocationCallbacks callbacks;
+
+    Pool* pools;
+    uint32_t pool_count;
+
+    Arena* arenas;
+    uint32_t arena_count;
+    std::atomic<uint32_t> current_arena;
+
+    ScopeCounters counters[HOST_ALLOC_SCOPE_COUNT];
+
+    /**
+     * Counters at the start of the current frame, for per-frame reporting
+     */
+    HostAllocStats frame_start;
+
+    void* allocate(size_t size, size_t alignment, VkSystemAllocationScope scope);
+    void* reallocate(void* original, size_t size, size_t alignment, VkSystemAllocationScope scope);
+    void release(void* memory);
+
+    void* allocatePool(uint32_t size_class);
+    void releasePool(uint32_t size_class, void* block);
+    uint8_t* allocateArena(uint32_t arena_index, size_t size);
+    void releaseArena(uint32_t arena_index, uint8_t* raw);
+
+    void countAlloc(uint32_t scope, size_t size);
+    void countFree(uint32_t scope, size_t size);
+
+    static size_t blockSizeNeeded(size_t size, size_t alignment);
+    static Header* getHeader(void* memory);
+
+    static VKAPI_ATTR void* VKAPI_CALL allocationCallback(void* user_data, size_t size, size_t alignment,
+        VkSystemAllocationScope scope);
+    static VKAPI_ATTR void* VKAPI_CALL reallocationCallback(void* user_data, void* original, size_t size,
+        size_t alignment, VkSystemAllocationScope scope);
+    static VKAPI_ATTR void VKAPI_CALL freeCallback(void* user_data, void* memory);
+    static VKAPI_ATTR void VKAPI_CALL internalAllocationCallback(void* user_data, size_t size,
+        VkInternalAllocationType type, VkSystemAllocationScope scope);
+    static VKAPI_ATTR void VKAPI_CALL internalFreeCallback(void* user_data, size_t size,
+        VkInternalAllocationType type, VkSystemAllocationScope scope);
+
+public:
+    /**
+     * Create allocator with empty pools
+     * @param frames_in_flight number of per-frame arenas used for command scope allocations
+     */
+    HostAllocator(uint32_t frames_in_flight);
+
+    /**
+     * Releases all pool and arena memory. Every Vulkan object created with these callbacks must be
+     *  destroyed first
+     */
+    ~HostAllocator();
+
+    /**
+     * Get the callbacks to pass as pAllocator to Vulkan
+     */
+    VkAllocationCallbacks* getCallbacks();
+
+    /**
+     * Mark the start of a frame. Switches to the next command scope arena, resetting it if it has no live
+     *  allocations, and restarts per-frame counters
+     */
+    void beginFrame();
+
+    /**
+     * Get counters accumulated since the allocator was created
+     */
+    HostAllocStats getStats();
+
+    /**
+     * Get counters accumulated since the last beginFrame
+     */
+    HostAllocStats getFrameStats();
+
+    /**
+     * Write a per-scope table of counters
+     * @param out stream to write to
+     */
+    void printStats(std::ostream& out);
+};
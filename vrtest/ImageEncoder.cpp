@@ -0,0 +1,244 @@
+/** @file ImageEncoder.cpp
+*
+* @brief Defines encoders that write 8-bit images to raw, PNG and QOI files
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/16/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include <string.h>
+
+#include "ImageEncoder.h"
+#include "Common.h"
+
+static void putU32BE(std::vector<uint8_t>* out, uint32_t value) {
+    out->push_back(static_cast<uint8_t>(value >> 24));
+    out->push_back(static_cast<uint8_t>(value >> 16));
+    out->push_back(static_cast<uint8_t>(value >> 8));
+    out->push_back(static_cast<uint8_t>(value));
+}
+
+struct CrcTable {
+    uint32_t values[256];
+
+    CrcTable() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t value = i;
+            for (uint32_t bit = 0; bit < 8; bit++) {
+                value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+            }
+            values[i] = value;
+        }
+    }
+};
+
+static uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc) {
+    // Function local so it is built once even if several threads encode
+    static const CrcTable table;
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = table.values[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// Append a PNG chunk, computing its CRC over the type and data
+static void putPngChunk(std::vector<uint8_t>* out, const char* type, const uint8_t* data, size_t size) {
+    putU32BE(out, static_cast<uint32_t>(size));
+    size_t type_offset = out->size();
+    out->insert(out->end(), type, type + 4);
+    out->insert(out->end(), data, data + size);
+    putU32BE(out, crc32(out->data() + type_offset, size + 4, 0));
+}
+
+static void encodePng(const uint8_t* pixels, uint32_t width, uint32_t height, bool bgra,
+    std::vector<uint8_t>* out) {
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    out->insert(out->end(), signature, signature + 8);
+
+    // 8-bit RGB, no interlacing
+    uint8_t header[13] = {
+        static_cast<uint8_t>(width >> 24), static_cast<uint8_t>(width >> 16),
+        static_cast<uint8_t>(width >> 8), static_cast<uint8_t>(width),
+        static_cast<uint8_t>(height >> 24), static_cast<uint8_t>(height >> 16),
+        static_cast<uint8_t>(height >> 8), static_cast<uint8_t>(height),
+        8, 2, 0, 0, 0
+    };
+    putPngChunk(out, "IHDR", header, sizeof(header));
+
+    // Scanlines with filter type 0, converted to RGB
+    size_t row_size = 1 + static_cast<size_t>(width) * 3;
+    std::vector<uint8_t> raw(row_size * height);
+    uint32_t r = bgra ? 2 : 0;
+    uint32_t b = bgra ? 0 : 2;
+    for (uint32_t y = 0; y < height; y++) {
+        uint8_t* row = raw.data() + y * row_size;
+        const uint8_t* src = pixels + static_cast<size_t>(y) * width * 4;
+        row[0] = 0;
+        for (uint32_t x = 0; x < width; x++) {
+            row[1 + x * 3] = src[x * 4 + r];
+            row[2 + x * 3] = src[x * 4 + 1];
+            row[3 + x * 3] = src[x * 4 + b];
+        }
+    }
+
+    // zlib stream of stored deflate blocks. Skipping compression keeps encoding at memory speed
+    std::vector<uint8_t> zlib;
+    zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+
+    size_t offset = 0;
+    do {
+        size_t block = MIN(raw.size() - offset, static_cast<size_t>(65535));
+        bool final_block = offset + block == raw.size();
+        zlib.push_back(final_block ? 1 : 0);
+        zlib.push_back(static_cast<uint8_t>(block));
+        zlib.push_back(static_cast<uint8_t>(block >> 8));
+        zlib.push_back(static_cast<uint8_t>(~block));
+        zlib.push_back(static_cast<uint8_t>(~block >> 8));
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + block);
+        offset += block;
+    } while (offset < raw.size());
+
+    // Adler-32, deferring the modulo as long as the sums can't overflow
+    uint32_t a = 1;
+    uint32_t s = 0;
+    offset = 0;
+    while (offset < raw.size()) {
+        size_t chunk = MIN(raw.size() - offset, static_cast<size_t>(5552));
+        for (size_t i = 0; i < chunk; i++) {
+            a += raw[offset + i];
+            s += a;
+        }
+        a %= 65521;
+        s %= 65521;
+        offset += chunk;
+    }
+    putU32BE(&zlib, (s << 16) | a);
+
+    putPngChunk(out, "IDAT", zlib.data(), zlib.size());
+    putPngChunk(out, "IEND", nullptr, 0);
+}
+
+static void encodeQoi(const uint8_t* pixels, uint32_t width, uint32_t height, bool bgra,
+    std::vector<uint8_t>* out) {
+    out->insert(out->end(), { 'q', 'o', 'i', 'f' });
+    putU32BE(out, width);
+    putU32BE(out, height);
+    out->push_back(3);
+    out->push_back(0);
+
+    uint32_t r = bgra ? 2 : 0;
+    uint32_t b = bgra ? 0 : 2;
+
+    // Pixels seen recently, indexed by hash. Alpha is always 255 since it isn't stored
+    uint8_t index[64][4];
+    memset(index, 0, sizeof(index));
+    uint8_t prev[4] = { 0, 0, 0, 255 };
+    uint32_t run = 0;
+
+    size_t pixel_count = static_cast<size_t>(width) * height;
+    for (size_t i = 0; i < pixel_count; i++) {
+        const uint8_t* src = pixels + i * 4;
+        uint8_t px[4] = { src[r], src[1], src[b], 255 };
+
+        if (memcmp(px, prev, 4) == 0) {
+            run++;
+            if (run == 62 || i + 1 == pixel_count) {
+                out->push_back(static_cast<uint8_t>(0xC0 | (run - 1)));
+                run = 0;
+            }
+            continue;
+        }
+
+        if (run > 0) {
+            out->push_back(static_cast<uint8_t>(0xC0 | (run - 1)));
+            run = 0;
+        }
+
+        uint32_t hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+        if (memcmp(index[hash], px, 4) == 0) {
+            out->push_back(static_cast<uint8_t>(hash));
+        }
+        else {
+            memcpy(index[hash], px, 4);
+
+            int dr = static_cast<int8_t>(px[0] - prev[0]);
+            int dg = static_cast<int8_t>(px[1] - prev[1]);
+            int db = static_cast<int8_t>(px[2] - prev[2]);
+            int dr_dg = dr - dg;
+            int db_dg = db - dg;
+
+            if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                out->push_back(static_cast<uint8_t>(0x40 | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2)));
+            }
+            else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7) {
+                out->push_back(static_cast<uint8_t>(0x80 | (dg + 32)));
+                out->push_back(static_cast<uint8_t>(((dr_dg + 8) << 4) | (db_dg + 8)));
+            }
+            else {
+                out->push_back(0xFE);
+                out->push_back(px[0]);
+                out->push_back(px[1]);
+                out->push_back(px[2]);
+            }
+        }
+
+        memcpy(prev, px, 4);
+    }
+
+    static const uint8_t end_marker[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    out->insert(out->end(), end_marker, end_marker + 8);
+}
+
+void encodeImage(ImageFileFormat format, const uint8_t* pixels, uint32_t width, uint32_t height, bool bgra,
+    std::vector<uint8_t>* out) {
+    out->clear();
+
+    switch (format) {
+    case ImageFileFormat::Raw:
+        out->assign(pixels, pixels + static_cast<size_t>(width) * height * 4);
+        break;
+    case ImageFileFormat::Png:
+        encodePng(pixels, width, height, bgra, out);
+        break;
+    case ImageFileFormat::Qoi:
+        encodeQoi(pixels, width, height, bgra, out);
+        break;
+    }
+}
+
+const char* getImageFileExtension(ImageFileFormat format) {
+    switch (format) {
+    case ImageFileFormat::Raw:
+        return "raw";
+    case ImageFileFormat::Png:
+        return "png";
+    case ImageFileFormat::Qoi:
+        return "qoi";
+    }
+
+    return "";
+}
+
+bool parseImageFileFormat(const char* name, ImageFileFormat* format) {
+    if (strcmp(name, "raw") == 0) {
+        *format = ImageFileFormat::Raw;
+    }
+    else if (strcmp(name, "png") == 0) {
+        *format = ImageFileFormat::Png;
+    }
+    else if (strcmp(name, "qoi") == 0) {
+        *format = ImageFileFormat::Qoi;
+    }
+    else {
+        return false;
+    }
+
+    return true;
+}
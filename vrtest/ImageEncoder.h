@@ -0,0 +1,47 @@
+/** @file ImageEncoder.h
+*
+* @brief Defines encoders that write 8-bit images to raw, PNG and QOI files
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/16/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+
+/**
+ * File formats for captured images. Raw is the pixels as read back, PNG is stored (uncompressed) deflate so
+ *  it is cheap to write, and QOI is a fast lossless compressed format
+ */
+enum class ImageFileFormat {
+    Raw,
+    Png,
+    Qoi
+};
+
+/**
+ * Encode a tightly packed image with 4 bytes per pixel. PNG and QOI drop the alpha channel
+ * @param format file format to encode
+ * @param pixels RGBA or BGRA pixels, row by row from the top
+ * @param width image width
+ * @param height image height
+ * @param bgra true if pixels are BGRA, false if RGBA
+ * @param out [output] encoded file contents, replacing any previous contents
+ */
+void encodeImage(ImageFileFormat format, const uint8_t* pixels, uint32_t width, uint32_t height, bool bgra,
+    std::vector<uint8_t>* out);
+
+/**
+ * Get the file extension of a format, without the dot
+ */
+const char* getImageFileExtension(ImageFileFormat format);
+
+/**
+ * Parse a format name ("raw", "png" or "qoi")
+ * @return false if the name is not a known format
+ */
+bool parseImageFileFormat(const char* name, ImageFileFormat* format);
@@ -0,0 +1,287 @@
+/** @file JobSystem.cpp
+*
+* @brief Defines a work-stealing job scheduler for fine-grained engine tasks
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/26/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include <iostream>
+#include <stdexcept>
+
+#include "JobSystem.h"
+#include "Common.h"
+
+/**
+ * Slots of the job ring checked for a free job before helping to run jobs
+ */
+#define JOB_ALLOC_SCAN 64
+
+/**
+ * Job system and worker the current thread belongs to
+ */
+static thread_local JobSystem* current_system = nullptr;
+static thread_local uint32_t current_index = 0;
+
+JobSystem::JobSystem(uint32_t thread_count, uint32_t job_capacity) : stopping(false), sleeping(0) {
+    if (thread_count == 0) {
+        thread_count = MAX(std::thread::hardware_concurrency(), 1u);
+    }
+
+    this->job_capacity = 1;
+    while (this->job_capacity < job_capacity) {
+        this->job_capacity <<= 1;
+    }
+
+    for (uint32_t i = 0; i < thread_count; i++) {
+        Worker* worker = new Worker(this->job_capacity);
+        worker->jobs = new Job[this->job_capacity];
+        for (uint32_t j = 0; j < this->job_capacity; j++) {
+            worker->jobs[j].counter = nullptr;
+            worker->jobs[j].in_use.store(false, std::memory_order_relaxed);
+        }
+        worker->rng = 0x9E3779B9u * (i + 1);
+        workers.push_back(worker);
+    }
+
+    current_system = this;
+    current_index = 0;
+
+    for (uint32_t i = 1; i < thread_count; i++) {
+        threads.push_back(std::thread(&JobSystem::workerLoop, this, i));
+    }
+}
+
+JobSystem::~JobSystem() {
+    stopping.store(true);
+    {
+        std::lock_guard<std::mutex> guard(sleep_lock);
+        wake.notify_all();
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (Worker* worker : workers) {
+        delete[] worker->jobs;
+        delete worker;
+    }
+
+    if (current_system == this) {
+        current_system = nullptr;
+    }
+}
+
+JobSystem::Worker* JobSystem::getCurrentWorker() {
+    if (current_system != this) {
+        throw std::runtime_error("Jobs can only be started from job system threads");
+    }
+    return workers[current_index];
+}
+
+Job* JobSystem::allocateJob(Worker* worker) {
+    while (true) {
+        for (uint32_t i = 0; i < JOB_ALLOC_SCAN; i++) {
+            Job* job = &worker->jobs[worker->next_job & (job_capacity - 1)];
+            worker->next_job++;
+            if (!job->in_use.load(std::memory_order_acquire)) {
+                job->in_use.store(true, std::memory_order_relaxed);
+                return job;
+            }
+        }
+
+        // Every job nearby is still queued or running, so help finish some before trying again
+        Job* other = findJob(worker);
+        if (other) {
+            execute(other);
+        }
+        else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void JobSystem::schedule(Job* job) {
+    Worker* worker = getCurrentWorker();
+    if (!worker->deque.push(job)) {
+        execute(job);
+        return;
+    }
+    wakeWorkers(1);
+}
+
+Job* JobSystem::findJob(Worker* worker) {
+    Job* job;
+    if (worker->deque.pop(&job)) {
+        return job;
+    }
+
+    // Steal from a random victim first, so thieves spread over the other threads
+    uint32_t count = static_cast<uint32_t>(workers.size());
+    if (count > 1) {
+        worker->rng ^= worker->rng << 13;
+        worker->rng ^= worker->rng >> 17;
+        worker->rng ^= worker->rng << 5;
+
+        uint32_t start = worker->rng % count;
+        for (uint32_t i = 0; i < count; i++) {
+            Worker* victim = workers[(start + i) % count];
+            if (victim != worker && victim->deque.steal(&job)) {
+                return job;
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+void JobSystem::execute(Job* job) {
+    try {
+        job->function();
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Job failed: " << e.what() << std::endl;
+    }
+    catch (...) {
+        // The counter must still be finished, or waiters hang
+        std::cerr << "Job failed" << std::endl;
+    }
+
+    JobCounter* counter = job->counter;
+    job->function = nullptr;
+    job->in_use.store(false, std::memory_order_release);
+
+    if (!counter) {
+        return;
+    }
+
+    // Waiters return once both count and finishing are zero, so the counter stays valid until finishing drops
+    counter->finishing.fetch_add(1);
+    if (counter->count.fetch_sub(1) == 1) {
+        std::vector<Job*> ready;
+        {
+            std::lock_guard<std::mutex> guard(counter->lock);
+            ready.swap(counter->continuations);
+        }
+        for (Job* continuation : ready) {
+            schedule(continuation);
+        }
+    }
+    counter->finishing.fetch_sub(1, std::memory_order_release);
+}
+
+bool JobSystem::hasQueuedJobs() {
+    for (Worker* worker : workers) {
+        if (!worker->deque.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void JobSystem::wakeWorkers(uint32_t count) {
+    // Pairs with the fence in workerLoop: either the worker sees the new job or this sees the worker asleep
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(sleep_lock);
+    for (uint32_t i = 0; i < count; i++) {
+        wake.notify_one();
+    }
+}
+
+void JobSystem::workerLoop(uint32_t index) {
+    current_system = this;
+    current_index = index;
+    Worker* worker = workers[index];
+
+    uint32_t idle = 0;
+    while (!stopping.load(std::memory_order_acquire)) {
+        Job* job = findJob(worker);
+        if (job) {
+            execute(job);
+            idle = 0;
+            continue;
+        }
+
+        if (++idle < spin_count) {
+            if (idle % 64 == 0) {
+                std::this_thread::yield();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> guard(sleep_lock);
+        sleeping.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!stopping.load() && !hasQueuedJobs()) {
+            wake.wait(guard);
+        }
+        sleeping.fetch_sub(1);
+        idle = 0;
+    }
+}
+
+void JobSystem::run(JobFunction function, JobCounter* counter) {
+    Job* job = allocateJob(getCurrentWorker());
+    job->function = std::move(function);
+    job->counter = counter;
+    if (counter) {
+        counter->count.fetch_add(1);
+    }
+    schedule(job);
+}
+
+void JobSystem::runAfter(JobCounter* dependency, JobFunction function, JobCounter* counter) {
+    Job* job = allocateJob(getCurrentWorker());
+    job->function = std::move(function);
+    job->counter = counter;
+    if (counter) {
+        counter->count.fetch_add(1);
+    }
+
+    // The last job of the dependency swaps out continuations under the same lock after reaching zero
+    {
+        std::lock_guard<std::mutex> guard(dependency->lock);
+        if (dependency->count.load() != 0) {
+            dependency->continuations.push_back(job);
+            return;
+        }
+    }
+    schedule(job);
+}
+
+void JobSystem::wait(JobCounter* counter) {
+    Worker* worker = getCurrentWorker();
+    while (!counter->isDone()) {
+        Job* job = findJob(worker);
+        if (job) {
+            execute(job);
+        }
+        else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void JobSystem::parallelFor(uint32_t count, uint32_t batch_size,
+    const std::function<void(uint32_t, uint32_t)>& function) {
+
+    batch_size = MAX(batch_size, 1u);
+    JobCounter counter;
+    for (uint32_t begin = 0; begin < count; begin += batch_size) {
+        uint32_t end = count - begin > batch_size ? begin + batch_size : count;
+        run([&function, begin, end]() { function(begin, end); }, &counter);
+    }
+    wait(&counter);
+}
+
+uint32_t JobSystem::getThreadCount() {
+    return static_cast<uint32_t>(workers.size());
+}
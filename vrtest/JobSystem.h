@@ -0,0 +1,191 @@
+/** @file JobSystem.h
+*
+* @brief Defines a work-stealing job scheduler for fine-grained engine tasks
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/26/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "WorkStealingDeque.h"
+
+typedef std::function<void()> JobFunction;
+
+struct Job;
+
+/**
+ * Counts unfinished jobs. Jobs started with a counter increment it and decrement it when they finish. Waiting on a
+ *  counter runs other jobs in the meantime, and jobs started with runAfter are held until their counter reaches
+ *  zero. A counter may be reused once it has reached zero and nothing is waiting on it
+ */
+class JobCounter {
+private:
+    friend class JobSystem;
+
+    std::atomic<uint32_t> count;
+
+    /**
+     * Threads still releasing continuations after a decrement, so a waiter can't destroy the counter under them
+     */
+    std::atomic<uint32_t> finishing;
+
+    /**
+     * Jobs held until the count reaches zero
+     */
+    std::mutex lock;
+    std::vector<Job*> continuations;
+
+public:
+    JobCounter() : count(0), finishing(0) {}
+
+    /**
+     * Check whether every job counted has finished
+     */
+    bool isDone() const {
+        return count.load(std::memory_order_acquire) == 0 && finishing.load(std::memory_order_acquire) == 0;
+    }
+};
+
+/**
+ * Scheduled unit of work. Jobs are recycled through per-thread rings, so starting one doesn't allocate unless the
+ *  function's captures exceed std::function's inline storage
+ */
+struct Job {
+    JobFunction function;
+    JobCounter* counter;
+    std::atomic<bool> in_use;
+};
+
+/**
+ * Runs jobs on one worker thread per core plus the thread that created the system. Each thread pushes the jobs
+ *  it starts onto its own deque and runs them newest first; threads that run dry steal the oldest jobs of a
+ *  random other thread, so work spreads without a shared queue to contend on. Idle workers spin briefly before
+ *  sleeping. The creating thread only runs jobs while it waits on a counter.
+ *
+ * Jobs may be started from the creating thread and from jobs, but not from other threads
+ */
+class JobSystem {
+private:
+    /**
+     * Per-thread scheduling state. Index 0 is the creating thread
+     */
+    struct Worker {
+        WorkStealingDeque<Job*> deque;
+
+        /**
+         * Ring of jobs this thread allocates from
+         */
+        Job* jobs;
+        uint32_t next_job = 0;
+
+        /**
+         * State of the random victim choice
+         */
+        uint32_t rng;
+
+        Worker(uint32_t capacity) : deque(capacity) {}
+    };
+
+    std::vector<Worker*> workers;
+    std::vector<std::thread> threads;
+
+    /**
+     * Jobs each thread can have allocated or queued at once
+     */
+    uint32_t job_capacity;
+
+    std::atomic<bool> stopping;
+
+    /**
+     * Workers that are asleep or about to sleep, so starting a job only takes the lock when someone is asleep
+     */
+    std::atomic<uint32_t> sleeping;
+    std::mutex sleep_lock;
+    std::condition_variable wake;
+
+    /**
+     * Idle iterations a worker spins before sleeping
+     */
+    uint32_t spin_count = 2000;
+
+    void workerLoop(uint32_t index);
+
+    Worker* getCurrentWorker();
+    Job* allocateJob(Worker* worker);
+
+    /**
+     * Queue a ready job on the current thread's deque, running it inline if the deque is full
+     */
+    void schedule(Job* job);
+
+    /**
+     * Take a job from the current thread's deque, or steal one
+     * @return nullptr if none was found
+     */
+    Job* findJob(Worker* worker);
+
+    /**
+     * Run a job, finish its counter and release continuations that were waiting on it
+     */
+    void execute(Job* job);
+
+    bool hasQueuedJobs();
+    void wakeWorkers(uint32_t count);
+
+public:
+    /**
+     * Start worker threads
+     * @param thread_count threads that run jobs including the creating thread, or 0 for the hardware thread count
+     * @param job_capacity jobs each thread can have outstanding at once, rounded up to a power of two
+     */
+    JobSystem(uint32_t thread_count, uint32_t job_capacity = 4096);
+
+    /**
+     * Joins workers. Jobs still queued are not run, so wait on counters first
+     */
+    ~JobSystem();
+
+    /**
+     * Start a job
+     * @param function work to run. Exceptions thrown by the job are caught and discarded
+     * @param counter counter to increment until the job finishes, or nullptr
+     */
+    void run(JobFunction function, JobCounter* counter = nullptr);
+
+    /**
+     * Start a job once every job counted by a dependency has finished
+     * @param dependency counter to wait for
+     * @param function work to run
+     * @param counter counter to increment until the job finishes, or nullptr. Incremented immediately
+     */
+    void runAfter(JobCounter* dependency, JobFunction function, JobCounter* counter = nullptr);
+
+    /**
+     * Run jobs until a counter reaches zero
+     */
+    void wait(JobCounter* counter);
+
+    /**
+     * Run a function over a range split into batches, and wait for all of them
+     * @param count size of the range
+     * @param batch_size indices per job
+     * @param function called with the begin and end of each batch
+     */
+    void parallelFor(uint32_t count, uint32_t batch_size, const std::function<void(uint32_t, uint32_t)>& function);
+
+    /**
+     * Get the number of threads running jobs, including the creating thread
+     */
+    uint32_t getThreadCount();
+};
@@ -0,0 +1,214 @@
+/** @file Ktx2TextureSource.cpp
+*
+* @brief Defines texture source that reads mip levels from KTX2 containers
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/22/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include <iostream>
+#include <stdexcept>
+#include <string.h>
+
+#include "Ktx2TextureSource.h"
+#include "BlockDecoder.h"
+#include "Common.h"
+
+static const uint8_t ktx2_identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+/**
+ * Fixed part of the KTX2 header, following the identifier. All fields are little endian
+ */
+struct Ktx2Header {
+    uint32_t vk_format;
+    uint32_t type_size;
+    uint32_t pixel_width;
+    uint32_t pixel_height;
+    uint32_t pixel_depth;
+    uint32_t layer_count;
+    uint32_t face_count;
+    uint32_t level_count;
+    uint32_t supercompression_scheme;
+    uint32_t dfd_offset;
+    uint32_t dfd_length;
+    uint32_t kvd_offset;
+    uint32_t kvd_length;
+    uint64_t sgd_offset;
+    uint64_t sgd_length;
+};
+
+#define KTX2_HEADER_SIZE 80
+#define KTX2_LEVEL_INDEX_ENTRY_SIZE 24
+
+static uint32_t readLittleEndian32(const uint8_t* data) {
+    return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+static uint64_t readLittleEndian64(const uint8_t* data) {
+    return readLittleEndian32(data) | (static_cast<uint64_t>(readLittleEndian32(data + 4)) << 32);
+}
+
+/**
+ * Read the identifier and header
+ * @return false if the file isn't KTX2
+ */
+static bool readHeader(std::ifstream& file, Ktx2Header* header) {
+    uint8_t data[KTX2_HEADER_SIZE];
+    file.read(reinterpret_cast<char*>(data), KTX2_HEADER_SIZE);
+    if (!file || memcmp(data, ktx2_identifier, sizeof(ktx2_identifier)) != 0) {
+        return false;
+    }
+
+    const uint8_t* field = data + sizeof(ktx2_identifier);
+    uint32_t* fields32[] = { &header->vk_format, &header->type_size, &header->pixel_width, &header->pixel_height,
+        &header->pixel_depth, &header->layer_count, &header->face_count, &header->level_count,
+        &header->supercompression_scheme, &header->dfd_offset, &header->dfd_length, &header->kvd_offset,
+        &header->kvd_length };
+    for (uint32_t* value : fields32) {
+        *value = readLittleEndian32(field);
+        field += 4;
+    }
+    header->sgd_offset = readLittleEndian64(field);
+    header->sgd_length = readLittleEndian64(field + 8);
+    return true;
+}
+
+Ktx2TextureSource::Ktx2TextureSource(const std::string& filename, GraphicsDevice* graphics_device) {
+    file.open(filename, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open texture file " + filename);
+    }
+
+    Ktx2Header header;
+    if (!readHeader(file, &header)) {
+        throw std::runtime_error("Failed to read KTX2 header of " + filename);
+    }
+    if (header.supercompression_scheme != 0) {
+        throw std::runtime_error("Supercompressed KTX2 textures are not supported");
+    }
+    if (header.pixel_height == 0 || header.pixel_depth > 1 || header.layer_count > 1 || header.face_count != 1) {
+        throw std::runtime_error("Only 2D KTX2 textures are supported");
+    }
+
+    file_format = static_cast<VkFormat>(header.vk_format);
+    extent = { header.pixel_width, header.pixel_height };
+
+    FormatBlockInfo block_info;
+    if (!getFormatBlockInfo(file_format, &block_info)) {
+        throw std::runtime_error("Unsupported KTX2 texture format");
+    }
+
+    if (graphics_device->supportsSampledFormat(file_format)) {
+        format = file_format;
+        decode = false;
+    }
+    else if (canDecodeFormat(file_format) && graphics_device->supportsSampledFormat(getDecodedFormat(file_format))) {
+        format = getDecodedFormat(file_format);
+        decode = true;
+        std::cout << "Decoding " << filename << " on the CPU, format " << file_format << " is not supported"
+            << std::endl;
+    }
+    else {
+        throw std::runtime_error("KTX2 texture format is not supported by the device");
+    }
+
+    // A level count of 0 asks the loader to generate mips, which isn't supported here, so only level 0 is used
+    uint32_t level_count = MAX(header.level_count, 1u);
+    std::vector<uint8_t> index(static_cast<size_t>(level_count) * KTX2_LEVEL_INDEX_ENTRY_SIZE);
+    file.read(reinterpret_cast<char*>(index.data()), index.size());
+    if (!file) {
+        throw std::runtime_error("Failed to read KTX2 level index of " + filename);
+    }
+
+    levels.resize(level_count);
+    for (uint32_t i = 0; i < level_count; i++) {
+        const uint8_t* entry = index.data() + i * KTX2_LEVEL_INDEX_ENTRY_SIZE;
+        levels[i].offset = readLittleEndian64(entry);
+        levels[i].length = readLittleEndian64(entry + 8);
+
+        VkExtent2D mip_extent = getMipExtent(extent, i);
+        if (levels[i].length < getFormatLevelSize(file_format, mip_extent.width, mip_extent.height)) {
+            throw std::runtime_error("KTX2 level is smaller than its extent requires");
+        }
+    }
+}
+
+VkFormat Ktx2TextureSource::getFileFormat() {
+    return file_format;
+}
+
+bool Ktx2TextureSource::isDecoding() {
+    return decode;
+}
+
+VkFormat Ktx2TextureSource::getFormat() {
+    return format;
+}
+
+VkExtent2D Ktx2TextureSource::getExtent() {
+    return extent;
+}
+
+uint32_t Ktx2TextureSource::getMipCount() {
+    return static_cast<uint32_t>(levels.size());
+}
+
+VkDeviceSize Ktx2TextureSource::getMipSize(uint32_t level) {
+    VkExtent2D mip_extent = getMipExtent(extent, level);
+    return getFormatLevelSize(format, mip_extent.width, mip_extent.height);
+}
+
+void Ktx2TextureSource::loadMip(uint32_t level, std::vector<uint8_t>* data) {
+    VkExtent2D mip_extent = getMipExtent(extent, level);
+    size_t stored_size = static_cast<size_t>(getFormatLevelSize(file_format, mip_extent.width, mip_extent.height));
+
+    // Blocks the device can sample are read straight into the upload data
+    std::vector<uint8_t>* target = decode ? &encoded : data;
+    target->resize(stored_size);
+
+    file.clear();
+    file.seekg(static_cast<std::streamoff>(levels[level].offset));
+    file.read(reinterpret_cast<char*>(target->data()), stored_size);
+    if (!file) {
+        throw std::runtime_error("Failed to read KTX2 level " + std::to_string(level));
+    }
+
+    if (decode) {
+        data->resize(static_cast<size_t>(mip_extent.width) * mip_extent.height * 4);
+        decodeBlocks(file_format, encoded.data(), mip_extent.width, mip_extent.height, data->data());
+    }
+}
+
+VkFormat readKtx2Format(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    Ktx2Header header;
+    if (!file.is_open() || !readHeader(file, &header)) {
+        return VK_FORMAT_UNDEFINED;
+    }
+    return static_cast<VkFormat>(header.vk_format);
+}
+
+Ktx2TextureSource* openKtx2Texture(GraphicsDevice* graphics_device, const std::vector<std::string>& filenames) {
+    const std::string* decodable = nullptr;
+
+    for (const std::string& filename : filenames) {
+        VkFormat file_format = readKtx2Format(filename);
+        if (file_format == VK_FORMAT_UNDEFINED) {
+            continue;
+        }
+        if (graphics_device->supportsSampledFormat(file_format)) {
+            return new Ktx2TextureSource(filename, graphics_device);
+        }
+        if (decodable == nullptr && canDecodeFormat(file_format)) {
+            decodable = &filename;
+        }
+    }
+
+    if (decodable == nullptr) {
+        throw std::runtime_error("No texture file in a format the device supports");
+    }
+    return new Ktx2TextureSource(*decodable, graphics_device);
+}
@@ -0,0 +1,99 @@
+/** @file Ktx2TextureSource.h
+*
+* @brief Defines texture source that reads mip levels from KTX2 containers
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/22/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "GraphicsDevice.h"
+#include "TextureSource.h"
+
+/**
+ * Reads 2D textures from KTX2 files, one level at a time. Levels in a format the device can sample, including
+ *  BC, ETC2 and ASTC blocks, are passed through untouched and uploaded as they are stored. Otherwise levels
+ *  are decoded to RGBA8 on the loader thread, which is supported for BC1-5 and ETC2. Supercompressed files,
+ *  arrays, cube maps and 3D textures aren't supported
+ */
+class Ktx2TextureSource : public TextureSource {
+private:
+    struct Level {
+        uint64_t offset;
+        uint64_t length;
+    };
+
+    std::ifstream file;
+
+    /**
+     * Format of the data in the file
+     */
+    VkFormat file_format;
+
+    /**
+     * Format returned to the streamer, file_format unless levels are decoded
+     */
+    VkFormat format;
+    bool decode;
+
+    VkExtent2D extent;
+
+    /**
+     * File location of each level, finest first
+     */
+    std::vector<Level> levels;
+
+    /**
+     * Compressed level data waiting to be decoded
+     */
+    std::vector<uint8_t> encoded;
+
+public:
+    /**
+     * Open a file and choose whether to decode it
+     * @param filename path to a KTX2 file
+     * @param graphics_device device whose format support decides between uploading blocks and decoding
+     */
+    Ktx2TextureSource(const std::string& filename, GraphicsDevice* graphics_device);
+
+    /**
+     * Get the format stored in the file
+     */
+    VkFormat getFileFormat();
+
+    /**
+     * Check whether levels are decoded on the CPU rather than uploaded as stored
+     */
+    bool isDecoding();
+
+    VkFormat getFormat();
+    VkExtent2D getExtent();
+    uint32_t getMipCount();
+    VkDeviceSize getMipSize(uint32_t level);
+    void loadMip(uint32_t level, std::vector<uint8_t>* data);
+};
+
+/**
+ * Read the format of a KTX2 file from its header
+ * @param filename path to a KTX2 file
+ * @return stored format, or VK_FORMAT_UNDEFINED if the file can't be read or isn't KTX2
+ */
+VkFormat readKtx2Format(const std::string& filename);
+
+/**
+ * Open the best of several encodings of the same texture, such as BC7, ASTC and ETC2 versions. The first file
+ *  the device can sample is used, otherwise the first that can be decoded
+ * @param graphics_device device to check format support on
+ * @param filenames candidate files in order of preference
+ * @return new source, owned by the caller
+ */
+Ktx2TextureSource* openKtx2Texture(GraphicsDevice* graphics_device, const std::vector<std::string>& filenames);
@@ -0,0 +1,167 @@
+/** @file LateLatch.cpp
+*
+* @brief Defines class holding per-frame view data in host-visible memory that
+*   is overwritten just before submission
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/10/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include <stdexcept>
+#include <string.h>
+
+#include "LateLatch.h"
+
+LateLatch::LateLatch(GraphicsDevice* graphics_device, VkAllocationCallbacks* p_allocs, uint32_t slot_count) {
+    this->graphics_device = graphics_device;
+    this->p_allocs = p_allocs;
+    this->slot_count = slot_count;
+
+    createBuffer();
+    createDescriptors();
+}
+
+LateLatch::~LateLatch() {
+    VkDevice device = graphics_device->device();
+
+    vkDestroyDescriptorPool(device, descriptor_pool, p_allocs);
+    vkDestroyDescriptorSetLayout(device, set_layout, p_allocs);
+
+    vkUnmapMemory(device, buffer_mem);
+    vkDestroyBuffer(device, buffer, p_allocs);
+    graphics_device->getMemoryTelemetry()->freeMemory(buffer_mem);
+
+    delete[] descriptor_sets;
+}
+
+void LateLatch::createBuffer() {
+    VkDevice device = graphics_device->device();
+
+    VkDeviceSize alignment = graphics_device->getDeviceProperties().limits.minUniformBufferOffsetAlignment;
+    slot_stride = (sizeof(LateLatchData) + alignment - 1) / alignment * alignment;
+
+    VkBufferCreateInfo buffer_ci = {};
+    buffer_ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_ci.flags = 0;
+    buffer_ci.size = slot_stride * slot_count;
+    buffer_ci.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+    buffer_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(device, &buffer_ci, p_allocs, &buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create late latch buffer");
+    }
+
+    VkMemoryRequirements mem_req;
+    vkGetBufferMemoryRequirements(device, buffer, &mem_req);
+
+    // Coherent so writes are visible to the submission without a flush
+    VkMemoryAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize = mem_req.size;
+    alloc_info.memoryTypeIndex = graphics_device->findMemType(mem_req.memoryTypeBits,
+        static_cast<VkMemoryPropertyFlagBits>(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT));
+
+    if (graphics_device->getMemoryTelemetry()->allocateMemory(alloc_info, MEMORY_CATEGORY_BUFFER, &buffer_mem) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate device memory for late latch buffer");
+    }
+
+    if (vkBindBufferMemory(device, buffer, buffer_mem, 0) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to bind memory to late latch buffer");
+    }
+
+    void* mapped_data;
+    if (vkMapMemory(device, buffer_mem, 0, VK_WHOLE_SIZE, 0, &mapped_data) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to map late latch buffer memory to host");
+    }
+    mapped = static_cast<uint8_t*>(mapped_data);
+    memset(mapped, 0, static_cast<size_t>(buffer_ci.size));
+}
+
+void LateLatch::createDescriptors() {
+    VkDevice device = graphics_device->device();
+
+    VkDescriptorSetLayoutBinding binding = {};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    binding.descriptorCount = 1;
+    binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    binding.pImmutableSamplers = nullptr;
+
+    VkDescriptorSetLayoutCreateInfo layout_ci = {};
+    layout_ci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_ci.flags = 0;
+    layout_ci.bindingCount = 1;
+    layout_ci.pBindings = &binding;
+
+    if (vkCreateDescriptorSetLayout(device, &layout_ci, p_allocs, &set_layout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create late latch descriptor set layout");
+    }
+
+    VkDescriptorPoolSize pool_size = {};
+    pool_size.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    pool_size.descriptorCount = slot_count;
+
+    VkDescriptorPoolCreateInfo pool_ci = {};
+    pool_ci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_ci.flags = 0;
+    pool_ci.maxSets = slot_count;
+    pool_ci.poolSizeCount = 1;
+    pool_ci.pPoolSizes = &pool_size;
+
+    if (vkCreateDescriptorPool(device, &pool_ci, p_allocs, &descriptor_pool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create late latch descriptor pool");
+    }
+
+    VkDescriptorSetLayout* layouts = new VkDescriptorSetLayout[slot_count];
+    for (uint32_t i = 0; i < slot_count; i++) {
+        layouts[i] = set_layout;
+    }
+
+    descriptor_sets = new VkDescriptorSet[slot_count];
+
+    VkDescriptorSetAllocateInfo set_ai = {};
+    set_ai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    set_ai.descriptorPool = descriptor_pool;
+    set_ai.descriptorSetCount = slot_count;
+    set_ai.pSetLayouts = layouts;
+
+    VkResult alloc_result = vkAllocateDescriptorSets(device, &set_ai, descriptor_sets);
+    delete[] layouts;
+    if (alloc_result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate late latch descriptor sets");
+    }
+
+    for (uint32_t i = 0; i < slot_count; i++) {
+        VkDescriptorBufferInfo buffer_info = {};
+        buffer_info.buffer = buffer;
+        buffer_info.offset = slot_stride * i;
+        buffer_info.range = sizeof(LateLatchData);
+
+        VkWriteDescriptorSet write = {};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = descriptor_sets[i];
+        write.dstBinding = 0;
+        write.dstArrayElement = 0;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        write.pBufferInfo = &buffer_info;
+
+        vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+    }
+}
+
+void LateLatch::write(uint32_t slot, const LateLatchData& data) {
+    memcpy(mapped + slot_stride * slot, &data, sizeof(LateLatchData));
+}
+
+VkDescriptorSetLayout LateLatch::getDescriptorSetLayout() {
+    return set_layout;
+}
+
+VkDescriptorSet LateLatch::getDescriptorSet(uint32_t slot) {
+    return descriptor_sets[slot];
+}
@@ -0,0 +1,85 @@
+/** @file LateLatch.h
+*
+* @brief Defines class holding per-frame view data in host-visible memory that
+*   is overwritten just before submission
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/10/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+
+#include "GraphicsDevice.h"
+
+/**
+ * Uniform block read by the scene shaders. Layout matches LateLatch in default.vert (std140)
+ */
+struct LateLatchData {
+    float view_proj[2][16];
+};
+
+/**
+ * One uniform buffer region per slot in persistently mapped, host coherent memory. Command buffers reference
+ *  their slot's descriptor set once, and the CPU writes the latest data into the slot after the slot's previous
+ *  submission retires and immediately before the next one is submitted, so no re-recording is needed
+ */
+class LateLatch {
+private:
+    GraphicsDevice* graphics_device;
+    VkAllocationCallbacks* p_allocs;
+
+    uint32_t slot_count;
+
+    /**
+     * Distance between slots, rounded up to the device's uniform buffer offset alignment
+     */
+    VkDeviceSize slot_stride;
+
+    VkBuffer buffer;
+    VkDeviceMemory buffer_mem;
+
+    /**
+     * Mapped pointer to the start of the buffer
+     */
+    uint8_t* mapped = nullptr;
+
+    VkDescriptorSetLayout set_layout;
+    VkDescriptorPool descriptor_pool;
+    VkDescriptorSet* descriptor_sets;
+
+    void createBuffer();
+    void createDescriptors();
+
+public:
+    /**
+     * Create buffer and descriptor sets
+     * @param graphics_device device to allocate on
+     * @param p_allocs allocation callbacks to use for vulkan calls
+     * @param slot_count number of slots, e.g. the swapchain length
+     */
+    LateLatch(GraphicsDevice* graphics_device, VkAllocationCallbacks* p_allocs, uint32_t slot_count);
+
+    ~LateLatch();
+
+    /**
+     * Overwrite a slot. The slot's last submission must have retired
+     * @param slot slot to write
+     * @param data data to copy into the slot
+     */
+    void write(uint32_t slot, const LateLatchData& data);
+
+    /**
+     * Get the layout of the descriptor set: a single uniform buffer at binding 0, visible to the vertex stage
+     */
+    VkDescriptorSetLayout getDescriptorSetLayout();
+
+    /**
+     * Get the descriptor set that points at a slot
+     */
+    VkDescriptorSet getDescriptorSet(uint32_t slot);
+};
@@ -0,0 +1,310 @@
+/** @file MaterialTable.cpp
+*
+* @brief Defines class holding every material's parameters and textures in
+*   one descriptor set, indexed by shaders with a material ID
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			01/07/2018
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include "MaterialTable.h"
+#include "Common.h"
+
+#include <iostream>
+#include <stdexcept>
+
+MaterialTable::MaterialTable(GraphicsDevice* graphics_device, VkAllocationCallbacks* p_allocs, uint32_t frame_count,
+    TextureStreamer* texture_streamer) {
+
+    this->graphics_device = graphics_device;
+    this->p_allocs = p_allocs;
+    this->frame_count = frame_count;
+    this->texture_streamer = texture_streamer;
+
+    // Draws select their material with a push constant, which is dynamically uniform but not constant
+    if (!graphics_device->supportsTextureArrayIndexing()) {
+        throw std::runtime_error("Failed to create material table: device can't index texture arrays");
+    }
+
+    const VkPhysicalDeviceLimits& limits = graphics_device->getDeviceProperties().limits;
+    bindless = graphics_device->supportsDescriptorIndexing();
+    if (bindless) {
+        texture_capacity = MIN(graphics_device->getMaxBindlessTextures(), static_cast<uint32_t>(MAX_BINDLESS_TEXTURES));
+    }
+    else {
+        texture_capacity = MIN(MIN(limits.maxPerStageDescriptorSamplers, limits.maxPerStageDescriptorSampledImages),
+            static_cast<uint32_t>(MAX_BOUND_TEXTURES));
+    }
+
+    createBuffer();
+    createDescriptors();
+
+    std::cout << "Created material table with " << texture_capacity << " texture slots" <<
+        (bindless ? " using descriptor indexing" : "") << std::endl;
+}
+
+MaterialTable::~MaterialTable() {
+    VkDevice device = graphics_device->device();
+
+    vkDestroyDescriptorPool(device, descriptor_pool, p_allocs);
+    vkDestroyDescriptorSetLayout(device, set_layout, p_allocs);
+    vkDestroySampler(device, sampler, p_allocs);
+
+    vkUnmapMemory(device, material_mem);
+    vkDestroyBuffer(device, material_buffer, p_allocs);
+    graphics_device->getMemoryTelemetry()->freeMemory(material_mem);
+}
+
+void MaterialTable::createBuffer() {
+    VkDevice device = graphics_device->device();
+
+    VkBufferCreateInfo buffer_ci = {};
+    buffer_ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_ci.flags = 0;
+    buffer_ci.size = sizeof(MaterialParams) * MAX_MATERIALS;
+    buffer_ci.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    buffer_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(device, &buffer_ci, p_allocs, &material_buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create material buffer");
+    }
+
+    VkMemoryRequirements mem_req;
+    vkGetBufferMemoryRequirements(device, material_buffer, &mem_req);
+
+    // Coherent so added materials are visible to the next submission without a flush
+    VkMemoryAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize = mem_req.size;
+    alloc_info.memoryTypeIndex = graphics_device->findMemType(mem_req.memoryTypeBits,
+        static_cast<VkMemoryPropertyFlagBits>(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT));
+
+    if (graphics_device->getMemoryTelemetry()->allocateMemory(alloc_info, MEMORY_CATEGORY_BUFFER, &material_mem) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate device memory for material buffer");
+    }
+
+    if (vkBindBufferMemory(device, material_buffer, material_mem, 0) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to bind memory to material buffer");
+    }
+
+    void* mapped_data;
+    if (vkMapMemory(device, material_mem, 0, VK_WHOLE_SIZE, 0, &mapped_data) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to map material buffer memory to host");
+    }
+    materials_mapped = static_cast<MaterialParams*>(mapped_data);
+}
+
+void MaterialTable::createDescriptors() {
+    VkDevice device = graphics_device->device();
+
+    // Trilinear and repeating, shared by every texture
+    VkSamplerCreateInfo sampler_ci = {};
+    sampler_ci.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_ci.flags = 0;
+    sampler_ci.magFilter = VK_FILTER_LINEAR;
+    sampler_ci.minFilter = VK_FILTER_LINEAR;
+    sampler_ci.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    sampler_ci.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler_ci.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler_ci.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler_ci.mipLodBias = 0.0f;
+    sampler_ci.anisotropyEnable = VK_FALSE;
+    sampler_ci.maxAnisotropy = 1.0f;
+    sampler_ci.compareEnable = VK_FALSE;
+    sampler_ci.minLod = 0.0f;
+    sampler_ci.maxLod = VK_LOD_CLAMP_NONE;
+    sampler_ci.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    sampler_ci.unnormalizedCoordinates = VK_FALSE;
+
+    if (vkCreateSampler(device, &sampler_ci, p_allocs, &sampler) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create material sampler");
+    }
+
+    VkDescriptorSetLayoutBinding bindings[2] = {};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[0].descriptorCount = texture_capacity;
+    bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    bindings[0].pImmutableSamplers = nullptr;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    bindings[1].pImmutableSamplers = nullptr;
+
+    VkDescriptorSetLayoutCreateInfo set_layout_ci = {};
+    set_layout_ci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    set_layout_ci.flags = 0;
+    set_layout_ci.bindingCount = 2;
+    set_layout_ci.pBindings = bindings;
+
+    VkDescriptorPoolSize pool_sizes[2] = {};
+    pool_sizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    pool_sizes[0].descriptorCount = texture_capacity * frame_count;
+    pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_sizes[1].descriptorCount = frame_count;
+
+    VkDescriptorPoolCreateInfo pool_ci = {};
+    pool_ci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_ci.flags = 0;
+    pool_ci.maxSets = frame_count;
+    pool_ci.poolSizeCount = 2;
+    pool_ci.pPoolSizes = pool_sizes;
+
+#if defined(VK_EXT_descriptor_indexing) && defined(VK_VERSION_1_1)
+    // Slots without a texture are never written, and slots are rewritten while recorded command buffers use them
+    VkDescriptorBindingFlagsEXT binding_flags[2] = {
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT, 0 };
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfoEXT binding_flags_ci = {};
+    binding_flags_ci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+    binding_flags_ci.bindingCount = 2;
+    binding_flags_ci.pBindingFlags = binding_flags;
+
+    if (bindless) {
+        set_layout_ci.pNext = &binding_flags_ci;
+        set_layout_ci.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+        pool_ci.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+    }
+#endif
+
+    if (vkCreateDescriptorSetLayout(device, &set_layout_ci, p_allocs, &set_layout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create material descriptor set layout");
+    }
+
+    if (vkCreateDescriptorPool(device, &pool_ci, p_allocs, &descriptor_pool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create material descriptor pool");
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(frame_count, set_layout);
+    descriptor_sets.resize(frame_count);
+
+    VkDescriptorSetAllocateInfo set_ai = {};
+    set_ai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    set_ai.descriptorPool = descriptor_pool;
+    set_ai.descriptorSetCount = frame_count;
+    set_ai.pSetLayouts = layouts.data();
+
+    if (vkAllocateDescriptorSets(device, &set_ai, descriptor_sets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate material descriptor sets");
+    }
+
+    // Without partial binding every slot must be valid, so unused slots show the streamer's white image
+    VkImageView initial_view = bindless ? VK_NULL_HANDLE : texture_streamer->getFallbackImageView();
+    written_views.assign(frame_count * texture_capacity, initial_view);
+
+    std::vector<VkDescriptorImageInfo> image_infos(texture_capacity);
+    for (uint32_t slot = 0; slot < texture_capacity; slot++) {
+        image_infos[slot].sampler = sampler;
+        image_infos[slot].imageView = initial_view;
+        image_infos[slot].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+
+    VkDescriptorBufferInfo buffer_info = {};
+    buffer_info.buffer = material_buffer;
+    buffer_info.offset = 0;
+    buffer_info.range = VK_WHOLE_SIZE;
+
+    for (uint32_t i = 0; i < frame_count; i++) {
+        VkWriteDescriptorSet writes[2] = {};
+        writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[0].dstSet = descriptor_sets[i];
+        writes[0].dstBinding = 1;
+        writes[0].dstArrayElement = 0;
+        writes[0].descriptorCount = 1;
+        writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[0].pBufferInfo = &buffer_info;
+        writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[1].dstSet = descriptor_sets[i];
+        writes[1].dstBinding = 0;
+        writes[1].dstArrayElement = 0;
+        writes[1].descriptorCount = texture_capacity;
+        writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[1].pImageInfo = image_infos.data();
+
+        vkUpdateDescriptorSets(device, bindless ? 1 : 2, writes, 0, nullptr);
+    }
+}
+
+uint32_t MaterialTable::addTexture(TextureHandle texture) {
+    if (textures.size() >= texture_capacity) {
+        throw std::runtime_error("Failed to add texture: material table is full");
+    }
+
+    textures.push_back(texture);
+    return static_cast<uint32_t>(textures.size() - 1);
+}
+
+MaterialHandle MaterialTable::addMaterial(const MaterialParams& params) {
+    if (material_count >= MAX_MATERIALS) {
+        throw std::runtime_error("Failed to add material: material table is full");
+    }
+
+    materials_mapped[material_count] = params;
+    return material_count++;
+}
+
+bool MaterialTable::update(uint32_t frame_index) {
+    // Views change when textures are added and when the streamer swaps in a new range of levels
+    std::vector<VkDescriptorImageInfo> image_infos;
+    std::vector<VkWriteDescriptorSet> writes;
+    image_infos.reserve(textures.size());
+
+    for (uint32_t slot = 0; slot < textures.size(); slot++) {
+        VkImageView view = texture_streamer->getImageView(textures[slot]);
+        VkImageView& written = written_views[frame_index * texture_capacity + slot];
+        if (view == written) {
+            continue;
+        }
+        written = view;
+
+        VkDescriptorImageInfo image_info;
+        image_info.sampler = sampler;
+        image_info.imageView = view;
+        image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        image_infos.push_back(image_info);
+
+        VkWriteDescriptorSet write = {};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = descriptor_sets[frame_index];
+        write.dstBinding = 0;
+        write.dstArrayElement = slot;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write.pImageInfo = &image_infos.back();
+        writes.push_back(write);
+    }
+
+    if (writes.empty()) {
+        return false;
+    }
+
+    vkUpdateDescriptorSets(graphics_device->device(), static_cast<uint32_t>(writes.size()), writes.data(), 0,
+        nullptr);
+    return !bindless;
+}
+
+VkDescriptorSetLayout MaterialTable::getDescriptorSetLayout() {
+    return set_layout;
+}
+
+VkDescriptorSet MaterialTable::getDescriptorSet(uint32_t frame_index) {
+    return descriptor_sets[frame_index];
+}
+
+uint32_t MaterialTable::getTextureCapacity() {
+    return texture_capacity;
+}
+
+bool MaterialTable::isBindless() {
+    return bindless;
+}
+
+uint32_t MaterialTable::getMaterialCount() {
+    return material_count;
+}
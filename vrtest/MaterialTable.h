@@ -0,0 +1,159 @@
+/** @file MaterialTable.h
+*
+* @brief Defines class holding every material's parameters and textures in
+*   one descriptor set, indexed by shaders with a material ID
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			01/07/2018
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <vector>
+
+#include "GraphicsDevice.h"
+#include "TextureStreamer.h"
+
+typedef uint32_t MaterialHandle;
+
+/**
+ * Most materials a table holds
+ */
+#define MAX_MATERIALS 1024
+
+/**
+ * Most textures the array holds with descriptor indexing, and without it. The array is written in full without
+ *  descriptor indexing, so it is kept to the smallest per-stage sampler limit Vulkan guarantees
+ */
+#define MAX_BINDLESS_TEXTURES 4096
+#define MAX_BOUND_TEXTURES 16
+
+/**
+ * Texture slot of a material with no texture
+ */
+#define NO_MATERIAL_TEXTURE 0xffffffffu
+
+/**
+ * Parameters of one material. Layout matches Material in default.frag
+ */
+struct MaterialParams {
+    /**
+     * Multiplies the vertex color
+     */
+    float base_color[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+    /**
+     * Slot in the texture array multiplying the base color, or NO_MATERIAL_TEXTURE
+     */
+    uint32_t base_color_texture = NO_MATERIAL_TEXTURE;
+    uint32_t padding[3] = {};
+};
+
+/**
+ * Set 1 of the scene pipeline layout: binding 0 is an array of every material's textures and binding 1 a storage
+ *  buffer of every material's parameters. Shaders index both with the material ID of the draw, so one set bound
+ *  once per pass serves every material, and draws of different materials differ only in their push constants.
+ *  With VK_EXT_descriptor_indexing the array is large, partially bound and updated after bind, so textures are
+ *  added and swapped by the streamer without re-recording command buffers. Without it, the array is small and
+ *  fully written, and command buffers that bound a set must be re-recorded after it changes. There is a set per
+ *  frame in flight, updated only when that frame's previous submission has retired
+ */
+class MaterialTable {
+private:
+    GraphicsDevice* graphics_device;
+    VkAllocationCallbacks* p_allocs;
+    TextureStreamer* texture_streamer;
+
+    uint32_t frame_count;
+
+    /**
+     * Whether the texture array is partially bound and updated after bind
+     */
+    bool bindless;
+    uint32_t texture_capacity;
+
+    VkSampler sampler;
+    VkDescriptorSetLayout set_layout;
+    VkDescriptorPool descriptor_pool;
+    std::vector<VkDescriptorSet> descriptor_sets;
+
+    /**
+     * Parameters of every material. Materials are only added, and an entry is written before any frame can
+     *  reference it, so one persistently mapped copy serves every frame
+     */
+    VkBuffer material_buffer;
+    VkDeviceMemory material_mem;
+    MaterialParams* materials_mapped;
+    uint32_t material_count = 0;
+
+    /**
+     * Texture in each slot, and the view each frame's set last had written to each slot
+     */
+    std::vector<TextureHandle> textures;
+    std::vector<VkImageView> written_views;
+
+    void createBuffer();
+    void createDescriptors();
+
+public:
+    /**
+     * Create the set layout and a set per frame, using descriptor indexing if the device supports it
+     * @param graphics_device device to create objects on
+     * @param p_allocs allocation callbacks passed to Vulkan calls
+     * @param frame_count number of frames in flight (swapchain length)
+     * @param texture_streamer streamer providing texture views, which must outlive the table
+     */
+    MaterialTable(GraphicsDevice* graphics_device, VkAllocationCallbacks* p_allocs, uint32_t frame_count,
+        TextureStreamer* texture_streamer);
+
+    ~MaterialTable();
+
+    /**
+     * Add a streamed texture to the array. It shows as white until its levels are resident
+     * @param texture texture of the table's streamer
+     * @return slot to reference from MaterialParams
+     */
+    uint32_t addTexture(TextureHandle texture);
+
+    /**
+     * Add a material
+     * @param params parameters, with texture slots returned by addTexture
+     * @return ID shaders index the table with
+     */
+    MaterialHandle addMaterial(const MaterialParams& params);
+
+    /**
+     * Write a frame's set with the current view of every texture. Call once the frame's previous submission has
+     *  retired, after the streamer's update
+     * @param frame_index frame whose set to update
+     * @return true if the set changed and descriptor indexing is unavailable, so command buffers that bound the
+     *  set must be re-recorded
+     */
+    bool update(uint32_t frame_index);
+
+    /**
+     * Get the layout of the table's set
+     */
+    VkDescriptorSetLayout getDescriptorSetLayout();
+
+    /**
+     * Get the set of a frame
+     */
+    VkDescriptorSet getDescriptorSet(uint32_t frame_index);
+
+    /**
+     * Get the size of the texture array, which shaders must declare it with
+     */
+    uint32_t getTextureCapacity();
+
+    /**
+     * Whether the table uses descriptor indexing
+     */
+    bool isBindless();
+
+    uint32_t getMaterialCount();
+};
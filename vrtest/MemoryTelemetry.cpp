@@ -0,0 +1,288 @@
+/** @file MemoryTelemetry.cpp
+*
+* @brief Defines class that tracks device memory allocations per heap, type and
+*   category and warns when heaps approach their budget
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/24/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include <iomanip>
+#include <iostream>
+#include <string.h>
+
+#include "MemoryTelemetry.h"
+#include "Common.h"
+
+static const char* category_names[MEMORY_CATEGORY_COUNT] = { "buffer", "image", "attachment", "staging" };
+static const char* pressure_names[] = { "none", "warning", "critical" };
+
+MemoryTelemetry::MemoryTelemetry(VkInstance instance, VkPhysicalDevice physical_device, VkDevice device,
+    VkAllocationCallbacks* p_allocs, bool memory_budget) {
+    this->instance = instance;
+    this->physical_device = physical_device;
+    this->device = device;
+    this->p_allocs = p_allocs;
+    this->memory_budget = memory_budget;
+
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &mem_props);
+
+    memset(&stats, 0, sizeof(stats));
+    memset(alloc_failed, 0, sizeof(alloc_failed));
+    stats.heap_count = mem_props.memoryHeapCount;
+    stats.type_count = mem_props.memoryTypeCount;
+    for (uint32_t i = 0; i < mem_props.memoryHeapCount; i++) {
+        stats.heaps[i].size = mem_props.memoryHeaps[i].size;
+        stats.heaps[i].device_local = (mem_props.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+        stats.heaps[i].budget = mem_props.memoryHeaps[i].size;
+    }
+
+    update();
+}
+
+MemoryTelemetry::~MemoryTelemetry() {
+    if (!allocations.empty()) {
+        std::cerr << allocations.size() << " device memory allocations were not freed" << std::endl;
+        printStats(std::cerr);
+    }
+}
+
+void MemoryTelemetry::countAlloc(MemoryCounters* counters, VkDeviceSize size) {
+    counters->alloc_count++;
+    counters->live_bytes += size;
+    counters->peak_bytes = MAX(counters->peak_bytes, counters->live_bytes);
+}
+
+void MemoryTelemetry::countFree(MemoryCounters* counters, VkDeviceSize size) {
+    counters->free_count++;
+    counters->live_bytes -= size;
+}
+
+VkResult MemoryTelemetry::allocateMemory(const VkMemoryAllocateInfo& alloc_info, MemoryCategory category,
+    VkDeviceMemory* memory) {
+
+    VkResult result = vkAllocateMemory(device, &alloc_info, p_allocs, memory);
+    uint32_t heap = mem_props.memoryTypes[alloc_info.memoryTypeIndex].heapIndex;
+
+    if (result != VK_SUCCESS) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stats.failed_allocs++;
+            alloc_failed[heap] = true;
+        }
+
+        // Out of memory is usually fatal to the caller, so say what the memory was used for first
+        std::cerr << "Failed to allocate " << alloc_info.allocationSize << " bytes of " << category_names[category]
+            << " memory from heap " << heap << ", memory type " << alloc_info.memoryTypeIndex << std::endl;
+        printStats(std::cerr);
+        return result;
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    Allocation allocation = { alloc_info.allocationSize, alloc_info.memoryTypeIndex, category };
+    allocations[*memory] = allocation;
+
+    countAlloc(&stats.heaps[heap].counters, allocation.size);
+    countAlloc(&stats.types[allocation.type], allocation.size);
+    countAlloc(&stats.categories[category], allocation.size);
+
+    return result;
+}
+
+void MemoryTelemetry::freeMemory(VkDeviceMemory memory) {
+    if (memory == VK_NULL_HANDLE) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = allocations.find(memory);
+        if (it != allocations.end()) {
+            const Allocation& allocation = it->second;
+            countFree(&stats.heaps[mem_props.memoryTypes[allocation.type].heapIndex].counters, allocation.size);
+            countFree(&stats.types[allocation.type], allocation.size);
+            countFree(&stats.categories[allocation.category], allocation.size);
+            allocations.erase(it);
+        }
+    }
+
+    vkFreeMemory(device, memory, p_allocs);
+}
+
+void MemoryTelemetry::queryHeapBudgets(VkDeviceSize* budgets, VkDeviceSize* usages) {
+#if defined(VK_EXT_memory_budget) && defined(VK_VERSION_1_1)
+    auto get_mem_props2 = (PFN_vkGetPhysicalDeviceMemoryProperties2)vkGetInstanceProcAddr(instance,
+        "vkGetPhysicalDeviceMemoryProperties2");
+    if (memory_budget && get_mem_props2 != nullptr) {
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_props = {};
+        budget_props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+        VkPhysicalDeviceMemoryProperties2 props = {};
+        props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        props.pNext = &budget_props;
+        get_mem_props2(physical_device, &props);
+
+        for (uint32_t i = 0; i < VK_MAX_MEMORY_HEAPS; i++) {
+            budgets[i] = budget_props.heapBudget[i];
+            usages[i] = budget_props.heapUsage[i];
+        }
+        return;
+    }
+#endif
+
+    std::lock_guard<std::mutex> guard(lock);
+    for (uint32_t i = 0; i < VK_MAX_MEMORY_HEAPS; i++) {
+        budgets[i] = i < mem_props.memoryHeapCount ? mem_props.memoryHeaps[i].size : 0;
+        usages[i] = stats.heaps[i].counters.live_bytes;
+    }
+}
+
+MemoryPressure MemoryTelemetry::getPressure(MemoryPressure current, VkDeviceSize budget, VkDeviceSize usage) {
+    double fraction = budget > 0 ? static_cast<double>(usage) / budget : 1.0;
+
+    if (fraction >= critical_fraction ||
+        (current == MEMORY_PRESSURE_CRITICAL && fraction >= critical_fraction - release_margin)) {
+        return MEMORY_PRESSURE_CRITICAL;
+    }
+    if (fraction >= warning_fraction ||
+        (current != MEMORY_PRESSURE_NONE && fraction >= warning_fraction - release_margin)) {
+        return MEMORY_PRESSURE_WARNING;
+    }
+    return MEMORY_PRESSURE_NONE;
+}
+
+void MemoryTelemetry::update() {
+    VkDeviceSize budgets[VK_MAX_MEMORY_HEAPS];
+    VkDeviceSize usages[VK_MAX_MEMORY_HEAPS];
+    queryHeapBudgets(budgets, usages);
+
+    std::vector<MemoryPressureEvent> events;
+    std::vector<MemoryPressureCallback> to_call;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (uint32_t i = 0; i < stats.heap_count; i++) {
+            MemoryHeapStats& heap = stats.heaps[i];
+            heap.budget = budgets[i];
+            heap.usage = usages[i];
+
+            MemoryPressure pressure = getPressure(heap.pressure, heap.budget, heap.usage);
+
+            // A failed allocation means the heap is full whatever the budget says, so report it even if the
+            // heap was already critical
+            if (pressure != heap.pressure || alloc_failed[i]) {
+                if (alloc_failed[i]) {
+                    pressure = MEMORY_PRESSURE_CRITICAL;
+                    alloc_failed[i] = false;
+                }
+                heap.pressure = pressure;
+                events.push_back({ i, pressure, heap.budget, heap.usage });
+            }
+        }
+
+        if (!events.empty()) {
+            for (auto& callback : callbacks) {
+                to_call.push_back(callback.second);
+            }
+        }
+    }
+
+    for (const MemoryPressureEvent& event : events) {
+        if (event.pressure != MEMORY_PRESSURE_NONE) {
+            std::cout << "Memory heap " << event.heap << " pressure " << pressure_names[event.pressure] << ": "
+                << event.usage / (1024 * 1024) << " of " << event.budget / (1024 * 1024) << " MB used" << std::endl;
+        }
+        for (MemoryPressureCallback& callback : to_call) {
+            callback(event);
+        }
+    }
+}
+
+uint32_t MemoryTelemetry::addPressureCallback(MemoryPressureCallback callback) {
+    std::lock_guard<std::mutex> guard(lock);
+    uint32_t id = next_callback_id++;
+    callbacks.push_back(std::make_pair(id, callback));
+    return id;
+}
+
+void MemoryTelemetry::removePressureCallback(uint32_t id) {
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto it = callbacks.begin(); it != callbacks.end(); ++it) {
+        if (it->first == id) {
+            callbacks.erase(it);
+            return;
+        }
+    }
+}
+
+void MemoryTelemetry::setPressureThresholds(float warning_fraction, float critical_fraction) {
+    std::lock_guard<std::mutex> guard(lock);
+    this->warning_fraction = warning_fraction;
+    this->critical_fraction = MAX(critical_fraction, warning_fraction);
+}
+
+MemoryPressure MemoryTelemetry::getDeviceLocalPressure() {
+    std::lock_guard<std::mutex> guard(lock);
+    MemoryPressure pressure = MEMORY_PRESSURE_NONE;
+    for (uint32_t i = 0; i < stats.heap_count; i++) {
+        if (stats.heaps[i].device_local) {
+            pressure = MAX(pressure, stats.heaps[i].pressure);
+        }
+    }
+    return pressure;
+}
+
+MemoryStats MemoryTelemetry::getStats() {
+    std::lock_guard<std::mutex> guard(lock);
+    return stats;
+}
+
+void MemoryTelemetry::printStats(std::ostream& out) {
+    MemoryStats snapshot = getStats();
+    const uint32_t mb = 1024 * 1024;
+
+    out << "Device memory by heap (MB):\n";
+    out << std::setw(6) << "heap" << std::setw(8) << "local" << std::setw(10) << "size" << std::setw(10) << "budget"
+        << std::setw(10) << "usage" << std::setw(10) << "live" << std::setw(10) << "peak" << std::setw(10)
+        << "count" << std::setw(10) << "pressure" << '\n';
+    for (uint32_t i = 0; i < snapshot.heap_count; i++) {
+        const MemoryHeapStats& heap = snapshot.heaps[i];
+        out << std::setw(6) << i << std::setw(8) << (heap.device_local ? "yes" : "no")
+            << std::setw(10) << heap.size / mb << std::setw(10) << heap.budget / mb
+            << std::setw(10) << heap.usage / mb << std::setw(10) << heap.counters.live_bytes / mb
+            << std::setw(10) << heap.counters.peak_bytes / mb
+            << std::setw(10) << heap.counters.alloc_count - heap.counters.free_count
+            << std::setw(10) << pressure_names[heap.pressure] << '\n';
+    }
+
+    out << "Device memory by type (bytes):\n";
+    out << std::setw(6) << "type" << std::setw(6) << "heap" << std::setw(8) << "flags" << std::setw(10) << "allocs"
+        << std::setw(10) << "frees" << std::setw(14) << "live" << std::setw(14) << "peak" << '\n';
+    for (uint32_t i = 0; i < snapshot.type_count; i++) {
+        const MemoryCounters& type = snapshot.types[i];
+        if (type.alloc_count == 0) {
+            continue;
+        }
+        out << std::setw(6) << i << std::setw(6) << mem_props.memoryTypes[i].heapIndex
+            << std::setw(8) << std::hex << mem_props.memoryTypes[i].propertyFlags << std::dec
+            << std::setw(10) << type.alloc_count << std::setw(10) << type.free_count
+            << std::setw(14) << type.live_bytes << std::setw(14) << type.peak_bytes << '\n';
+    }
+
+    out << "Device memory by category (bytes):\n";
+    out << std::setw(12) << "category" << std::setw(10) << "allocs" << std::setw(10) << "frees"
+        << std::setw(14) << "live" << std::setw(14) << "peak" << '\n';
+    for (uint32_t i = 0; i < MEMORY_CATEGORY_COUNT; i++) {
+        const MemoryCounters& category = snapshot.categories[i];
+        out << std::setw(12) << category_names[i] << std::setw(10) << category.alloc_count
+            << std::setw(10) << category.free_count << std::setw(14) << category.live_bytes
+            << std::setw(14) << category.peak_bytes << '\n';
+    }
+
+    if (snapshot.failed_allocs > 0) {
+        out << "Failed allocations: " << snapshot.failed_allocs << '\n';
+    }
+    out.flush();
+}
@@ -0,0 +1,217 @@
+/** @file MemoryTelemetry.h
+*
+* @brief Defines class that tracks device memory allocations per heap, type and
+*   category and warns when heaps approach their budget
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/24/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * What device memory is used for
+ */
+enum MemoryCategory {
+    MEMORY_CATEGORY_BUFFER,
+    MEMORY_CATEGORY_IMAGE,
+    MEMORY_CATEGORY_ATTACHMENT,
+    MEMORY_CATEGORY_STAGING,
+    MEMORY_CATEGORY_COUNT
+};
+
+/**
+ * How close a heap is to its budget
+ */
+enum MemoryPressure {
+    MEMORY_PRESSURE_NONE,
+    MEMORY_PRESSURE_WARNING,
+    MEMORY_PRESSURE_CRITICAL
+};
+
+/**
+ * Allocation counters of one heap, memory type or category
+ */
+struct MemoryCounters {
+    uint64_t alloc_count;
+    uint64_t free_count;
+    VkDeviceSize live_bytes;
+    VkDeviceSize peak_bytes;
+};
+
+/**
+ * Snapshot of one heap
+ */
+struct MemoryHeapStats {
+    MemoryCounters counters;
+    VkDeviceSize size;
+    bool device_local;
+
+    /**
+     * Budget and usage of the whole process. Without VK_EXT_memory_budget the budget is the heap size and
+     *  usage is the live bytes allocated through the telemetry
+     */
+    VkDeviceSize budget;
+    VkDeviceSize usage;
+
+    MemoryPressure pressure;
+};
+
+/**
+ * Snapshot of all counters
+ */
+struct MemoryStats {
+    uint32_t heap_count;
+    uint32_t type_count;
+    MemoryHeapStats heaps[VK_MAX_MEMORY_HEAPS];
+    MemoryCounters types[VK_MAX_MEMORY_TYPES];
+    MemoryCounters categories[MEMORY_CATEGORY_COUNT];
+    uint64_t failed_allocs;
+};
+
+/**
+ * Reported to pressure callbacks when a heap's pressure changes
+ */
+struct MemoryPressureEvent {
+    uint32_t heap;
+    MemoryPressure pressure;
+    VkDeviceSize budget;
+    VkDeviceSize usage;
+};
+
+typedef std::function<void(const MemoryPressureEvent& event)> MemoryPressureCallback;
+
+/**
+ * Device memory allocations go through this class so every live allocation is attributed to a heap, memory type
+ *  and category. Heap budgets are queried once per frame, and callbacks are raised when a heap crosses the
+ *  warning or critical fraction of its budget so systems like texture streaming can release memory before
+ *  allocations start failing. A failed allocation prints the counters and forces critical pressure on its heap
+ */
+class MemoryTelemetry {
+private:
+    struct Allocation {
+        VkDeviceSize size;
+        uint32_t type;
+        MemoryCategory category;
+    };
+
+    VkInstance instance;
+    VkPhysicalDevice physical_device;
+    VkDevice device;
+    VkAllocationCallbacks* p_allocs;
+
+    /**
+     * Whether VK_EXT_memory_budget is enabled on the device
+     */
+    bool memory_budget;
+
+    VkPhysicalDeviceMemoryProperties mem_props;
+
+    std::mutex lock;
+    std::unordered_map<VkDeviceMemory, Allocation> allocations;
+    MemoryStats stats;
+
+    /**
+     * Heaps that failed an allocation since the last update
+     */
+    bool alloc_failed[VK_MAX_MEMORY_HEAPS];
+
+    /**
+     * Fractions of a heap's budget that raise warning and critical pressure. Pressure drops a level once usage
+     *  falls a margin below the threshold, so it doesn't flicker around it
+     */
+    float warning_fraction = 0.8f;
+    float critical_fraction = 0.95f;
+    float release_margin = 0.05f;
+
+    std::vector<std::pair<uint32_t, MemoryPressureCallback>> callbacks;
+    uint32_t next_callback_id = 0;
+
+    static void countAlloc(MemoryCounters* counters, VkDeviceSize size);
+    static void countFree(MemoryCounters* counters, VkDeviceSize size);
+
+    MemoryPressure getPressure(MemoryPressure current, VkDeviceSize budget, VkDeviceSize usage);
+
+public:
+    /**
+     * @param instance instance the device was created from, to load VK_EXT_memory_budget queries
+     * @param physical_device physical device
+     * @param device logical device allocations are made on
+     * @param p_allocs allocation callbacks passed to Vulkan calls
+     * @param memory_budget whether VK_EXT_memory_budget is enabled on the device
+     */
+    MemoryTelemetry(VkInstance instance, VkPhysicalDevice physical_device, VkDevice device,
+        VkAllocationCallbacks* p_allocs, bool memory_budget);
+
+    /**
+     * Reports allocations still live, which are leaks
+     */
+    ~MemoryTelemetry();
+
+    /**
+     * Allocate device memory and attribute it to a category
+     * @param alloc_info allocation parameters, as for vkAllocateMemory
+     * @param category what the memory is used for
+     * @param memory [output] allocated memory
+     * @return result of vkAllocateMemory
+     */
+    VkResult allocateMemory(const VkMemoryAllocateInfo& alloc_info, MemoryCategory category, VkDeviceMemory* memory);
+
+    /**
+     * Free memory allocated with allocateMemory. VK_NULL_HANDLE is ignored
+     */
+    void freeMemory(VkDeviceMemory memory);
+
+    /**
+     * Query the budget and usage of each heap. Without VK_EXT_memory_budget, budgets are heap sizes and usage is
+     *  the live bytes allocated through the telemetry
+     * @param budgets [output] VK_MAX_MEMORY_HEAPS budgets
+     * @param usages [output] VK_MAX_MEMORY_HEAPS usages
+     */
+    void queryHeapBudgets(VkDeviceSize* budgets, VkDeviceSize* usages);
+
+    /**
+     * Refresh heap budgets and raise callbacks for heaps whose pressure changed. Call once per frame on the
+     *  thread that submits frames; callbacks run on that thread
+     */
+    void update();
+
+    /**
+     * Register a callback for pressure changes
+     * @return id to remove the callback with
+     */
+    uint32_t addPressureCallback(MemoryPressureCallback callback);
+
+    void removePressureCallback(uint32_t id);
+
+    /**
+     * Set the fractions of each heap's budget that raise warning and critical pressure
+     */
+    void setPressureThresholds(float warning_fraction, float critical_fraction);
+
+    /**
+     * Get the highest pressure over device local heaps, as of the last update
+     */
+    MemoryPressure getDeviceLocalPressure();
+
+    /**
+     * Get a snapshot of all counters, with budgets as of the last update
+     */
+    MemoryStats getStats();
+
+    /**
+     * Write per-heap, per-type and per-category tables of counters
+     * @param out stream to write to
+     */
+    void printStats(std::ostream& out);
+};
@@ -0,0 +1,513 @@
+/** @file MeshLod.cpp
+*
+* @brief Defines generation of mesh level of detail chains with quadric error
+*   metrics, and selection of a level per object from projected error
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			01/03/2018
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <math.h>
+#include <string.h>
+
+#include "MeshLod.h"
+#include "Common.h"
+
+/**
+ * Weight of the planes that keep open borders in place, relative to the faces along them
+ */
+#define BORDER_WEIGHT 10.0
+
+/**
+ * A level that removes fewer triangles than this fraction of the previous level isn't worth its draws
+ */
+#define MIN_LEVEL_REDUCTION 0.85f
+
+/**
+ * Sum of weighted squared distances to a set of planes, as a symmetric 4x4 matrix
+ */
+struct Quadric {
+    double a2, b2, c2, d2;
+    double ab, ac, ad, bc, bd, cd;
+
+    /**
+     * Total weight of the planes, which turns the sum into a mean
+     */
+    double weight;
+};
+
+static void addPlane(Quadric* q, double a, double b, double c, double d, double weight) {
+    q->a2 += weight * a * a;
+    q->b2 += weight * b * b;
+    q->c2 += weight * c * c;
+    q->d2 += weight * d * d;
+    q->ab += weight * a * b;
+    q->ac += weight * a * c;
+    q->ad += weight * a * d;
+    q->bc += weight * b * c;
+    q->bd += weight * b * d;
+    q->cd += weight * c * d;
+    q->weight += weight;
+}
+
+static void addQuadric(Quadric* q, const Quadric& other) {
+    q->a2 += other.a2;
+    q->b2 += other.b2;
+    q->c2 += other.c2;
+    q->d2 += other.d2;
+    q->ab += other.ab;
+    q->ac += other.ac;
+    q->ad += other.ad;
+    q->bc += other.bc;
+    q->bd += other.bd;
+    q->cd += other.cd;
+    q->weight += other.weight;
+}
+
+/**
+ * Mean squared distance of a point from the planes of two quadrics
+ */
+static double evaluateQuadrics(const Quadric& q0, const Quadric& q1, const float* p) {
+    Quadric q = q0;
+    addQuadric(&q, q1);
+    if (q.weight <= 0.0) {
+        return 0.0;
+    }
+
+    double x = p[0], y = p[1], z = p[2];
+    double error = q.a2 * x * x + q.b2 * y * y + q.c2 * z * z + q.d2 +
+        2.0 * (q.ab * x * y + q.ac * x * z + q.bc * y * z + q.ad * x + q.bd * y + q.cd * z);
+    return MAX(error, 0.0) / q.weight;
+}
+
+static void triangleNormal(const float* p0, const float* p1, const float* p2, double* normal) {
+    double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    double e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+    normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+static uint64_t edgeKey(uint32_t a, uint32_t b) {
+    return a < b ? (static_cast<uint64_t>(a) << 32) | b : (static_cast<uint64_t>(b) << 32) | a;
+}
+
+/**
+ * Collapses edges of a mesh, keeping its state between levels so quadrics accumulate the error of every
+ *  earlier collapse
+ */
+class MeshSimplifier {
+private:
+    const float* positions;
+    uint32_t vertex_count;
+
+    /**
+     * Current triangles, as the first vertex at each position. Adjacency, quadrics and collapses all work on these
+     */
+    std::vector<uint32_t> triangles;
+
+    /**
+     * The vertex each corner of the current triangles draws, at the same position as its entry in triangles, so
+     *  attribute seams stay sharp
+     */
+    std::vector<uint32_t> corners;
+
+    /**
+     * Quadric of each position's first vertex
+     */
+    std::vector<Quadric> quadrics;
+
+    /**
+     * Largest error of any collapse so far
+     */
+    float error = 0.0f;
+
+    /**
+     * Whether collapsing one vertex onto another would turn a remaining triangle around it over
+     */
+    bool flipsTriangle(uint32_t from, uint32_t to, const std::vector<uint32_t>& adjacency_offsets,
+        const std::vector<uint32_t>& adjacency) {
+
+        for (uint32_t i = adjacency_offsets[from]; i < adjacency_offsets[from + 1]; i++) {
+            const uint32_t* triangle = &triangles[adjacency[i] * 3];
+            if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+                continue;
+            }
+
+            uint32_t moved[3];
+            for (uint32_t v = 0; v < 3; v++) {
+                moved[v] = triangle[v] == from ? to : triangle[v];
+            }
+
+            double before[3], after[3];
+            triangleNormal(&positions[triangle[0] * 3], &positions[triangle[1] * 3], &positions[triangle[2] * 3],
+                before);
+            triangleNormal(&positions[moved[0] * 3], &positions[moved[1] * 3], &positions[moved[2] * 3], after);
+            if (before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0.0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Pair each vertex drawn at one end of an edge with the vertex the face across the edge draws at the other.
+     *  Fails if a vertex has no face across the edge, as collapsing it would move it off its attribute seam
+     */
+    bool pairCorners(uint32_t from, uint32_t to, const std::vector<uint32_t>& adjacency_offsets,
+        const std::vector<uint32_t>& adjacency, std::unordered_map<uint32_t, uint32_t>* corner_remap) {
+
+        std::unordered_map<uint32_t, uint32_t> pairs;
+        for (uint32_t i = adjacency_offsets[from]; i < adjacency_offsets[from + 1]; i++) {
+            const uint32_t* triangle = &triangles[adjacency[i] * 3];
+            const uint32_t* corner = &corners[adjacency[i] * 3];
+            if (triangle[0] != to && triangle[1] != to && triangle[2] != to) {
+                continue;
+            }
+
+            uint32_t from_corner = 0, to_corner = 0;
+            for (uint32_t v = 0; v < 3; v++) {
+                from_corner = triangle[v] == from ? corner[v] : from_corner;
+                to_corner = triangle[v] == to ? corner[v] : to_corner;
+            }
+            pairs.insert(std::make_pair(from_corner, to_corner));
+        }
+
+        for (uint32_t i = adjacency_offsets[from]; i < adjacency_offsets[from + 1]; i++) {
+            const uint32_t* triangle = &triangles[adjacency[i] * 3];
+            for (uint32_t v = 0; v < 3; v++) {
+                if (triangle[v] == from && pairs.find(corners[adjacency[i] * 3 + v]) == pairs.end()) {
+                    return false;
+                }
+            }
+        }
+
+        corner_remap->insert(pairs.begin(), pairs.end());
+        return true;
+    }
+
+public:
+    MeshSimplifier(const MeshData& mesh) {
+        positions = mesh.positions.data();
+        vertex_count = mesh.getVertexCount();
+
+        // Weld vertices by position, so attribute seams collapse as one
+        std::vector<uint32_t> welded(vertex_count);
+        std::unordered_map<std::string, uint32_t> first_at_position;
+        for (uint32_t i = 0; i < vertex_count; i++) {
+            std::string key(reinterpret_cast<const char*>(&positions[i * 3]), sizeof(float) * 3);
+            welded[i] = first_at_position.insert(std::make_pair(key, i)).first->second;
+        }
+
+        triangles.reserve(mesh.indices.size());
+        corners.reserve(mesh.indices.size());
+        for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+            uint32_t a = welded[mesh.indices[i]];
+            uint32_t b = welded[mesh.indices[i + 1]];
+            uint32_t c = welded[mesh.indices[i + 2]];
+            if (a != b && b != c && a != c) {
+                triangles.push_back(a);
+                triangles.push_back(b);
+                triangles.push_back(c);
+                corners.insert(corners.end(), mesh.indices.begin() + i, mesh.indices.begin() + i + 3);
+            }
+        }
+
+        // Each face adds its plane to its corners, weighted by area
+        quadrics.assign(vertex_count, Quadric());
+        std::unordered_map<uint64_t, uint32_t> edge_uses;
+        for (size_t t = 0; t < triangles.size(); t += 3) {
+            double normal[3];
+            const float* p0 = &positions[triangles[t] * 3];
+            triangleNormal(p0, &positions[triangles[t + 1] * 3], &positions[triangles[t + 2] * 3], normal);
+            double length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+            if (length > 0.0) {
+                double a = normal[0] / length, b = normal[1] / length, c = normal[2] / length;
+                double d = -(a * p0[0] + b * p0[1] + c * p0[2]);
+                for (uint32_t v = 0; v < 3; v++) {
+                    addPlane(&quadrics[triangles[t + v]], a, b, c, d, 0.5 * length);
+                }
+            }
+
+            for (uint32_t v = 0; v < 3; v++) {
+                edge_uses[edgeKey(triangles[t + v], triangles[t + (v + 1) % 3])]++;
+            }
+        }
+
+        // Edges of one face are open borders: a plane through the edge, perpendicular to the face, keeps them
+        // from shrinking inwards
+        for (size_t t = 0; t < triangles.size(); t += 3) {
+            double normal[3];
+            triangleNormal(&positions[triangles[t] * 3], &positions[triangles[t + 1] * 3],
+                &positions[triangles[t + 2] * 3], normal);
+
+            for (uint32_t v = 0; v < 3; v++) {
+                uint32_t i0 = triangles[t + v];
+                uint32_t i1 = triangles[t + (v + 1) % 3];
+                if (edge_uses[edgeKey(i0, i1)] != 1) {
+                    continue;
+                }
+
+                const float* p0 = &positions[i0 * 3];
+                const float* p1 = &positions[i1 * 3];
+                double edge[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+                double plane[3] = {
+                    edge[1] * normal[2] - edge[2] * normal[1],
+                    edge[2] * normal[0] - edge[0] * normal[2],
+                    edge[0] * normal[1] - edge[1] * normal[0]
+                };
+                double length = sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+                if (length == 0.0) {
+                    continue;
+                }
+
+                double a = plane[0] / length, b = plane[1] / length, c = plane[2] / length;
+                double d = -(a * p0[0] + b * p0[1] + c * p0[2]);
+                double weight = BORDER_WEIGHT * (edge[0] * edge[0] + edge[1] * edge[1] + edge[2] * edge[2]);
+                addPlane(&quadrics[i0], a, b, c, d, weight);
+                addPlane(&quadrics[i1], a, b, c, d, weight);
+            }
+        }
+    }
+
+    /**
+     * Collapse edges, cheapest first, until the mesh is down to a triangle count or the next collapse would
+     *  exceed an error
+     * @param target_triangles triangles to stop at
+     * @param max_error largest error of a collapse, in mesh units
+     */
+    void simplify(uint32_t target_triangles, float max_error) {
+        double max_cost = static_cast<double>(max_error) * max_error;
+
+        while (getTriangleCount() > target_triangles) {
+            // Triangles around each vertex
+            uint32_t triangle_count = getTriangleCount();
+            std::vector<uint32_t> adjacency_offsets(vertex_count + 1, 0);
+            for (uint32_t index : triangles) {
+                adjacency_offsets[index + 1]++;
+            }
+            for (uint32_t i = 0; i < vertex_count; i++) {
+                adjacency_offsets[i + 1] += adjacency_offsets[i];
+            }
+            std::vector<uint32_t> adjacency(triangles.size());
+            std::vector<uint32_t> fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+            for (uint32_t t = 0; t < triangle_count; t++) {
+                for (uint32_t v = 0; v < 3; v++) {
+                    adjacency[fill[triangles[t * 3 + v]]++] = t;
+                }
+            }
+
+            // Every edge once, in whichever direction costs less
+            std::vector<uint64_t> edges;
+            edges.reserve(triangles.size());
+            for (uint32_t t = 0; t < triangle_count; t++) {
+                for (uint32_t v = 0; v < 3; v++) {
+                    edges.push_back(edgeKey(triangles[t * 3 + v], triangles[t * 3 + (v + 1) % 3]));
+                }
+            }
+            std::sort(edges.begin(), edges.end());
+            edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+            struct Collapse {
+                uint32_t from;
+                uint32_t to;
+                double cost;
+            };
+            std::vector<Collapse> collapses;
+            collapses.reserve(edges.size());
+            for (uint64_t edge : edges) {
+                uint32_t a = static_cast<uint32_t>(edge >> 32);
+                uint32_t b = static_cast<uint32_t>(edge);
+                double to_a = evaluateQuadrics(quadrics[a], quadrics[b], &positions[a * 3]);
+                double to_b = evaluateQuadrics(quadrics[a], quadrics[b], &positions[b * 3]);
+                collapses.push_back(to_a < to_b ? Collapse{ b, a, to_a } : Collapse{ a, b, to_b });
+            }
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) {
+                return x.cost < y.cost;
+            });
+
+            // Collapses in one pass must not share a neighborhood, so each sees the triangles adjacency describes
+            std::vector<uint32_t> remap(vertex_count);
+            for (uint32_t i = 0; i < vertex_count; i++) {
+                remap[i] = i;
+            }
+            std::vector<bool> touched(vertex_count, false);
+            std::unordered_map<uint32_t, uint32_t> corner_remap;
+            uint32_t remaining = triangle_count;
+            uint32_t collapsed = 0;
+
+            for (const Collapse& collapse : collapses) {
+                if (collapse.cost > max_cost || remaining <= target_triangles) {
+                    break;
+                }
+                if (touched[collapse.from] || touched[collapse.to] ||
+                    flipsTriangle(collapse.from, collapse.to, adjacency_offsets, adjacency) ||
+                    !pairCorners(collapse.from, collapse.to, adjacency_offsets, adjacency, &corner_remap)) {
+                    continue;
+                }
+
+                remap[collapse.from] = collapse.to;
+                addQuadric(&quadrics[collapse.to], quadrics[collapse.from]);
+                error = MAX(error, static_cast<float>(sqrt(collapse.cost)));
+                collapsed++;
+
+                for (uint32_t i = adjacency_offsets[collapse.from]; i < adjacency_offsets[collapse.from + 1]; i++) {
+                    const uint32_t* triangle = &triangles[adjacency[i] * 3];
+                    if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) {
+                        remaining--;
+                    }
+                    touched[triangle[0]] = true;
+                    touched[triangle[1]] = true;
+                    touched[triangle[2]] = true;
+                }
+            }
+
+            if (collapsed == 0) {
+                break;
+            }
+
+            // Drop triangles that lost a side. Corners only move if their position collapsed, to the vertex paired
+            //  with theirs
+            size_t write = 0;
+            for (size_t t = 0; t < triangles.size(); t += 3) {
+                uint32_t a = remap[triangles[t]];
+                uint32_t b = remap[triangles[t + 1]];
+                uint32_t c = remap[triangles[t + 2]];
+                if (a == b || b == c || a == c) {
+                    continue;
+                }
+
+                for (uint32_t v = 0; v < 3; v++) {
+                    uint32_t corner = corners[t + v];
+                    if (remap[triangles[t + v]] != triangles[t + v]) {
+                        corner = corner_remap[corner];
+                    }
+                    corners[write + v] = corner;
+                }
+                triangles[write++] = a;
+                triangles[write++] = b;
+                triangles[write++] = c;
+            }
+            triangles.resize(write);
+            corners.resize(write);
+        }
+    }
+
+    uint32_t getTriangleCount() {
+        return static_cast<uint32_t>(triangles.size() / 3);
+    }
+
+    float getError() {
+        return error;
+    }
+
+    /**
+     * Append the current triangles. Indices are of vertices in the original mesh
+     */
+    void getIndices(std::vector<uint32_t>* indices) {
+        indices->insert(indices->end(), corners.begin(), corners.end());
+    }
+};
+
+LodChain generateLods(MeshData* mesh, const LodOptions& options) {
+    if (mesh->indices.empty()) {
+        throw std::runtime_error("Failed to generate LODs: mesh has no indices");
+    }
+
+    LodChain chain;
+    chain.level_count = 1;
+    chain.levels[0].first_index = 0;
+    chain.levels[0].index_count = static_cast<uint32_t>(mesh->indices.size());
+    chain.levels[0].error = 0.0f;
+
+    // Bounding sphere around the center of the bounding box
+    uint32_t vertex_count = mesh->getVertexCount();
+    float bounds_min[3] = { mesh->positions[0], mesh->positions[1], mesh->positions[2] };
+    float bounds_max[3] = { mesh->positions[0], mesh->positions[1], mesh->positions[2] };
+    for (uint32_t i = 1; i < vertex_count; i++) {
+        for (uint32_t c = 0; c < 3; c++) {
+            bounds_min[c] = MIN(bounds_min[c], mesh->positions[i * 3 + c]);
+            bounds_max[c] = MAX(bounds_max[c], mesh->positions[i * 3 + c]);
+        }
+    }
+
+    chain.radius = 0.0f;
+    for (uint32_t c = 0; c < 3; c++) {
+        chain.center[c] = 0.5f * (bounds_min[c] + bounds_max[c]);
+    }
+    for (uint32_t i = 0; i < vertex_count; i++) {
+        float dx = mesh->positions[i * 3] - chain.center[0];
+        float dy = mesh->positions[i * 3 + 1] - chain.center[1];
+        float dz = mesh->positions[i * 3 + 2] - chain.center[2];
+        chain.radius = MAX(chain.radius, sqrtf(dx * dx + dy * dy + dz * dz));
+    }
+
+    uint32_t max_levels = MIN(options.max_levels, static_cast<uint32_t>(MAX_LOD_LEVELS));
+    if (max_levels <= 1) {
+        return chain;
+    }
+
+    // The simplifier reads positions while indices are appended, which doesn't move them
+    MeshSimplifier simplifier(*mesh);
+    uint32_t triangle_count = chain.levels[0].index_count / 3;
+
+    while (chain.level_count < max_levels) {
+        uint32_t target = static_cast<uint32_t>(triangle_count * options.reduction);
+        if (target < options.min_triangles) {
+            break;
+        }
+
+        simplifier.simplify(target, options.max_error * chain.radius);
+        uint32_t simplified_count = simplifier.getTriangleCount();
+        if (simplified_count > triangle_count * MIN_LEVEL_REDUCTION) {
+            break;
+        }
+
+        LodLevel& level = chain.levels[chain.level_count++];
+        level.first_index = static_cast<uint32_t>(mesh->indices.size());
+        level.index_count = simplified_count * 3;
+        level.error = simplifier.getError();
+        simplifier.getIndices(&mesh->indices);
+        triangle_count = simplified_count;
+    }
+
+    return chain;
+}
+
+LodSelector::LodSelector(uint32_t object_count, float threshold, float hysteresis) : levels(object_count, 0) {
+    this->threshold = threshold;
+    this->hysteresis = hysteresis;
+}
+
+uint32_t LodSelector::select(const LodChain& chain, uint32_t object, float distance, float projection_scale,
+    float object_scale) {
+
+    // Inside the bounds every level would be too coarse
+    if (distance <= 0.0f) {
+        levels[object] = 0;
+        return 0;
+    }
+
+    float pixels_per_unit = projection_scale * object_scale / distance;
+    uint32_t level = MIN(static_cast<uint32_t>(levels[object]), chain.level_count - 1);
+
+    // Refine as soon as the current level is visibly wrong, but only coarsen once the next level is well under
+    // the threshold
+    while (level > 0 && chain.levels[level].error * pixels_per_unit > threshold) {
+        level--;
+    }
+    while (level + 1 < chain.level_count &&
+        chain.levels[level + 1].error * pixels_per_unit <= threshold * (1.0f - hysteresis)) {
+        level++;
+    }
+
+    levels[object] = static_cast<uint8_t>(level);
+    return level;
+}
@@ -0,0 +1,124 @@
+/** @file MeshLod.h
+*
+* @brief Defines generation of mesh level of detail chains with quadric error
+*   metrics, and selection of a level per object from projected error
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			01/03/2018
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "VertexFormat.h"
+
+#define MAX_LOD_LEVELS 8
+
+/**
+ * One level of a chain: a range of the mesh's index buffer
+ */
+struct LodLevel {
+    uint32_t first_index;
+    uint32_t index_count;
+
+    /**
+     * Distance of the simplified surface from the original, in mesh units, estimated from the quadrics of the
+     *  collapses that made it. 0 for the original
+     */
+    float error;
+};
+
+/**
+ * Levels of a mesh from the original (level 0) to the coarsest. Every level indexes the same vertices, and their
+ *  indices follow each other in the mesh's index buffer
+ */
+struct LodChain {
+    uint32_t level_count = 0;
+    LodLevel levels[MAX_LOD_LEVELS];
+
+    /**
+     * Bounding sphere of the mesh, used to find how far away an object is
+     */
+    float center[3];
+    float radius;
+};
+
+/**
+ * How far to simplify
+ */
+struct LodOptions {
+    uint32_t max_levels = MAX_LOD_LEVELS;
+
+    /**
+     * Triangles each level aims for, relative to the previous level
+     */
+    float reduction = 0.5f;
+
+    /**
+     * No level is made with fewer triangles than this
+     */
+    uint32_t min_triangles = 32;
+
+    /**
+     * Largest error of any level, relative to the bounding sphere radius
+     */
+    float max_error = 0.25f;
+};
+
+/**
+ * Generate a chain of simplified levels by collapsing edges in order of quadric error. Collapses keep one of
+ *  the edge's vertices, so levels reuse the original vertices and only add indices. Vertices at the same
+ *  position collapse as one, so attribute seams don't tear apart, while each corner keeps its own vertex so
+ *  the seams stay sharp
+ * @param mesh [in/output] indexed mesh. Indices of the new levels are appended
+ * @param options how far to simplify
+ * @return levels, with level 0 covering the indices the mesh had
+ */
+LodChain generateLods(MeshData* mesh, const LodOptions& options);
+
+/**
+ * Picks a level per object from the error its levels would have on screen. An object only moves to a coarser
+ *  level once that level is well below the threshold, so objects near a switching distance don't flicker
+ *  between levels every frame
+ */
+class LodSelector {
+private:
+    /**
+     * Level each object was drawn at last
+     */
+    std::vector<uint8_t> levels;
+
+    /**
+     * Projected error allowed, in pixels
+     */
+    float threshold;
+
+    /**
+     * Fraction of the threshold a coarser level's error must be below before switching to it
+     */
+    float hysteresis;
+
+public:
+    /**
+     * @param object_count number of objects, all starting at level 0
+     * @param threshold projected error allowed, in pixels
+     * @param hysteresis fraction of the threshold a coarser level must be under to switch to it
+     */
+    LodSelector(uint32_t object_count, float threshold = 1.0f, float hysteresis = 0.25f);
+
+    /**
+     * Select the level an object is drawn at this frame
+     * @param chain levels of the object's mesh
+     * @param object index of the object
+     * @param distance distance from the eye to the nearest point of the object's bounds, in world units
+     * @param projection_scale pixels per world unit at a distance of one: viewport height / (2 tan(fov / 2))
+     * @param object_scale largest scale of the object's world matrix
+     * @return level to draw
+     */
+    uint32_t select(const LodChain& chain, uint32_t object, float distance, float projection_scale,
+        float object_scale);
+};
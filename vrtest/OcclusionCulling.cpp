@@ -0,0 +1,873 @@
+/** @file OcclusionCulling.cpp
+*
+* @brief Defines hierarchical-Z occlusion culling: a depth pyramid built from
+*   the previous frame's depth, tested against on the GPU or the CPU
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			01/05/2018
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include "OcclusionCulling.h"
+#include "Common.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+/**
+ * Push constants of hiz_build.comp
+ */
+struct BuildConstants {
+    uint32_t level;
+    uint32_t eye_width;
+    uint32_t eye_height;
+};
+
+/**
+ * Push constants of hiz_cull.comp. Offsets are in 32-bit words from the start of the frame's slice
+ */
+struct CullConstants {
+    float bounds_min[4];
+    float bounds_max[4];
+    uint32_t params_offset;
+    uint32_t candidates_offset;
+    uint32_t levels_offset;
+    uint32_t regions_offset;
+    uint32_t region_words;
+    uint32_t commands_offset;
+    uint32_t instance_count;
+    uint32_t level_count;
+    uint32_t draws_per_level;
+    uint32_t mode;
+};
+
+/**
+ * Boxes are tested at the level where they span at most this many texels, so at most 5x5 texels are read
+ */
+#define TEST_TEXELS 4.0f
+
+/**
+ * Widest level read back for the CPU test, covering both eyes
+ */
+#define READBACK_WIDTH 128
+
+static uint32_t floorPow2(uint32_t value) {
+    uint32_t result = 1;
+    while (result * 2 <= value) {
+        result *= 2;
+    }
+    return result;
+}
+
+void CpuDepthPyramid::update(const float* depth, uint32_t width, uint32_t height, const float view_proj[2][16]) {
+    level_count = 0;
+    uint32_t total = 0;
+    while (level_count < MAX_PYRAMID_LEVELS) {
+        widths[level_count] = width;
+        heights[level_count] = height;
+        offsets[level_count] = total;
+        total += width * height;
+        level_count++;
+
+        if (width == 1 && height == 1) {
+            break;
+        }
+        width = MAX(width / 2, 1u);
+        height = MAX(height / 2, 1u);
+    }
+
+    texels.resize(total);
+    memcpy(texels.data(), depth, sizeof(float) * widths[0] * heights[0]);
+
+    for (uint32_t level = 1; level < level_count; level++) {
+        const float* source = texels.data() + offsets[level - 1];
+        float* target = texels.data() + offsets[level];
+        uint32_t source_width = widths[level - 1];
+        uint32_t source_height = heights[level - 1];
+
+        for (uint32_t y = 0; y < heights[level]; y++) {
+            uint32_t y0 = y * 2;
+            uint32_t y1 = MIN(y0 + 1, source_height - 1);
+            for (uint32_t x = 0; x < widths[level]; x++) {
+                uint32_t x0 = x * 2;
+                uint32_t x1 = MIN(x0 + 1, source_width - 1);
+                float a = MAX(source[y0 * source_width + x0], source[y0 * source_width + x1]);
+                float b = MAX(source[y1 * source_width + x0], source[y1 * source_width + x1]);
+                target[y * widths[level] + x] = MAX(a, b);
+            }
+        }
+    }
+
+    for (uint32_t eye = 0; eye < 2; eye++) {
+        this->view_proj[eye] = mat4Load(view_proj[eye]);
+    }
+}
+
+bool CpuDepthPyramid::isValid() const {
+    return level_count > 0;
+}
+
+float CpuDepthPyramid::getFarthestDepth(float x0, float y0, float x1, float y1) const {
+    // Coarsest level needed to keep the rectangle within a few texels
+    float size = MAX(x1 - x0, y1 - y0);
+    uint32_t level = 0;
+    if (size > TEST_TEXELS) {
+        level = MIN(static_cast<uint32_t>(ceilf(log2f(size / TEST_TEXELS))), level_count - 1);
+    }
+
+    uint32_t tx0 = MIN(static_cast<uint32_t>(x0) >> level, widths[level] - 1);
+    uint32_t ty0 = MIN(static_cast<uint32_t>(y0) >> level, heights[level] - 1);
+    uint32_t tx1 = MIN(static_cast<uint32_t>(x1) >> level, widths[level] - 1);
+    uint32_t ty1 = MIN(static_cast<uint32_t>(y1) >> level, heights[level] - 1);
+
+    const float* texel_row = texels.data() + offsets[level];
+    float farthest = 0.0f;
+    for (uint32_t y = ty0; y <= ty1; y++) {
+        for (uint32_t x = tx0; x <= tx1; x++) {
+            farthest = MAX(farthest, texel_row[y * widths[level] + x]);
+        }
+    }
+    return farthest;
+}
+
+bool CpuDepthPyramid::isBoxVisible(const Mat4& world, const float bounds_min[3], const float bounds_max[3]) const {
+    // Corners as component arrays, four at a time: corners 0-3 are the near z face and 4-7 the far one
+    Float4 xs = float4Set(bounds_min[0], bounds_max[0], bounds_min[0], bounds_max[0]);
+    Float4 ys = float4Set(bounds_min[1], bounds_min[1], bounds_max[1], bounds_max[1]);
+    Float4 zs[2] = { float4Splat(bounds_min[2]), float4Splat(bounds_max[2]) };
+    float eye_width = static_cast<float>(widths[0] / 2);
+    float eye_height = static_cast<float>(heights[0]);
+
+    for (uint32_t eye = 0; eye < 2; eye++) {
+        // Rows of the box's model-view-projection, so each clip component is computed for four corners at once
+        Mat4 rows = mat4Transpose(view_proj[eye] * world);
+        Float4 xy_terms[4];
+        for (uint32_t r = 0; r < 4; r++) {
+            xy_terms[r] = float4MulAdd(float4SplatLane<0>(rows.cols[r]), xs,
+                float4MulAdd(float4SplatLane<1>(rows.cols[r]), ys, float4SplatLane<3>(rows.cols[r])));
+        }
+
+        Float4 low_x = float4Splat(FLT_MAX);
+        Float4 low_y = float4Splat(FLT_MAX);
+        Float4 high_x = float4Splat(-FLT_MAX);
+        Float4 high_y = float4Splat(-FLT_MAX);
+        Float4 near_z = float4Splat(FLT_MAX);
+
+        for (uint32_t face = 0; face < 2; face++) {
+            Float4 clip[4];
+            for (uint32_t r = 0; r < 4; r++) {
+                clip[r] = float4MulAdd(float4SplatLane<2>(rows.cols[r]), zs[face], xy_terms[r]);
+            }
+
+            // Corners in front of the near plane have negative depth. The box may cover the whole eye
+            if (float4ReduceMin(clip[2]) < 0.0f) {
+                return true;
+            }
+
+            Float4 x = float4Div(clip[0], clip[3]);
+            Float4 y = float4Div(clip[1], clip[3]);
+            low_x = float4Min(low_x, x);
+            low_y = float4Min(low_y, y);
+            high_x = float4Max(high_x, x);
+            high_y = float4Max(high_y, y);
+            near_z = float4Min(near_z, float4Div(clip[2], clip[3]));
+        }
+
+        // Depth is only known inside the view the pyramid was rendered with
+        float min_x = float4ReduceMin(low_x);
+        float min_y = float4ReduceMin(low_y);
+        float max_x = float4ReduceMax(high_x);
+        float max_y = float4ReduceMax(high_y);
+        if (min_x < -1.0f || min_y < -1.0f || max_x > 1.0f || max_y > 1.0f) {
+            return true;
+        }
+
+        // Each eye has its half of the pyramid
+        float x0 = (min_x * 0.5f + 0.5f + eye) * eye_width;
+        float x1 = (max_x * 0.5f + 0.5f + eye) * eye_width;
+        float y0 = (min_y * 0.5f + 0.5f) * eye_height;
+        float y1 = (max_y * 0.5f + 0.5f) * eye_height;
+        if (float4ReduceMin(near_z) <= getFarthestDepth(x0, y0, x1, y1)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+DepthPyramid::DepthPyramid(GraphicsDevice* graphics_device, VkAllocationCallbacks* p_allocs, uint32_t frame_count,
+    VkImage depth_image, VkFormat depth_format, VkExtent2D depth_extent, bool readback) {
+
+    this->graphics_device = graphics_device;
+    this->p_allocs = p_allocs;
+    this->frame_count = frame_count;
+    this->depth_extent = depth_extent;
+    this->readback = readback;
+
+    frame_views.resize(frame_count);
+    frame_built.assign(frame_count, false);
+    memset(&last_view, 0, sizeof(last_view));
+
+    createImage(depth_image, depth_format);
+    clearImage();
+    createPipelines();
+    if (readback) {
+        createReadback();
+    }
+
+    std::cout << "Created " << extent.width << "x" << extent.height << " depth pyramid with " << level_count <<
+        " levels" << std::endl;
+}
+
+DepthPyramid::~DepthPyramid() {
+    VkDevice device = graphics_device->device();
+
+    vkDestroyPipeline(device, build_pipeline, p_allocs);
+    vkDestroyPipeline(device, cull_pipeline, p_allocs);
+    vkDestroyPipelineLayout(device, build_layout, p_allocs);
+    vkDestroyPipelineLayout(device, cull_layout, p_allocs);
+    vkDestroyShaderModule(device, build_shader, p_allocs);
+    vkDestroyShaderModule(device, cull_shader, p_allocs);
+    vkDestroyDescriptorPool(device, descriptor_pool, p_allocs);
+    vkDestroyDescriptorSetLayout(device, build_set_layout, p_allocs);
+    vkDestroyDescriptorSetLayout(device, cull_set_layout, p_allocs);
+
+    if (readback) {
+        vkUnmapMemory(device, readback_mem);
+        vkDestroyBuffer(device, readback_buffer, p_allocs);
+        graphics_device->getMemoryTelemetry()->freeMemory(readback_mem);
+    }
+
+    vkDestroySampler(device, sampler, p_allocs);
+    vkDestroyImageView(device, depth_view, p_allocs);
+    vkDestroyImageView(device, chain_view, p_allocs);
+    for (uint32_t level = 0; level < level_count; level++) {
+        vkDestroyImageView(device, levels[level], p_allocs);
+    }
+    vkDestroyImage(device, image, p_allocs);
+    graphics_device->getMemoryTelemetry()->freeMemory(image_mem);
+}
+
+void DepthPyramid::createImage(VkImage depth_image, VkFormat depth_format) {
+    VkDevice device = graphics_device->device();
+
+    // Level 0 is about half the depth resolution. Powers of two make every texel of a level cover exactly 2x2
+    // texels of the one below, and keep the boundary between the eyes on a texel edge
+    uint32_t eye_texels = floorPow2(MAX(depth_extent.width / 4, 1u));
+    extent.width = eye_texels * 2;
+    extent.height = floorPow2(MAX(depth_extent.height / 2, 1u));
+
+    level_count = 1;
+    while ((extent.width >> (level_count - 1)) > 1 || (extent.height >> (level_count - 1)) > 1) {
+        level_count++;
+    }
+    if (level_count > MAX_PYRAMID_LEVELS) {
+        throw std::runtime_error("Failed to create depth pyramid: depth buffer too large");
+    }
+
+    VkImageCreateInfo image_ci = {};
+    image_ci.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_ci.flags = 0;
+    image_ci.imageType = VK_IMAGE_TYPE_2D;
+    image_ci.format = VK_FORMAT_R32_SFLOAT;
+    image_ci.extent = { extent.width, extent.height, 1 };
+    image_ci.mipLevels = level_count;
+    image_ci.arrayLayers = 1;
+    image_ci.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_ci.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_ci.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+        VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    image_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_ci.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    if (vkCreateImage(device, &image_ci, p_allocs, &image) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create depth pyramid image");
+    }
+
+    VkMemoryRequirements mem_req;
+    vkGetImageMemoryRequirements(device, image, &mem_req);
+
+    VkMemoryAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize = mem_req.size;
+    alloc_info.memoryTypeIndex = graphics_device->findMemType(mem_req.memoryTypeBits,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    if (graphics_device->getMemoryTelemetry()->allocateMemory(alloc_info, MEMORY_CATEGORY_IMAGE, &image_mem) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate device memory for depth pyramid");
+    }
+
+    if (vkBindImageMemory(device, image, image_mem, 0) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to bind memory to depth pyramid");
+    }
+
+    // One view per level for the build to write, and one of the whole chain for the cull to sample
+    VkImageViewCreateInfo view_ci = {};
+    view_ci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_ci.flags = 0;
+    view_ci.image = image;
+    view_ci.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_ci.format = VK_FORMAT_R32_SFLOAT;
+    view_ci.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+    view_ci.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+    view_ci.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+    view_ci.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+    view_ci.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    view_ci.subresourceRange.levelCount = 1;
+    view_ci.subresourceRange.baseArrayLayer = 0;
+    view_ci.subresourceRange.layerCount = 1;
+
+    for (uint32_t level = 0; level < level_count; level++) {
+        view_ci.subresourceRange.baseMipLevel = level;
+        if (vkCreateImageView(device, &view_ci, p_allocs, &levels[level]) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create depth pyramid level view");
+        }
+    }
+
+    view_ci.subresourceRange.baseMipLevel = 0;
+    view_ci.subresourceRange.levelCount = level_count;
+    if (vkCreateImageView(device, &view_ci, p_allocs, &chain_view) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create depth pyramid view");
+    }
+
+    // Sampled views of a depth/stencil image may only have one aspect
+    view_ci.image = depth_image;
+    view_ci.format = depth_format;
+    view_ci.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    view_ci.subresourceRange.levelCount = 1;
+    if (vkCreateImageView(device, &view_ci, p_allocs, &depth_view) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create depth view for depth pyramid");
+    }
+
+    // Shaders only use texelFetch, so filtering doesn't matter
+    VkSamplerCreateInfo sampler_ci = {};
+    sampler_ci.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_ci.flags = 0;
+    sampler_ci.magFilter = VK_FILTER_NEAREST;
+    sampler_ci.minFilter = VK_FILTER_NEAREST;
+    sampler_ci.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_ci.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_ci.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_ci.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_ci.mipLodBias = 0.0f;
+    sampler_ci.anisotropyEnable = VK_FALSE;
+    sampler_ci.maxAnisotropy = 1.0f;
+    sampler_ci.compareEnable = VK_FALSE;
+    sampler_ci.minLod = 0.0f;
+    sampler_ci.maxLod = static_cast<float>(level_count);
+    sampler_ci.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    sampler_ci.unnormalizedCoordinates = VK_FALSE;
+
+    if (vkCreateSampler(device, &sampler_ci, p_allocs, &sampler) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create depth pyramid sampler");
+    }
+}
+
+void DepthPyramid::clearImage() {
+    VkDevice device = graphics_device->device();
+
+    // The pyramid stays in the general layout from here on. Clearing it to the far plane means nothing is
+    // occluded until a frame has built it
+    VkCommandPoolCreateInfo pool_ci = {};
+    pool_ci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_ci.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    pool_ci.queueFamilyIndex = graphics_device->getGraphicsQueueFamily();
+
+    VkCommandPool pool;
+    if (vkCreateCommandPool(device, &pool_ci, p_allocs, &pool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create depth pyramid command pool");
+    }
+
+    VkCommandBufferAllocateInfo buffer_ai = {};
+    buffer_ai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    buffer_ai.commandPool = pool;
+    buffer_ai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    buffer_ai.commandBufferCount = 1;
+
+    VkCommandBuffer cmd;
+    if (vkAllocateCommandBuffers(device, &buffer_ai, &cmd) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate depth pyramid command buffer");
+    }
+
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (vkBeginCommandBuffer(cmd, &begin_info) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to begin depth pyramid command buffer");
+    }
+
+    VkImageSubresourceRange range = {};
+    range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    range.baseMipLevel = 0;
+    range.levelCount = level_count;
+    range.baseArrayLayer = 0;
+    range.layerCount = 1;
+
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = range;
+
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+        nullptr, 1, &barrier);
+
+    VkClearColorValue far_plane = {};
+    far_plane.float32[0] = 1.0f;
+    vkCmdClearColorImage(cmd, image, VK_IMAGE_LAYOUT_GENERAL, &far_plane, 1, &range);
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr,
+        0, nullptr, 1, &barrier);
+
+    if (vkEndCommandBuffer(cmd) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to end depth pyramid command buffer");
+    }
+
+    VkFenceCreateInfo fence_ci = {};
+    fence_ci.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fence_ci.flags = 0;
+
+    VkFence fence;
+    if (vkCreateFence(device, &fence_ci, p_allocs, &fence) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create depth pyramid fence");
+    }
+
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &cmd;
+
+    if (vkQueueSubmit(graphics_device->getGraphicsQueue(), 1, &submit_info, fence) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit depth pyramid clear");
+    }
+
+    vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+    vkDestroyFence(device, fence, p_allocs);
+    vkDestroyCommandPool(device, pool, p_allocs);
+}
+
+void DepthPyramid::createPipelines() {
+    VkDevice device = graphics_device->device();
+
+    // Build: depth buffer for level 0, and the level below and the level being written for the rest
+    VkDescriptorSetLayoutBinding build_bindings[3] = {};
+    build_bindings[0].binding = 0;
+    build_bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    build_bindings[0].descriptorCount = 1;
+    build_bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    build_bindings[1].binding = 1;
+    build_bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    build_bindings[1].descriptorCount = 1;
+    build_bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    build_bindings[2].binding = 2;
+    build_bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    build_bindings[2].descriptorCount = 1;
+    build_bindings[2].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    // Cull: the whole pyramid, and the frame's slice of the instance buffer
+    VkDescriptorSetLayoutBinding cull_bindings[2] = {};
+    cull_bindings[0].binding = 0;
+    cull_bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    cull_bindings[0].descriptorCount = 1;
+    cull_bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    cull_bindings[1].binding = 1;
+    cull_bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    cull_bindings[1].descriptorCount = 1;
+    cull_bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutCreateInfo set_layout_ci = {};
+    set_layout_ci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    set_layout_ci.flags = 0;
+    set_layout_ci.bindingCount = 3;
+    set_layout_ci.pBindings = build_bindings;
+
+    if (vkCreateDescriptorSetLayout(device, &set_layout_ci, p_allocs, &build_set_layout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create depth pyramid descriptor set layout");
+    }
+
+    set_layout_ci.bindingCount = 2;
+    set_layout_ci.pBindings = cull_bindings;
+
+    if (vkCreateDescriptorSetLayout(device, &set_layout_ci, p_allocs, &cull_set_layout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create occlusion cull descriptor set layout");
+    }
+
+    VkDescriptorPoolSize pool_sizes[3] = {};
+    pool_sizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    pool_sizes[0].descriptorCount = level_count + frame_count;
+    pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    pool_sizes[1].descriptorCount = 2 * level_count;
+    pool_sizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_sizes[2].descriptorCount = frame_count;
+
+    VkDescriptorPoolCreateInfo pool_ci = {};
+    pool_ci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_ci.flags = 0;
+    pool_ci.maxSets = level_count + frame_count;
+    pool_ci.poolSizeCount = 3;
+    pool_ci.pPoolSizes = pool_sizes;
+
+    if (vkCreateDescriptorPool(device, &pool_ci, p_allocs, &descriptor_pool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create depth pyramid descriptor pool");
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(level_count, build_set_layout);
+    layouts.resize(level_count + frame_count, cull_set_layout);
+    std::vector<VkDescriptorSet> sets(layouts.size());
+
+    VkDescriptorSetAllocateInfo set_ai = {};
+    set_ai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    set_ai.descriptorPool = descriptor_pool;
+    set_ai.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+    set_ai.pSetLayouts = layouts.data();
+
+    if (vkAllocateDescriptorSets(device, &set_ai, sets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate depth pyramid descriptor sets");
+    }
+    memcpy(build_sets, sets.data(), sizeof(VkDescriptorSet) * level_count);
+    cull_sets.assign(sets.begin() + level_count, sets.end());
+
+    // Level 0 reads the depth buffer and doesn't touch binding 1, which still needs a valid view
+    for (uint32_t level = 0; level < level_count; level++) {
+        VkDescriptorImageInfo image_infos[3];
+        image_infos[0].sampler = sampler;
+        image_infos[0].imageView = depth_view;
+        image_infos[0].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        image_infos[1].sampler = VK_NULL_HANDLE;
+        image_infos[1].imageView = levels[level > 0 ? level - 1 : 0];
+        image_infos[1].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        image_infos[2].sampler = VK_NULL_HANDLE;
+        image_infos[2].imageView = levels[level];
+        image_infos[2].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        VkWriteDescriptorSet writes[2] = {};
+        writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[0].dstSet = build_sets[level];
+        writes[0].dstBinding = 0;
+        writes[0].dstArrayElement = 0;
+        writes[0].descriptorCount = 1;
+        writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[0].pImageInfo = &image_infos[0];
+        writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[1].dstSet = build_sets[level];
+        writes[1].dstBinding = 1;
+        writes[1].dstArrayElement = 0;
+        writes[1].descriptorCount = 2;
+        writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        writes[1].pImageInfo = &image_infos[1];
+
+        vkUpdateDescriptorSets(device, 2, writes, 0, nullptr);
+    }
+
+    VkPushConstantRange ranges[2] = {};
+    ranges[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    ranges[0].offset = 0;
+    ranges[0].size = sizeof(BuildConstants);
+    ranges[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    ranges[1].offset = 0;
+    ranges[1].size = sizeof(CullConstants);
+
+    VkPipelineLayoutCreateInfo playout_ci = {};
+    playout_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    playout_ci.flags = 0;
+    playout_ci.setLayoutCount = 1;
+    playout_ci.pSetLayouts = &build_set_layout;
+    playout_ci.pushConstantRangeCount = 1;
+    playout_ci.pPushConstantRanges = &ranges[0];
+
+    if (vkCreatePipelineLayout(device, &playout_ci, p_allocs, &build_layout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create depth pyramid pipeline layout");
+    }
+
+    playout_ci.pSetLayouts = &cull_set_layout;
+    playout_ci.pPushConstantRanges = &ranges[1];
+
+    if (vkCreatePipelineLayout(device, &playout_ci, p_allocs, &cull_layout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create occlusion cull pipeline layout");
+    }
+
+    build_shader = graphics_device->loadShader("hiz_build.spv");
+    cull_shader = graphics_device->loadShader("hiz_cull.spv");
+
+    // Compute pipelines have no render pass or vertex state to vary, so they don't go through the pipeline library
+    VkComputePipelineCreateInfo pipeline_ci = {};
+    pipeline_ci.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_ci.flags = 0;
+    pipeline_ci.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_ci.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_ci.stage.module = build_shader;
+    pipeline_ci.stage.pName = "main";
+    pipeline_ci.layout = build_layout;
+    pipeline_ci.basePipelineHandle = VK_NULL_HANDLE;
+    pipeline_ci.basePipelineIndex = -1;
+
+    if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipeline_ci, p_allocs, &build_pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create depth pyramid pipeline");
+    }
+
+    pipeline_ci.stage.module = cull_shader;
+    pipeline_ci.layout = cull_layout;
+
+    if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipeline_ci, p_allocs, &cull_pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create occlusion cull pipeline");
+    }
+}
+
+void DepthPyramid::createReadback() {
+    VkDevice device = graphics_device->device();
+
+    // Finest level narrow enough to be cheap to read and test against every frame
+    readback_level = 0;
+    while (readback_level + 1 < level_count && (extent.width >> readback_level) > READBACK_WIDTH) {
+        readback_level++;
+    }
+    uint32_t width = MAX(extent.width >> readback_level, 1u);
+    uint32_t height = MAX(extent.height >> readback_level, 1u);
+    readback_stride = sizeof(float) * width * height;
+
+    VkBufferCreateInfo buffer_ci = {};
+    buffer_ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_ci.flags = 0;
+    buffer_ci.size = readback_stride * frame_count;
+    buffer_ci.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    buffer_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(device, &buffer_ci, p_allocs, &readback_buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create depth pyramid readback buffer");
+    }
+
+    VkMemoryRequirements mem_req;
+    vkGetBufferMemoryRequirements(device, readback_buffer, &mem_req);
+
+    VkMemoryAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize = mem_req.size;
+    alloc_info.memoryTypeIndex = graphics_device->findMemType(mem_req.memoryTypeBits,
+        static_cast<VkMemoryPropertyFlagBits>(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT));
+
+    if (graphics_device->getMemoryTelemetry()->allocateMemory(alloc_info, MEMORY_CATEGORY_STAGING, &readback_mem) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate device memory for depth pyramid readback");
+    }
+
+    if (vkBindBufferMemory(device, readback_buffer, readback_mem, 0) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to bind memory to depth pyramid readback buffer");
+    }
+
+    void* mapped_data;
+    if (vkMapMemory(device, readback_mem, 0, VK_WHOLE_SIZE, 0, &mapped_data) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to map depth pyramid readback memory to host");
+    }
+    readback_mapped = static_cast<uint8_t*>(mapped_data);
+}
+
+void DepthPyramid::setCullTarget(VkBuffer buffer, VkDeviceSize stride, const OcclusionCullLayout& layout) {
+    cull_buffer = buffer;
+    cull_stride = stride;
+    cull = layout;
+
+    for (uint32_t i = 0; i < frame_count; i++) {
+        VkDescriptorImageInfo image_info;
+        image_info.sampler = sampler;
+        image_info.imageView = chain_view;
+        image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        VkDescriptorBufferInfo buffer_info;
+        buffer_info.buffer = buffer;
+        buffer_info.offset = stride * i;
+        buffer_info.range = stride;
+
+        VkWriteDescriptorSet writes[2] = {};
+        writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[0].dstSet = cull_sets[i];
+        writes[0].dstBinding = 0;
+        writes[0].dstArrayElement = 0;
+        writes[0].descriptorCount = 1;
+        writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[0].pImageInfo = &image_info;
+        writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[1].dstSet = cull_sets[i];
+        writes[1].dstBinding = 1;
+        writes[1].dstArrayElement = 0;
+        writes[1].descriptorCount = 1;
+        writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[1].pBufferInfo = &buffer_info;
+
+        vkUpdateDescriptorSets(graphics_device->device(), 2, writes, 0, nullptr);
+    }
+}
+
+void DepthPyramid::recordBuild(VkCommandBuffer cmd, uint32_t frame_index, VkExtent2D eye_extent) {
+    // The previous frame's build wrote the pyramid, and this frame's cull and the last readback read it
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    BuildConstants constants;
+    constants.eye_width = MAX(eye_extent.width, 1u);
+    constants.eye_height = MAX(eye_extent.height, 1u);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, build_pipeline);
+
+    // Each level waits for the one below it
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    for (uint32_t level = 0; level < level_count; level++) {
+        if (level > 0) {
+            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                1, &barrier, 0, nullptr, 0, nullptr);
+        }
+
+        uint32_t width = MAX(extent.width >> level, 1u);
+        uint32_t height = MAX(extent.height >> level, 1u);
+        constants.level = level;
+
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, build_layout, 0, 1, &build_sets[level], 0,
+            nullptr);
+        vkCmdPushConstants(cmd, build_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(BuildConstants), &constants);
+        vkCmdDispatch(cmd, (width + 7) / 8, (height + 7) / 8, 1);
+    }
+
+    if (!readback) {
+        return;
+    }
+
+    // Copy the readback level into the frame's slot, read by the host once the frame retires
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier,
+        0, nullptr, 0, nullptr);
+
+    VkBufferImageCopy region = {};
+    region.bufferOffset = readback_stride * frame_index;
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = readback_level;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = { 0, 0, 0 };
+    region.imageExtent = { MAX(extent.width >> readback_level, 1u), MAX(extent.height >> readback_level, 1u), 1 };
+
+    vkCmdCopyImageToBuffer(cmd, image, VK_IMAGE_LAYOUT_GENERAL, readback_buffer, 1, &region);
+
+    VkBufferMemoryBarrier host_barrier = {};
+    host_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    host_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    host_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    host_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    host_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    host_barrier.buffer = readback_buffer;
+    host_barrier.offset = region.bufferOffset;
+    host_barrier.size = readback_stride;
+
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1,
+        &host_barrier, 0, nullptr);
+}
+
+void DepthPyramid::recordCull(VkCommandBuffer cmd, uint32_t frame_index) {
+    if (cull_buffer == VK_NULL_HANDLE) {
+        throw std::runtime_error("Failed to record occlusion cull: no cull target set");
+    }
+
+    // The previous frame's build wrote the pyramid
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+        &barrier, 0, nullptr, 0, nullptr);
+
+    CullConstants constants;
+    for (uint32_t i = 0; i < 3; i++) {
+        constants.bounds_min[i] = cull.bounds_min[i];
+        constants.bounds_max[i] = cull.bounds_max[i];
+    }
+    constants.bounds_min[3] = 1.0f;
+    constants.bounds_max[3] = 1.0f;
+    constants.params_offset = static_cast<uint32_t>(cull.params_offset / 4);
+    constants.candidates_offset = static_cast<uint32_t>(cull.candidates_offset / 4);
+    constants.levels_offset = static_cast<uint32_t>(cull.levels_offset / 4);
+    constants.regions_offset = static_cast<uint32_t>(cull.regions_offset / 4);
+    constants.region_words = static_cast<uint32_t>(cull.region_size / 4);
+    constants.commands_offset = static_cast<uint32_t>(cull.commands_offset / 4);
+    constants.instance_count = cull.instance_count;
+    constants.level_count = cull.level_count;
+    constants.draws_per_level = cull.draws_per_level;
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cull_layout, 0, 1, &cull_sets[frame_index], 0,
+        nullptr);
+
+    // Test and compact, counting into each level's first draw
+    constants.mode = 0;
+    vkCmdPushConstants(cmd, cull_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullConstants), &constants);
+    vkCmdDispatch(cmd, (cull.instance_count + 63) / 64, 1, 1);
+
+    VkBufferMemoryBarrier buffer_barrier = {};
+    buffer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    buffer_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    buffer_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    buffer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    buffer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    buffer_barrier.buffer = cull_buffer;
+    buffer_barrier.offset = cull_stride * frame_index;
+    buffer_barrier.size = cull_stride;
+
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0,
+        nullptr, 1, &buffer_barrier, 0, nullptr);
+
+    // Copy each level's count to its other draws
+    uint32_t command_count = cull.level_count * cull.draws_per_level;
+    constants.mode = 1;
+    vkCmdPushConstants(cmd, cull_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullConstants), &constants);
+    vkCmdDispatch(cmd, (command_count + 63) / 64, 1, 1);
+
+    buffer_barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, 1, &buffer_barrier, 0,
+        nullptr);
+}
+
+void DepthPyramid::latch(uint32_t frame_index, const float view_proj[2][16]) {
+    memcpy(frame_views[frame_index].view_proj, view_proj, sizeof(last_view.view_proj));
+    memcpy(last_view.view_proj, view_proj, sizeof(last_view.view_proj));
+    frame_built[frame_index] = true;
+    history_valid = true;
+}
+
+void DepthPyramid::writeCullParams(OcclusionCullParams* params) {
+    memcpy(params->view_proj, last_view.view_proj, sizeof(params->view_proj));
+    params->history_valid = history_valid ? 1 : 0;
+}
+
+bool DepthPyramid::readBack(uint32_t frame_index, CpuDepthPyramid* pyramid) {
+    if (!readback || !frame_built[frame_index]) {
+        return false;
+    }
+
+    const float* depth = reinterpret_cast<const float*>(readback_mapped + readback_stride * frame_index);
+    pyramid->update(depth, MAX(extent.width >> readback_level, 1u), MAX(extent.height >> readback_level, 1u),
+        frame_views[frame_index].view_proj);
+    return true;
+}
@@ -0,0 +1,289 @@
+/** @file OcclusionCulling.h
+*
+* @brief Defines hierarchical-Z occlusion culling: a depth pyramid built from
+*   the previous frame's depth, tested against on the GPU or the CPU
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			01/05/2018
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <vector>
+
+#include "GraphicsDevice.h"
+#include "LateLatch.h"
+#include "VectorMath.h"
+
+/**
+ * Levels a pyramid can have: enough for a 32768 texel wide depth buffer
+ */
+#define MAX_PYRAMID_LEVELS 16
+
+/**
+ * Where objects are tested against the depth pyramid
+ */
+enum class OcclusionMode {
+    /**
+     * Draw every object
+     */
+    None,
+
+    /**
+     * A compute pass tests the candidates and compacts the visible ones into the indirect draws
+     */
+    Gpu,
+
+    /**
+     * A coarse level of the pyramid is read back and tested against before objects are written. The readback is
+     *  as old as the frames in flight, so this culls less than the GPU test
+     */
+    Cpu
+};
+
+/**
+ * Data the CPU writes for hiz_cull.comp each frame. Layout matches Params in hiz_cull.comp
+ */
+struct OcclusionCullParams {
+    /**
+     * View-projection per eye the pyramid's depth was rendered with
+     */
+    float view_proj[2][16];
+
+    /**
+     * 0 until a pyramid has been built, so the first frame draws everything
+     */
+    uint32_t history_valid;
+    uint32_t padding[3];
+};
+
+/**
+ * Where the GPU test finds its inputs and writes its outputs within one frame's slice of the instance buffer.
+ *  Offsets are in bytes from the start of the slice and must be multiples of 4
+ */
+struct OcclusionCullLayout {
+    /**
+     * OcclusionCullParams written by the CPU
+     */
+    VkDeviceSize params_offset;
+
+    /**
+     * World matrix of every candidate, and the level of detail each is drawn at as a uint32_t
+     */
+    VkDeviceSize candidates_offset;
+    VkDeviceSize levels_offset;
+
+    /**
+     * Visible candidates' matrices are compacted into one region per level
+     */
+    VkDeviceSize regions_offset;
+    VkDeviceSize region_size;
+
+    /**
+     * VkDrawIndexedIndirectCommand for each draw of each level. Instance counts must be written as 0: the test
+     *  counts visible instances into each level's first draw and copies the count to the others
+     */
+    VkDeviceSize commands_offset;
+
+    uint32_t instance_count;
+    uint32_t level_count;
+    uint32_t draws_per_level;
+
+    /**
+     * Bounding box shared by every candidate, in mesh units
+     */
+    float bounds_min[3];
+    float bounds_max[3];
+};
+
+/**
+ * Depth pyramid on the CPU, built from a level read back from the GPU. Each level holds the farthest depth of the
+ *  2x2 texels below it. Both eyes are side by side, so each covers half the width
+ */
+class CpuDepthPyramid {
+private:
+    /**
+     * Every level, finest first
+     */
+    std::vector<float> texels;
+    uint32_t level_count = 0;
+    uint32_t widths[MAX_PYRAMID_LEVELS];
+    uint32_t heights[MAX_PYRAMID_LEVELS];
+    uint32_t offsets[MAX_PYRAMID_LEVELS];
+
+    /**
+     * View-projection per eye the depth was rendered with
+     */
+    Mat4 view_proj[2];
+
+    /**
+     * Get the farthest depth under a rectangle of level 0 texels
+     */
+    float getFarthestDepth(float x0, float y0, float x1, float y1) const;
+
+public:
+    /**
+     * Replace the pyramid
+     * @param depth finest level, row major
+     * @param width width of the level, a power of two covering both eyes
+     * @param height height of the level, a power of two
+     * @param view_proj view-projection per eye the depth was rendered with, column major
+     */
+    void update(const float* depth, uint32_t width, uint32_t height, const float view_proj[2][16]);
+
+    /**
+     * Returns true once update has been called
+     */
+    bool isValid() const;
+
+    /**
+     * Test whether any part of a box may be in front of the depth in either eye. Conservative: boxes crossing the
+     *  near plane or reaching outside the view are visible
+     * @param world world matrix of the box
+     * @param bounds_min corner of the box in its own space
+     * @param bounds_max opposite corner
+     * @return false if the box is hidden in both eyes
+     */
+    bool isBoxVisible(const Mat4& world, const float bounds_min[3], const float bounds_max[3]) const;
+};
+
+/**
+ * Depth pyramid on the GPU. hiz_build.comp reduces a frame's depth to a power of two mip chain where each texel
+ *  holds the farthest depth below it, and hiz_cull.comp tests the next frame's candidates against it. The pyramid
+ *  outlives the frame, so it is synchronized here rather than by the frame graph
+ */
+class DepthPyramid {
+private:
+    GraphicsDevice* graphics_device;
+    VkAllocationCallbacks* p_allocs;
+
+    uint32_t frame_count;
+
+    /**
+     * R32_SFLOAT mip chain, kept in the general layout. Level 0 is half the depth resolution, rounded down to
+     *  powers of two
+     */
+    VkImage image;
+    VkDeviceMemory image_mem;
+    VkExtent2D extent;
+    uint32_t level_count;
+    VkImageView levels[MAX_PYRAMID_LEVELS];
+    VkImageView chain_view;
+    VkSampler sampler;
+
+    /**
+     * Depth aspect of the depth buffer the pyramid is built from
+     */
+    VkImageView depth_view = VK_NULL_HANDLE;
+    VkExtent2D depth_extent;
+
+    VkDescriptorPool descriptor_pool;
+    VkDescriptorSetLayout build_set_layout;
+    VkDescriptorSetLayout cull_set_layout;
+    VkDescriptorSet build_sets[MAX_PYRAMID_LEVELS];
+    std::vector<VkDescriptorSet> cull_sets;
+    VkPipelineLayout build_layout;
+    VkPipelineLayout cull_layout;
+    VkShaderModule build_shader;
+    VkShaderModule cull_shader;
+    VkPipeline build_pipeline;
+    VkPipeline cull_pipeline;
+
+    /**
+     * Instance buffer the cull reads and compacts into, one slice per frame
+     */
+    VkBuffer cull_buffer = VK_NULL_HANDLE;
+    VkDeviceSize cull_stride;
+    OcclusionCullLayout cull;
+
+    /**
+     * Copy of one coarse level per frame for the CPU test, if enabled
+     */
+    bool readback;
+    uint32_t readback_level;
+    VkBuffer readback_buffer;
+    VkDeviceMemory readback_mem;
+    VkDeviceSize readback_stride;
+    uint8_t* readback_mapped;
+
+    /**
+     * View-projection each frame was latched with, and the latest one
+     */
+    std::vector<LateLatchData> frame_views;
+    std::vector<bool> frame_built;
+    LateLatchData last_view;
+    bool history_valid = false;
+
+    void createImage(VkImage depth_image, VkFormat depth_format);
+    void createPipelines();
+    void createReadback();
+    void clearImage();
+
+public:
+    /**
+     * Create the pyramid, cleared to the far plane, and its pipelines
+     * @param graphics_device device to create objects on
+     * @param p_allocs allocation callbacks passed to Vulkan calls
+     * @param frame_count number of frames in flight (swapchain length)
+     * @param depth_image depth buffer to build from. It needs sampled usage and is read in the shader read only
+     *  layout
+     * @param depth_format format of the depth buffer
+     * @param depth_extent dimensions of the depth buffer
+     * @param readback copy a coarse level back to the host every frame for the CPU test
+     */
+    DepthPyramid(GraphicsDevice* graphics_device, VkAllocationCallbacks* p_allocs, uint32_t frame_count,
+        VkImage depth_image, VkFormat depth_format, VkExtent2D depth_extent, bool readback);
+
+    ~DepthPyramid();
+
+    /**
+     * Set the buffer the GPU test reads candidates from and compacts visible instances into. Required before
+     *  recordCull
+     * @param buffer instance buffer with storage buffer usage
+     * @param stride distance between frames' slices, a multiple of minStorageBufferOffsetAlignment
+     * @param layout placement of the cull's data within a slice
+     */
+    void setCullTarget(VkBuffer buffer, VkDeviceSize stride, const OcclusionCullLayout& layout);
+
+    /**
+     * Record the pyramid build from the depth buffer, and the readback copy if enabled
+     * @param cmd command buffer outside a render pass
+     * @param frame_index frame the command buffer renders, selecting the readback buffer
+     * @param eye_extent area of each eye in the depth buffer. Eyes are side by side from the top left corner
+     */
+    void recordBuild(VkCommandBuffer cmd, uint32_t frame_index, VkExtent2D eye_extent);
+
+    /**
+     * Record the GPU test of a frame's candidates against the pyramid built by the previous frame. Ends with a
+     *  barrier making the compacted instances and counts visible to indirect draws and vertex input
+     * @param cmd command buffer outside a render pass
+     * @param frame_index frame the command buffer renders, selecting the instance buffer slice
+     */
+    void recordCull(VkCommandBuffer cmd, uint32_t frame_index);
+
+    /**
+     * Record the view a frame is rendered with, as predicted when the frame is built
+     * @param frame_index frame being submitted
+     * @param view_proj view-projection per eye
+     */
+    void latch(uint32_t frame_index, const float view_proj[2][16]);
+
+    /**
+     * Write the parameters of the GPU test for the next frame: the view of the last latched frame, whose depth
+     *  the pyramid holds when the cull runs
+     * @param params [output] parameters in the instance buffer slice
+     */
+    void writeCullParams(OcclusionCullParams* params);
+
+    /**
+     * Update a CPU pyramid from a frame's readback. Only valid once the frame's previous submission has retired
+     * @param frame_index frame whose readback to read
+     * @param pyramid [output] pyramid to update
+     * @return false if readback is disabled or the frame hasn't built a pyramid yet
+     */
+    bool readBack(uint32_t frame_index, CpuDepthPyramid* pyramid);
+};
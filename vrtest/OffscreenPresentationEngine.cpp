@@ -0,0 +1,172 @@
+/** @file OffscreenPresentationEngine.cpp
+*
+* @brief Defines presentation engine that renders to device images without a
+*   window, for benchmarks and headless runs
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/14/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include <stdexcept>
+#include <iostream>
+
+#include "OffscreenPresentationEngine.h"
+#include "Common.h"
+
+OffscreenPresentationEngine::OffscreenPresentationEngine(uint32_t resolution_x, uint32_t resolution_y,
+    uint32_t image_count, VkAllocationCallbacks* p_allocs, const char* app_name)
+    : PresentationEngine(resolution_x, resolution_y, p_allocs, app_name), present_count(0), exit_requested(false) {
+
+    this->sc_image_count = MAX(image_count, 1u);
+    this->sc_format = VK_FORMAT_B8G8R8A8_UNORM;
+    this->sc_usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    this->sc_extent.width = resolution_x;
+    this->sc_extent.height = resolution_y;
+}
+
+OffscreenPresentationEngine::~OffscreenPresentationEngine() {
+    if (!image_memory) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < sc_image_count; i++) {
+        vkDestroyImageView(device, sc_image_views[i], p_allocs);
+        vkDestroyImage(device, sc_images[i], p_allocs);
+        memory_telemetry->freeMemory(image_memory[i]);
+    }
+
+    delete[] sc_image_views;
+    delete[] sc_images;
+    delete[] image_memory;
+}
+
+bool OffscreenPresentationEngine::shouldExit() {
+    return exit_requested || (frame_limit > 0 && present_count >= frame_limit);
+}
+
+void OffscreenPresentationEngine::pollEvents() {
+}
+
+void OffscreenPresentationEngine::createSwapchain(VkPhysicalDevice physical_device, VkDevice device,
+    int /*gfx_queue_family*/, int /*present_queue_family*/) {
+    this->device = device;
+
+    VkPhysicalDeviceMemoryProperties mem_props;
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &mem_props);
+
+    // Images can be copied out, e.g. for capture, as well as rendered to
+    VkImageCreateInfo image_ci = {};
+    image_ci.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_ci.flags = 0;
+    image_ci.imageType = VK_IMAGE_TYPE_2D;
+    image_ci.format = sc_format;
+    image_ci.extent.width = sc_extent.width;
+    image_ci.extent.height = sc_extent.height;
+    image_ci.extent.depth = 1;
+    image_ci.mipLevels = 1;
+    image_ci.arrayLayers = 1;
+    image_ci.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_ci.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_ci.usage = sc_usage;
+    image_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_ci.queueFamilyIndexCount = 0;
+    image_ci.pQueueFamilyIndices = nullptr;
+    image_ci.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    sc_images = new VkImage[sc_image_count];
+    image_memory = new VkDeviceMemory[sc_image_count];
+    for (uint32_t i = 0; i < sc_image_count; i++) {
+        if (vkCreateImage(device, &image_ci, p_allocs, &(sc_images[i])) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create offscreen image");
+        }
+
+        VkMemoryRequirements mem_req;
+        vkGetImageMemoryRequirements(device, sc_images[i], &mem_req);
+
+        // Prefer device local memory, but software devices may only expose host memory
+        uint32_t mem_type = UINT32_MAX;
+        for (uint32_t type = 0; type < mem_props.memoryTypeCount; type++) {
+            if ((mem_req.memoryTypeBits & (1 << type)) == 0) {
+                continue;
+            }
+            if (mem_type == UINT32_MAX ||
+                (mem_props.memoryTypes[type].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0) {
+                mem_type = type;
+                if ((mem_props.memoryTypes[type].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0) {
+                    break;
+                }
+            }
+        }
+        if (mem_type == UINT32_MAX) {
+            throw std::runtime_error("Failed to find memory type for offscreen image");
+        }
+
+        VkMemoryAllocateInfo alloc_info = {};
+        alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        alloc_info.allocationSize = mem_req.size;
+        alloc_info.memoryTypeIndex = mem_type;
+
+        VkResult result = memory_telemetry->allocateMemory(alloc_info, MEMORY_CATEGORY_ATTACHMENT, &(image_memory[i]));
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate offscreen image memory");
+        }
+        if (vkBindImageMemory(device, sc_images[i], image_memory[i], 0) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to bind offscreen image memory");
+        }
+    }
+
+    createImageViews();
+
+    std::cout << "Offscreen images created" << std::endl;
+    std::cout << "\tImage count: " << sc_image_count << std::endl;
+    std::cout << "\tExtent: " << sc_extent.width << " x " << sc_extent.height << std::endl;
+}
+
+int OffscreenPresentationEngine::getNextSwapchainImage(VkSemaphore** wait_sem, VkSemaphore** signal_sem) {
+    // Nothing else uses the images, so the renderer's frame sync is the only wait needed
+    *wait_sem = nullptr;
+    *signal_sem = nullptr;
+
+    // Advance on acquire so the next frame's image can be acquired before this one is presented
+    uint32_t image = next_image;
+    next_image = (next_image + 1) % sc_image_count;
+    return static_cast<int>(image);
+}
+
+void OffscreenPresentationEngine::presentSwapchainImage(int /*image_index*/, VkQueue /*present_queue*/) {
+    present_count++;
+}
+
+VkSurfaceKHR OffscreenPresentationEngine::getPresentSurface(VkInstance instance) {
+    this->instance = instance;
+    return VK_NULL_HANDLE;
+}
+
+const char** OffscreenPresentationEngine::getRequiredExtensions(uint32_t* extension_count) {
+    *extension_count = 0;
+    return nullptr;
+}
+
+const char** OffscreenPresentationEngine::getRequiredDeviceExtensions(uint32_t* extension_count) {
+    *extension_count = 0;
+    return nullptr;
+}
+
+VkImageLayout OffscreenPresentationEngine::getPresentLayout() {
+    return VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+}
+
+void OffscreenPresentationEngine::setFrameLimit(uint64_t frame_limit) {
+    this->frame_limit = frame_limit;
+}
+
+void OffscreenPresentationEngine::requestExit() {
+    exit_requested = true;
+}
+
+uint64_t OffscreenPresentationEngine::getPresentCount() {
+    return present_count;
+}
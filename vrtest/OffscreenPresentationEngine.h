@@ -0,0 +1,95 @@
+/** @file OffscreenPresentationEngine.h
+*
+* @brief Defines presentation engine that renders to device images without a
+*   window, for benchmarks and headless runs
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/14/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <atomic>
+
+#include "PresentationEngine.h"
+
+/**
+ * Images are handed out round robin without waiting on a display. Frames in flight are limited by the number
+ *  of images, since each is only reused once the renderer's frame sync slot for it has retired
+ */
+class OffscreenPresentationEngine : public PresentationEngine {
+private:
+    /**
+     * Memory backing each image
+     */
+    VkDeviceMemory* image_memory = nullptr;
+
+protected:
+    /**
+     * Index of the next image to hand out
+     */
+    uint32_t next_image = 0;
+
+    /**
+     * Number of frames presented. Read by shouldExit, which may run on another thread than presentation
+     */
+    std::atomic<uint64_t> present_count;
+
+private:
+    /**
+     * Presents after which shouldExit returns true, or 0 to run until requestExit
+     */
+    uint64_t frame_limit = 0;
+    std::atomic<bool> exit_requested;
+
+public:
+    /**
+     * @param resolution_x: Image width
+     * @param resolution_y: Image height
+     * @param image_count: Number of images, which bounds the frames in flight
+     * @param p_allocs: Allocation callbacks used for Vulkan calls, or nullptr
+     * @param app_name: Name of the application
+     */
+    OffscreenPresentationEngine(uint32_t resolution_x, uint32_t resolution_y, uint32_t image_count,
+        VkAllocationCallbacks* p_allocs, const char* app_name);
+
+    /**
+     * Destructor
+     */
+    ~OffscreenPresentationEngine();
+
+    bool shouldExit();
+    void pollEvents();
+    void createSwapchain(VkPhysicalDevice physical_device, VkDevice device, int gfx_queue_family,
+        int present_queue_family);
+    int getNextSwapchainImage(VkSemaphore** wait_sem, VkSemaphore** signal_sem);
+    void presentSwapchainImage(int image_index, VkQueue present_queue);
+    VkSurfaceKHR getPresentSurface(VkInstance instance);
+    const char** getRequiredExtensions(uint32_t* extension_count);
+    const char** getRequiredDeviceExtensions(uint32_t* extension_count);
+
+    /**
+     * Images are left ready to be copied out
+     */
+    VkImageLayout getPresentLayout();
+
+    /**
+     * Exit after a number of presents
+     * @param frame_limit number of presents, or 0 for no limit
+     */
+    void setFrameLimit(uint64_t frame_limit);
+
+    /**
+     * Make shouldExit return true
+     */
+    void requestExit();
+
+    /**
+     * Get the number of frames presented so far
+     */
+    uint64_t getPresentCount();
+};
@@ -0,0 +1,481 @@
+/** @file PipelineLibrary.cpp
+*
+* @brief Defines class that compiles graphics pipeline variants on worker
+*   threads and caches them by a hashed state key
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/08/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include <iostream>
+#include <stdexcept>
+#include <string.h>
+
+#include "PipelineLibrary.h"
+
+static const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+static const uint64_t FNV_PRIME = 1099511628211ULL;
+
+static void hashBytes(uint64_t& hash, const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+}
+
+template <typename T>
+static void hashValue(uint64_t& hash, const T& value) {
+    hashBytes(hash, &value, sizeof(T));
+}
+
+void PipelineKey::setSpecConstant(VkShaderStageFlagBits stage, uint32_t constant_id, uint32_t value) {
+    for (auto& constant : spec_constants) {
+        if (constant.stage == stage && constant.constant_id == constant_id) {
+            constant.value = value;
+            return;
+        }
+    }
+
+    PipelineSpecConstant constant;
+    constant.stage = stage;
+    constant.constant_id = constant_id;
+    constant.value = value;
+    spec_constants.push_back(constant);
+}
+
+void PipelineKey::setSpecConstant(VkShaderStageFlagBits stage, uint32_t constant_id, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    setSpecConstant(stage, constant_id, bits);
+}
+
+uint64_t PipelineKey::hash() const {
+    uint64_t hash = FNV_OFFSET_BASIS;
+
+    // Hash field by field rather than the whole struct so padding never contributes
+    hashValue(hash, vert_shader);
+    hashValue(hash, frag_shader);
+    for (const auto& constant : spec_constants) {
+        hashValue(hash, constant.stage);
+        hashValue(hash, constant.constant_id);
+        hashValue(hash, constant.value);
+    }
+    for (const auto& binding : vertex_bindings) {
+        hashValue(hash, binding.binding);
+        hashValue(hash, binding.stride);
+        hashValue(hash, binding.inputRate);
+    }
+    for (const auto& attribute : vertex_attributes) {
+        hashValue(hash, attribute.location);
+        hashValue(hash, attribute.binding);
+        hashValue(hash, attribute.format);
+        hashValue(hash, attribute.offset);
+    }
+    hashValue(hash, topology);
+    hashValue(hash, polygon_mode);
+    hashValue(hash, cull_mode);
+    hashValue(hash, front_face);
+    hashValue(hash, depth_test);
+    hashValue(hash, depth_write);
+    hashValue(hash, depth_compare);
+    hashValue(hash, blend_enable);
+    hashValue(hash, src_color_blend);
+    hashValue(hash, dst_color_blend);
+    hashValue(hash, color_write_mask);
+    hashValue(hash, layout);
+    hashValue(hash, render_pass);
+    hashValue(hash, subpass);
+
+    return hash;
+}
+
+bool PipelineKey::operator==(const PipelineKey& other) const {
+    if (spec_constants.size() != other.spec_constants.size() ||
+        vertex_bindings.size() != other.vertex_bindings.size() ||
+        vertex_attributes.size() != other.vertex_attributes.size()) {
+        return false;
+    }
+
+    for (size_t i = 0; i < spec_constants.size(); i++) {
+        const PipelineSpecConstant& a = spec_constants[i];
+        const PipelineSpecConstant& b = other.spec_constants[i];
+        if (a.stage != b.stage || a.constant_id != b.constant_id || a.value != b.value) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < vertex_bindings.size(); i++) {
+        const VkVertexInputBindingDescription& a = vertex_bindings[i];
+        const VkVertexInputBindingDescription& b = other.vertex_bindings[i];
+        if (a.binding != b.binding || a.stride != b.stride || a.inputRate != b.inputRate) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < vertex_attributes.size(); i++) {
+        const VkVertexInputAttributeDescription& a = vertex_attributes[i];
+        const VkVertexInputAttributeDescription& b = other.vertex_attributes[i];
+        if (a.location != b.location || a.binding != b.binding || a.format != b.format || a.offset != b.offset) {
+            return false;
+        }
+    }
+
+    return vert_shader == other.vert_shader && frag_shader == other.frag_shader &&
+        topology == other.topology && polygon_mode == other.polygon_mode && cull_mode == other.cull_mode &&
+        front_face == other.front_face && depth_test == other.depth_test && depth_write == other.depth_write &&
+        depth_compare == other.depth_compare && blend_enable == other.blend_enable &&
+        src_color_blend == other.src_color_blend && dst_color_blend == other.dst_color_blend &&
+        color_write_mask == other.color_write_mask && layout == other.layout &&
+        render_pass == other.render_pass && subpass == other.subpass;
+}
+
+PipelineLibrary::PipelineLibrary(GraphicsDevice* graphics_device, VkAllocationCallbacks* p_allocs,
+    uint32_t thread_count)
+{
+    this->graphics_device = graphics_device;
+    this->p_allocs = p_allocs;
+    completed_count = 0;
+
+    VkPipelineCacheCreateInfo cache_ci = {};
+    cache_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cache_ci.flags = 0;
+    cache_ci.initialDataSize = 0;
+    cache_ci.pInitialData = nullptr;
+
+    if (vkCreatePipelineCache(graphics_device->device(), &cache_ci, p_allocs, &pipeline_cache) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline cache");
+    }
+
+    workers = new ThreadPool(thread_count);
+}
+
+PipelineLibrary::~PipelineLibrary() {
+    delete workers;
+
+    VkDevice device = graphics_device->device();
+    for (auto& entry : variants) {
+        if (entry.second.pipeline != VK_NULL_HANDLE) {
+            vkDestroyPipeline(device, entry.second.pipeline, p_allocs);
+        }
+    }
+
+    vkDestroyPipelineCache(device, pipeline_cache, p_allocs);
+}
+
+void PipelineLibrary::request(const PipelineKey& key) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (variants.find(key) != variants.end()) {
+            return;
+        }
+
+        Variant variant;
+        variant.state = VariantState::Pending;
+        variant.pipeline = VK_NULL_HANDLE;
+        variants[key] = variant;
+    }
+
+    workers->enqueue([this, key]() {
+        compileVariant(key);
+    });
+}
+
+VkPipeline PipelineLibrary::get(const PipelineKey& key) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = variants.find(key);
+        if (it != variants.end()) {
+            return it->second.state == VariantState::Ready ? it->second.pipeline : fallback;
+        }
+    }
+
+    request(key);
+    return fallback;
+}
+
+VkPipeline PipelineLibrary::getBlocking(const PipelineKey& key) {
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        auto it = variants.find(key);
+        if (it == variants.end()) {
+            Variant variant;
+            variant.state = VariantState::Pending;
+            variant.pipeline = VK_NULL_HANDLE;
+            variants[key] = variant;
+        }
+        else {
+            // Another thread owns the compile, wait for it to publish
+            variant_done.wait(guard, [&]() { return variants[key].state != VariantState::Pending; });
+
+            if (variants[key].state == VariantState::Failed) {
+                throw std::runtime_error("Failed to create graphics pipeline.");
+            }
+            return variants[key].pipeline;
+        }
+    }
+
+    compileVariant(key);
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (variants[key].state == VariantState::Failed) {
+        throw std::runtime_error("Failed to create graphics pipeline.");
+    }
+    return variants[key].pipeline;
+}
+
+void PipelineLibrary::setFallback(const PipelineKey& key) {
+    VkPipeline pipeline = getBlocking(key);
+
+    std::lock_guard<std::mutex> guard(lock);
+    fallback = pipeline;
+}
+
+bool PipelineLibrary::isFinished(const PipelineKey& key, bool* failed) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = variants.find(key);
+    if (it == variants.end() || it->second.state == VariantState::Pending) {
+        return false;
+    }
+
+    *failed = it->second.state == VariantState::Failed;
+    return true;
+}
+
+bool PipelineLibrary::evict(VkShaderModule shader) {
+    std::vector<VkPipeline> pipelines;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        // A compiling variant is published into the map by its worker, so it can't be removed yet
+        for (const auto& entry : variants) {
+            bool uses_shader = entry.first.vert_shader == shader || entry.first.frag_shader == shader;
+            if (uses_shader && entry.second.state == VariantState::Pending) {
+                return false;
+            }
+        }
+
+        for (auto it = variants.begin(); it != variants.end();) {
+            if (it->first.vert_shader == shader || it->first.frag_shader == shader) {
+                if (it->second.pipeline != VK_NULL_HANDLE) {
+                    pipelines.push_back(it->second.pipeline);
+                }
+                it = variants.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+
+    for (VkPipeline pipeline : pipelines) {
+        vkDestroyPipeline(graphics_device->device(), pipeline, p_allocs);
+    }
+    return true;
+}
+
+uint32_t PipelineLibrary::takeCompletedCount() {
+    return completed_count.exchange(0);
+}
+
+void PipelineLibrary::waitIdle() {
+    workers->waitIdle();
+}
+
+void PipelineLibrary::compileVariant(const PipelineKey& key) {
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VariantState state = VariantState::Ready;
+
+    try {
+        pipeline = compile(key);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        state = VariantState::Failed;
+    }
+    catch (...) {
+        // Waiters block until the variant is published, so it must be marked failed whatever was thrown
+        std::cerr << "Failed to compile pipeline variant" << std::endl;
+        state = VariantState::Failed;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        Variant& variant = variants[key];
+        variant.state = state;
+        variant.pipeline = pipeline;
+    }
+    variant_done.notify_all();
+    completed_count++;
+}
+
+VkPipeline PipelineLibrary::compile(const PipelineKey& key) {
+    // Specialization constants: gather the entries and data of each stage
+    VkShaderStageFlagBits stage_bits[2] = { VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT };
+    std::vector<VkSpecializationMapEntry> spec_entries[2];
+    std::vector<uint32_t> spec_data[2];
+    VkSpecializationInfo spec_info[2] = {};
+
+    for (uint32_t s = 0; s < 2; s++) {
+        for (const auto& constant : key.spec_constants) {
+            if (constant.stage != stage_bits[s]) {
+                continue;
+            }
+
+            VkSpecializationMapEntry entry = {};
+            entry.constantID = constant.constant_id;
+            entry.offset = static_cast<uint32_t>(spec_data[s].size() * sizeof(uint32_t));
+            entry.size = sizeof(uint32_t);
+            spec_entries[s].push_back(entry);
+            spec_data[s].push_back(constant.value);
+        }
+
+        spec_info[s].mapEntryCount = static_cast<uint32_t>(spec_entries[s].size());
+        spec_info[s].pMapEntries = spec_entries[s].data();
+        spec_info[s].dataSize = spec_data[s].size() * sizeof(uint32_t);
+        spec_info[s].pData = spec_data[s].data();
+    }
+
+    // Shader stages: vertex and fragment
+    VkPipelineShaderStageCreateInfo stages_ci[2] = {};
+    stages_ci[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages_ci[0].flags = 0;
+    stages_ci[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    stages_ci[0].module = key.vert_shader;
+    stages_ci[0].pName = "main";
+    stages_ci[0].pSpecializationInfo = spec_entries[0].empty() ? nullptr : &spec_info[0];
+
+    stages_ci[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stages_ci[1].flags = 0;
+    stages_ci[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    stages_ci[1].module = key.frag_shader;
+    stages_ci[1].pName = "main";
+    stages_ci[1].pSpecializationInfo = spec_entries[1].empty() ? nullptr : &spec_info[1];
+
+    // Vertex input state
+    VkPipelineVertexInputStateCreateInfo vi_state_ci = {};
+    vi_state_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vi_state_ci.flags = 0;
+    vi_state_ci.vertexBindingDescriptionCount = static_cast<uint32_t>(key.vertex_bindings.size());
+    vi_state_ci.pVertexBindingDescriptions = key.vertex_bindings.data();
+    vi_state_ci.vertexAttributeDescriptionCount = static_cast<uint32_t>(key.vertex_attributes.size());
+    vi_state_ci.pVertexAttributeDescriptions = key.vertex_attributes.data();
+
+    // Input assembly state
+    VkPipelineInputAssemblyStateCreateInfo ia_state_ci = {};
+    ia_state_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    ia_state_ci.flags = 0;
+    ia_state_ci.topology = key.topology;
+    ia_state_ci.primitiveRestartEnable = VK_FALSE;
+
+    // Viewport state: single viewport and scissor, set when recording so variants don't depend on resolution
+    VkPipelineViewportStateCreateInfo vp_state_ci = {};
+    vp_state_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    vp_state_ci.flags = 0;
+    vp_state_ci.viewportCount = 1;
+    vp_state_ci.pViewports = nullptr;
+    vp_state_ci.scissorCount = 1;
+    vp_state_ci.pScissors = nullptr;
+
+    VkDynamicState dynamic_states[2] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+    VkPipelineDynamicStateCreateInfo dyn_state_ci = {};
+    dyn_state_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dyn_state_ci.flags = 0;
+    dyn_state_ci.dynamicStateCount = 2;
+    dyn_state_ci.pDynamicStates = dynamic_states;
+
+    // Rasterizer state
+    VkPipelineRasterizationStateCreateInfo ras_state_ci = {};
+    ras_state_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    ras_state_ci.flags = 0;
+    ras_state_ci.depthClampEnable = VK_FALSE;
+    ras_state_ci.rasterizerDiscardEnable = VK_FALSE;
+    ras_state_ci.polygonMode = key.polygon_mode;
+    ras_state_ci.cullMode = key.cull_mode;
+    ras_state_ci.frontFace = key.front_face;
+    ras_state_ci.depthBiasEnable = VK_FALSE;
+    ras_state_ci.depthBiasConstantFactor = 0.0f;
+    ras_state_ci.depthBiasClamp = 0.0f;
+    ras_state_ci.depthBiasSlopeFactor = 0.0f;
+    ras_state_ci.lineWidth = 1.0f;
+
+    // Multisample state
+    VkPipelineMultisampleStateCreateInfo ms_state_ci = {};
+    ms_state_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    ms_state_ci.flags = 0;
+    ms_state_ci.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT; //TODO: enable msaa once resolve enabled
+    ms_state_ci.sampleShadingEnable = VK_FALSE;
+    ms_state_ci.minSampleShading = 1.0f;
+    ms_state_ci.pSampleMask = nullptr;
+    ms_state_ci.alphaToCoverageEnable = VK_FALSE;
+    ms_state_ci.alphaToOneEnable = VK_FALSE;
+
+    // Depth stencil state: no stencil
+    VkPipelineDepthStencilStateCreateInfo ds_state_ci = {};
+    ds_state_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    ds_state_ci.flags = 0;
+    ds_state_ci.depthTestEnable = key.depth_test;
+    ds_state_ci.depthWriteEnable = key.depth_write;
+    ds_state_ci.depthCompareOp = key.depth_compare;
+    ds_state_ci.depthBoundsTestEnable = VK_FALSE;
+    ds_state_ci.minDepthBounds = 0.0f;
+    ds_state_ci.maxDepthBounds = 0.0f;
+    ds_state_ci.stencilTestEnable = VK_FALSE;
+    ds_state_ci.front = {};
+    ds_state_ci.back = {};
+
+    // Blend state
+    VkPipelineColorBlendAttachmentState blend_attachment;
+    blend_attachment.blendEnable = key.blend_enable;
+    blend_attachment.colorWriteMask = key.color_write_mask;
+    blend_attachment.srcColorBlendFactor = key.src_color_blend;
+    blend_attachment.dstColorBlendFactor = key.dst_color_blend;
+    blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+    blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    blend_attachment.alphaBlendOp = VK_BLEND_OP_MAX;
+
+    VkPipelineColorBlendStateCreateInfo blend_state_ci = {};
+    blend_state_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    blend_state_ci.flags = 0;
+    blend_state_ci.logicOpEnable = VK_FALSE;
+    blend_state_ci.logicOp = VK_LOGIC_OP_COPY;
+    blend_state_ci.attachmentCount = 1;
+    blend_state_ci.pAttachments = &blend_attachment;
+    blend_state_ci.blendConstants[0] = 0.0f;
+    blend_state_ci.blendConstants[1] = 0.0f;
+    blend_state_ci.blendConstants[2] = 0.0f;
+    blend_state_ci.blendConstants[3] = 0.0f;
+
+    // Full pipeline description
+    VkGraphicsPipelineCreateInfo pipeline_ci = {};
+    pipeline_ci.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipeline_ci.flags = 0;
+    pipeline_ci.stageCount = 2;
+    pipeline_ci.pStages = stages_ci;
+    pipeline_ci.pVertexInputState = &vi_state_ci;
+    pipeline_ci.pInputAssemblyState = &ia_state_ci;
+    pipeline_ci.pTessellationState = nullptr;
+    pipeline_ci.pViewportState = &vp_state_ci;
+    pipeline_ci.pRasterizationState = &ras_state_ci;
+    pipeline_ci.pMultisampleState = &ms_state_ci;
+    pipeline_ci.pDepthStencilState = &ds_state_ci;
+    pipeline_ci.pColorBlendState = &blend_state_ci;
+    pipeline_ci.pDynamicState = &dyn_state_ci;
+    pipeline_ci.layout = key.layout;
+    pipeline_ci.renderPass = key.render_pass;
+    pipeline_ci.subpass = key.subpass;
+    pipeline_ci.basePipelineHandle = VK_NULL_HANDLE;
+    pipeline_ci.basePipelineIndex = 0;
+
+    // The pipeline cache is internally synchronized, so all workers share it
+    VkPipeline pipeline;
+    if (vkCreateGraphicsPipelines(graphics_device->device(), pipeline_cache, 1, &pipeline_ci, p_allocs,
+        &pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create graphics pipeline.");
+    }
+
+    return pipeline;
+}
@@ -0,0 +1,205 @@
+/** @file PipelineLibrary.h
+*
+* @brief Defines class that compiles graphics pipeline variants on worker
+*   threads and caches them by a hashed state key
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/08/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "GraphicsDevice.h"
+#include "ThreadPool.h"
+
+/**
+ * A 32-bit specialization constant value (int, uint, float bits or VkBool32) for one shader stage
+ */
+struct PipelineSpecConstant {
+    VkShaderStageFlagBits stage;
+    uint32_t constant_id;
+    uint32_t value;
+};
+
+/**
+ * Everything that determines the compiled pipeline. Two equal keys always produce interchangeable pipelines.
+ *  Viewport and scissor are always dynamic so they are not part of the key
+ */
+struct PipelineKey {
+    VkShaderModule vert_shader = VK_NULL_HANDLE;
+    VkShaderModule frag_shader = VK_NULL_HANDLE;
+    std::vector<PipelineSpecConstant> spec_constants;
+
+    std::vector<VkVertexInputBindingDescription> vertex_bindings;
+    std::vector<VkVertexInputAttributeDescription> vertex_attributes;
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+    VkPolygonMode polygon_mode = VK_POLYGON_MODE_FILL;
+    VkCullModeFlags cull_mode = VK_CULL_MODE_BACK_BIT;
+    VkFrontFace front_face = VK_FRONT_FACE_CLOCKWISE;
+
+    VkBool32 depth_test = VK_TRUE;
+    VkBool32 depth_write = VK_TRUE;
+    VkCompareOp depth_compare = VK_COMPARE_OP_LESS;
+
+    VkBool32 blend_enable = VK_FALSE;
+    VkBlendFactor src_color_blend = VK_BLEND_FACTOR_SRC_ALPHA;
+    VkBlendFactor dst_color_blend = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    VkColorComponentFlags color_write_mask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+        VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    VkRenderPass render_pass = VK_NULL_HANDLE;
+    uint32_t subpass = 0;
+
+    /**
+     * Set a specialization constant, replacing any previous value for the same stage and id
+     */
+    void setSpecConstant(VkShaderStageFlagBits stage, uint32_t constant_id, uint32_t value);
+    void setSpecConstant(VkShaderStageFlagBits stage, uint32_t constant_id, float value);
+
+    /**
+     * FNV-1a hash of every field
+     */
+    uint64_t hash() const;
+
+    bool operator==(const PipelineKey& other) const;
+};
+
+struct PipelineKeyHash {
+    size_t operator()(const PipelineKey& key) const {
+        return static_cast<size_t>(key.hash());
+    }
+};
+
+class PipelineLibrary {
+private:
+    enum class VariantState {
+        Pending,
+        Ready,
+        Failed
+    };
+
+    struct Variant {
+        VariantState state;
+        VkPipeline pipeline;
+    };
+
+    GraphicsDevice* graphics_device;
+    VkAllocationCallbacks* p_allocs;
+
+    /**
+     * Driver cache shared by every compile so variants reuse each other's shader compilation work
+     */
+    VkPipelineCache pipeline_cache = VK_NULL_HANDLE;
+
+    /**
+     * Variants by key. Entries are only removed by evict or destruction, so a failed variant is not retried
+     */
+    std::unordered_map<PipelineKey, Variant, PipelineKeyHash> variants;
+    std::mutex lock;
+    std::condition_variable variant_done;
+
+    /**
+     * Pipeline returned by get() while the requested variant compiles
+     */
+    VkPipeline fallback = VK_NULL_HANDLE;
+
+    /**
+     * Number of variants finished since the last call to takeCompletedCount
+     */
+    std::atomic<uint32_t> completed_count;
+
+    /**
+     * Workers compiling variants. Deleted first on destruction so no compile outlives the cache
+     */
+    ThreadPool* workers = nullptr;
+
+    /**
+     * Build the pipeline described by the key. Thread safe
+     */
+    VkPipeline compile(const PipelineKey& key);
+
+    /**
+     * Compile a variant and publish the result
+     */
+    void compileVariant(const PipelineKey& key);
+
+public:
+    /**
+     * Create the pipeline cache and compile workers
+     * @param graphics_device device to create pipelines on
+     * @param p_allocs allocation callbacks to use for vulkan calls
+     * @param thread_count number of compile threads, or 0 to pick from the hardware thread count
+     */
+    PipelineLibrary(GraphicsDevice* graphics_device, VkAllocationCallbacks* p_allocs, uint32_t thread_count = 0);
+
+    /**
+     * Waits for in-flight compiles and destroys every pipeline
+     */
+    ~PipelineLibrary();
+
+    /**
+     * Queue compilation of a variant if it isn't cached or already compiling
+     * @param key variant to compile
+     */
+    void request(const PipelineKey& key);
+
+    /**
+     * Get a variant without blocking. Missing variants are requested
+     * @param key variant to get
+     * @return the variant if ready, otherwise the fallback pipeline (which may be VK_NULL_HANDLE)
+     */
+    VkPipeline get(const PipelineKey& key);
+
+    /**
+     * Get a variant, compiling it on the calling thread or waiting for a worker if necessary
+     * @param key variant to get
+     * @return the compiled pipeline
+     */
+    VkPipeline getBlocking(const PipelineKey& key);
+
+    /**
+     * Compile (if necessary) a variant and use it as the fallback for variants that aren't ready
+     * @param key variant to use as the fallback
+     */
+    void setFallback(const PipelineKey& key);
+
+    /**
+     * Check whether a variant has finished compiling, without requesting or waiting for it
+     * @param key variant to check
+     * @param failed [output] whether compilation failed, set only when finished
+     * @return true if the variant is ready or failed
+     */
+    bool isFinished(const PipelineKey& key, bool* failed);
+
+    /**
+     * Destroy every variant built from a shader module, so the module can be destroyed. Call only once no
+     *  pending command buffer uses them, and after setting a fallback that doesn't use the module
+     * @param shader vertex or fragment shader module
+     * @return false, destroying nothing, if a variant using the module is still compiling
+     */
+    bool evict(VkShaderModule shader);
+
+    /**
+     * Get and reset the number of variants that finished compiling, so callers know when to re-record
+     *  command buffers that used the fallback
+     * @return number of variants finished since the last call
+     */
+    uint32_t takeCompletedCount();
+
+    /**
+     * Block until every requested variant has finished compiling
+     */
+    void waitIdle();
+};
@@ -0,0 +1,189 @@
+/** @file Pose.cpp
+*
+* @brief Defines head pose sources and prediction of the pose at display time
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/10/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include <chrono>
+#include <math.h>
+#include <string.h>
+
+#include "Pose.h"
+#include "Common.h"
+
+static const float PI = 3.14159265358979f;
+
+double getPoseTime() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Quaternion product a * b
+static void quatMultiply(const float a[4], const float b[4], float out[4]) {
+    float result[4];
+    result[0] = a[3] * b[0] + a[0] * b[3] + a[1] * b[2] - a[2] * b[1];
+    result[1] = a[3] * b[1] - a[0] * b[2] + a[1] * b[3] + a[2] * b[0];
+    result[2] = a[3] * b[2] + a[0] * b[1] - a[1] * b[0] + a[2] * b[3];
+    result[3] = a[3] * b[3] - a[0] * b[0] - a[1] * b[1] - a[2] * b[2];
+    memcpy(out, result, sizeof(result));
+}
+
+static void quatFromAxisAngle(const float axis[3], float angle, float out[4]) {
+    float s = sinf(angle * 0.5f);
+    out[0] = axis[0] * s;
+    out[1] = axis[1] * s;
+    out[2] = axis[2] * s;
+    out[3] = cosf(angle * 0.5f);
+}
+
+// Column major rotation matrix of a unit quaternion
+static void quatToMatrix(const float q[4], float m[16]) {
+    float x = q[0], y = q[1], z = q[2], w = q[3];
+
+    m[0] = 1.0f - 2.0f * (y * y + z * z);
+    m[1] = 2.0f * (x * y + z * w);
+    m[2] = 2.0f * (x * z - y * w);
+    m[3] = 0.0f;
+    m[4] = 2.0f * (x * y - z * w);
+    m[5] = 1.0f - 2.0f * (x * x + z * z);
+    m[6] = 2.0f * (y * z + x * w);
+    m[7] = 0.0f;
+    m[8] = 2.0f * (x * z + y * w);
+    m[9] = 2.0f * (y * z - x * w);
+    m[10] = 1.0f - 2.0f * (x * x + y * y);
+    m[11] = 0.0f;
+    m[12] = 0.0f;
+    m[13] = 0.0f;
+    m[14] = 0.0f;
+    m[15] = 1.0f;
+}
+
+static void matMultiply(const float a[16], const float b[16], float out[16]) {
+    float result[16];
+    for (int col = 0; col < 4; col++) {
+        for (int row = 0; row < 4; row++) {
+            float sum = 0.0f;
+            for (int k = 0; k < 4; k++) {
+                sum += a[k * 4 + row] * b[col * 4 + k];
+            }
+            result[col * 4 + row] = sum;
+        }
+    }
+    memcpy(out, result, sizeof(result));
+}
+
+SyntheticPoseSource::SyntheticPoseSource(float yaw_amplitude, float frequency) {
+    this->yaw_amplitude = yaw_amplitude;
+    this->frequency = frequency;
+
+    // Stand back from the origin so the test scene is in view
+    position[0] = 0.0f;
+    position[1] = 0.0f;
+    position[2] = -1.5f;
+}
+
+Pose SyntheticPoseSource::samplePose(double now) {
+    Pose pose;
+    float omega = 2.0f * PI * frequency;
+    float phase = static_cast<float>(fmod(now * frequency, 1.0)) * 2.0f * PI;
+
+    // Yaw about the vertical axis and bob along it at twice the rate
+    float up[3] = { 0.0f, 1.0f, 0.0f };
+    float yaw = yaw_amplitude * sinf(phase);
+    quatFromAxisAngle(up, yaw, pose.orientation);
+
+    float bob = 0.02f;
+    pose.position[0] = position[0];
+    pose.position[1] = position[1] + bob * sinf(2.0f * phase);
+    pose.position[2] = position[2];
+
+    pose.angular_velocity[0] = 0.0f;
+    pose.angular_velocity[1] = yaw_amplitude * omega * cosf(phase);
+    pose.angular_velocity[2] = 0.0f;
+
+    pose.linear_velocity[0] = 0.0f;
+    pose.linear_velocity[1] = bob * 2.0f * omega * cosf(2.0f * phase);
+    pose.linear_velocity[2] = 0.0f;
+
+    pose.time = now;
+    return pose;
+}
+
+PosePredictor::PosePredictor(double max_prediction) {
+    this->max_prediction = max_prediction;
+}
+
+Pose PosePredictor::predict(const Pose& pose, double display_time) {
+    Pose predicted = pose;
+    double dt = MIN(MAX(display_time - pose.time, 0.0), max_prediction);
+
+    // Rotate by the angle swept at constant angular velocity. Velocity is in world space so it pre-multiplies
+    float speed = sqrtf(pose.angular_velocity[0] * pose.angular_velocity[0] +
+        pose.angular_velocity[1] * pose.angular_velocity[1] +
+        pose.angular_velocity[2] * pose.angular_velocity[2]);
+    if (speed > 1e-6f) {
+        float axis[3] = {
+            pose.angular_velocity[0] / speed,
+            pose.angular_velocity[1] / speed,
+            pose.angular_velocity[2] / speed
+        };
+        float delta[4];
+        quatFromAxisAngle(axis, speed * static_cast<float>(dt), delta);
+        quatMultiply(delta, pose.orientation, predicted.orientation);
+    }
+
+    for (int i = 0; i < 3; i++) {
+        predicted.position[i] = pose.position[i] + pose.linear_velocity[i] * static_cast<float>(dt);
+    }
+
+    predicted.time = pose.time + dt;
+    return predicted;
+}
+
+void computeEyeViewProj(const Pose& pose, const StereoConfig& config, float view_proj[2][16]) {
+    // View = inverse(head to world) = transpose(R) * translate(-position)
+    float rotation[16];
+    quatToMatrix(pose.orientation, rotation);
+
+    float head_view[16];
+    for (int col = 0; col < 3; col++) {
+        for (int row = 0; row < 3; row++) {
+            head_view[col * 4 + row] = rotation[row * 4 + col];
+        }
+        head_view[col * 4 + 3] = 0.0f;
+    }
+    for (int row = 0; row < 3; row++) {
+        head_view[12 + row] = -(head_view[row] * pose.position[0] + head_view[4 + row] * pose.position[1] +
+            head_view[8 + row] * pose.position[2]);
+    }
+    head_view[15] = 1.0f;
+
+    // Perspective projection for z forward, y down view space into depth 0..1
+    float f = 1.0f / tanf(config.vertical_fov * 0.5f);
+    float depth_scale = config.far_plane / (config.far_plane - config.near_plane);
+
+    float proj[16] = {};
+    proj[0] = f / config.aspect;
+    proj[5] = f;
+    proj[10] = depth_scale;
+    proj[11] = 1.0f;
+    proj[14] = -config.near_plane * depth_scale;
+
+    for (int eye = 0; eye < 2; eye++) {
+        // Eyes sit half the IPD either side of the head along its x axis
+        float eye_offset[16] = {
+            1.0f, 0.0f, 0.0f, 0.0f,
+            0.0f, 1.0f, 0.0f, 0.0f,
+            0.0f, 0.0f, 1.0f, 0.0f,
+            eye == 0 ? config.ipd * 0.5f : -config.ipd * 0.5f, 0.0f, 0.0f, 1.0f
+        };
+
+        float eye_view[16];
+        matMultiply(eye_offset, head_view, eye_view);
+        matMultiply(proj, eye_view, view_proj[eye]);
+    }
+}
@@ -0,0 +1,122 @@
+/** @file Pose.h
+*
+* @brief Defines head pose sources and prediction of the pose at display time
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/10/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Tracked head pose. Uses the same axes as Vulkan view space: x right, y down, z forward
+ */
+struct Pose {
+    /**
+     * Head to world rotation as a unit quaternion (x, y, z, w)
+     */
+    float orientation[4];
+
+    /**
+     * Head position in world space, meters
+     */
+    float position[3];
+
+    /**
+     * World space angular velocity in radians per second, and linear velocity in meters per second
+     */
+    float angular_velocity[3];
+    float linear_velocity[3];
+
+    /**
+     * Time the pose was sampled at, seconds on the pose clock
+     */
+    double time;
+};
+
+/**
+ * Seconds on the steady clock that poses and display times are measured with
+ */
+double getPoseTime();
+
+/**
+ * Provides the most recent tracked pose. Implemented by HMD runtimes and test sources. Poses are sampled from the
+ *  render thread and the submit thread, so samplePose must be safe to call concurrently
+ */
+class PoseSource {
+public:
+    virtual ~PoseSource() {}
+
+    /**
+     * Get the most recent pose
+     * @param now current time on the pose clock
+     * @return latest pose with its sample time and velocities
+     */
+    virtual Pose samplePose(double now) = 0;
+};
+
+/**
+ * Deterministic head motion for testing: the pose is a pure function of the time passed in. The head yaws
+ *  and bobs sinusoidally around a fixed position
+ */
+class SyntheticPoseSource : public PoseSource {
+private:
+    float yaw_amplitude;
+    float frequency;
+    float position[3];
+
+public:
+    /**
+     * @param yaw_amplitude peak yaw in radians
+     * @param frequency oscillations per second
+     */
+    SyntheticPoseSource(float yaw_amplitude = 0.35f, float frequency = 0.25f);
+
+    Pose samplePose(double now) override;
+};
+
+/**
+ * Extrapolates poses to the time the frame will be displayed
+ */
+class PosePredictor {
+private:
+    /**
+     * Longest extrapolation allowed, seconds. Beyond this constant velocity is a worse guess than no motion
+     */
+    double max_prediction;
+
+public:
+    PosePredictor(double max_prediction = 0.05);
+
+    /**
+     * Predict a pose assuming constant angular and linear velocity
+     * @param pose sampled pose
+     * @param display_time time the frame is expected to reach the display
+     * @return predicted pose with its time set to the (clamped) prediction time
+     */
+    Pose predict(const Pose& pose, double display_time);
+};
+
+/**
+ * Per-eye projection parameters for a stereo view
+ */
+struct StereoConfig {
+    float ipd = 0.064f;
+    float vertical_fov = 1.57f;
+    float aspect = 1.0f;
+    float near_plane = 0.05f;
+    float far_plane = 100.0f;
+};
+
+/**
+ * Compute view-projection matrices for each eye from a head pose. Matrices are column major with Vulkan clip
+ *  space (y down, depth 0 to 1)
+ * @param pose head pose
+ * @param config stereo parameters
+ * @param view_proj [output] left and right eye matrices
+ */
+void computeEyeViewProj(const Pose& pose, const StereoConfig& config, float view_proj[2][16]);
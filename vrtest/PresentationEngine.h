@@ -11,35 +11,28 @@
 */
 #pragma once
 
-#define GLFW_INCLUDE_VULKAN
-#include <GLFW/glfw3.h>
 #include <vulkan/vulkan.h>
 #include <stdint.h>
 
+#include "MemoryTelemetry.h"
+
+/**
+ * Owns the images frames are rendered to and hands them to whatever displays them. Subclasses provide the
+ *  images and the acquire/present protocol, e.g. a window swapchain or offscreen images
+ */
 class PresentationEngine {
-private:
+protected:
     /**
      * Presentation engine resolution
      */
     uint32_t resolution_x;
     uint32_t resolution_y;
-    
+
     /**
      * Name of application
      */
     const char* app_name;
 
-    /**
-     * Window handle
-     * TODO: move to subclass
-     */
-    GLFWwindow* window = nullptr;
-
-    /**
-     * Vulkan surface handle of the presentation engine
-     */
-    VkSurfaceKHR win_surface = nullptr;
-
     /**
      * Swapchain image dimensions
      */
@@ -49,48 +42,31 @@ private:
      * Format of swapchain images
      */
     VkFormat sc_format;
-    bool sc_is_srgb;
 
     /**
-     * Color space of swapchain images
+     * Usage flags swapchain images were created with
      */
-    VkColorSpaceKHR sc_color_space;
+    VkImageUsageFlags sc_usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
     /**
-     * Number of images in swapchain
+     * Telemetry that device memory for engine-owned images and buffers is allocated through
      */
-    uint32_t sc_image_count;
+    MemoryTelemetry* memory_telemetry = nullptr;
 
     /**
-     * Vulkan swapchain handle
+     * Number of images in swapchain
      */
-    VkSwapchainKHR swapchain;
+    uint32_t sc_image_count = 0;
 
     /**
      * Array of vulkan image handles for the swapchain
      */
-    VkImage* sc_images;
+    VkImage* sc_images = nullptr;
 
     /**
      * Array of vulkan image views for the swapchain images
      */
-    VkImageView* sc_image_views;
-
-    /**
-    * Semaphores signaled when the swapchain image has been released by the
-    * presentation engine
-    */
-    VkSemaphore* image_ready_semaphores;
-
-    /**
-    * Semephores to signal when rendering to a swapchain image is complete
-    */
-    VkSemaphore* frame_done_semaphores;
-
-    /**
-    * Index of next semaphore pair to use for swapchain synchronization
-    */
-    uint32_t sem_index = 0;
+    VkImageView* sc_image_views = nullptr;
 
     /**
      * Instance used to create present surface
@@ -107,6 +83,16 @@ private:
      */
     VkAllocationCallbacks* p_allocs = nullptr;
 
+    /**
+     * Create a color view for each swapchain image
+     */
+    void createImageViews();
+
+    /**
+     * Destroy the views created by createImageViews and free the image arrays
+     */
+    void destroyImageViews();
+
 public:
     /**
      * Constructor initializes the presentation engine. Can be called before any device initialization.
@@ -121,17 +107,17 @@ public:
     /**
      * Destructor
      */
-    ~PresentationEngine();
+    virtual ~PresentationEngine();
 
     /**
      * Returns true if the presentation engine has received a signal to shut down
      */
-    bool shouldExit();
+    virtual bool shouldExit() = 0;
 
     /**
      * Polls for events (window signals, etc)
      */
-    void pollEvents();
+    virtual void pollEvents() = 0;
 
     /**
      * Creates optimal swapchain for device and presentation engine. Also creates synchronization
@@ -141,30 +127,76 @@ public:
      * @param gfx_queue_family: Queue family used for graphics commands
      * @param present_queue_family: Queue family used for present commands
      */
-    void createSwapchain(VkPhysicalDevice physical_device, VkDevice device, int gfx_queue_family,
-        int present_queue_family);
+    virtual void createSwapchain(VkPhysicalDevice physical_device, VkDevice device, int gfx_queue_family,
+        int present_queue_family) = 0;
 
     /**
      * Gets the index of the next swapchain image to render to
-     * @param wait_sem semaphore that will be signaled when the image is free to use
-     * @param wait_sem semaphore that presentation engine will wait on before reading image
-     * @param index of swapchain image to render to or -1 if none is available
+     * @param wait_sem semaphore that will be signaled when the image is free to use, or nullptr if there is
+     *  nothing to wait for
+     * @param signal_sem semaphore that presentation engine will wait on before reading image, or nullptr if
+     *  it doesn't need one
+     * @return index of swapchain image to render to or -1 if none is available
      */
-    int getNextSwapchainImage(VkSemaphore** wait_sem, VkSemaphore** signal_sem);
+    virtual int getNextSwapchainImage(VkSemaphore** wait_sem, VkSemaphore** signal_sem) = 0;
 
     /**
      * Presents an image back to the engine after rendering
      * @param image_index the swapchain image index to present
      * @param present_queue the queue used for present commands
      */
-    void presentSwapchainImage(int image_index, VkQueue present_queue);
+    virtual void presentSwapchainImage(int image_index, VkQueue present_queue) = 0;
 
     /**
      * Returns the Vulkan surface associated with this presentation engine
      * @param instance: Vulkan instance to use
-     * @return surfance handle
+     * @return surface handle, or VK_NULL_HANDLE if the engine doesn't present to a surface
+     */
+    virtual VkSurfaceKHR getPresentSurface(VkInstance instance) = 0;
+
+    /**
+     * Get a list of instance extension names required to support rendering to this presentation engine
+     * @param extension_count: [output] length of extension list
+     * @return array of extension name strings
+     */
+    virtual const char** getRequiredExtensions(uint32_t* extension_count) = 0;
+
+    /**
+     * Get a list of device extension names required to support rendering to this presentation engine
+     * @param extension_count: [output] length of extension list
+     * @return array of extension name strings
+     */
+    virtual const char** getRequiredDeviceExtensions(uint32_t* extension_count) = 0;
+
+    /**
+     * Get the layout swapchain images must be in when presented
+     */
+    virtual VkImageLayout getPresentLayout() = 0;
+
+    /**
+     * Tag presents with IDs so their display times can be queried. The device must have VK_GOOGLE_display_timing
+     *  enabled. Must be called before createSwapchain. Ignored by engines without a display
+     */
+    virtual void enableDisplayTiming();
+
+    /**
+     * Set the telemetry to allocate device memory through. Called by the graphics device before createSwapchain
      */
-    VkSurfaceKHR getPresentSurface(VkInstance instance);
+    void setMemoryTelemetry(MemoryTelemetry* memory_telemetry);
+
+    /**
+     * Get the display times of presents that have completed since the last call. Requires display timing
+     * @param times [output] display times in seconds, in the time domain of the presentation engine
+     * @param max_count capacity of times
+     * @return number of times written, 0 if display timing is not enabled
+     */
+    virtual uint32_t getPastPresentTimes(double* times, uint32_t max_count);
+
+    /**
+     * Get the refresh interval of the display
+     * @return refresh interval in seconds
+     */
+    virtual double getRefreshInterval();
 
     /**
      * Get length of the swapchain
@@ -178,6 +210,12 @@ public:
      */
     VkImageView* getSwapchainImageViews();
 
+    /**
+     * Get swapchain image handles
+     * @return array of image handles
+     */
+    VkImage* getSwapchainImages();
+
     /**
      * Gets the dimensions of swapchain images
      */
@@ -189,11 +227,9 @@ public:
     VkFormat getSwapchainFormat();
 
     /**
-     * Get a list of extension names required to support rendering to this presentation engine
-     * @param extension_count: [output] length of extension list
-     * @return array of extension name strings
+     * Gets usage flags of swapchain images, e.g. to check whether they can be copied from
      */
-    const char** getRequiredExtensions(uint32_t* extension_count);
+    VkImageUsageFlags getSwapchainUsage();
 
     /**
      * Get the application name
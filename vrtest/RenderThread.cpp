@@ -0,0 +1,132 @@
+/** @file RenderThread.cpp
+*
+* @brief Defines class that runs the renderer on its own thread, fed with
+*   per-frame packets produced by the simulation thread
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/28/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include <chrono>
+#include <stdexcept>
+
+#include "RenderThread.h"
+#include "Common.h"
+
+/**
+ * Times a waiting thread yields before it starts sleeping between checks
+ */
+#define RENDER_THREAD_SPIN_COUNT 64
+
+/**
+ * Yield while a wait is short, then sleep so a stalled partner doesn't burn a core
+ */
+static void backOff(uint32_t* idle) {
+    if (++*idle < RENDER_THREAD_SPIN_COUNT) {
+        std::this_thread::yield();
+    }
+    else {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+}
+
+RenderThread::RenderThread(Renderer* renderer, SubmitQueue* submit_queue, FramePacer* frame_pacer,
+    HostAllocator* host_allocator) : free_packets(RENDER_PACKET_COUNT), submitted_packets(RENDER_PACKET_COUNT),
+    stopping(false), failed(false), submitted_count(0) {
+
+    this->renderer = renderer;
+    this->submit_queue = submit_queue;
+    this->frame_pacer = frame_pacer;
+    this->host_allocator = host_allocator;
+
+    for (uint32_t i = 0; i < RENDER_PACKET_COUNT; i++) {
+        free_packets.push(&packets[i]);
+    }
+
+    submit_queue->start();
+    thread = std::thread(&RenderThread::renderLoop, this);
+}
+
+RenderThread::~RenderThread() {
+    stopping.store(true);
+    thread.join();
+    submit_queue->stop();
+}
+
+void RenderThread::renderLoop() {
+    double present_times[16];
+    uint32_t idle = 0;
+
+    while (!stopping.load(std::memory_order_acquire)) {
+        RenderPacket* packet;
+        if (!submitted_packets.pop(&packet)) {
+            backOff(&idle);
+            continue;
+        }
+        idle = 0;
+
+        try {
+            // Feed display times of earlier frames, then start as late as the deadline allows
+            uint32_t present_count = submit_queue->getPastPresentTimes(present_times, 16);
+            for (uint32_t i = 0; i < present_count; i++) {
+                frame_pacer->addPresentTime(present_times[i]);
+            }
+            frame_pacer->waitForFrameStart();
+
+            renderPacket(packet);
+        }
+        catch (...) {
+            // Leave the renderer alone from here on; the main thread rethrows and shuts down
+            error = std::current_exception();
+            failed.store(true, std::memory_order_release);
+            free_packets.push(packet);
+            return;
+        }
+
+        free_packets.push(packet);
+    }
+}
+
+void RenderThread::renderPacket(const RenderPacket* packet) {
+    if (host_allocator) {
+        host_allocator->beginFrame();
+    }
+
+    if (packet->color_mode != color_mode) {
+        renderer->setColorMode(packet->color_mode);
+        color_mode = packet->color_mode;
+    }
+
+    bool submitted = renderer->drawFrame();
+    frame_pacer->endFrame(submitted);
+    if (submitted) {
+        submitted_count.fetch_add(1, std::memory_order_release);
+    }
+}
+
+RenderPacket* RenderThread::acquirePacket() {
+    uint32_t idle = 0;
+    while (true) {
+        if (failed.load(std::memory_order_acquire)) {
+            std::rethrow_exception(error);
+        }
+
+        RenderPacket* packet;
+        if (free_packets.pop(&packet)) {
+            return packet;
+        }
+        backOff(&idle);
+    }
+}
+
+void RenderThread::submitPacket(RenderPacket* packet) {
+    // Can't fail: there are only as many packets as queue slots
+    submitted_packets.push(packet);
+}
+
+uint64_t RenderThread::getSubmittedFrameCount() {
+    return submitted_count.load(std::memory_order_acquire);
+}
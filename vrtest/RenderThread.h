@@ -0,0 +1,129 @@
+/** @file RenderThread.h
+*
+* @brief Defines class that runs the renderer on its own thread, fed with
+*   per-frame packets produced by the simulation thread
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/28/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <exception>
+#include <thread>
+
+#include "Renderer.h"
+#include "FramePacer.h"
+#include "HostAllocator.h"
+#include "SpscQueue.h"
+#include "SubmitQueue.h"
+
+/**
+ * Packets in flight between the simulation and render threads: one being filled, one queued and one being
+ *  rendered, so simulating a frame overlaps with rendering the previous one
+ */
+#define RENDER_PACKET_COUNT 3
+
+/**
+ * Everything the render thread needs from the simulation to draw a frame. A packet is not modified once
+ *  submitted, so the render thread reads it without locks. Poses are not part of the packet since the renderer
+ *  samples them as late as possible on its own
+ */
+struct RenderPacket {
+    /**
+     * Simulation frame number, starting at 1
+     */
+    uint64_t frame;
+
+    /**
+     * getPoseTime() when the simulation produced the packet
+     */
+    double sim_time;
+
+    /**
+     * Fragment shader variant of the scene, see Renderer::setColorMode
+     */
+    uint32_t color_mode;
+};
+
+/**
+ * Owns frame pacing and recording on a dedicated thread, so slow event handling on the main thread doesn't delay
+ *  the GPU and waiting on the GPU doesn't delay input. Frames are handed to the submit queue's thread for
+ *  submission and presentation, so a present that blocks doesn't delay recording the next frame. Packets are
+ *  passed through lock-free single producer, single consumer queues in both directions. The main thread blocks
+ *  when every packet is in use, which keeps the simulation at most two frames ahead of rendering.
+ *
+ * Once started, the renderer and presentation engine must only be used by the render and submit threads until the
+ *  render thread stops
+ */
+class RenderThread {
+private:
+    Renderer* renderer;
+    SubmitQueue* submit_queue;
+    FramePacer* frame_pacer;
+    HostAllocator* host_allocator;
+
+    /**
+     * Packets in the pool, packets free for the simulation to fill, and packets waiting to be rendered
+     */
+    RenderPacket packets[RENDER_PACKET_COUNT];
+    SpscQueue<RenderPacket*> free_packets;
+    SpscQueue<RenderPacket*> submitted_packets;
+
+    std::thread thread;
+    std::atomic<bool> stopping;
+
+    /**
+     * Error that stopped the render thread, rethrown on the main thread by the next acquirePacket
+     */
+    std::atomic<bool> failed;
+    std::exception_ptr error;
+
+    std::atomic<uint64_t> submitted_count;
+
+    /**
+     * Color mode the renderer was last set to
+     */
+    uint32_t color_mode = 0;
+
+    void renderLoop();
+    void renderPacket(const RenderPacket* packet);
+
+public:
+    /**
+     * Start the submit thread and the render thread. The renderer must have created its command buffers
+     * @param renderer renderer to draw frames with. Not owned
+     * @param submit_queue submit queue of the renderer's device, whose thread is started. Not owned
+     * @param frame_pacer pacer scheduling frame starts. Not owned
+     * @param host_allocator allocator whose frame scope is advanced each frame, or nullptr. Not owned
+     */
+    RenderThread(Renderer* renderer, SubmitQueue* submit_queue, FramePacer* frame_pacer,
+        HostAllocator* host_allocator);
+
+    /**
+     * Stops the thread after the frame it is rendering, then stops the submit thread once it has submitted the
+     *  frames queued. Packets still queued are dropped, and submitted frames may still be in flight on the GPU
+     */
+    ~RenderThread();
+
+    /**
+     * Get a free packet to fill, waiting for the render thread to release one. Main thread only
+     * @return packet to fill and pass to submitPacket
+     */
+    RenderPacket* acquirePacket();
+
+    /**
+     * Queue a filled packet for rendering. Main thread only
+     * @param packet packet from acquirePacket
+     */
+    void submitPacket(RenderPacket* packet);
+
+    /**
+     * Get the number of frames submitted to the device so far
+     */
+    uint64_t getSubmittedFrameCount();
+};
@@ -11,48 +11,115 @@
 */
 
 #include "Renderer.h"
+#include "SubmitQueue.h"
+#include "Common.h"
 
+#include <algorithm>
 #include <iostream>
+#include <math.h>
+#include <string.h>
+
+/**
+ * Push constants of default.vert and default.frag: position decode of the mesh's vertex format, the eye being
+ *  drawn and the draw's material
+ */
+struct SceneConstants {
+    float position_scale[4];
+    float position_offset[4];
+    uint32_t eye;
+    uint32_t material;
+};
+
+/**
+ * Push constants of upscale.frag
+ */
+struct UpscaleConstants {
+    float ring_radius[4];
+    float centers[4];
+    float scale;
+    float aspect;
+    uint32_t ring_count;
+};
 
 Renderer::Renderer(GraphicsDevice* graphics_device, PresentationEngine* presentation_engine,
-    VkAllocationCallbacks* p_allocs)
+    VkAllocationCallbacks* p_allocs, StartupProfiler* profiler) : static_pose_source(0.0f)
 {
     this->graphics_device = graphics_device;
     this->presentation_engine = presentation_engine;
     this->p_allocs = p_allocs;
+    this->profiler = profiler;
     this->sc_image_count = presentation_engine->getSwapchainLength();
+    this->pose_source = &static_pose_source;
+    this->foveation = getDefaultFoveation();
+
+    // Side-by-side stereo: each eye gets half the swapchain width
+    VkExtent2D sc_extent = presentation_engine->getSwapchainExtent();
+    stereo.aspect = (sc_extent.width * 0.5f) / sc_extent.height;
 
     createCommandPool();
 }
 
 Renderer::~Renderer() {
     VkDevice device = graphics_device->device();
+    delete shader_watcher;
     vkDestroyCommandPool(device, command_pool, p_allocs);
 
     vkDestroyBuffer(device, vertex_buffer, p_allocs);
-    vkFreeMemory(device, vertex_buffer_mem, p_allocs);
+    graphics_device->getMemoryTelemetry()->freeMemory(vertex_buffer_mem);
+
+    vkDestroyBuffer(device, instance_buffer, p_allocs);
+    graphics_device->getMemoryTelemetry()->freeMemory(instance_buffer_mem);
+    delete transforms;
+    delete lod_selector;
 
-    vkDestroyPipeline(device, pipeline, p_allocs);
+    // Holds a view of a frame graph depth image
+    delete depth_pyramid;
+
+    // Waits for any variant still compiling, which references the shader modules and layout
+    delete pipeline_library;
     vkDestroyShaderModule(device, vert_shader, p_allocs);
     vkDestroyShaderModule(device, frag_shader, p_allocs);
+    for (const auto& retired : retired_shaders) {
+        vkDestroyShaderModule(device, retired.module, p_allocs);
+    }
+    if (reload_pending) {
+        if (reload_key.vert_shader != vert_shader) {
+            vkDestroyShaderModule(device, reload_key.vert_shader, p_allocs);
+        }
+        if (reload_key.frag_shader != frag_shader) {
+            vkDestroyShaderModule(device, reload_key.frag_shader, p_allocs);
+        }
+    }
     vkDestroyPipelineLayout(device, pipeline_layout, p_allocs);
+    delete late_latch;
 
-    vkDestroyRenderPass(device, render_pass, p_allocs);
+    vkDestroyShaderModule(device, upscale_vert_shader, p_allocs);
+    vkDestroyShaderModule(device, upscale_frag_shader, p_allocs);
+    vkDestroyPipelineLayout(device, upscale_layout, p_allocs);
+    vkDestroyDescriptorPool(device, upscale_pool, p_allocs);
+    vkDestroyDescriptorSetLayout(device, upscale_set_layout, p_allocs);
+    vkDestroySampler(device, upscale_sampler, p_allocs);
 
-    for (unsigned int i = 0; i < sc_image_count; i++) {
-        vkDestroyFramebuffer(device, framebuffers[i], p_allocs);
-        vkDestroyFence(device, cmd_buffer_fences[i], p_allocs);
-    }
+    delete gpu_timer;
+    delete resolution;
+    delete material_table;
+    delete texture_streamer;
+
+    // Finishes writing queued frames
+    delete frame_capture;
+
+    delete frame_graph;
+
+    delete frame_sync;
 
-    delete[] framebuffers;
     delete[] command_buffers;
-    delete[] cmd_buffer_fences;
+    delete[] cmd_buffer_dirty;
 }
 
 void Renderer::createCommandPool() {
     VkCommandPoolCreateInfo pool_ci = {};
     pool_ci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    pool_ci.flags = 0;
+    pool_ci.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
     pool_ci.queueFamilyIndex = static_cast<uint32_t>(graphics_device->getGraphicsQueueFamily());
 
     if (vkCreateCommandPool(graphics_device->device(), &pool_ci, p_allocs, &command_pool) != VK_SUCCESS) {
@@ -62,290 +129,489 @@ void Renderer::createCommandPool() {
     std::cout << "Created command pool" << std::endl;
 }
 
-void Renderer::createRenderPass() {
-    // Attachment descriptions for color and depth buffer
-    VkAttachmentDescription attachments[2] = {};
-    attachments[0].flags = 0;
-    attachments[0].format = presentation_engine->getSwapchainFormat();
-    attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
-    attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    attachments[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-    attachments[1].flags = 0;
-    attachments[1].format = graphics_device->getDepthStencilFormat();
-    attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
-    attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-    VkAttachmentReference color_attachment_ref = {};
-    color_attachment_ref.attachment = 0;
-    color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-    VkAttachmentReference ds_attachment_ref = {};
-    ds_attachment_ref.attachment = 1;
-    ds_attachment_ref.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-    // Subpass descriptions
-    VkSubpassDescription subpass = {};
-    subpass.flags = 0;
-    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpass.inputAttachmentCount = 0;
-    subpass.pInputAttachments = nullptr;
-    subpass.colorAttachmentCount = 1;
-    subpass.pColorAttachments = &color_attachment_ref;
-    subpass.pResolveAttachments = nullptr;
-    subpass.pDepthStencilAttachment = &ds_attachment_ref;
-    subpass.preserveAttachmentCount = 0;
-    subpass.pResolveAttachments = nullptr;
-
-    // Override implicit dependency on swapchain image
-    VkSubpassDependency dependency = {};
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    dependency.dependencyFlags = 0;
-
-    // Render pass specification
-    VkRenderPassCreateInfo render_pass_ci = {};
-    render_pass_ci.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    render_pass_ci.flags = 0;
-    render_pass_ci.attachmentCount = 2;
-    render_pass_ci.pAttachments = attachments;
-    render_pass_ci.subpassCount = 1;
-    render_pass_ci.pSubpasses = &subpass;
-    render_pass_ci.dependencyCount = 1;
-    render_pass_ci.pDependencies = &dependency;
-
-    if (vkCreateRenderPass(graphics_device->device(), &render_pass_ci, p_allocs, &render_pass) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create render pass");
+void Renderer::setShaderCode(std::vector<char> vert_code, std::vector<char> frag_code) {
+    this->vert_code = std::move(vert_code);
+    this->frag_code = std::move(frag_code);
+}
+
+void Renderer::createFrameGraph() {
+    frame_graph = new FrameGraph(graphics_device, p_allocs);
+
+    // Swapchain images are acquired at the color output stage and handed back for presentation
+    VkExtent2D sc_extent = presentation_engine->getSwapchainExtent();
+    backbuffer = frame_graph->importImage("backbuffer", presentation_engine->getSwapchainFormat(), sc_extent,
+        VK_IMAGE_ASPECT_COLOR_BIT, sc_image_count, presentation_engine->getSwapchainImages(),
+        presentation_engine->getSwapchainImageViews(), VK_IMAGE_LAYOUT_UNDEFINED,
+        presentation_engine->getPresentLayout(),
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+
+    // Depth buffer is shared by every frame, so the previous frame's depth tests and depth pyramid build must
+    // finish first
+    VkImage ds_image = graphics_device->getDepthStencilImage();
+    VkImageView ds_view = graphics_device->getDepthStencilView();
+    depth_buffer = frame_graph->importImage("depth", graphics_device->getDepthStencilFormat(), sc_extent,
+        VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT, 1, &ds_image, &ds_view, VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    // The pyramid is built by sampling the depth buffer
+    if (workload.occlusion != OcclusionMode::None &&
+        !graphics_device->supportsSampledFormat(graphics_device->getDepthStencilFormat())) {
+        std::cout << "Depth buffer format can't be sampled, disabling occlusion culling" << std::endl;
+        workload.occlusion = OcclusionMode::None;
+    }
+
+    // Instances are tested against the previous frame's pyramid before anything is drawn. The cull works on the
+    // instance buffer and the pyramid, which live outside the graph, so it synchronizes them itself
+    if (workload.occlusion == OcclusionMode::Gpu) {
+        cull_pass = frame_graph->addPass("occlusion cull", FrameGraphPassType::Compute,
+            [this](VkCommandBuffer cmd, uint32_t frame_index) {
+            depth_pyramid->recordCull(cmd, frame_index);
+        });
+        frame_graph->setSideEffects(cull_pass);
+    }
+
+    VkClearValue clear_color = {};
+    clear_color.color = { 0.0f, 0.0f, 0.0f, 1.0f };
+    VkClearValue clear_depth = {};
+    clear_depth.depthStencil.depth = 1.0f;
+
+    // Each foveation ring renders the scene into its own target, allocated at the ring's scale of the largest
+    // resolution. Only the scaled corner is drawn to, and the upscale pass composites the rings
+    static const char* ring_names[MAX_FOVEATION_RINGS] = { "scene inset", "scene ring 1", "scene ring 2" };
+    static const char* ring_color_names[MAX_FOVEATION_RINGS] = { "inset color", "ring 1 color", "ring 2 color" };
+    static const char* ring_depth_names[MAX_FOVEATION_RINGS] = { "inset depth", "ring 1 depth", "ring 2 depth" };
+
+    for (uint32_t ring = 0; ring < foveation.ring_count; ring++) {
+        float ring_scale = foveation.rings[ring].scale;
+        ring_extents[ring].width = MAX(static_cast<uint32_t>(ceilf(sc_extent.width * ring_scale)), 2u);
+        ring_extents[ring].height = MAX(static_cast<uint32_t>(ceilf(sc_extent.height * ring_scale)), 1u);
+
+        ring_colors[ring] = frame_graph->createImage(ring_color_names[ring], presentation_engine->getSwapchainFormat(),
+            ring_extents[ring], VK_IMAGE_ASPECT_COLOR_BIT);
+
+        // The device depth buffer only fits a full resolution ring
+        if (ring_extents[ring].width == sc_extent.width && ring_extents[ring].height == sc_extent.height) {
+            ring_depths[ring] = depth_buffer;
+        }
+        else {
+            ring_depths[ring] = frame_graph->createImage(ring_depth_names[ring],
+                graphics_device->getDepthStencilFormat(), ring_extents[ring],
+                VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT);
+        }
+
+        ring_passes[ring] = frame_graph->addPass(ring_names[ring], FrameGraphPassType::Graphics,
+            [this, ring](VkCommandBuffer cmd, uint32_t frame_index) {
+            recordScene(cmd, frame_index, ring);
+        });
+        frame_graph->clear(ring_passes[ring], ring_colors[ring], FrameGraphUsage::ColorAttachment, clear_color);
+        frame_graph->clear(ring_passes[ring], ring_depths[ring], FrameGraphUsage::DepthStencilAttachment,
+            clear_depth);
+    }
+
+    // The outermost ring covers the whole view, so its depth is reduced into the pyramid the next frame is
+    // tested against
+    uint32_t pyramid_ring = foveation.ring_count - 1;
+    if (workload.occlusion != OcclusionMode::None) {
+        pyramid_pass = frame_graph->addPass("depth pyramid", FrameGraphPassType::Compute,
+            [this, pyramid_ring](VkCommandBuffer cmd, uint32_t frame_index) {
+            VkExtent2D eye_extent;
+            eye_extent.width = MAX(static_cast<uint32_t>(ring_extents[pyramid_ring].width / 2 * render_scale), 1u);
+            eye_extent.height = MAX(static_cast<uint32_t>(ring_extents[pyramid_ring].height * render_scale), 1u);
+            depth_pyramid->recordBuild(cmd, frame_index, eye_extent);
+        });
+        frame_graph->read(pyramid_pass, ring_depths[pyramid_ring], FrameGraphUsage::SampledCompute);
+        frame_graph->setSideEffects(pyramid_pass);
+    }
+
+    // The upscale covers every pixel, so the backbuffer's previous contents are not needed
+    upscale_pass = frame_graph->addPass("upscale", FrameGraphPassType::Graphics, [this](VkCommandBuffer cmd, uint32_t) {
+        recordUpscale(cmd);
+    });
+    for (uint32_t ring = 0; ring < foveation.ring_count; ring++) {
+        frame_graph->read(upscale_pass, ring_colors[ring], FrameGraphUsage::SampledFragment);
+    }
+    frame_graph->write(upscale_pass, backbuffer, FrameGraphUsage::ColorAttachment);
+
+    // Copy the finished frame into its readback slot in the same command buffer, so capturing adds no
+    // submissions or waits
+    if (capture_enabled) {
+        frame_capture = new FrameCapture(graphics_device, p_allocs, sc_image_count, sc_extent,
+            presentation_engine->getSwapchainFormat(), capture_directory.c_str(), capture_format);
+        capture_buffer = frame_graph->importBuffer("capture", frame_capture->getBufferSize(), sc_image_count,
+            frame_capture->getBuffers());
+
+        capture_pass = frame_graph->addPass("capture", FrameGraphPassType::Transfer,
+            [this](VkCommandBuffer cmd, uint32_t frame_index) {
+            frame_capture->recordCopy(cmd, frame_index, frame_graph->getImage(backbuffer, frame_index));
+        });
+        frame_graph->read(capture_pass, backbuffer, FrameGraphUsage::TransferSrc);
+        frame_graph->write(capture_pass, capture_buffer, FrameGraphUsage::TransferDst);
+        frame_graph->setSideEffects(capture_pass);
+    }
+
+    frame_graph->markOutput(backbuffer);
+    frame_graph->compile();
+
+    render_pass = frame_graph->getRenderPass(ring_passes[0]);
+
+    if (workload.occlusion != OcclusionMode::None) {
+        depth_pyramid = new DepthPyramid(graphics_device, p_allocs, sc_image_count,
+            frame_graph->getImage(ring_depths[pyramid_ring], 0), graphics_device->getDepthStencilFormat(),
+            ring_extents[pyramid_ring], workload.occlusion == OcclusionMode::Cpu);
+    }
+}
+
+void Renderer::createMaterials() {
+    texture_streamer = new TextureStreamer(graphics_device, p_allocs, sc_image_count, 256ull * 1024 * 1024);
+    material_table = new MaterialTable(graphics_device, p_allocs, sc_image_count, texture_streamer);
+
+    // Material 0 leaves the vertex colors as they are. The others tint them and multiply in a checkerboard
+    MaterialParams plain;
+    material_table->addMaterial(plain);
+
+    uint32_t material_count = MAX(workload.material_count, 1u);
+    for (uint32_t i = 1; i < material_count; i++) {
+        TextureHandle texture = texture_streamer->addTexture(new ProceduralTextureSource(256));
+        material_textures.push_back(texture);
+
+        MaterialParams params;
+        params.base_color[0] = 0.5f + 0.5f * static_cast<float>(i % 2);
+        params.base_color[1] = 0.5f + 0.5f * static_cast<float>((i / 2) % 2);
+        params.base_color[2] = 0.5f + 0.5f * static_cast<float>((i / 4) % 2);
+        params.base_color_texture = material_table->addTexture(texture);
+        material_table->addMaterial(params);
     }
 }
 
 void Renderer::createPipeline() {
-    // Pipeline layout: empty for now
+    late_latch = new LateLatch(graphics_device, p_allocs, sc_image_count);
+
+    // Pipeline layout shared by every scene draw: late latched view data, then the material table. The vertex
+    // decode, eye index and material ID are push constants
+    VkDescriptorSetLayout set_layouts[2] = { late_latch->getDescriptorSetLayout(),
+        material_table->getDescriptorSetLayout() };
+
+    VkPushConstantRange scene_range = {};
+    scene_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    scene_range.offset = 0;
+    scene_range.size = sizeof(SceneConstants);
+
     VkPipelineLayoutCreateInfo playout_ci = {};
     playout_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     playout_ci.flags = 0;
-    playout_ci.setLayoutCount = 0;
-    playout_ci.pSetLayouts = nullptr;
-    playout_ci.pushConstantRangeCount = 0;
-    playout_ci.pPushConstantRanges = nullptr;
+    playout_ci.setLayoutCount = 2;
+    playout_ci.pSetLayouts = set_layouts;
+    playout_ci.pushConstantRangeCount = 1;
+    playout_ci.pPushConstantRanges = &scene_range;
 
     if (vkCreatePipelineLayout(graphics_device->device(), &playout_ci, p_allocs, &pipeline_layout) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create pipeline layout");
     }
 
     // Shader stages: vertex and fragment
-    vert_shader = graphics_device->loadShader("vert.spv");
-    frag_shader = graphics_device->loadShader("frag.spv");
-
-    VkPipelineShaderStageCreateInfo stages_ci[2] = {};
-    stages_ci[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    stages_ci[0].flags = 0;
-    stages_ci[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-    stages_ci[0].module = vert_shader;
-    stages_ci[0].pName = "main";
-    stages_ci[0].pSpecializationInfo = nullptr;
-
-    stages_ci[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    stages_ci[1].flags = 0;
-    stages_ci[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    stages_ci[1].module = frag_shader;
-    stages_ci[1].pName = "main";
-    stages_ci[1].pSpecializationInfo = nullptr;
-
-    // Vertex input state: vertex buffer contains position and color data
-    VkVertexInputBindingDescription vi_binding = {};
-    vi_binding.binding = 0;
-    vi_binding.stride = 24;
-    vi_binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-    VkVertexInputAttributeDescription vi_attributes[2] = {};
-    vi_attributes[0].binding = 0;
-    vi_attributes[0].location = 0;
-    vi_attributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-    vi_attributes[0].offset = 0;
-    vi_attributes[1].binding = 0;
-    vi_attributes[1].location = 1;
-    vi_attributes[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-    vi_attributes[1].offset = 12;
-
-    VkPipelineVertexInputStateCreateInfo vi_state_ci = {};
-    vi_state_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vi_state_ci.flags = 0;
-    vi_state_ci.vertexBindingDescriptionCount = 1;
-    vi_state_ci.pVertexBindingDescriptions = &vi_binding;
-    vi_state_ci.vertexAttributeDescriptionCount = 2;
-    vi_state_ci.pVertexAttributeDescriptions = vi_attributes;
-
-    // Input assembly state: triangle list
-    VkPipelineInputAssemblyStateCreateInfo ia_state_ci = {};
-    ia_state_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    ia_state_ci.flags = 0;
-    ia_state_ci.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    ia_state_ci.primitiveRestartEnable = VK_FALSE;
-
-    // Viewport state: single viewport and scissor, full screen
-    VkExtent2D sc_extent = presentation_engine->getSwapchainExtent();
-    VkViewport viewport;
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = static_cast<float>(sc_extent.width);
-    viewport.height = static_cast<float>(sc_extent.height);
-    viewport.maxDepth = 1.0f;
-    viewport.minDepth = 0.0f;
+    if (vert_code.empty() || frag_code.empty()) {
+        vert_code = GraphicsDevice::getShaderCode("vert.spv");
+        frag_code = GraphicsDevice::getShaderCode("frag.spv");
+    }
+    vert_shader = graphics_device->createShaderModule(reinterpret_cast<const uint32_t*>(vert_code.data()),
+        vert_code.size());
+    frag_shader = graphics_device->createShaderModule(reinterpret_cast<const uint32_t*>(frag_code.data()),
+        frag_code.size());
+
+    // Vertex input state: vertex buffer in the mesh's layout, instance buffer a world matrix, and the defaults for
+    // attributes the mesh doesn't have. A stride of 0 gives every vertex the same defaults
+    VkVertexInputBindingDescription vi_bindings[3] = {};
+    vi_bindings[0].binding = 0;
+    vi_bindings[0].stride = vertex_format.stride;
+    vi_bindings[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    vi_bindings[1].binding = 1;
+    vi_bindings[1].stride = sizeof(float) * 16;
+    vi_bindings[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+    vi_bindings[2].binding = 2;
+    vi_bindings[2].stride = 0;
+    vi_bindings[2].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    std::vector<VkVertexInputAttributeDescription> vi_attributes;
+    vertex_format.getAttributes(0, 2, &vi_attributes);
+
+    // A mat4 attribute takes one location per column
+    for (uint32_t i = 0; i < 4; i++) {
+        VkVertexInputAttributeDescription column = {};
+        column.binding = 1;
+        column.location = 2 + i;
+        column.format = VK_FORMAT_R32G32B32A32_SFLOAT;
+        column.offset = sizeof(float) * 4 * i;
+        vi_attributes.push_back(column);
+    }
 
-    VkRect2D scissor;
-    scissor.offset = { 0, 0 };
-    scissor.extent = sc_extent;
+    // Embedded shaders come with reflection data, so mismatches with the layout are caught here instead of by
+    // validation layers or as garbage on screen
+    const ShaderReflection* vert_reflection = GraphicsDevice::getShaderReflection("vert.spv");
+    const ShaderReflection* frag_reflection = GraphicsDevice::getShaderReflection("frag.spv");
+    uint32_t missing_location;
+    if (vert_reflection && !checkVertexInputs(*vert_reflection, vi_attributes, &missing_location)) {
+        throw std::runtime_error("Vertex format has no attribute for shader input " +
+            std::to_string(missing_location));
+    }
+    for (const ShaderReflection* reflection : { vert_reflection, frag_reflection }) {
+        if (reflection && reflection->push_constant_size > sizeof(SceneConstants)) {
+            throw std::runtime_error("Scene shaders use more push constants than SceneConstants holds");
+        }
+    }
 
-    VkPipelineViewportStateCreateInfo vp_state_ci = {};
-    vp_state_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    vp_state_ci.flags = 0;
-    vp_state_ci.viewportCount = 1;
-    vp_state_ci.pViewports = &viewport;
-    vp_state_ci.scissorCount = 1;
-    vp_state_ci.pScissors = &scissor;
-
-    // Rasterizer state
-    VkPipelineRasterizationStateCreateInfo ras_state_ci = {};
-    ras_state_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    ras_state_ci.flags = 0;
-    ras_state_ci.depthClampEnable = VK_FALSE;
-    ras_state_ci.rasterizerDiscardEnable = VK_FALSE;
-    ras_state_ci.polygonMode = VK_POLYGON_MODE_FILL;
-    ras_state_ci.cullMode = VK_CULL_MODE_BACK_BIT;
-    ras_state_ci.frontFace = VK_FRONT_FACE_CLOCKWISE;
-    ras_state_ci.depthBiasEnable = VK_FALSE; // what is this useful for?
-    ras_state_ci.depthBiasConstantFactor = 0.0f;
-    ras_state_ci.depthBiasClamp = 0.0f;
-    ras_state_ci.depthBiasSlopeFactor = 0.0f;
-    ras_state_ci.lineWidth = 1.0f;
-
-    // Multisample state
-    VkPipelineMultisampleStateCreateInfo ms_state_ci = {};
-    ms_state_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    ms_state_ci.flags = 0;
-    ms_state_ci.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT; //TODO: enable msaa once resolve enabled
-    ms_state_ci.sampleShadingEnable = VK_FALSE;  //TODO: enable for quality
-    ms_state_ci.minSampleShading = 1.0f;
-    ms_state_ci.pSampleMask = nullptr;
-    ms_state_ci.alphaToCoverageEnable = VK_FALSE; // what is this useful for?
-    ms_state_ci.alphaToOneEnable = VK_FALSE; // what is this useful for?
-
-                                             // Depth stencil state: standard depth buffering, no stencil
-    VkPipelineDepthStencilStateCreateInfo ds_state_ci = {};
-    ds_state_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-    ds_state_ci.flags = 0;
-    ds_state_ci.depthTestEnable = VK_TRUE;
-    ds_state_ci.depthWriteEnable = VK_TRUE;
-    ds_state_ci.depthCompareOp = VK_COMPARE_OP_LESS;
-    ds_state_ci.depthBoundsTestEnable = VK_FALSE; // what is this useful for?
-    ds_state_ci.minDepthBounds = 0.0f;
-    ds_state_ci.maxDepthBounds = 0.0f;
-    ds_state_ci.stencilTestEnable = VK_FALSE; // TODO: enable later if necessary
-    ds_state_ci.front = {};
-    ds_state_ci.back = {};
-
-    // Blend state: disabled for now
-    VkPipelineColorBlendAttachmentState blend_attachment;
-    blend_attachment.blendEnable = VK_FALSE;
-    blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | \
-        VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-    blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-    blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
-    blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-    blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-    blend_attachment.alphaBlendOp = VK_BLEND_OP_MAX;
-
-    VkPipelineColorBlendStateCreateInfo blend_state_ci = {};
-    blend_state_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    blend_state_ci.flags = 0;
-    blend_state_ci.logicOpEnable = VK_FALSE; // what is this useful for?
-    blend_state_ci.logicOp = VK_LOGIC_OP_COPY;
-    blend_state_ci.attachmentCount = 1;
-    blend_state_ci.pAttachments = &blend_attachment;
-    blend_state_ci.blendConstants[0] = 0.0f;
-    blend_state_ci.blendConstants[1] = 0.0f;
-    blend_state_ci.blendConstants[2] = 0.0f;
-    blend_state_ci.blendConstants[3] = 0.0f;
-
-    // Full pipeline description
-    VkGraphicsPipelineCreateInfo pipeline_ci = {};
-    pipeline_ci.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipeline_ci.flags = 0;
-    pipeline_ci.stageCount = 2;
-    pipeline_ci.pStages = stages_ci;
-    pipeline_ci.pVertexInputState = &vi_state_ci;
-    pipeline_ci.pInputAssemblyState = &ia_state_ci;
-    pipeline_ci.pTessellationState = nullptr;
-    pipeline_ci.pViewportState = &vp_state_ci;
-    pipeline_ci.pRasterizationState = &ras_state_ci;
-    pipeline_ci.pMultisampleState = &ms_state_ci;
-    pipeline_ci.pDepthStencilState = &ds_state_ci;
-    pipeline_ci.pColorBlendState = &blend_state_ci;
-    pipeline_ci.pDynamicState = nullptr;
-    pipeline_ci.layout = pipeline_layout;
-    pipeline_ci.renderPass = render_pass;
-    pipeline_ci.subpass = 0;
-    pipeline_ci.basePipelineHandle = nullptr;
-    pipeline_ci.basePipelineIndex = 0;
-
-    // TODO: pipeline cache
-    if (vkCreateGraphicsPipelines(graphics_device->device(), nullptr, 1, &pipeline_ci, p_allocs, &pipeline) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create graphics pipeline.");
-    }
-}
-
-void Renderer::createFramebuffer() {
-    VkImageView attachments[2];
-    attachments[1] = graphics_device->getDepthStencilView();
+    // Remaining state uses the key defaults: triangle list, back face culling, depth less, blending disabled
+    scene_key.vert_shader = vert_shader;
+    scene_key.frag_shader = frag_shader;
+    scene_key.setSpecConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0, static_cast<uint32_t>(0));
+    scene_key.setSpecConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 1, material_table->getTextureCapacity());
+    scene_key.vertex_bindings.assign(vi_bindings, vi_bindings + 3);
+    scene_key.vertex_attributes = vi_attributes;
+    scene_key.layout = pipeline_layout;
+    // Ring render passes have the same attachment formats, so they are compatible and share the inset's pipelines
+    scene_key.render_pass = render_pass;
+    scene_key.subpass = frame_graph->getSubpass(ring_passes[0]);
+
+    pipeline_library = new PipelineLibrary(graphics_device, p_allocs);
+    pipeline_library->request(scene_key);
+}
 
-    uint32_t sc_image_count = presentation_engine->getSwapchainLength();
-    VkImageView* sc_image_views = presentation_engine->getSwapchainImageViews();
-    VkExtent2D sc_extent = presentation_engine->getSwapchainExtent();
+void Renderer::createUpscale() {
+    VkDevice device = graphics_device->device();
 
-    framebuffers = new VkFramebuffer[sc_image_count];
-    VkFramebufferCreateInfo framebuffer_ci = {};
-    for (uint32_t i = 0; i < sc_image_count; i++) {
-        attachments[0] = sc_image_views[i];
-
-        framebuffer_ci.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        framebuffer_ci.flags = 0;
-        framebuffer_ci.renderPass = render_pass;
-        framebuffer_ci.attachmentCount = 2;
-        framebuffer_ci.pAttachments = attachments;
-        framebuffer_ci.width = sc_extent.width;
-        framebuffer_ci.height = sc_extent.height;
-        framebuffer_ci.layers = 1;
-
-        if (vkCreateFramebuffer(graphics_device->device(), &framebuffer_ci, p_allocs, &(framebuffers[i])) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to create framebuffer");
+    // Bilinear sampler clamped to the target. The shader keeps taps inside each eye's rendered area
+    VkSamplerCreateInfo sampler_ci = {};
+    sampler_ci.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_ci.flags = 0;
+    sampler_ci.magFilter = VK_FILTER_LINEAR;
+    sampler_ci.minFilter = VK_FILTER_LINEAR;
+    sampler_ci.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_ci.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_ci.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_ci.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_ci.mipLodBias = 0.0f;
+    sampler_ci.anisotropyEnable = VK_FALSE;
+    sampler_ci.maxAnisotropy = 1.0f;
+    sampler_ci.compareEnable = VK_FALSE;
+    sampler_ci.minLod = 0.0f;
+    sampler_ci.maxLod = 0.0f;
+    sampler_ci.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+    sampler_ci.unnormalizedCoordinates = VK_FALSE;
+
+    if (vkCreateSampler(device, &sampler_ci, p_allocs, &upscale_sampler) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create upscale sampler");
+    }
+
+    // Descriptor set with the color target of each ring
+    VkDescriptorSetLayoutBinding binding = {};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    binding.descriptorCount = MAX_FOVEATION_RINGS;
+    binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    binding.pImmutableSamplers = nullptr;
+
+    VkDescriptorSetLayoutCreateInfo set_layout_ci = {};
+    set_layout_ci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    set_layout_ci.flags = 0;
+    set_layout_ci.bindingCount = 1;
+    set_layout_ci.pBindings = &binding;
+
+    if (vkCreateDescriptorSetLayout(device, &set_layout_ci, p_allocs, &upscale_set_layout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create upscale descriptor set layout");
+    }
+
+    VkDescriptorPoolSize pool_size = {};
+    pool_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    pool_size.descriptorCount = MAX_FOVEATION_RINGS;
+
+    VkDescriptorPoolCreateInfo pool_ci = {};
+    pool_ci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_ci.flags = 0;
+    pool_ci.maxSets = 1;
+    pool_ci.poolSizeCount = 1;
+    pool_ci.pPoolSizes = &pool_size;
+
+    if (vkCreateDescriptorPool(device, &pool_ci, p_allocs, &upscale_pool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create upscale descriptor pool");
+    }
+
+    VkDescriptorSetAllocateInfo set_ai = {};
+    set_ai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    set_ai.descriptorPool = upscale_pool;
+    set_ai.descriptorSetCount = 1;
+    set_ai.pSetLayouts = &upscale_set_layout;
+
+    if (vkAllocateDescriptorSets(device, &set_ai, &upscale_set) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate upscale descriptor set");
+    }
+
+    // Entries past the ring count are never sampled but must still be valid, so they repeat the inset
+    VkDescriptorImageInfo image_infos[MAX_FOVEATION_RINGS];
+    for (uint32_t ring = 0; ring < MAX_FOVEATION_RINGS; ring++) {
+        uint32_t source = ring < foveation.ring_count ? ring : 0;
+        image_infos[ring].sampler = upscale_sampler;
+        image_infos[ring].imageView = frame_graph->getImageView(ring_colors[source], 0);
+        image_infos[ring].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+
+    VkWriteDescriptorSet write = {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = upscale_set;
+    write.dstBinding = 0;
+    write.dstArrayElement = 0;
+    write.descriptorCount = MAX_FOVEATION_RINGS;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.pImageInfo = image_infos;
+
+    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+
+    // Pipeline layout: ring targets, and ring placement and scale as push constants
+    VkPushConstantRange scale_range = {};
+    scale_range.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    scale_range.offset = 0;
+    scale_range.size = sizeof(UpscaleConstants);
+
+    VkPipelineLayoutCreateInfo playout_ci = {};
+    playout_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    playout_ci.flags = 0;
+    playout_ci.setLayoutCount = 1;
+    playout_ci.pSetLayouts = &upscale_set_layout;
+    playout_ci.pushConstantRangeCount = 1;
+    playout_ci.pPushConstantRanges = &scale_range;
+
+    if (vkCreatePipelineLayout(device, &playout_ci, p_allocs, &upscale_layout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline layout");
+    }
+
+    upscale_vert_shader = graphics_device->loadShader("upscale_vert.spv");
+    upscale_frag_shader = graphics_device->loadShader("upscale_frag.spv");
+
+    // Full screen triangle generated in the vertex shader: no vertex input, culling or depth
+    upscale_key.vert_shader = upscale_vert_shader;
+    upscale_key.frag_shader = upscale_frag_shader;
+    upscale_key.cull_mode = VK_CULL_MODE_NONE;
+    upscale_key.depth_test = VK_FALSE;
+    upscale_key.depth_write = VK_FALSE;
+    upscale_key.layout = upscale_layout;
+    upscale_key.render_pass = frame_graph->getRenderPass(upscale_pass);
+    upscale_key.subpass = frame_graph->getSubpass(upscale_pass);
+
+    pipeline_library->request(upscale_key);
+}
+
+void Renderer::importMesh() {
+    uint32_t triangle_count = MAX(workload.triangle_count, 1u);
+    scene_mesh = MeshData();
+    scene_mesh.positions.reserve(9 * triangle_count);
+    scene_mesh.colors.reserve(12 * triangle_count);
+
+    // Three test triangles, red, green and blue at their corners
+    float base_positions[] = {
+        -0.6f, -0.3f, 0.5f,
+        -0.3f, 0.3f, 0.5f,
+        -0.9f, 0.3f, 0.5f,
+
+        0.0f, -0.3f, 0.5f,
+        0.3f, 0.3f, 0.5f,
+        -0.3f, 0.3f, 0.5f,
+
+        0.6f, -0.3f, 0.5f,
+        0.9f, 0.3f, 0.5f,
+        0.3f, 0.3f, 0.5f
+    };
+
+    uint32_t base_count = MIN(triangle_count, 3u);
+    scene_mesh.positions.assign(base_positions, base_positions + 9 * base_count);
+    for (uint32_t i = 0; i < 3 * base_count; i++) {
+        float color[4] = { static_cast<float>(i % 3 == 0), static_cast<float>(i % 3 == 1),
+            static_cast<float>(i % 3 == 2), 1.0f };
+        scene_mesh.colors.insert(scene_mesh.colors.end(), color, color + 4);
+        scene_mesh.indices.push_back(i);
+    }
+
+    // Extra triangles tile a gently curved sheet behind the test triangles, two per grid cell, so there is a
+    // surface for LODs to simplify
+    uint32_t extra_count = triangle_count - base_count;
+    if (extra_count > 0) {
+        uint32_t grid = static_cast<uint32_t>(ceil(sqrt(extra_count / 2.0)));
+        float cell = 2.0f / grid;
+        uint32_t first_vertex = scene_mesh.getVertexCount();
+
+        for (uint32_t y = 0; y <= grid; y++) {
+            for (uint32_t x = 0; x <= grid; x++) {
+                float position[3] = { -1.0f + x * cell, -1.0f + y * cell, 0.0f };
+                position[2] = 1.0f + 0.05f * sinf(3.0f * position[0]) * cosf(3.0f * position[1]);
+
+                // Neighbors differ, so every triangle is red, green and blue at its corners
+                uint32_t channel = (x + 2 * y) % 3;
+                float color[4] = { static_cast<float>(channel == 0), static_cast<float>(channel == 1),
+                    static_cast<float>(channel == 2), 1.0f };
+                scene_mesh.positions.insert(scene_mesh.positions.end(), position, position + 3);
+                scene_mesh.colors.insert(scene_mesh.colors.end(), color, color + 4);
+            }
+        }
+
+        for (uint32_t i = 0; i < extra_count; i++) {
+            uint32_t cell_index = i / 2;
+            uint32_t corner = first_vertex + (cell_index / grid) * (grid + 1) + cell_index % grid;
+            uint32_t triangle[2][3] = {
+                { corner, corner + 1, corner + grid + 1 },
+                { corner + 1, corner + grid + 2, corner + grid + 1 }
+            };
+            scene_mesh.indices.insert(scene_mesh.indices.end(), triangle[i % 2], triangle[i % 2] + 3);
         }
     }
+
+    // Textured materials tile their checkerboard across the view
+    if (workload.material_count > 1) {
+        uint32_t vertex_count = scene_mesh.getVertexCount();
+        scene_mesh.uvs.reserve(2 * vertex_count);
+        for (uint32_t i = 0; i < vertex_count; i++) {
+            scene_mesh.uvs.push_back(2.0f * scene_mesh.positions[3 * i]);
+            scene_mesh.uvs.push_back(2.0f * scene_mesh.positions[3 * i + 1]);
+        }
+    }
+
+    // Levels are appended to the index buffer, and all share the vertices. A single level still provides the
+    // bounds and the range every draw covers
+    LodOptions lod_options;
+    lod_options.max_levels = workload.lod ? MAX_LOD_LEVELS : 1;
+    scene_lods = generateLods(&scene_mesh, lod_options);
+
+    // Every level simplifies the same vertices, so one box bounds them all
+    for (uint32_t axis = 0; axis < 3; axis++) {
+        scene_bounds_min[axis] = scene_mesh.positions[axis];
+        scene_bounds_max[axis] = scene_mesh.positions[axis];
+    }
+    for (size_t i = 3; i < scene_mesh.positions.size(); i++) {
+        scene_bounds_min[i % 3] = MIN(scene_bounds_min[i % 3], scene_mesh.positions[i]);
+        scene_bounds_max[i % 3] = MAX(scene_bounds_max[i % 3], scene_mesh.positions[i]);
+    }
+
+    // The pipeline's vertex input depends on the layout, so it is chosen before the pipeline is requested
+    VertexImportOptions options;
+    options.full_precision = workload.full_precision_vertices;
+    vertex_format = chooseVertexFormat(scene_mesh, options);
+
+    std::cout << "Imported mesh with " << vertex_format.stride << " byte vertices and " << scene_lods.level_count
+        << " levels of detail" << std::endl;
 }
 
 void Renderer::createVertexBuffer() {
     VkDevice device = graphics_device->device();
 
-    // Create vertex buffer object
+    // Create vertex buffer object: encoded vertices, then the attribute defaults at an aligned offset, then the
+    // indices of every level
+    VkDeviceSize vertices_size = static_cast<VkDeviceSize>(vertex_format.stride) * scene_mesh.getVertexCount();
+    vertex_defaults_offset = (vertices_size + 15) & ~static_cast<VkDeviceSize>(15);
+    index_offset = vertex_defaults_offset + VERTEX_DEFAULTS_SIZE;
+
     VkBufferCreateInfo buffer_ci = {};
     buffer_ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     buffer_ci.flags = 0;
-    buffer_ci.size = 36 * 3;
-    buffer_ci.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+    buffer_ci.size = index_offset + sizeof(uint32_t) * scene_mesh.indices.size();
+    buffer_ci.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
     buffer_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
     if (vkCreateBuffer(device, &buffer_ci, p_allocs, &vertex_buffer) != VK_SUCCESS) {
@@ -362,7 +628,8 @@ void Renderer::createVertexBuffer() {
     alloc_info.memoryTypeIndex = graphics_device->findMemType(mem_req.memoryTypeBits,
         static_cast<VkMemoryPropertyFlagBits>(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT));
 
-    if (vkAllocateMemory(device, &alloc_info, p_allocs, &vertex_buffer_mem) != VK_SUCCESS) {
+    MemoryTelemetry* memory_telemetry = graphics_device->getMemoryTelemetry();
+    if (memory_telemetry->allocateMemory(alloc_info, MEMORY_CATEGORY_BUFFER, &vertex_buffer_mem) != VK_SUCCESS) {
         throw std::runtime_error("Failed to allocate device memory for vertex buffer");
     }
 
@@ -370,49 +637,220 @@ void Renderer::createVertexBuffer() {
         throw std::runtime_error("Failed to bind memory to vertex buffer");
     }
 
-    // Copy vertex data to vertex buffer
-    float vertex_data[] = {
-        -0.6f, -0.3f, 0.5f,
-        1.0f, 0.0f, 0.0f,
-        -0.3f, 0.3f, 0.5f,
-        0.0f, 1.0f, 0.0f,
-        -0.9f, 0.3f, 0.5f,
-        0.0f, 0.0f, 1.0f,
-
-        0.0f, -0.3f, 0.5f,
-        1.0f, 0.0f, 0.0f,
-        0.3f, 0.3f, 0.5f,
-        0.0f, 1.0f, 0.0f,
-        -0.3f, 0.3f, 0.5f,
-        0.0f, 0.0f, 1.0f,
-
-        0.6f, -0.3f, 0.5f,
-        1.0f, 0.0f, 0.0f,
-        0.9f, 0.3f, 0.5f,
-        0.0f, 1.0f, 0.0f,
-        0.3f, 0.3f, 0.5f,
-        0.0f, 0.0f, 1.0f
-    };
+    // Encode vertex data into vertex buffer
     void* mapped_data;
-    if (vkMapMemory(device, vertex_buffer_mem, 0, mem_req.size, 0, &mapped_data) != VK_SUCCESS) {
+    if (vkMapMemory(device, vertex_buffer_mem, 0, buffer_ci.size, 0, &mapped_data) != VK_SUCCESS) {
         throw std::runtime_error("Failed to map vertex buffer memory to host");
     }
-    memcpy(mapped_data, vertex_data, mem_req.size);
+
+    encodeVertices(scene_mesh, vertex_format, mapped_data);
+    encodeVertexDefaults(static_cast<uint8_t*>(mapped_data) + vertex_defaults_offset);
+    memcpy(static_cast<uint8_t*>(mapped_data) + index_offset, scene_mesh.indices.data(),
+        sizeof(uint32_t) * scene_mesh.indices.size());
+
     vkUnmapMemory(device, vertex_buffer_mem);
 
+    // Only the encoded copy is needed from here on
+    scene_mesh = MeshData();
+
     std::cout << "Finished creating vertex buffer" << std::endl;
 }
 
+void Renderer::createInstanceBuffer() {
+    VkDevice device = graphics_device->device();
+
+    // Instances are stacked further away under the root, so extra instances add load without covering the first
+    uint32_t instance_count = MAX(workload.instance_count, 1u);
+    transforms = new TransformHierarchy(instance_count + 1);
+    uint32_t root = transforms->addNode(-1);
+    for (uint32_t i = 0; i < instance_count; i++) {
+        uint32_t node = transforms->addNode(static_cast<int32_t>(root));
+        transforms->setLocalPosition(node, vec3(0.0f, 0.0f, 0.05f * i));
+    }
+
+    lod_selector = new LodSelector(instance_count);
+    draws_per_level = MIN(MAX(workload.draw_count, 1u), scene_lods.levels[0].index_count / 3);
+
+    // Any number of instances may be drawn at a level, so each level's region has room for all of them. Slices
+    // stay 64-byte aligned for streaming stores
+    instance_region_size = sizeof(float) * 16 * instance_count;
+    indirect_offset = sizeof(float) * 16 + instance_region_size * scene_lods.level_count;
+    VkDeviceSize indirect_size = sizeof(VkDrawIndexedIndirectCommand) * scene_lods.level_count * draws_per_level;
+    instance_stride = (indirect_offset + indirect_size + 63) & ~static_cast<VkDeviceSize>(63);
+    VkBufferUsageFlags usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+
+    // The GPU cull reads every candidate from the slice and compacts the visible ones into the regions. Slices
+    // are bound as storage buffers, so they also follow the device's offset alignment
+    if (workload.occlusion == OcclusionMode::Gpu) {
+        occlusion_layout.params_offset = instance_stride;
+        occlusion_layout.candidates_offset = occlusion_layout.params_offset +
+            ((sizeof(OcclusionCullParams) + 63) & ~static_cast<size_t>(63));
+        occlusion_layout.levels_offset = occlusion_layout.candidates_offset + instance_region_size;
+        occlusion_layout.regions_offset = sizeof(float) * 16;
+        occlusion_layout.region_size = instance_region_size;
+        occlusion_layout.commands_offset = indirect_offset;
+        occlusion_layout.instance_count = instance_count;
+        occlusion_layout.level_count = scene_lods.level_count;
+        occlusion_layout.draws_per_level = draws_per_level;
+        memcpy(occlusion_layout.bounds_min, scene_bounds_min, sizeof(scene_bounds_min));
+        memcpy(occlusion_layout.bounds_max, scene_bounds_max, sizeof(scene_bounds_max));
+
+        VkDeviceSize alignment = MAX(graphics_device->getDeviceProperties().limits.minStorageBufferOffsetAlignment,
+            static_cast<VkDeviceSize>(64));
+        instance_stride = (occlusion_layout.levels_offset + sizeof(uint32_t) * instance_count + alignment - 1) /
+            alignment * alignment;
+        usage |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    }
+
+    VkBufferCreateInfo buffer_ci = {};
+    buffer_ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_ci.flags = 0;
+    buffer_ci.size = instance_stride * sc_image_count;
+    buffer_ci.usage = usage;
+    buffer_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(device, &buffer_ci, p_allocs, &instance_buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create instance buffer");
+    }
+
+    VkMemoryRequirements mem_req;
+    vkGetBufferMemoryRequirements(device, instance_buffer, &mem_req);
+
+    VkMemoryAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize = mem_req.size;
+    alloc_info.memoryTypeIndex = graphics_device->findMemType(mem_req.memoryTypeBits,
+        static_cast<VkMemoryPropertyFlagBits>(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT));
+
+    MemoryTelemetry* memory_telemetry = graphics_device->getMemoryTelemetry();
+    if (memory_telemetry->allocateMemory(alloc_info, MEMORY_CATEGORY_BUFFER, &instance_buffer_mem) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate device memory for instance buffer");
+    }
+
+    if (vkBindBufferMemory(device, instance_buffer, instance_buffer_mem, 0) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to bind memory to instance buffer");
+    }
+
+    // Mappings are aligned to at least 64 bytes, and regions are whole matrices, so streaming stores can be used
+    void* mapped_data;
+    if (vkMapMemory(device, instance_buffer_mem, 0, VK_WHOLE_SIZE, 0, &mapped_data) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to map instance buffer memory to host");
+    }
+    instance_mapped = static_cast<uint8_t*>(mapped_data);
+
+    if (workload.occlusion == OcclusionMode::Gpu) {
+        depth_pyramid->setCullTarget(instance_buffer, instance_stride, occlusion_layout);
+    }
+
+    std::cout << "Finished creating instance buffer" << std::endl;
+}
+
+void Renderer::updateInstances(uint32_t index) {
+    uint8_t* slice = instance_mapped + instance_stride * index;
+    uint32_t instance_count = transforms->getNodeCount() - 1;
+    uint32_t level_instances[MAX_LOD_LEVELS] = {};
+    bool gpu_cull = workload.occlusion == OcclusionMode::Gpu;
+
+    if (scene_lods.level_count == 1 && workload.occlusion == OcclusionMode::None) {
+        // Node order is the order of the only region, so the hierarchy streams straight into it
+        transforms->update(reinterpret_cast<float*>(slice));
+        level_instances[0] = instance_count;
+    }
+    else {
+        transforms->update();
+
+        // The slot's previous submission has retired, so its copy of the pyramid is complete
+        bool cpu_cull = workload.occlusion == OcclusionMode::Cpu && depth_pyramid->readBack(index, &cpu_pyramid);
+
+        // Error is judged at the resolution of the inset, the finest anything is drawn at
+        float eye_height = ring_extents[0].height * render_scale;
+        float projection_scale = eye_height / (2.0f * tanf(stereo.vertical_fov * 0.5f));
+        Vec3 eye = vec3(lod_eye_position[0], lod_eye_position[1], lod_eye_position[2]);
+        Vec3 center = vec3(scene_lods.center[0], scene_lods.center[1], scene_lods.center[2]);
+        uint8_t* regions = slice + sizeof(float) * 16;
+        float* candidates = reinterpret_cast<float*>(slice + occlusion_layout.candidates_offset);
+        uint32_t* candidate_levels = reinterpret_cast<uint32_t*>(slice + occlusion_layout.levels_offset);
+
+        for (uint32_t i = 0; i < instance_count; i++) {
+            const Mat4& world = transforms->getWorldMatrix(i + 1);
+            if (cpu_cull && !cpu_pyramid.isBoxVisible(world, scene_bounds_min, scene_bounds_max)) {
+                continue;
+            }
+
+            uint32_t level = 0;
+            if (scene_lods.level_count > 1) {
+                float scale = sqrtf(MAX(MAX(float4Dot(world.cols[0], world.cols[0]), float4Dot(world.cols[1],
+                    world.cols[1])), float4Dot(world.cols[2], world.cols[2])));
+                float distance = length(transformPoint(world, center) - eye) - scene_lods.radius * scale;
+                level = lod_selector->select(scene_lods, i, distance, projection_scale, scale);
+            }
+
+            // The GPU cull compacts candidates into the regions itself
+            if (gpu_cull) {
+                mat4Stream(candidates + 16 * i, world);
+                candidate_levels[i] = level;
+            }
+            else {
+                float* slot = reinterpret_cast<float*>(regions + instance_region_size * level);
+                mat4Stream(slot + 16 * level_instances[level]++, world);
+            }
+        }
+        float4StreamFence();
+
+        if (gpu_cull) {
+            uint8_t* params = slice + occlusion_layout.params_offset;
+            depth_pyramid->writeCullParams(reinterpret_cast<OcclusionCullParams*>(params));
+        }
+    }
+
+    // Every level's draws are recorded, so levels without instances just draw none. The GPU cull counts
+    // instances up from zero
+    VkDrawIndexedIndirectCommand* commands = reinterpret_cast<VkDrawIndexedIndirectCommand*>(slice + indirect_offset);
+    for (uint32_t level = 0; level < scene_lods.level_count; level++) {
+        const LodLevel& lod = scene_lods.levels[level];
+        uint32_t triangle_count = lod.index_count / 3;
+
+        // Split the level's triangles evenly across the draws
+        for (uint32_t draw = 0; draw < draws_per_level; draw++) {
+            uint32_t first = triangle_count * draw / draws_per_level;
+            uint32_t last = triangle_count * (draw + 1) / draws_per_level;
+
+            VkDrawIndexedIndirectCommand& command = commands[level * draws_per_level + draw];
+            command.indexCount = (last - first) * 3;
+            command.instanceCount = gpu_cull ? 0 : level_instances[level];
+            command.firstIndex = lod.first_index + first * 3;
+            command.vertexOffset = 0;
+            command.firstInstance = 0;
+        }
+    }
+}
+
 void Renderer::createCommandBuffer() {
-    // Create pipeline related objects
-    createRenderPass();
-    createPipeline();
-    createFramebuffer();
+    // Create pipeline related objects. The pipeline only depends on the render pass, so it compiles on a
+    // library worker while everything else is created
+    {
+        ScopedPhase phase(profiler, "frame graph compile");
+        createFrameGraph();
+    }
+    {
+        ScopedPhase phase(profiler, "mesh import");
+        importMesh();
+    }
+    {
+        ScopedPhase phase(profiler, "pipeline request");
+        createMaterials();
+        createPipeline();
+        createUpscale();
+    }
+
+    ScopedPhase phase(profiler, "vertex buffer and command buffers");
     createVertexBuffer();
+    createInstanceBuffer();
 
     uint32_t sc_image_count = presentation_engine->getSwapchainLength();
     command_buffers = new VkCommandBuffer[sc_image_count];
-    cmd_buffer_fences = new VkFence[sc_image_count];
+    cmd_buffer_dirty = new bool[sc_image_count];
 
     // Allocate the command buffer from the pool
     VkCommandBufferAllocateInfo buffer_ai = {};
@@ -425,58 +863,403 @@ void Renderer::createCommandBuffer() {
         throw std::runtime_error("Failed to allocate command buffer");
     }
 
-    VkFenceCreateInfo fence_ci = {};
-    fence_ci.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fence_ci.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-    VkClearColorValue clear_color = { 0.0f, 0.0f, 0.0f, 1.0f };
-    VkClearValue clear_values[2];
-    clear_values[0].color = clear_color;
-    clear_values[1].depthStencil.depth = 1.0f;
+    frame_sync = new FrameSync(graphics_device, p_allocs, sc_image_count);
+    gpu_timer = new GpuTimer(graphics_device, p_allocs, sc_image_count);
+    resolution = new DynamicResolution(gpu_budget_ms);
+    render_scale = resolution->getScale();
 
-    VkDeviceSize vtx_buffer_offset = 0;
+    // Recording binds the pipeline, so the default variant must be finished. It becomes the fallback drawn
+    // while other variants compile (this also throws on a compile failure)
+    pipeline_library->setFallback(scene_key);
+    pipeline_library->getBlocking(upscale_key);
 
     for (uint32_t i = 0; i < sc_image_count; i++) {
-        // Begin recording command buffer
-        VkCommandBufferBeginInfo begin_info = {};
-        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        begin_info.flags = 0;
-        begin_info.pInheritanceInfo = nullptr;
-
-        if (vkBeginCommandBuffer(command_buffers[i], &begin_info) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to begin command buffer recording");
+        recordCommandBuffer(i);
+    }
+}
+
+void Renderer::recordCommandBuffer(uint32_t index) {
+    // Begin recording command buffer. The pool allows individual resets, so this discards the old contents
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = 0;
+    begin_info.pInheritanceInfo = nullptr;
+
+    if (vkBeginCommandBuffer(command_buffers[index], &begin_info) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to begin command buffer recording");
+    }
+
+    // Record the frame graph passes and the barriers between them
+    gpu_timer->begin(command_buffers[index], index);
+    frame_graph->execute(command_buffers[index], index);
+    gpu_timer->end(command_buffers[index], index);
+
+    // Finish recording command buffer
+    if (vkEndCommandBuffer(command_buffers[index]) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to end command buffer recording");
+    }
+
+    cmd_buffer_dirty[index] = false;
+
+    // Pipelines of replaced shaders are no longer referenced by this command buffer
+    for (auto& retired : retired_shaders) {
+        retired.referenced[index] = false;
+    }
+}
+
+void Renderer::recordScene(VkCommandBuffer cmd, uint32_t frame_index, uint32_t ring) {
+    VkDescriptorSet sets[2] = { late_latch->getDescriptorSet(frame_index),
+        material_table->getDescriptorSet(frame_index) };
+
+    // Instances of each level are in their own region of this frame's slice, after the root's matrix
+    VkDeviceSize slice = instance_stride * frame_index;
+    VkDeviceSize regions = slice + sizeof(float) * 16;
+    VkBuffer buffers[3] = { vertex_buffer, instance_buffer, vertex_buffer };
+    VkDeviceSize offsets[3] = { 0, regions, vertex_defaults_offset };
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_library->get(scene_key));
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 2, sets, 0, nullptr);
+    vkCmdBindVertexBuffers(cmd, 0, 3, buffers, offsets);
+    vkCmdBindIndexBuffer(cmd, vertex_buffer, index_offset, VK_INDEX_TYPE_UINT32);
+
+    SceneConstants constants;
+    memcpy(constants.position_scale, vertex_format.decode_scale, sizeof(constants.position_scale));
+    memcpy(constants.position_offset, vertex_format.decode_offset, sizeof(constants.position_offset));
+
+    // Draw each eye side by side into the scaled corner of the ring's target, restricted to the area the ring
+    // covers. Viewport and scissor are dynamic so pipeline variants don't depend on the resolution
+    uint32_t eye_width = static_cast<uint32_t>(ring_extents[ring].width / 2 * render_scale);
+    uint32_t eye_height = static_cast<uint32_t>(ring_extents[ring].height * render_scale);
+
+    for (uint32_t eye = 0; eye < 2; eye++) {
+        VkViewport viewport;
+        viewport.x = static_cast<float>(eye * eye_width);
+        viewport.y = 0.0f;
+        viewport.width = static_cast<float>(eye_width);
+        viewport.height = static_cast<float>(eye_height);
+        viewport.maxDepth = 1.0f;
+        viewport.minDepth = 0.0f;
+
+        VkRect2D eye_rect;
+        eye_rect.offset = { static_cast<int32_t>(eye * eye_width), 0 };
+        eye_rect.extent = { eye_width, eye_height };
+        VkRect2D scissor = getFoveationScissor(foveation, eye, ring, eye_rect);
+
+        vkCmdSetViewport(cmd, 0, 1, &viewport);
+        vkCmdSetScissor(cmd, 0, 1, &scissor);
+        constants.eye = eye;
+
+        // Instance counts and index ranges are written each frame by updateInstances. Draws are issued one at a
+        // time, so neither multiDrawIndirect nor drawIndirectFirstInstance is needed
+        for (uint32_t level = 0; level < scene_lods.level_count; level++) {
+            VkDeviceSize region = regions + instance_region_size * level;
+            vkCmdBindVertexBuffers(cmd, 1, 1, &instance_buffer, &region);
+
+            // Every material is in the bound set, so switching material is only a push constant
+            for (uint32_t draw = 0; draw < draws_per_level; draw++) {
+                constants.material = draw % material_table->getMaterialCount();
+                vkCmdPushConstants(cmd, pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                    sizeof(SceneConstants), &constants);
+
+                VkDeviceSize command = slice + indirect_offset +
+                    sizeof(VkDrawIndexedIndirectCommand) * (level * draws_per_level + draw);
+                vkCmdDrawIndexedIndirect(cmd, instance_buffer, command, 1, sizeof(VkDrawIndexedIndirectCommand));
+            }
         }
+    }
+}
+
+void Renderer::recordUpscale(VkCommandBuffer cmd) {
+    VkExtent2D sc_extent = presentation_engine->getSwapchainExtent();
+
+    VkViewport viewport;
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = static_cast<float>(sc_extent.width);
+    viewport.height = static_cast<float>(sc_extent.height);
+    viewport.maxDepth = 1.0f;
+    viewport.minDepth = 0.0f;
 
-        // Record the render pass and draw triangle
-        VkRenderPassBeginInfo rp_begin_info = {};
-        rp_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        rp_begin_info.renderPass = render_pass;
-        rp_begin_info.framebuffer = framebuffers[i];
-        rp_begin_info.renderArea.offset = { 0, 0 };
-        rp_begin_info.renderArea.extent = presentation_engine->getSwapchainExtent();
-        rp_begin_info.clearValueCount = 2;
-        rp_begin_info.pClearValues = clear_values;
+    VkRect2D scissor;
+    scissor.offset = { 0, 0 };
+    scissor.extent = sc_extent;
 
-        vkCmdBeginRenderPass(command_buffers[i], &rp_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+    UpscaleConstants constants = {};
+    constants.ring_radius[0] = foveation.rings[0].radius;
+    constants.ring_radius[1] = foveation.rings[1].radius;
+    constants.ring_radius[3] = foveation.blend_width;
+    constants.centers[0] = foveation.center[0][0];
+    constants.centers[1] = foveation.center[0][1];
+    constants.centers[2] = foveation.center[1][0];
+    constants.centers[3] = foveation.center[1][1];
+    constants.scale = render_scale;
+    constants.aspect = stereo.aspect;
+    constants.ring_count = foveation.ring_count;
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_library->get(upscale_key));
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, upscale_layout, 0, 1, &upscale_set, 0, nullptr);
+    vkCmdSetViewport(cmd, 0, 1, &viewport);
+    vkCmdSetScissor(cmd, 0, 1, &scissor);
+    vkCmdPushConstants(cmd, upscale_layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(UpscaleConstants), &constants);
+    vkCmdDraw(cmd, 3, 1, 0, 0);
+}
 
-        vkCmdBindPipeline(command_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-        vkCmdBindVertexBuffers(command_buffers[i], 0, 1, &vertex_buffer, &vtx_buffer_offset);
-        vkCmdDraw(command_buffers[i], 9, 1, 0, 0);
+void Renderer::updateResolution(uint32_t index) {
+    // The slot's previous submission has retired, so its timestamps are available without waiting
+    double gpu_ms;
+    if (!gpu_timer->getElapsed(index, &gpu_ms)) {
+        return;
+    }
 
-        vkCmdEndRenderPass(command_buffers[i]);
+    last_gpu_ms = gpu_ms;
+    if (frame_pacer) {
+        frame_pacer->addGpuTime(gpu_ms);
+    }
 
-        // Finish recording command buffer
-        if (vkEndCommandBuffer(command_buffers[i]) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to end command buffer recording");
+    if (dynamic_resolution && resolution->update(gpu_ms)) {
+        render_scale = resolution->getScale();
+        for (uint32_t i = 0; i < sc_image_count; i++) {
+            cmd_buffer_dirty[i] = true;
         }
+    }
+}
 
-        // Create fence for the command buffer
-        if (vkCreateFence(graphics_device->device(), &fence_ci, p_allocs, &(cmd_buffer_fences[i])) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to create fence");
+void Renderer::predictPose(uint32_t index) {
+    // Predict for when this frame is expected to reach the display
+    double now = getPoseTime();
+    if (last_submit_time > 0.0) {
+        frame_interval += (MIN(now - last_submit_time, 0.1) - frame_interval) * 0.1;
+    }
+    last_submit_time = now;
+
+    // The pacer knows which vsync the frame targets, so prefer it over the latency estimate
+    double display_time = now + frame_interval * display_latency_frames;
+    if (frame_pacer && frame_pacer->getTargetPresentTime() > now) {
+        display_time = frame_pacer->getTargetPresentTime();
+    }
+
+    Pose pose = pose_source->samplePose(now);
+    Pose predicted = pose_predictor.predict(pose, display_time);
+    memcpy(lod_eye_position, predicted.position, sizeof(lod_eye_position));
+
+    // The next frame's instances are tested against the depth this view renders. The latch only corrects the
+    // prediction for the same display time, so the view the GPU sees differs by the prediction error at most
+    if (depth_pyramid) {
+        float view_proj[2][16];
+        computeEyeViewProj(predicted, stereo, view_proj);
+        depth_pyramid->latch(index, view_proj);
+    }
+
+    // Sample again as the frame is submitted, which with the submit thread can be well after it was built
+    graphics_device->getSubmitQueue()->setLatch([this, display_time](uint32_t slot) {
+        latchPose(slot, display_time);
+    });
+}
+
+void Renderer::latchPose(uint32_t index, double display_time) {
+    Pose pose = pose_source->samplePose(getPoseTime());
+    Pose predicted = pose_predictor.predict(pose, display_time);
+
+    LateLatchData data;
+    computeEyeViewProj(predicted, stereo, data.view_proj);
+    late_latch->write(index, data);
+}
+
+void Renderer::setFoveation(const FoveationConfig& foveation) {
+    this->foveation = foveation;
+}
+
+void Renderer::setPoseSource(PoseSource* pose_source) {
+    this->pose_source = pose_source ? pose_source : &static_pose_source;
+}
+
+void Renderer::setWorkload(const SceneWorkload& workload) {
+    this->workload = workload;
+}
+
+void Renderer::setDynamicResolution(bool enabled) {
+    dynamic_resolution = enabled;
+}
+
+bool Renderer::getLastGpuTime(double* gpu_ms) {
+    if (last_gpu_ms < 0.0) {
+        return false;
+    }
+
+    *gpu_ms = last_gpu_ms;
+    return true;
+}
+
+void Renderer::setFramePacer(FramePacer* frame_pacer) {
+    this->frame_pacer = frame_pacer;
+}
+
+void Renderer::enableCapture(const char* directory, ImageFileFormat format) {
+    if (frame_graph) {
+        throw std::runtime_error("Capture must be enabled before creating command buffers");
+    }
+    if ((presentation_engine->getSwapchainUsage() & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) == 0) {
+        throw std::runtime_error("Failed to enable capture: swapchain images can't be copied from");
+    }
+
+    capture_enabled = true;
+    capture_directory = directory;
+    capture_format = format;
+}
+
+FrameCapture* Renderer::getFrameCapture() {
+    return frame_capture;
+}
+
+const VertexFormat& Renderer::getVertexFormat() {
+    return vertex_format;
+}
+
+TextureStreamer* Renderer::getTextureStreamer() {
+    return texture_streamer;
+}
+
+MaterialTable* Renderer::getMaterialTable() {
+    return material_table;
+}
+
+TransformHierarchy* Renderer::getTransforms() {
+    return transforms;
+}
+
+void Renderer::setColorMode(uint32_t color_mode) {
+    scene_key.setSpecConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0, color_mode);
+    pipeline_library->request(scene_key);
+
+    // A pipeline being built from reloaded shaders replaces the scene's, so it must be of the same variant
+    if (reload_pending) {
+        reload_key.setSpecConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0, color_mode);
+        pipeline_library->request(reload_key);
+    }
+
+    for (uint32_t i = 0; i < sc_image_count; i++) {
+        cmd_buffer_dirty[i] = true;
+    }
+}
+
+void Renderer::enableShaderReload(const char* source_directory, const char* compiler) {
+    shader_watcher = new ShaderWatcher(source_directory, compiler);
+    shader_watcher->addShader("default.vert", "vert.spv");
+    shader_watcher->addShader("default.frag", "frag.spv");
+    shader_watcher->start();
+}
+
+void Renderer::updateShaderReload() {
+    // Start building a pipeline from newly compiled shaders. Shaders compiled while one builds wait in the watcher
+    std::vector<CompiledShader> shaders;
+    if (!reload_pending && shader_watcher->takeCompiled(&shaders)) {
+        reload_key = scene_key;
+        for (const auto& shader : shaders) {
+            VkShaderModule module = graphics_device->createShaderModule(
+                reinterpret_cast<const uint32_t*>(shader.code.data()), shader.code.size());
+            if (shader.source == "default.vert") {
+                reload_key.vert_shader = module;
+            }
+            else {
+                reload_key.frag_shader = module;
+            }
+        }
+
+        pipeline_library->request(reload_key);
+        reload_pending = true;
+    }
+
+    // Once it is ready, swap it in. Each command buffer is re-recorded with it when its slot next comes up, so
+    // frames already submitted finish with the old pipeline
+    bool failed;
+    if (reload_pending && pipeline_library->isFinished(reload_key, &failed)) {
+        reload_pending = false;
+
+        if (failed) {
+            std::cout << "Failed to build pipeline from reloaded shaders, keeping the previous one" << std::endl;
+            if (reload_key.vert_shader != vert_shader) {
+                retireShader(reload_key.vert_shader, false);
+            }
+            if (reload_key.frag_shader != frag_shader) {
+                retireShader(reload_key.frag_shader, false);
+            }
+        }
+        else {
+            if (reload_key.vert_shader != vert_shader) {
+                retireShader(vert_shader, true);
+                vert_shader = reload_key.vert_shader;
+            }
+            if (reload_key.frag_shader != frag_shader) {
+                retireShader(frag_shader, true);
+                frag_shader = reload_key.frag_shader;
+            }
+
+            // The variant is ready, so this doesn't block
+            scene_key = reload_key;
+            pipeline_library->setFallback(scene_key);
+
+            for (uint32_t i = 0; i < sc_image_count; i++) {
+                cmd_buffer_dirty[i] = true;
+            }
+            std::cout << "Reloaded scene shaders" << std::endl;
+        }
+    }
+
+    // Destroy replaced shaders and their pipelines once no command buffer can reference them
+    for (auto it = retired_shaders.begin(); it != retired_shaders.end();) {
+        bool referenced = std::find(it->referenced.begin(), it->referenced.end(), true) != it->referenced.end();
+        if (!referenced && pipeline_library->evict(it->module)) {
+            vkDestroyShaderModule(graphics_device->device(), it->module, p_allocs);
+            it = retired_shaders.erase(it);
+        }
+        else {
+            ++it;
         }
     }
 }
 
-void Renderer::drawFrame() {
-    graphics_device->submitRenderCommandBuffer(command_buffers, cmd_buffer_fences);
+void Renderer::retireShader(VkShaderModule shader, bool referenced) {
+    RetiredShader retired;
+    retired.module = shader;
+    retired.referenced.assign(sc_image_count, referenced);
+    retired_shaders.push_back(retired);
+}
+
+bool Renderer::drawFrame() {
+    // Never waits on a compile, so editing shaders doesn't stall frames
+    if (shader_watcher) {
+        updateShaderReload();
+    }
+
+    // Command buffers recorded with the fallback pick up newly compiled variants when re-recorded
+    if (pipeline_library->takeCompletedCount() > 0) {
+        for (uint32_t i = 0; i < sc_image_count; i++) {
+            cmd_buffer_dirty[i] = true;
+        }
+    }
+
+    // The pose is latched as the frame is submitted so it is as fresh as possible when the GPU reads it
+    return graphics_device->submitRenderCommandBuffer(command_buffers, frame_sync, [this](uint32_t index) {
+        updateResolution(index);
+        graphics_device->getMemoryTelemetry()->update();
+
+        // Textured draws span about the height of the view
+        for (TextureHandle texture : material_textures) {
+            texture_streamer->reportScreenSize(texture, ring_extents[0].height * render_scale);
+        }
+        texture_streamer->update();
+
+        // Without descriptor indexing, rewriting the frame's material set invalidates its command buffer
+        if (material_table->update(index)) {
+            cmd_buffer_dirty[index] = true;
+        }
+        if (frame_capture) {
+            frame_capture->collect(index);
+        }
+        if (cmd_buffer_dirty[index]) {
+            recordCommandBuffer(index);
+        }
+        updateInstances(index);
+        predictPose(index);
+    });
 }
@@ -12,9 +12,72 @@
 #pragma once
 
 #include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
 
 #include "GraphicsDevice.h"
 #include "PresentationEngine.h"
+#include "FrameGraph.h"
+#include "PipelineLibrary.h"
+#include "FrameSync.h"
+#include "LateLatch.h"
+#include "Pose.h"
+#include "GpuTimer.h"
+#include "DynamicResolution.h"
+#include "Foveation.h"
+#include "FramePacer.h"
+#include "FrameCapture.h"
+#include "TextureStreamer.h"
+#include "TransformHierarchy.h"
+#include "VertexFormat.h"
+#include "MeshLod.h"
+#include "OcclusionCulling.h"
+#include "MaterialTable.h"
+#include "ShaderWatcher.h"
+#include "StartupProfiler.h"
+
+/**
+ * Geometry drawn by the scene pass. The defaults are the three test triangles
+ */
+struct SceneWorkload {
+    /**
+     * Triangles in the vertex buffer. Beyond the first three, small triangles are tiled behind them
+     */
+    uint32_t triangle_count = 3;
+
+    /**
+     * Draw calls per eye the triangles are split across
+     */
+    uint32_t draw_count = 1;
+
+    /**
+     * Instances per draw call, each offset slightly further away
+     */
+    uint32_t instance_count = 1;
+
+    /**
+     * Store vertices with 32-bit float positions instead of the quantized layout chosen at import
+     */
+    bool full_precision_vertices = false;
+
+    /**
+     * Generate simplified levels of the geometry at import, and draw each instance at the coarsest level its
+     *  distance allows
+     */
+    bool lod = true;
+
+    /**
+     * Skip instances hidden behind the previous frame's depth. Falls back to None if the depth buffer can't be
+     *  sampled
+     */
+    OcclusionMode occlusion = OcclusionMode::Gpu;
+
+    /**
+     * Materials the draw calls cycle through. The first is plain, and each other one has its own streamed
+     *  texture and tint
+     */
+    uint32_t material_count = 1;
+};
 
 class Renderer {
 private:
@@ -29,43 +92,372 @@ private:
     PresentationEngine* presentation_engine;
 
     /**
-     * List of framebuffers to render to. One per swapchain image
+     * Frame graph describing the passes of a frame. Owns render passes and framebuffers
      */
-    VkFramebuffer* framebuffers;
+    FrameGraph* frame_graph = nullptr;
 
     /**
-    * Fences signaled when submitted command buffer moves from pending to ready
-    */
-    VkFence* cmd_buffer_fences;
+     * Frame graph handles for the scene pass of each foveation ring, the upscale pass and the resources they
+     *  use. Ring 0 is the full resolution inset
+     */
+    FrameGraphPass ring_passes[MAX_FOVEATION_RINGS];
+    FrameGraphPass upscale_pass;
+    FrameGraphPass capture_pass;
+    FrameGraphPass cull_pass;
+    FrameGraphPass pyramid_pass;
+    FrameGraphResource backbuffer;
+    FrameGraphResource capture_buffer;
+    FrameGraphResource depth_buffer;
+    FrameGraphResource ring_colors[MAX_FOVEATION_RINGS];
+    FrameGraphResource ring_depths[MAX_FOVEATION_RINGS];
+    VkExtent2D ring_extents[MAX_FOVEATION_RINGS];
+
+    /**
+     * Radial rings each eye is rendered in
+     */
+    FoveationConfig foveation;
+
+    /**
+     * Measures GPU time of each frame, which drives the resolution scale
+     */
+    GpuTimer* gpu_timer = nullptr;
+    DynamicResolution* resolution = nullptr;
+
+    /**
+     * GPU time to aim for: a 90 Hz frame less headroom for the compositor
+     */
+    double gpu_budget_ms = 10.0;
+
+    /**
+     * Resolution scale the command buffers were recorded with
+     */
+    float render_scale = 1.0f;
+
+    /**
+     * Objects for the pass that upscales the scene to the swapchain image
+     */
+    VkShaderModule upscale_vert_shader;
+    VkShaderModule upscale_frag_shader;
+    VkDescriptorSetLayout upscale_set_layout;
+    VkDescriptorPool upscale_pool;
+    VkDescriptorSet upscale_set;
+    VkSampler upscale_sampler;
+    VkPipelineLayout upscale_layout;
+    PipelineKey upscale_key;
+
+    /**
+     * Tracks when the submission of each swapchain image's command buffer retires
+     */
+    FrameSync* frame_sync = nullptr;
+
+    /**
+     * Command buffers that must be re-recorded before their next submission, e.g. because a pipeline variant
+     *  they reference finished compiling
+     */
+    bool* cmd_buffer_dirty = nullptr;
+
+    /**
+     * Compiles and caches pipeline variants
+     */
+    PipelineLibrary* pipeline_library = nullptr;
+
+    /**
+     * Pipeline state of the scene draw. The first variant built from the current shaders is the fallback
+     */
+    PipelineKey scene_key;
+
+    /**
+     * Recompiles the scene shaders when their sources change, or nullptr. The scene pipeline built from new
+     *  shaders compiles on a library worker and replaces scene_key at the start of a frame once it is ready
+     */
+    ShaderWatcher* shader_watcher = nullptr;
+    bool reload_pending = false;
+    PipelineKey reload_key;
+
+    /**
+     * Shader modules replaced by a reload, and which command buffers may still reference pipelines built from
+     *  them. A module and its pipelines are destroyed once every command buffer has been re-recorded
+     */
+    struct RetiredShader {
+        VkShaderModule module;
+        std::vector<bool> referenced;
+    };
+    std::vector<RetiredShader> retired_shaders;
+
+    /**
+     * View data for each swapchain image, written with the predicted pose just before submission
+     */
+    LateLatch* late_latch = nullptr;
+
+    /**
+     * Source of head poses. Defaults to a stationary synthetic pose. The latch samples it on the submit thread
+     */
+    PoseSource* pose_source;
+    SyntheticPoseSource static_pose_source;
+    PosePredictor pose_predictor;
+    StereoConfig stereo;
+
+    /**
+     * Smoothed interval between submissions, used to predict when a frame reaches the display
+     */
+    double last_submit_time = 0.0;
+    double frame_interval = 1.0 / 90.0;
+
+    /**
+     * Frames between submission and display: one to render and one waiting for scanout
+     */
+    double display_latency_frames = 2.0;
+
+    /**
+     * Scene geometry and whether the resolution scale follows GPU time
+     */
+    SceneWorkload workload;
+    bool dynamic_resolution = true;
+
+    /**
+     * Most recent measured GPU frame time in milliseconds, or a negative value if none
+     */
+    double last_gpu_ms = -1.0;
+
+    /**
+     * Pacer scheduling frames, or nullptr. When set it receives GPU times and provides the display time poses
+     *  are predicted for
+     */
+    FramePacer* frame_pacer = nullptr;
+
+    /**
+     * Readback of presented frames, or nullptr if capture is disabled. Capture settings are kept until the
+     *  frame graph is created
+     */
+    FrameCapture* frame_capture = nullptr;
+
+    /**
+     * Streams texture mip levels, advanced once per frame
+     */
+    TextureStreamer* texture_streamer = nullptr;
+
+    /**
+     * Parameters and textures of every material, bound once per pass as set 1 of the scene layout
+     */
+    MaterialTable* material_table = nullptr;
+    std::vector<TextureHandle> material_textures;
+    bool capture_enabled = false;
+    std::string capture_directory;
+    ImageFileFormat capture_format;
+
+    /**
+     * SPIR-V code for the scene shaders, if loaded ahead of time
+     */
+    std::vector<char> vert_code;
+    std::vector<char> frag_code;
 
     VkShaderModule vert_shader;
     VkShaderModule frag_shader;
+
+    /**
+     * Scene geometry as imported, kept until it is encoded into the vertex buffer, and the layout chosen for it
+     */
+    MeshData scene_mesh;
+    VertexFormat vertex_format;
+
+    /**
+     * Levels of detail of the scene geometry, and the level each instance was last drawn at
+     */
+    LodChain scene_lods;
+    LodSelector* lod_selector = nullptr;
+
+    /**
+     * Head position of the last predicted pose. Levels are selected against it, a frame behind the pose the GPU
+     *  sees, so selection stays out of the time between latching and submission
+     */
+    float lod_eye_position[3] = { 0.0f, 0.0f, 0.0f };
+
+    /**
+     * Bounding box of the scene geometry, tested against the depth pyramid per instance
+     */
+    float scene_bounds_min[3];
+    float scene_bounds_max[3];
+
+    /**
+     * Farthest depth of the last frame rendered, and its copy on the CPU when testing there
+     */
+    DepthPyramid* depth_pyramid = nullptr;
+    CpuDepthPyramid cpu_pyramid;
+
+    /**
+     * Encoded vertices, followed by the defaults read by attributes the mesh doesn't have and the indices of
+     *  every level
+     */
     VkBuffer vertex_buffer;
     VkDeviceMemory vertex_buffer_mem;
+    VkDeviceSize vertex_defaults_offset;
+    VkDeviceSize index_offset;
+
+    /**
+     * Transforms of the scene root (node 0) and one child node per instance
+     */
+    TransformHierarchy* transforms = nullptr;
+
+    /**
+     * Per frame instance data, one slice per swapchain image: the root's world matrix, a region per LOD level
+     *  with room for every instance's world matrix, then the indirect draws of each level. With GPU occlusion
+     *  culling, the cull's parameters and every candidate's matrix and level follow, and the cull fills the
+     *  regions. Each frame's slice is rewritten just before submission, so it is persistently mapped
+     */
+    VkBuffer instance_buffer;
+    VkDeviceMemory instance_buffer_mem;
+    uint8_t* instance_mapped;
+    VkDeviceSize instance_stride;
+    VkDeviceSize instance_region_size;
+    VkDeviceSize indirect_offset;
+    OcclusionCullLayout occlusion_layout;
+
+    /**
+     * Indirect draws each level's triangles are split across
+     */
+    uint32_t draws_per_level;
 
     VkRenderPass render_pass;
     VkPipelineLayout pipeline_layout;
-    VkPipeline pipeline;
 
     VkCommandPool command_pool;
     VkCommandBuffer* command_buffers;
 
     VkAllocationCallbacks* p_allocs;
 
+    /**
+     * Profiler timing initialization phases, or nullptr
+     */
+    StartupProfiler* profiler;
+
     uint32_t sc_image_count;
 
     void createCommandPool();
-    void createRenderPass();
+    void createFrameGraph();
+    void createMaterials();
     void createPipeline();
-    void createFramebuffer();
+    void createUpscale();
+    void importMesh();
     void createVertexBuffer();
+    void createInstanceBuffer();
+    void updateInstances(uint32_t index);
+    void recordCommandBuffer(uint32_t index);
+    void recordScene(VkCommandBuffer cmd, uint32_t frame_index, uint32_t ring);
+    void recordUpscale(VkCommandBuffer cmd);
+    void updateResolution(uint32_t index);
+    void predictPose(uint32_t index);
+    void latchPose(uint32_t index, double display_time);
+    void updateShaderReload();
+    void retireShader(VkShaderModule shader, bool referenced);
 
 public:
     Renderer(GraphicsDevice* graphics_device, PresentationEngine* presentation_engine,
-        VkAllocationCallbacks* p_allocs);
+        VkAllocationCallbacks* p_allocs, StartupProfiler* profiler = nullptr);
 
     ~Renderer();
 
+    /**
+     * Provide scene shader code loaded elsewhere (e.g. on a worker thread during device creation). If not
+     *  called, the shaders built with the app (vert.spv/frag.spv) are used
+     * @param vert_code SPIR-V for the vertex shader
+     * @param frag_code SPIR-V for the fragment shader
+     */
+    void setShaderCode(std::vector<char> vert_code, std::vector<char> frag_code);
+
+    /**
+     * Build the frame graph, pipeline and vertex data, and record a command buffer per swapchain image.
+     *  Pipeline compilation runs on a worker thread while the remaining objects are created
+     */
     void createCommandBuffer();
-    void drawFrame();
+
+    /**
+     * Switch the scene to another fragment shader variant (specialization constant 0 of default.frag). The
+     *  variant compiles in the background and the fallback is drawn until it is ready
+     * @param color_mode 0 for vertex colors, 1 for grayscale
+     */
+    void setColorMode(uint32_t color_mode);
+
+    /**
+     * Recompile the scene shaders whenever their sources change, and switch to them without stalling frames.
+     *  Compiled code also replaces vert.spv/frag.spv, so builds that load shader files use it on the next start
+     * @param source_directory directory containing default.vert and default.frag
+     * @param compiler path of glslangValidator
+     */
+    void enableShaderReload(const char* source_directory, const char* compiler);
+
+    /**
+     * Set the foveation rings. Must be called before createCommandBuffer since each ring is a frame graph pass
+     * @param foveation ring configuration, e.g. getUnfoveated() to render the whole view at full resolution
+     */
+    void setFoveation(const FoveationConfig& foveation);
+
+    /**
+     * Set the source of head poses. Not owned by the renderer
+     * @param pose_source source to sample each frame, or nullptr for a stationary pose
+     */
+    void setPoseSource(PoseSource* pose_source);
+
+    /**
+     * Set the scene geometry. Must be called before createCommandBuffer
+     * @param workload triangle, draw and instance counts
+     */
+    void setWorkload(const SceneWorkload& workload);
+
+    /**
+     * Enable or disable scaling resolution from GPU time. When disabled, rendering stays at full resolution
+     */
+    void setDynamicResolution(bool enabled);
+
+    /**
+     * Get the GPU time of the most recently retired frame
+     * @param gpu_ms [output] GPU time in milliseconds
+     * @return false if no frame has been timed yet or timestamps are unsupported
+     */
+    bool getLastGpuTime(double* gpu_ms);
+
+    /**
+     * Set the pacer scheduling frames. Not owned by the renderer
+     * @param frame_pacer pacer, or nullptr to predict display times from the submission rate
+     */
+    void setFramePacer(FramePacer* frame_pacer);
+
+    /**
+     * Copy every presented frame back to the host and write it to a file on a background thread. Must be
+     *  called before createCommandBuffer
+     * @param directory existing directory files are written to
+     * @param format format of written files
+     */
+    void enableCapture(const char* directory, ImageFileFormat format);
+
+    /**
+     * Get the frame capture, or nullptr if capture is disabled
+     */
+    FrameCapture* getFrameCapture();
+
+    /**
+     * Get the layout of the scene's vertices. Chosen by createCommandBuffer
+     */
+    const VertexFormat& getVertexFormat();
+
+    /**
+     * Get the texture streamer. Created by createCommandBuffer
+     */
+    TextureStreamer* getTextureStreamer();
+
+    /**
+     * Get the material table draws index. Created by createCommandBuffer
+     */
+    MaterialTable* getMaterialTable();
+
+    /**
+     * Get the scene transforms: node 0 is the root and node i + 1 places instance i. Created by
+     *  createCommandBuffer. Changes are picked up by the next drawFrame
+     */
+    TransformHierarchy* getTransforms();
+
+    /**
+     * Submit the command buffer for the next swapchain image
+     * @return true if a frame was submitted, false if no image or command buffer was ready
+     */
+    bool drawFrame();
 };
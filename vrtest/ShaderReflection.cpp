@@ -0,0 +1,34 @@
+/** @file ShaderReflection.cpp
+*
+* @brief Defines reflection data of the shaders embedded at build time, and
+*   checks of pipeline state against it
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			01/11/2018
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include "ShaderReflection.h"
+#include "Common.h"
+
+bool checkVertexInputs(const ShaderReflection& reflection,
+    const std::vector<VkVertexInputAttributeDescription>& attributes, uint32_t* missing_location) {
+
+    for (uint32_t i = 0; i < reflection.input_count; i++) {
+        bool found = false;
+        for (const auto& attribute : attributes) {
+            if (attribute.location == reflection.inputs[i].location) {
+                found = true;
+                break;
+            }
+        }
+
+        if (!found) {
+            *missing_location = reflection.inputs[i].location;
+            return false;
+        }
+    }
+    return true;
+}
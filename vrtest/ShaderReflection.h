@@ -0,0 +1,84 @@
+/** @file ShaderReflection.h
+*
+* @brief Defines reflection data of the shaders embedded at build time, and
+*   checks of pipeline state against it
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			01/11/2018
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Vertex shader input. Matrices take one input per column
+ */
+struct ShaderInputReflection {
+    uint32_t location;
+
+    /**
+     * 32-bit format matching the input's type in the shader. Attributes may use any format converting to it
+     */
+    VkFormat format;
+};
+
+/**
+ * Descriptor a shader declares
+ */
+struct ShaderBindingReflection {
+    uint32_t set;
+    uint32_t binding;
+    VkDescriptorType type;
+
+    /**
+     * Array size, with the default value of a specialization constant size, or 0 for a runtime array
+     */
+    uint32_t count;
+};
+
+/**
+ * Interface of a shader, read from its SPIR-V by vrshaderembed
+ */
+struct ShaderReflection {
+    VkShaderStageFlagBits stage;
+
+    /**
+     * Inputs by location. Only vertex shaders list their inputs
+     */
+    const ShaderInputReflection* inputs;
+    uint32_t input_count;
+
+    const ShaderBindingReflection* bindings;
+    uint32_t binding_count;
+
+    /**
+     * End of the last push constant the shader declares, or 0 if it has none
+     */
+    uint32_t push_constant_size;
+};
+
+/**
+ * SPIR-V built into the binary, under the name of the file it was compiled to
+ */
+struct EmbeddedShader {
+    const char* name;
+    const uint32_t* code;
+    size_t code_size;
+    ShaderReflection reflection;
+};
+
+/**
+ * Check that vertex attributes feed every input of a vertex shader
+ * @param reflection vertex shader interface
+ * @param attributes attributes of the pipeline's vertex input state
+ * @param missing_location [output] first input without an attribute, set when returning false
+ * @return true if every input has an attribute
+ */
+bool checkVertexInputs(const ShaderReflection& reflection,
+    const std::vector<VkVertexInputAttributeDescription>& attributes, uint32_t* missing_location);
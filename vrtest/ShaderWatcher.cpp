@@ -0,0 +1,245 @@
+/** @file ShaderWatcher.cpp
+*
+* @brief Defines class that watches shader sources and recompiles them to
+*   SPIR-V on a background thread when they change
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			01/09/2018
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include "ShaderWatcher.h"
+#include "GraphicsDevice.h"
+#include "Common.h"
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+/**
+ * How long the directory must be quiet after a change before compiling, and how often the thread checks for
+ *  changes and shutdown
+ */
+#define SHADER_WATCH_INTERVAL_MS 100
+
+ShaderWatcher::ShaderWatcher(const char* source_directory, const char* compiler) : stopping(false) {
+    this->source_directory = source_directory;
+    this->compiler = compiler;
+}
+
+ShaderWatcher::~ShaderWatcher() {
+    stopping = true;
+    if (watch_thread.joinable()) {
+        watch_thread.join();
+    }
+}
+
+void ShaderWatcher::addShader(const char* source, const char* output) {
+    WatchedShader shader;
+    shader.source = source;
+    shader.output = output;
+    getModifiedTime(shader.source, &shader.modified_time, &shader.size);
+    shader.changed = false;
+    shaders.push_back(shader);
+}
+
+void ShaderWatcher::start() {
+    watch_thread = std::thread(&ShaderWatcher::watchLoop, this);
+    std::cout << "Watching " << shaders.size() << " shaders in " << source_directory << std::endl;
+}
+
+bool ShaderWatcher::takeCompiled(std::vector<CompiledShader>* shaders) {
+    shaders->clear();
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (compiled.empty()) {
+        return false;
+    }
+    shaders->swap(compiled);
+    return true;
+}
+
+void ShaderWatcher::watchLoop() {
+    bool pending = false;
+
+#ifdef __linux__
+    // Watch the directory rather than the files, since editors that save by renaming a new file over the old one
+    // would remove a watch on the file
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0 || inotify_add_watch(fd, source_directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        std::cout << "Failed to watch " << source_directory << ", shaders won't be reloaded" << std::endl;
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+
+    alignas(struct inotify_event) char events[4096];
+    while (!stopping) {
+        pollfd poll_fd = {};
+        poll_fd.fd = fd;
+        poll_fd.events = POLLIN;
+
+        if (poll(&poll_fd, 1, SHADER_WATCH_INTERVAL_MS) > 0) {
+            ssize_t length;
+            while ((length = read(fd, events, sizeof(events))) > 0) {
+                for (char* p = events; p < events + length;) {
+                    const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(p);
+                    for (auto& shader : shaders) {
+                        if (event->len > 0 && strcmp(event->name, shader.source.c_str()) == 0) {
+                            shader.changed = true;
+                            pending = true;
+                        }
+                    }
+                    p += sizeof(struct inotify_event) + event->len;
+                }
+            }
+        }
+        else if (pending) {
+            pending = false;
+            compileChanged();
+        }
+    }
+
+    close(fd);
+#else
+    // No change notifications, so compare modification times and sizes each interval. The size catches saves
+    //  within one tick of a coarse clock
+    while (!stopping) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(SHADER_WATCH_INTERVAL_MS));
+
+        bool modified = false;
+        for (auto& shader : shaders) {
+            int64_t modified_time, size;
+            getModifiedTime(shader.source, &modified_time, &size);
+            if (modified_time != shader.modified_time || size != shader.size) {
+                shader.modified_time = modified_time;
+                shader.size = size;
+                shader.changed = true;
+                modified = true;
+            }
+        }
+
+        if (pending && !modified) {
+            compileChanged();
+        }
+        pending = modified;
+    }
+#endif
+}
+
+void ShaderWatcher::compileChanged() {
+    for (auto& shader : shaders) {
+        if (!shader.changed) {
+            continue;
+        }
+        shader.changed = false;
+
+        CompiledShader result;
+        result.source = shader.source;
+        if (!compile(shader, &result.code)) {
+            continue;
+        }
+        std::cout << "Recompiled " << shader.source << std::endl;
+
+        // A newer compile of a source the app hasn't taken yet replaces the older one
+        std::lock_guard<std::mutex> guard(lock);
+        bool replaced = false;
+        for (auto& entry : compiled) {
+            if (entry.source == result.source) {
+                entry.code.swap(result.code);
+                replaced = true;
+            }
+        }
+        if (!replaced) {
+            compiled.push_back(std::move(result));
+        }
+    }
+}
+
+bool ShaderWatcher::compile(const WatchedShader& shader, std::vector<char>* code) {
+    // Compile to a temporary file so a failed compile leaves the last good output in place
+    std::string temp_output = shader.output + ".tmp";
+    std::string command = "\"" + compiler + "\" -V \"" + source_directory + "/" + shader.source + "\" -o \"" +
+        temp_output + "\" 2>&1";
+#ifdef _WIN32
+    // cmd strips the outer quotes of a command line that starts with one
+    command = "\"" + command + "\"";
+#endif
+
+    FILE* pipe = popen(command.c_str(), "r");
+    if (!pipe) {
+        std::cout << "Failed to run shader compiler " << compiler << std::endl;
+        return false;
+    }
+
+    std::string log;
+    char line[256];
+    while (fgets(line, sizeof(line), pipe)) {
+        log += line;
+    }
+
+    if (pclose(pipe) != 0) {
+        std::cout << "Failed to compile " << shader.source << ":" << std::endl << log;
+        remove(temp_output.c_str());
+        return false;
+    }
+
+    remove(shader.output.c_str());
+    if (rename(temp_output.c_str(), shader.output.c_str()) != 0) {
+        std::cout << "Failed to write " << shader.output << std::endl;
+        return false;
+    }
+
+    try {
+        *code = GraphicsDevice::readShaderFile(shader.output.c_str());
+    }
+    catch (const std::exception& e) {
+        std::cout << e.what() << std::endl;
+        return false;
+    }
+    catch (...) {
+        // Anything escaping would end the watch thread and the app with it
+        std::cout << "Failed to read " << shader.output << std::endl;
+        return false;
+    }
+    return !code->empty();
+}
+
+void ShaderWatcher::getModifiedTime(const std::string& source, int64_t* modified_time, int64_t* size) {
+    std::string path = source_directory + "/" + source;
+
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        *modified_time = -1;
+        *size = -1;
+        return;
+    }
+
+#if defined(_WIN32)
+    int64_t nanoseconds = 0;
+#elif defined(__APPLE__)
+    int64_t nanoseconds = info.st_mtimespec.tv_nsec;
+#else
+    int64_t nanoseconds = info.st_mtim.tv_nsec;
+#endif
+    *modified_time = static_cast<int64_t>(info.st_mtime) * 1000000000 + nanoseconds;
+    *size = static_cast<int64_t>(info.st_size);
+}
@@ -0,0 +1,115 @@
+/** @file ShaderWatcher.h
+*
+* @brief Defines class that watches shader sources and recompiles them to
+*   SPIR-V on a background thread when they change
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			01/09/2018
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * SPIR-V compiled from a changed source
+ */
+struct CompiledShader {
+    /**
+     * Source file name, as passed to ShaderWatcher::addShader
+     */
+    std::string source;
+    std::vector<char> code;
+};
+
+/**
+ * Recompiles shaders while the app runs. A thread waits for sources in one directory to change (inotify on Linux,
+ *  modification times elsewhere), runs the compiler on each changed source, writes the SPIR-V over the file the
+ *  app loads at startup and queues the code for the app to pick up. Editors often save in several steps, so
+ *  changes are collected until the directory has been quiet for a moment. Sources that fail to compile print the
+ *  compiler's output and queue nothing
+ */
+class ShaderWatcher {
+private:
+    struct WatchedShader {
+        std::string source;
+        std::string output;
+        int64_t modified_time;
+        int64_t size;
+        bool changed;
+    };
+
+    std::string source_directory;
+    std::string compiler;
+
+    /**
+     * Shaders to watch. Only changed once the thread has started by the thread itself
+     */
+    std::vector<WatchedShader> shaders;
+
+    /**
+     * Compiled code waiting for takeCompiled, at most one entry per source
+     */
+    std::vector<CompiledShader> compiled;
+    std::mutex lock;
+
+    std::atomic<bool> stopping;
+    std::thread watch_thread;
+
+    void watchLoop();
+
+    /**
+     * Compile every changed shader and queue the results
+     */
+    void compileChanged();
+
+    /**
+     * Run the compiler on a shader
+     * @return true if it compiled and its output was written
+     */
+    bool compile(const WatchedShader& shader, std::vector<char>* code);
+
+    /**
+     * Get the modification time of a source in nanoseconds, as finely as the platform records it, and its size.
+     *  Both are -1 if it can't be read
+     */
+    void getModifiedTime(const std::string& source, int64_t* modified_time, int64_t* size);
+
+public:
+    /**
+     * @param source_directory directory holding the shader sources
+     * @param compiler GLSL to SPIR-V compiler accepting glslangValidator's arguments
+     */
+    ShaderWatcher(const char* source_directory, const char* compiler);
+
+    /**
+     * Stops watching, waiting for any compile in progress
+     */
+    ~ShaderWatcher();
+
+    /**
+     * Watch a source. Must be called before start
+     * @param source file name in the source directory
+     * @param output file the compiled SPIR-V is written to, relative to the working directory
+     */
+    void addShader(const char* source, const char* output);
+
+    /**
+     * Start the watch thread
+     */
+    void start();
+
+    /**
+     * Take the shaders compiled since the last call. Never blocks on a compile
+     * @param shaders [output] compiled shaders, replacing the vector's contents
+     * @return true if any shader was compiled
+     */
+    bool takeCompiled(std::vector<CompiledShader>* shaders);
+};
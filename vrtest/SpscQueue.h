@@ -0,0 +1,95 @@
+/** @file SpscQueue.h
+*
+* @brief Defines a bounded lock-free queue for one producer thread and one
+*   consumer thread
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/16/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <stddef.h>
+
+#include "Common.h"
+
+/**
+ * Ring buffer where only the producer writes the tail and only the consumer writes the head, so neither side
+ *  ever blocks or takes a lock. The indexes are padded onto separate cache lines so the threads don't contend on
+ *  them, without over-aligning the queue, so classes holding one can still be allocated with plain new
+ */
+template <typename T>
+class SpscQueue {
+private:
+    /**
+     * Storage with one spare slot, which distinguishes full from empty
+     */
+    std::vector<T> slots;
+    char head_padding[CACHE_LINE_SIZE];
+
+    /**
+     * Next slot to pop, written by the consumer
+     */
+    std::atomic<size_t> head;
+    char tail_padding[CACHE_LINE_SIZE];
+
+    /**
+     * Next slot to push, written by the producer
+     */
+    std::atomic<size_t> tail;
+    char end_padding[CACHE_LINE_SIZE];
+
+    size_t next(size_t index) const {
+        return index + 1 == slots.size() ? 0 : index + 1;
+    }
+
+public:
+    /**
+     * @param capacity maximum number of queued values
+     */
+    explicit SpscQueue(size_t capacity) : slots(capacity + 1), head(0), tail(0) {
+    }
+
+    /**
+     * Push a value. Producer thread only
+     * @return false if the queue is full
+     */
+    bool push(const T& value) {
+        size_t current = tail.load(std::memory_order_relaxed);
+        size_t following = next(current);
+        if (following == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        slots[current] = value;
+        tail.store(following, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Pop a value. Consumer thread only
+     * @param value [output] popped value
+     * @return false if the queue is empty
+     */
+    bool pop(T* value) {
+        size_t current = head.load(std::memory_order_relaxed);
+        if (current == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        *value = slots[current];
+        head.store(next(current), std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Check whether the queue is empty. Only a hint when called from the producer
+     */
+    bool empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+};
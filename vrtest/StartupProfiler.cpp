@@ -0,0 +1,93 @@
+/** @file StartupProfiler.cpp
+*
+* @brief Defines class that records wall time of initialization phases and
+*   writes them to a report
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/06/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include <iomanip>
+#include <map>
+
+#include "StartupProfiler.h"
+
+StartupProfiler::StartupProfiler() {
+    origin = std::chrono::steady_clock::now();
+}
+
+uint32_t StartupProfiler::beginPhase(const char* name) {
+    Phase phase;
+    phase.name = name;
+    phase.thread = std::this_thread::get_id();
+    phase.start = std::chrono::steady_clock::now();
+    phase.end = phase.start;
+    phase.done = false;
+
+    std::lock_guard<std::mutex> guard(lock);
+    phases.push_back(phase);
+    return static_cast<uint32_t>(phases.size() - 1);
+}
+
+void StartupProfiler::endPhase(uint32_t phase) {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> guard(lock);
+    phases[phase].end = now;
+    phases[phase].done = true;
+}
+
+void StartupProfiler::mark(const char* name) {
+    endPhase(beginPhase(name));
+}
+
+void StartupProfiler::writeReport(std::ostream& out) {
+    std::lock_guard<std::mutex> guard(lock);
+
+    // Number threads in order of first appearance so the report is readable
+    std::map<std::thread::id, uint32_t> thread_numbers;
+    for (const auto& phase : phases) {
+        if (thread_numbers.find(phase.thread) == thread_numbers.end()) {
+            uint32_t number = static_cast<uint32_t>(thread_numbers.size());
+            thread_numbers[phase.thread] = number;
+        }
+    }
+
+    out << "Startup phases (ms):\n";
+    out << std::setw(32) << std::left << "phase" << std::right << std::setw(8) << "thread"
+        << std::setw(12) << "start" << std::setw(12) << "duration" << '\n';
+
+    out << std::fixed << std::setprecision(3);
+    for (const auto& phase : phases) {
+        double start = std::chrono::duration<double, std::milli>(phase.start - origin).count();
+        double duration = std::chrono::duration<double, std::milli>(phase.end - phase.start).count();
+
+        out << std::setw(32) << std::left << phase.name << std::right << std::setw(8)
+            << thread_numbers[phase.thread] << std::setw(12) << start;
+        if (phase.done) {
+            out << std::setw(12) << duration;
+        }
+        else {
+            out << std::setw(12) << "unfinished";
+        }
+        out << '\n';
+    }
+    out << std::defaultfloat;
+    out.flush();
+}
+
+ScopedPhase::ScopedPhase(StartupProfiler* profiler, const char* name) {
+    this->profiler = profiler;
+    if (profiler) {
+        phase = profiler->beginPhase(name);
+    }
+}
+
+ScopedPhase::~ScopedPhase() {
+    if (profiler) {
+        profiler->endPhase(phase);
+    }
+}
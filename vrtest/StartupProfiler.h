@@ -0,0 +1,89 @@
+/** @file StartupProfiler.h
+*
+* @brief Defines class that records wall time of initialization phases and
+*   writes them to a report
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/06/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <ostream>
+
+class StartupProfiler {
+private:
+    /**
+     * A timed phase. Phases may overlap when run on different threads
+     */
+    struct Phase {
+        std::string name;
+        std::thread::id thread;
+        std::chrono::steady_clock::time_point start;
+        std::chrono::steady_clock::time_point end;
+        bool done;
+    };
+
+    /**
+     * Time all phases are reported relative to
+     */
+    std::chrono::steady_clock::time_point origin;
+
+    /**
+     * Recorded phases, guarded by lock since workers record their own phases
+     */
+    std::vector<Phase> phases;
+    std::mutex lock;
+
+public:
+    /**
+     * Start the profiler clock
+     */
+    StartupProfiler();
+
+    /**
+     * Begin timing a phase on the calling thread
+     * @param name phase name shown in the report
+     * @return id to pass to endPhase
+     */
+    uint32_t beginPhase(const char* name);
+
+    /**
+     * Finish timing a phase
+     * @param phase id returned by beginPhase
+     */
+    void endPhase(uint32_t phase);
+
+    /**
+     * Record an instantaneous event, such as the first presented frame
+     * @param name event name shown in the report
+     */
+    void mark(const char* name);
+
+    /**
+     * Write phases with start offset and duration in milliseconds
+     * @param out stream to write the report to
+     */
+    void writeReport(std::ostream& out);
+};
+
+/**
+ * Times a phase for the lifetime of the object. The profiler may be null to disable timing
+ */
+class ScopedPhase {
+private:
+    StartupProfiler* profiler;
+    uint32_t phase;
+
+public:
+    ScopedPhase(StartupProfiler* profiler, const char* name);
+    ~ScopedPhase();
+};
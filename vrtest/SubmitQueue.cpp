@@ -0,0 +1,289 @@
+/** @file SubmitQueue.cpp
+*
+* @brief Defines class that gathers the command buffers and semaphores of a
+*   frame into a single queue submission, and optionally submits and presents
+*   frames on a dedicated thread
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			01/13/2018
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include <chrono>
+#include <stdexcept>
+
+#include "SubmitQueue.h"
+#include "Common.h"
+
+/**
+ * Times a waiting thread yields before it starts sleeping between checks
+ */
+#define SUBMIT_SPIN_COUNT 64
+
+/**
+ * Display times kept for getPastPresentTimes. The oldest are dropped if they aren't read
+ */
+#define SUBMIT_PRESENT_TIME_COUNT 16
+
+/**
+ * Yield while a wait is short, then sleep so an idle thread doesn't burn a core
+ */
+static void backOff(uint32_t* idle) {
+    if (++*idle < SUBMIT_SPIN_COUNT) {
+        std::this_thread::yield();
+    }
+    else {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+}
+
+SubmitQueue::SubmitQueue(PresentationEngine* presentation_engine, VkQueue gfx_queue, VkQueue present_queue)
+    : free_batches(SUBMIT_BATCH_COUNT), queued_batches(SUBMIT_BATCH_COUNT), acquired_images(1), stopping(false),
+    failed(false) {
+
+    this->presentation_engine = presentation_engine;
+    this->gfx_queue = gfx_queue;
+    this->present_queue = present_queue;
+
+    for (uint32_t i = 0; i < SUBMIT_BATCH_COUNT; i++) {
+        free_batches.push(&batches[i]);
+    }
+}
+
+SubmitQueue::~SubmitQueue() {
+    stop();
+}
+
+void SubmitQueue::start() {
+    if (threaded) {
+        return;
+    }
+
+    threaded = true;
+    thread = std::thread(&SubmitQueue::submitLoop, this);
+}
+
+void SubmitQueue::stop() {
+    if (!threaded) {
+        return;
+    }
+
+    stopping.store(true, std::memory_order_release);
+    thread.join();
+    threaded = false;
+}
+
+bool SubmitQueue::isThreaded() {
+    return threaded;
+}
+
+void SubmitQueue::submitLoop() {
+    uint32_t idle = 0;
+
+    try {
+        while (true) {
+            bool busy = false;
+
+            // Acquire the next frame's image before presenting, so recording it doesn't wait on the present
+            if (acquired_images.empty()) {
+                AcquiredImage image;
+                image.index = presentation_engine->getNextSwapchainImage(&image.wait_sem, &image.signal_sem);
+                if (image.index >= 0) {
+                    acquired_images.push(image);
+                    busy = true;
+                }
+            }
+
+            Batch* batch;
+            if (queued_batches.pop(&batch)) {
+                submitBatch(batch);
+                free_batches.push(batch);
+                busy = true;
+            }
+            else if (stopping.load(std::memory_order_acquire)) {
+                // Nothing is queued after stop is called, so every frame has been submitted
+                break;
+            }
+
+            if (busy) {
+                idle = 0;
+            }
+            else {
+                backOff(&idle);
+            }
+        }
+    }
+    catch (...) {
+        // Leave the queues alone from here on; the building thread rethrows
+        error = std::current_exception();
+        failed.store(true, std::memory_order_release);
+    }
+}
+
+void SubmitQueue::submitBatch(Batch* batch) {
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.waitSemaphoreCount = static_cast<uint32_t>(batch->wait_semaphores.size());
+    submit_info.pWaitSemaphores = batch->wait_semaphores.data();
+    submit_info.pWaitDstStageMask = batch->wait_stages.data();
+    submit_info.commandBufferCount = static_cast<uint32_t>(batch->command_buffers.size());
+    submit_info.pCommandBuffers = batch->command_buffers.data();
+    submit_info.signalSemaphoreCount = static_cast<uint32_t>(batch->signal_semaphores.size());
+    submit_info.pSignalSemaphores = batch->signal_semaphores.data();
+
+    if (batch->latch) {
+        batch->latch(batch->slot);
+        batch->latch = nullptr;
+    }
+    batch->frame_sync->submitReserved(gfx_queue, submit_info, batch->slot, batch->value);
+
+    presentation_engine->presentSwapchainImage(batch->image.index, present_queue);
+
+    if (threaded) {
+        // Display timing reads the swapchain, which this thread owns, so collect times here for the reader
+        double times[SUBMIT_PRESENT_TIME_COUNT];
+        uint32_t count = presentation_engine->getPastPresentTimes(times, SUBMIT_PRESENT_TIME_COUNT);
+        if (count > 0) {
+            std::lock_guard<std::mutex> guard(present_time_lock);
+            present_times.insert(present_times.end(), times, times + count);
+            if (present_times.size() > SUBMIT_PRESENT_TIME_COUNT) {
+                present_times.erase(present_times.begin(), present_times.end() - SUBMIT_PRESENT_TIME_COUNT);
+            }
+        }
+    }
+}
+
+void SubmitQueue::checkFailed() {
+    if (failed.load(std::memory_order_acquire)) {
+        std::rethrow_exception(error);
+    }
+}
+
+int SubmitQueue::acquireImage() {
+    checkFailed();
+
+    // The submit thread frees batches and acquires images, so give it a moment before reporting nothing ready
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(1);
+    uint32_t idle = 0;
+    auto keep_waiting = [&]() {
+        if (!threaded || std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        backOff(&idle);
+        checkFailed();
+        return true;
+    };
+
+    while (building == nullptr && !free_batches.pop(&building)) {
+        if (!keep_waiting()) {
+            return -1;
+        }
+    }
+
+    if (!image_held) {
+        AcquiredImage& image = building->image;
+        if (threaded) {
+            while (!acquired_images.pop(&image)) {
+                if (!keep_waiting()) {
+                    return -1;
+                }
+            }
+        }
+        else {
+            image.index = presentation_engine->getNextSwapchainImage(&image.wait_sem, &image.signal_sem);
+            if (image.index < 0) {
+                return -1;
+            }
+        }
+        image_held = true;
+    }
+
+    return building->image.index;
+}
+
+void SubmitQueue::addCommandBuffer(VkCommandBuffer command_buffer) {
+    pending_command_buffers.push_back(command_buffer);
+}
+
+void SubmitQueue::addWaitSemaphore(VkSemaphore semaphore, VkPipelineStageFlags stage) {
+    pending_wait_semaphores.push_back(semaphore);
+    pending_wait_stages.push_back(stage);
+}
+
+void SubmitQueue::addSignalSemaphore(VkSemaphore semaphore) {
+    pending_signal_semaphores.push_back(semaphore);
+}
+
+void SubmitQueue::setLatch(LatchFunction latch) {
+    pending_latch = std::move(latch);
+}
+
+uint64_t SubmitQueue::submitFrame(VkCommandBuffer command_buffer, FrameSync* frame_sync, uint32_t slot) {
+    checkFailed();
+
+    if (!image_held) {
+        throw std::runtime_error("Frame submitted without an acquired image");
+    }
+
+    Batch* batch = building;
+    building = nullptr;
+    image_held = false;
+
+    batch->command_buffers.assign(pending_command_buffers.begin(), pending_command_buffers.end());
+    batch->command_buffers.push_back(command_buffer);
+    pending_command_buffers.clear();
+
+    // Rendering only waits for the image where it first writes color
+    batch->wait_semaphores.clear();
+    batch->wait_stages.clear();
+    if (batch->image.wait_sem) {
+        batch->wait_semaphores.push_back(*batch->image.wait_sem);
+        batch->wait_stages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+    }
+    batch->wait_semaphores.insert(batch->wait_semaphores.end(), pending_wait_semaphores.begin(),
+        pending_wait_semaphores.end());
+    batch->wait_stages.insert(batch->wait_stages.end(), pending_wait_stages.begin(), pending_wait_stages.end());
+    pending_wait_semaphores.clear();
+    pending_wait_stages.clear();
+
+    batch->signal_semaphores.assign(pending_signal_semaphores.begin(), pending_signal_semaphores.end());
+    if (batch->image.signal_sem) {
+        batch->signal_semaphores.push_back(*batch->image.signal_sem);
+    }
+    pending_signal_semaphores.clear();
+
+    batch->latch = std::move(pending_latch);
+    pending_latch = nullptr;
+
+    // Frame sync bookkeeping stays on this thread. The submit thread only touches the slot's own objects
+    batch->frame_sync = frame_sync;
+    batch->slot = slot;
+    batch->value = frame_sync->reserve(slot);
+
+    if (threaded) {
+        // Can't fail: there are only as many batches as queue slots
+        queued_batches.push(batch);
+    }
+    else {
+        submitBatch(batch);
+        free_batches.push(batch);
+    }
+
+    return batch->value;
+}
+
+uint32_t SubmitQueue::getPastPresentTimes(double* times, uint32_t max_count) {
+    if (!threaded) {
+        return presentation_engine->getPastPresentTimes(times, max_count);
+    }
+
+    std::lock_guard<std::mutex> guard(present_time_lock);
+    uint32_t count = MIN(max_count, static_cast<uint32_t>(present_times.size()));
+    for (uint32_t i = 0; i < count; i++) {
+        times[i] = present_times[i];
+    }
+    present_times.erase(present_times.begin(), present_times.begin() + count);
+    return count;
+}
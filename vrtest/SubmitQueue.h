@@ -0,0 +1,224 @@
+/** @file SubmitQueue.h
+*
+* @brief Defines class that gathers the command buffers and semaphores of a
+*   frame into a single queue submission, and optionally submits and presents
+*   frames on a dedicated thread
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			01/13/2018
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "FrameSync.h"
+#include "PresentationEngine.h"
+#include "SpscQueue.h"
+
+/**
+ * Frames that can be queued for the submit thread, including the one being built
+ */
+#define SUBMIT_BATCH_COUNT 3
+
+/**
+ * Called with a batch's frame sync slot immediately before the batch is submitted
+ */
+typedef std::function<void(uint32_t slot)> LatchFunction;
+
+/**
+ * Work recorded for a frame, such as texture uploads, is added on the thread that submits frames and goes into the
+ *  frame's batch ahead of the frame's own command buffer. The whole batch is made with one vkQueueSubmit, which
+ *  waits on the image acquire and signals the present semaphore and the frame's FrameSync value. A frame may also
+ *  set a latch, which writes data the GPU should read as fresh as possible, such as the head pose, right before
+ *  the submission.
+ *
+ * Without the submit thread batches are submitted and presented by submitFrame. Once started, the submit thread
+ *  owns the graphics and present queues and the presentation engine's acquire and present: it acquires the image
+ *  for the next frame before presenting the current one, then submits and presents batches in order. A present
+ *  that blocks only holds up that thread, so the next frame is recorded in the meantime
+ */
+class SubmitQueue {
+private:
+    /**
+     * Swapchain image acquired for a frame, see PresentationEngine::getNextSwapchainImage
+     */
+    struct AcquiredImage {
+        int index;
+        VkSemaphore* wait_sem;
+        VkSemaphore* signal_sem;
+    };
+
+    /**
+     * Everything submitted for one frame
+     */
+    struct Batch {
+        AcquiredImage image;
+
+        /**
+         * Command buffers in submission order, with the frame's own last
+         */
+        std::vector<VkCommandBuffer> command_buffers;
+
+        std::vector<VkSemaphore> wait_semaphores;
+        std::vector<VkPipelineStageFlags> wait_stages;
+        std::vector<VkSemaphore> signal_semaphores;
+
+        /**
+         * Frame sync and slot the batch is submitted to, and the counter value reserved for it
+         */
+        FrameSync* frame_sync;
+        uint32_t slot;
+        uint64_t value;
+
+        LatchFunction latch;
+    };
+
+    PresentationEngine* presentation_engine;
+    VkQueue gfx_queue;
+    VkQueue present_queue;
+
+    /**
+     * Work added for the next frame
+     */
+    std::vector<VkCommandBuffer> pending_command_buffers;
+    std::vector<VkSemaphore> pending_wait_semaphores;
+    std::vector<VkPipelineStageFlags> pending_wait_stages;
+    std::vector<VkSemaphore> pending_signal_semaphores;
+    LatchFunction pending_latch;
+
+    /**
+     * Batch of the frame being built, holding its acquired image from acquireImage until submitFrame
+     */
+    Batch* building = nullptr;
+    bool image_held = false;
+
+    /**
+     * Batches in the pool, batches free to build, and batches waiting for the submit thread
+     */
+    Batch batches[SUBMIT_BATCH_COUNT];
+    SpscQueue<Batch*> free_batches;
+    SpscQueue<Batch*> queued_batches;
+
+    /**
+     * Image acquired ahead by the submit thread for the next frame
+     */
+    SpscQueue<AcquiredImage> acquired_images;
+
+    std::thread thread;
+    bool threaded = false;
+    std::atomic<bool> stopping;
+
+    /**
+     * Error that stopped the submit thread, rethrown on the building thread by the next acquireImage or submitFrame
+     */
+    std::atomic<bool> failed;
+    std::exception_ptr error;
+
+    /**
+     * Display times the submit thread read since the last getPastPresentTimes
+     */
+    std::vector<double> present_times;
+    std::mutex present_time_lock;
+
+    void submitLoop();
+
+    /**
+     * Make a batch's single queue submission, then present its image
+     */
+    void submitBatch(Batch* batch);
+
+    void checkFailed();
+
+public:
+    /**
+     * @param presentation_engine engine to acquire images from and present to. Not owned
+     * @param gfx_queue queue batches are submitted to
+     * @param present_queue queue images are presented with
+     */
+    SubmitQueue(PresentationEngine* presentation_engine, VkQueue gfx_queue, VkQueue present_queue);
+
+    /**
+     * Stops the submit thread if it is running
+     */
+    ~SubmitQueue();
+
+    /**
+     * Start submitting and presenting on a dedicated thread. From here on the queues and the presentation engine's
+     *  acquire, present and display timing must only be used through the submit queue
+     */
+    void start();
+
+    /**
+     * Submit the frames still queued and stop the submit thread. Call before waiting for the device to go idle.
+     *  No frames may be submitted afterwards. The image the thread acquired ahead, and one held by acquireImage
+     *  without a submitted frame, are never rendered or presented, so they and their acquire semaphores stay
+     *  pending: the swapchain must be destroyed or recreated before presenting again
+     */
+    void stop();
+
+    /**
+     * Whether the submit thread is running
+     */
+    bool isThreaded();
+
+    /**
+     * Get the swapchain image to render the next frame to. The image is held until the frame is submitted, so
+     *  calling again first returns the same image. With the submit thread, waits up to a millisecond for the image
+     *  and for a free batch
+     * @return index of the swapchain image, or -1 if none is available yet
+     */
+    int acquireImage();
+
+    /**
+     * Add a command buffer to the next frame's batch, to run before the frame's own command buffer. Thread that
+     *  submits frames only
+     */
+    void addCommandBuffer(VkCommandBuffer command_buffer);
+
+    /**
+     * Make the next frame's batch wait on a semaphore, e.g. one signaled by another queue
+     * @param semaphore binary semaphore to wait on
+     * @param stage stages of the batch that wait
+     */
+    void addWaitSemaphore(VkSemaphore semaphore, VkPipelineStageFlags stage);
+
+    /**
+     * Make the next frame's batch signal a binary semaphore when it completes
+     */
+    void addSignalSemaphore(VkSemaphore semaphore);
+
+    /**
+     * Set the next frame's latch. With the submit thread the latch runs on that thread, so it must only touch data
+     *  the building thread leaves alone until the frame's slot is waited on again. The latch is moved into the
+     *  frame's batch, so whether setting one allocates is up to std::function: captures beyond its small-object
+     *  storage, whose size the standard library chooses, are allocated
+     * @param latch called just before the batch is submitted
+     */
+    void setLatch(LatchFunction latch);
+
+    /**
+     * Submit the frame rendering to the image from acquireImage, together with the work added for it, and present
+     *  the image. With the submit thread this only queues the batch
+     * @param command_buffer the frame's own command buffer
+     * @param frame_sync tracks completion of the batch
+     * @param slot frame sync slot occupied by the batch, which must have been waited on with waitSlot
+     * @return counter value of the batch's submission
+     */
+    uint64_t submitFrame(VkCommandBuffer command_buffer, FrameSync* frame_sync, uint32_t slot);
+
+    /**
+     * Get the display times of presents that have completed since the last call, see
+     *  PresentationEngine::getPastPresentTimes
+     */
+    uint32_t getPastPresentTimes(double* times, uint32_t max_count);
+};
@@ -0,0 +1,69 @@
+/** @file TextureSource.cpp
+*
+* @brief Defines interface that provides texture mip levels to the texture
+*   streamer, and a procedural implementation
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/20/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include "TextureSource.h"
+#include "Common.h"
+
+VkExtent2D getMipExtent(VkExtent2D extent, uint32_t level) {
+    VkExtent2D mip_extent;
+    mip_extent.width = MAX(extent.width >> level, 1u);
+    mip_extent.height = MAX(extent.height >> level, 1u);
+    return mip_extent;
+}
+
+ProceduralTextureSource::ProceduralTextureSource(uint32_t size) {
+    this->size = MAX(size, 1u);
+    this->mip_count = 1;
+    while ((this->size >> mip_count) > 0) {
+        mip_count++;
+    }
+}
+
+VkFormat ProceduralTextureSource::getFormat() {
+    return VK_FORMAT_R8G8B8A8_UNORM;
+}
+
+VkExtent2D ProceduralTextureSource::getExtent() {
+    return { size, size };
+}
+
+uint32_t ProceduralTextureSource::getMipCount() {
+    return mip_count;
+}
+
+VkDeviceSize ProceduralTextureSource::getMipSize(uint32_t level) {
+    VkExtent2D extent = getMipExtent(getExtent(), level);
+    return static_cast<VkDeviceSize>(extent.width) * extent.height * 4;
+}
+
+void ProceduralTextureSource::loadMip(uint32_t level, std::vector<uint8_t>* data) {
+    static const uint8_t tints[4][3] = { { 255, 255, 255 }, { 255, 160, 160 }, { 160, 255, 160 }, { 160, 160, 255 } };
+
+    VkExtent2D extent = getMipExtent(getExtent(), level);
+    data->resize(static_cast<size_t>(getMipSize(level)));
+
+    // Squares are a fixed size in level 0 texels, so every level shows the same pattern
+    uint32_t square = MAX(32u >> level, 1u);
+    const uint8_t* tint = tints[level % 4];
+
+    uint8_t* texel = data->data();
+    for (uint32_t y = 0; y < extent.height; y++) {
+        for (uint32_t x = 0; x < extent.width; x++) {
+            uint8_t value = ((x / square + y / square) & 1) ? 255 : 64;
+            texel[0] = static_cast<uint8_t>(value * tint[0] / 255);
+            texel[1] = static_cast<uint8_t>(value * tint[1] / 255);
+            texel[2] = static_cast<uint8_t>(value * tint[2] / 255);
+            texel[3] = 255;
+            texel += 4;
+        }
+    }
+}
@@ -0,0 +1,79 @@
+/** @file TextureSource.h
+*
+* @brief Defines interface that provides texture mip levels to the texture
+*   streamer, and a procedural implementation
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/20/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Supplies the pixel data of each mip level on demand, so only resident levels need to be held in memory.
+ *  Levels are numbered from 0, the full resolution level
+ */
+class TextureSource {
+public:
+    virtual ~TextureSource() {}
+
+    /**
+     * Get the format of the data returned by loadMip
+     */
+    virtual VkFormat getFormat() = 0;
+
+    /**
+     * Get the dimensions of level 0
+     */
+    virtual VkExtent2D getExtent() = 0;
+
+    /**
+     * Get the number of levels
+     */
+    virtual uint32_t getMipCount() = 0;
+
+    /**
+     * Get the size in bytes of a level's data
+     */
+    virtual VkDeviceSize getMipSize(uint32_t level) = 0;
+
+    /**
+     * Read a level, tightly packed. Called from loader threads, one call at a time per source. Throws if the level
+     *  can't be read, so the streamer keeps the levels it has
+     * @param level mip level
+     * @param data [output] level data, getMipSize(level) bytes
+     */
+    virtual void loadMip(uint32_t level, std::vector<uint8_t>* data) = 0;
+};
+
+/**
+ * RGBA8 checkerboard with a full mip chain. Each level is tinted differently so residency is visible
+ */
+class ProceduralTextureSource : public TextureSource {
+private:
+    uint32_t size;
+    uint32_t mip_count;
+
+public:
+    /**
+     * @param size width and height of level 0, a power of two
+     */
+    ProceduralTextureSource(uint32_t size);
+
+    VkFormat getFormat();
+    VkExtent2D getExtent();
+    uint32_t getMipCount();
+    VkDeviceSize getMipSize(uint32_t level);
+    void loadMip(uint32_t level, std::vector<uint8_t>* data);
+};
+
+/**
+ * Get the extent of a mip level, at least 1 texel on each axis
+ */
+VkExtent2D getMipExtent(VkExtent2D extent, uint32_t level);
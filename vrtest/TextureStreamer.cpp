@@ -0,0 +1,619 @@
+/** @file TextureStreamer.cpp
+*
+* @brief Defines class that keeps texture mip levels resident according to
+*   screen-space demand within a device memory budget
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/20/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <stdexcept>
+#include <string.h>
+
+#include "TextureStreamer.h"
+#include "SubmitQueue.h"
+#include "Common.h"
+
+/**
+ * Alignment of each level in a staging buffer. A multiple of every texel block size and of 4
+ */
+#define STAGING_ALIGNMENT 16
+
+TextureStreamer::TextureStreamer(GraphicsDevice* graphics_device, VkAllocationCallbacks* p_allocs,
+    uint32_t frames_in_flight, VkDeviceSize budget) {
+    this->graphics_device = graphics_device;
+    this->memory_telemetry = graphics_device->getMemoryTelemetry();
+    this->p_allocs = p_allocs;
+    this->frames_in_flight = frames_in_flight;
+    this->budget = budget;
+    this->effective_budget = budget;
+    this->upload_limit = 16 * 1024 * 1024;
+
+    createCommandPool();
+    createFallback();
+
+    // Pressure callbacks run during the telemetry update, on the thread that also calls update
+    pressure_callback = memory_telemetry->addPressureCallback([this](const MemoryPressureEvent&) {
+        pressure_changed = true;
+    });
+    refreshBudget();
+
+    // A single loader keeps reads sequential, which suits disks better than parallel reads
+    loader = new ThreadPool(1);
+}
+
+TextureStreamer::~TextureStreamer() {
+    memory_telemetry->removePressureCallback(pressure_callback);
+
+    // Finish loads first, since they reference the sources
+    delete loader;
+    for (Load* load : completed_loads) {
+        delete load;
+    }
+
+    VkDevice device = graphics_device->device();
+    for (Upload& upload : uploads) {
+        vkDestroyBuffer(device, upload.staging, p_allocs);
+        memory_telemetry->freeMemory(upload.staging_memory);
+
+        // The fallback image is destroyed below
+        if (upload.texture != UINT32_MAX) {
+            vkDestroyImageView(device, upload.view, p_allocs);
+            vkDestroyImage(device, upload.image, p_allocs);
+            memory_telemetry->freeMemory(upload.memory);
+        }
+    }
+
+    for (Retired& image : retired) {
+        vkDestroyImageView(device, image.view, p_allocs);
+        vkDestroyImage(device, image.image, p_allocs);
+        memory_telemetry->freeMemory(image.memory);
+    }
+
+    for (Texture& texture : textures) {
+        if (texture.image) {
+            vkDestroyImageView(device, texture.view, p_allocs);
+            vkDestroyImage(device, texture.image, p_allocs);
+            memory_telemetry->freeMemory(texture.memory);
+        }
+        delete texture.source;
+    }
+
+    vkDestroyImageView(device, fallback_view, p_allocs);
+    vkDestroyImage(device, fallback_image, p_allocs);
+    memory_telemetry->freeMemory(fallback_memory);
+
+    vkDestroyCommandPool(device, command_pool, p_allocs);
+}
+
+void TextureStreamer::createCommandPool() {
+    VkCommandPoolCreateInfo pool_ci = {};
+    pool_ci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_ci.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    pool_ci.queueFamilyIndex = graphics_device->getGraphicsQueueFamily();
+
+    if (vkCreateCommandPool(graphics_device->device(), &pool_ci, p_allocs, &command_pool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create texture streaming command pool");
+    }
+}
+
+void TextureStreamer::createFallback() {
+    VkDeviceSize size;
+    createImage(VK_FORMAT_R8G8B8A8_UNORM, { 1, 1 }, 1, &fallback_image, &fallback_view, &fallback_memory, &size);
+
+    // Upload through the regular path. It goes in the first frame's batch, ahead of anything sampling the image
+    Load* load = new Load();
+    load->texture = UINT32_MAX;
+    load->base_mip = 0;
+    load->mips.push_back(std::vector<uint8_t>(4, 255));
+    startUpload(load);
+}
+
+void TextureStreamer::createImage(VkFormat format, VkExtent2D extent, uint32_t mip_count, VkImage* image,
+    VkImageView* view, VkDeviceMemory* memory, VkDeviceSize* size) {
+    VkDevice device = graphics_device->device();
+
+    VkImageCreateInfo image_ci = {};
+    image_ci.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_ci.flags = 0;
+    image_ci.imageType = VK_IMAGE_TYPE_2D;
+    image_ci.format = format;
+    image_ci.extent = { extent.width, extent.height, 1 };
+    image_ci.mipLevels = mip_count;
+    image_ci.arrayLayers = 1;
+    image_ci.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_ci.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_ci.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    image_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_ci.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    if (vkCreateImage(device, &image_ci, p_allocs, image) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create texture image");
+    }
+
+    VkMemoryRequirements mem_req;
+    vkGetImageMemoryRequirements(device, *image, &mem_req);
+
+    VkMemoryAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize = mem_req.size;
+    alloc_info.memoryTypeIndex = graphics_device->findMemType(mem_req.memoryTypeBits,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    if (memory_telemetry->allocateMemory(alloc_info, MEMORY_CATEGORY_IMAGE, memory) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate texture memory");
+    }
+    if (vkBindImageMemory(device, *image, *memory, 0) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to bind texture memory");
+    }
+    *size = mem_req.size;
+
+    VkImageViewCreateInfo view_ci = {};
+    view_ci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_ci.flags = 0;
+    view_ci.image = *image;
+    view_ci.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_ci.format = format;
+    view_ci.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+    view_ci.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+    view_ci.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+    view_ci.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+    view_ci.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    view_ci.subresourceRange.baseMipLevel = 0;
+    view_ci.subresourceRange.levelCount = mip_count;
+    view_ci.subresourceRange.baseArrayLayer = 0;
+    view_ci.subresourceRange.layerCount = 1;
+
+    if (vkCreateImageView(device, &view_ci, p_allocs, view) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create texture image view");
+    }
+}
+
+uint32_t TextureStreamer::getTailMip(const Texture& texture) {
+    uint32_t level = 0;
+    while (level + 1 < texture.mip_count) {
+        VkExtent2D extent = getMipExtent(texture.extent, level);
+        if (extent.width <= 64 && extent.height <= 64) {
+            break;
+        }
+        level++;
+    }
+    return level;
+}
+
+VkDeviceSize TextureStreamer::estimateSize(const Texture& texture, uint32_t base_mip) {
+    VkDeviceSize size = 0;
+    for (uint32_t level = base_mip; level < texture.mip_count; level++) {
+        size += texture.source->getMipSize(level);
+    }
+    return size;
+}
+
+TextureHandle TextureStreamer::addTexture(TextureSource* source) {
+    Texture texture;
+    texture.source = source;
+    texture.format = source->getFormat();
+    texture.extent = source->getExtent();
+    texture.mip_count = MAX(source->getMipCount(), 1u);
+    texture.resident_mip = texture.mip_count;
+    texture.desired_mip = getTailMip(texture);
+
+    TextureHandle handle = static_cast<TextureHandle>(textures.size());
+    textures.push_back(texture);
+
+    // Start with the smallest levels so the texture can be sampled soon after it is added
+    requestLoad(handle, textures[handle].desired_mip);
+    return handle;
+}
+
+void TextureStreamer::reportScreenSize(TextureHandle handle, float screen_size) {
+    Texture& texture = textures[handle];
+
+    // Each level halves the texel density, so the level matching the screen size is the log of the ratio
+    float texels = static_cast<float>(MAX(texture.extent.width, texture.extent.height));
+    float ratio = texels / MAX(screen_size, 1.0f);
+    uint32_t level = ratio <= 1.0f ? 0 : static_cast<uint32_t>(floorf(log2f(ratio)));
+    level = MIN(level, getTailMip(texture));
+
+    // The first report of a frame replaces the previous frame's demand
+    if (texture.last_seen_frame != frame) {
+        texture.desired_mip = level;
+        texture.last_seen_frame = frame;
+    }
+    else {
+        texture.desired_mip = MIN(texture.desired_mip, level);
+    }
+}
+
+void TextureStreamer::requestLoad(TextureHandle handle, uint32_t base_mip) {
+    Texture& texture = textures[handle];
+    texture.busy = true;
+
+    TextureSource* source = texture.source;
+    uint32_t mip_count = texture.mip_count;
+    loader->enqueue([this, handle, base_mip, source, mip_count]() {
+        Load* load = new Load();
+        load->texture = handle;
+        load->base_mip = base_mip;
+        load->mips.resize(mip_count - base_mip);
+        try {
+            for (uint32_t level = base_mip; level < mip_count; level++) {
+                source->loadMip(level, &(load->mips[level - base_mip]));
+            }
+        }
+        catch (const std::exception& e) {
+            // An empty load tells update the texture keeps its current levels
+            std::cerr << "Failed to load texture mips: " << e.what() << std::endl;
+            load->mips.clear();
+        }
+        catch (...) {
+            // Still publish the load, or the texture stays busy and is never requested again
+            std::cerr << "Failed to load texture mips" << std::endl;
+            load->mips.clear();
+        }
+
+        std::lock_guard<std::mutex> guard(load_lock);
+        completed_loads.push_back(load);
+    });
+}
+
+void TextureStreamer::startUpload(Load* load) {
+    VkDevice device = graphics_device->device();
+
+    Upload upload = {};
+    upload.texture = load->texture;
+    upload.base_mip = load->base_mip;
+
+    VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+    VkExtent2D extent = { 1, 1 };
+    uint32_t mip_count = static_cast<uint32_t>(load->mips.size());
+    if (load->texture == UINT32_MAX) {
+        upload.image = fallback_image;
+    }
+    else {
+        Texture& texture = textures[load->texture];
+        format = texture.format;
+        extent = getMipExtent(texture.extent, load->base_mip);
+        createImage(format, extent, mip_count, &upload.image, &upload.view, &upload.memory, &upload.size);
+        usage += upload.size;
+    }
+
+    // Pack the levels into a host visible staging buffer
+    std::vector<VkDeviceSize> offsets(mip_count);
+    VkDeviceSize staging_size = 0;
+    for (uint32_t i = 0; i < mip_count; i++) {
+        offsets[i] = staging_size;
+        staging_size += (load->mips[i].size() + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT * STAGING_ALIGNMENT;
+    }
+
+    VkBufferCreateInfo buffer_ci = {};
+    buffer_ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_ci.flags = 0;
+    buffer_ci.size = staging_size;
+    buffer_ci.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    buffer_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(device, &buffer_ci, p_allocs, &upload.staging) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create texture staging buffer");
+    }
+
+    VkMemoryRequirements mem_req;
+    vkGetBufferMemoryRequirements(device, upload.staging, &mem_req);
+
+    VkMemoryAllocateInfo alloc_info = {};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize = mem_req.size;
+    alloc_info.memoryTypeIndex = graphics_device->findMemType(mem_req.memoryTypeBits,
+        static_cast<VkMemoryPropertyFlagBits>(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT));
+
+    VkResult result = memory_telemetry->allocateMemory(alloc_info, MEMORY_CATEGORY_STAGING, &upload.staging_memory);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate texture staging memory");
+    }
+    if (vkBindBufferMemory(device, upload.staging, upload.staging_memory, 0) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to bind texture staging memory");
+    }
+
+    void* mapped;
+    if (vkMapMemory(device, upload.staging_memory, 0, staging_size, 0, &mapped) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to map texture staging memory");
+    }
+    for (uint32_t i = 0; i < mip_count; i++) {
+        memcpy(static_cast<uint8_t*>(mapped) + offsets[i], load->mips[i].data(), load->mips[i].size());
+    }
+    vkUnmapMemory(device, upload.staging_memory);
+
+    // Record the copies into every level, leaving the image ready to sample
+    VkCommandBufferAllocateInfo buffer_ai = {};
+    buffer_ai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    buffer_ai.commandPool = command_pool;
+    buffer_ai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    buffer_ai.commandBufferCount = 1;
+
+    if (vkAllocateCommandBuffers(device, &buffer_ai, &upload.cmd) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate texture upload command buffer");
+    }
+
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (vkBeginCommandBuffer(upload.cmd, &begin_info) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to begin texture upload command buffer");
+    }
+
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = upload.image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = mip_count;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+
+    vkCmdPipelineBarrier(upload.cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
+        nullptr, 0, nullptr, 1, &barrier);
+
+    std::vector<VkBufferImageCopy> regions(mip_count);
+    for (uint32_t i = 0; i < mip_count; i++) {
+        VkExtent2D mip_extent = getMipExtent(extent, i);
+        regions[i] = {};
+        regions[i].bufferOffset = offsets[i];
+        regions[i].bufferRowLength = 0;
+        regions[i].bufferImageHeight = 0;
+        regions[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        regions[i].imageSubresource.mipLevel = i;
+        regions[i].imageSubresource.baseArrayLayer = 0;
+        regions[i].imageSubresource.layerCount = 1;
+        regions[i].imageOffset = { 0, 0, 0 };
+        regions[i].imageExtent = { mip_extent.width, mip_extent.height, 1 };
+    }
+    vkCmdCopyBufferToImage(upload.cmd, upload.staging, upload.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        mip_count, regions.data());
+
+    // Frames submitted after the upload sample the image, so make the copy visible to their shaders
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    vkCmdPipelineBarrier(upload.cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    if (vkEndCommandBuffer(upload.cmd) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to end texture upload command buffer");
+    }
+
+    // Submitted with this frame rather than on its own, so a frame's uploads cost no extra queue submissions
+    graphics_device->getSubmitQueue()->addCommandBuffer(upload.cmd);
+    upload.frame = frame;
+
+    uploads.push_back(upload);
+    delete load;
+}
+
+bool TextureStreamer::finishUploads() {
+    VkDevice device = graphics_device->device();
+    bool changed = false;
+
+    for (size_t i = 0; i < uploads.size();) {
+        // Slots are only reused once their frame retired, so the upload's frame has retired once more than
+        // frames_in_flight frames followed it
+        Upload& upload = uploads[i];
+        if (upload.frame + frames_in_flight >= frame) {
+            i++;
+            continue;
+        }
+
+        vkFreeCommandBuffers(device, command_pool, 1, &upload.cmd);
+        vkDestroyBuffer(device, upload.staging, p_allocs);
+        memory_telemetry->freeMemory(upload.staging_memory);
+
+        // Swap the new image in. The old one may still be sampled by frames in flight
+        if (upload.texture != UINT32_MAX) {
+            Texture& texture = textures[upload.texture];
+            if (texture.image) {
+                Retired old;
+                old.image = texture.image;
+                old.view = texture.view;
+                old.memory = texture.memory;
+                old.size = texture.size;
+                old.frame = frame;
+                retired.push_back(old);
+            }
+
+            texture.image = upload.image;
+            texture.view = upload.view;
+            texture.memory = upload.memory;
+            texture.size = upload.size;
+            texture.resident_mip = upload.base_mip;
+            texture.busy = false;
+            changed = true;
+        }
+
+        uploads[i] = uploads.back();
+        uploads.pop_back();
+    }
+
+    return changed;
+}
+
+void TextureStreamer::releaseRetired() {
+    VkDevice device = graphics_device->device();
+
+    while (!retired.empty() && retired.front().frame + frames_in_flight < frame) {
+        Retired& image = retired.front();
+        vkDestroyImageView(device, image.view, p_allocs);
+        vkDestroyImage(device, image.image, p_allocs);
+        memory_telemetry->freeMemory(image.memory);
+        usage -= image.size;
+        retired.pop_front();
+    }
+}
+
+void TextureStreamer::refreshBudget() {
+    VkDeviceSize device_budget;
+    VkDeviceSize device_usage;
+    graphics_device->getDeviceLocalBudget(&device_budget, &device_usage);
+
+    // The device budget covers every allocation of the process, so only what others leave is available
+    VkDeviceSize others = device_usage > usage ? device_usage - usage : 0;
+    VkDeviceSize available = device_budget > others ? device_budget - others : 0;
+    effective_budget = MIN(budget, available);
+
+    // Near the budget stop growing, and once critical give back a quarter of what textures hold. Refreshes while
+    // pressure stays critical keep shrinking, until over-detailed levels are all released
+    switch (memory_telemetry->getDeviceLocalPressure()) {
+    case MEMORY_PRESSURE_WARNING:
+        effective_budget = MIN(effective_budget, usage);
+        break;
+    case MEMORY_PRESSURE_CRITICAL:
+        effective_budget = MIN(effective_budget, usage - usage / 4);
+        break;
+    default:
+        break;
+    }
+}
+
+void TextureStreamer::scheduleLoads() {
+    // Textures not seen for a while only need their smallest levels
+    std::vector<TextureHandle> wanting;
+    std::vector<TextureHandle> shrinkable;
+    for (TextureHandle handle = 0; handle < textures.size(); handle++) {
+        Texture& texture = textures[handle];
+        if (frame > texture.last_seen_frame + idle_frames) {
+            texture.desired_mip = getTailMip(texture);
+        }
+        if (texture.busy) {
+            continue;
+        }
+
+        if (texture.desired_mip < texture.resident_mip) {
+            wanting.push_back(handle);
+        }
+        else if (texture.desired_mip > texture.resident_mip) {
+            shrinkable.push_back(handle);
+        }
+    }
+
+    // Shrink over-detailed textures only when memory is needed, least recently seen first
+    VkDeviceSize projected = usage;
+    std::sort(shrinkable.begin(), shrinkable.end(), [this](TextureHandle a, TextureHandle b) {
+        return textures[a].last_seen_frame < textures[b].last_seen_frame;
+    });
+    for (TextureHandle handle : shrinkable) {
+        if (projected <= effective_budget) {
+            break;
+        }
+
+        Texture& texture = textures[handle];
+        projected -= MIN(texture.size, projected);
+        projected += estimateSize(texture, texture.desired_mip);
+        requestLoad(handle, texture.desired_mip);
+    }
+
+    // Grow the textures missing the most detail first, as far as the budget allows
+    std::sort(wanting.begin(), wanting.end(), [this](TextureHandle a, TextureHandle b) {
+        uint32_t missing_a = textures[a].resident_mip - textures[a].desired_mip;
+        uint32_t missing_b = textures[b].resident_mip - textures[b].desired_mip;
+        return missing_a > missing_b;
+    });
+    for (TextureHandle handle : wanting) {
+        Texture& texture = textures[handle];
+
+        // Until the swap both images are allocated, so the new image must fit alongside the old
+        uint32_t base_mip = texture.desired_mip;
+        while (base_mip < texture.resident_mip && projected + estimateSize(texture, base_mip) > effective_budget) {
+            base_mip++;
+        }
+        if (base_mip >= texture.resident_mip) {
+            continue;
+        }
+
+        projected += estimateSize(texture, base_mip);
+        requestLoad(handle, base_mip);
+    }
+}
+
+bool TextureStreamer::update() {
+    frame++;
+
+    bool changed = finishUploads();
+    releaseRetired();
+
+    if (frame % 60 == 0 || pressure_changed) {
+        pressure_changed = false;
+        refreshBudget();
+    }
+
+    // Start uploads of loaded levels, spreading large bursts over several frames
+    std::vector<Load*> loads;
+    {
+        std::lock_guard<std::mutex> guard(load_lock);
+        loads.swap(completed_loads);
+    }
+
+    VkDeviceSize uploaded = 0;
+    for (size_t i = 0; i < loads.size(); i++) {
+        if (uploaded >= upload_limit) {
+            std::lock_guard<std::mutex> guard(load_lock);
+            completed_loads.insert(completed_loads.end(), loads.begin() + i, loads.end());
+            break;
+        }
+
+        if (loads[i]->mips.empty()) {
+            textures[loads[i]->texture].busy = false;
+            delete loads[i];
+            continue;
+        }
+
+        for (const std::vector<uint8_t>& mip : loads[i]->mips) {
+            uploaded += mip.size();
+        }
+        startUpload(loads[i]);
+    }
+
+    scheduleLoads();
+
+    return changed;
+}
+
+VkImageView TextureStreamer::getImageView(TextureHandle handle) {
+    VkImageView view = textures[handle].view;
+    return view ? view : fallback_view;
+}
+
+VkImageView TextureStreamer::getFallbackImageView() {
+    return fallback_view;
+}
+
+uint32_t TextureStreamer::getResidentMip(TextureHandle handle) {
+    return textures[handle].resident_mip;
+}
+
+void TextureStreamer::setBudget(VkDeviceSize budget) {
+    this->budget = budget;
+    refreshBudget();
+}
+
+VkDeviceSize TextureStreamer::getBudget() {
+    return effective_budget;
+}
+
+VkDeviceSize TextureStreamer::getUsage() {
+    return usage;
+}
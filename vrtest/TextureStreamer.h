@@ -0,0 +1,272 @@
+/** @file TextureStreamer.h
+*
+* @brief Defines class that keeps texture mip levels resident according to
+*   screen-space demand within a device memory budget
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/20/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "GraphicsDevice.h"
+#include "TextureSource.h"
+#include "ThreadPool.h"
+
+typedef uint32_t TextureHandle;
+
+/**
+ * Each texture holds a contiguous range of its mip chain, from its finest resident level down to the smallest
+ *  level. Only the smallest levels are loaded when a texture is added. Callers report how large each texture
+ *  appears on screen, and levels are loaded on a background thread to match. Changing residency builds a new
+ *  image with the new range, uploads it on the graphics queue and swaps it in at a frame boundary, so views
+ *  are never modified while frames in flight sample them. When the budget is exceeded, textures that are
+ *  more detailed than currently needed are shrunk, least recently seen first. The budget also backs off when the
+ *  memory telemetry reports pressure on device local heaps
+ */
+class TextureStreamer {
+private:
+    struct Texture {
+        TextureSource* source;
+        VkFormat format;
+        VkExtent2D extent;
+        uint32_t mip_count;
+
+        /**
+         * Current image, or VK_NULL_HANDLE until the first upload completes
+         */
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+
+        /**
+         * Finest level in the current image, or mip_count if none
+         */
+        uint32_t resident_mip;
+
+        /**
+         * Finest level requested by screen-space demand
+         */
+        uint32_t desired_mip;
+
+        /**
+         * Whether a load or upload is in progress
+         */
+        bool busy = false;
+
+        /**
+         * Frame the texture was last reported visible
+         */
+        uint64_t last_seen_frame = 0;
+    };
+
+    /**
+     * Mip levels read by the loader thread
+     */
+    struct Load {
+        TextureHandle texture;
+        uint32_t base_mip;
+        std::vector<std::vector<uint8_t>> mips;
+    };
+
+    /**
+     * Image being uploaded on the graphics queue, in the batch of the frame it was started in
+     */
+    struct Upload {
+        TextureHandle texture;
+        uint32_t base_mip;
+        VkImage image;
+        VkImageView view;
+        VkDeviceMemory memory;
+        VkDeviceSize size;
+        VkBuffer staging;
+        VkDeviceMemory staging_memory;
+        VkCommandBuffer cmd;
+        uint64_t frame;
+    };
+
+    /**
+     * Image replaced by a swap, destroyed once frames that may sample it have retired
+     */
+    struct Retired {
+        VkImage image;
+        VkImageView view;
+        VkDeviceMemory memory;
+        VkDeviceSize size;
+        uint64_t frame;
+    };
+
+    GraphicsDevice* graphics_device;
+    MemoryTelemetry* memory_telemetry;
+    VkAllocationCallbacks* p_allocs;
+
+    /**
+     * Frames that can be in flight, so retired images are kept this many frames
+     */
+    uint32_t frames_in_flight;
+
+    std::vector<Texture> textures;
+
+    /**
+     * Loads the source data of requested mip ranges
+     */
+    ThreadPool* loader = nullptr;
+
+    /**
+     * Finished loads, handed from the loader thread to update
+     */
+    std::vector<Load*> completed_loads;
+    std::mutex load_lock;
+
+    std::vector<Upload> uploads;
+    std::deque<Retired> retired;
+
+    VkCommandPool command_pool = VK_NULL_HANDLE;
+
+    /**
+     * 1x1 white image returned for textures that aren't resident yet
+     */
+    VkImage fallback_image = VK_NULL_HANDLE;
+    VkImageView fallback_view = VK_NULL_HANDLE;
+    VkDeviceMemory fallback_memory = VK_NULL_HANDLE;
+
+    /**
+     * Device memory budget for textures set by the caller, and the budget actually enforced, which is lower
+     *  if the device reports less memory available
+     */
+    VkDeviceSize budget;
+    VkDeviceSize effective_budget;
+
+    /**
+     * Pressure callback registered with the memory telemetry, and whether pressure on a device local heap changed
+     *  since the budget was last refreshed
+     */
+    uint32_t pressure_callback;
+    bool pressure_changed = false;
+
+    /**
+     * Bytes of device memory held by current, uploading and retired images
+     */
+    VkDeviceSize usage = 0;
+
+    /**
+     * Upload bytes started per frame, so a burst of requests doesn't stall the queue for a frame
+     */
+    VkDeviceSize upload_limit;
+
+    /**
+     * Frames without being reported visible before a texture's demand falls to its smallest levels
+     */
+    uint32_t idle_frames = 120;
+
+    uint64_t frame = 0;
+
+    void createCommandPool();
+    void createFallback();
+
+    /**
+     * Get the finest level that is always resident, the first level no larger than 64 texels
+     */
+    uint32_t getTailMip(const Texture& texture);
+
+    /**
+     * Estimate the device memory of an image holding levels from base_mip down
+     */
+    VkDeviceSize estimateSize(const Texture& texture, uint32_t base_mip);
+
+    void refreshBudget();
+    void requestLoad(TextureHandle handle, uint32_t base_mip);
+    void startUpload(Load* load);
+
+    /**
+     * Swap in images whose uploads have completed, going by the frames retired as for retired images
+     * @return true if any texture's view changed
+     */
+    bool finishUploads();
+
+    void releaseRetired();
+    void scheduleLoads();
+
+    /**
+     * Create a sampled image and view, allocated from device local memory
+     */
+    void createImage(VkFormat format, VkExtent2D extent, uint32_t mip_count, VkImage* image, VkImageView* view,
+        VkDeviceMemory* memory, VkDeviceSize* size);
+
+public:
+    /**
+     * @param graphics_device device to create images on and submit uploads to
+     * @param p_allocs allocation callbacks passed to Vulkan calls
+     * @param frames_in_flight number of frames that may still sample an image after it is swapped out
+     * @param budget device memory in bytes textures may use
+     */
+    TextureStreamer(GraphicsDevice* graphics_device, VkAllocationCallbacks* p_allocs, uint32_t frames_in_flight,
+        VkDeviceSize budget);
+
+    /**
+     * Waits for loads and destroys every image. Uploads must have completed, e.g. by waiting for the device to go
+     *  idle. Sources are deleted
+     */
+    ~TextureStreamer();
+
+    /**
+     * Add a texture. Its smallest levels are loaded in the background
+     * @param source provider of level data, owned by the streamer
+     * @return handle to the texture
+     */
+    TextureHandle addTexture(TextureSource* source);
+
+    /**
+     * Report how large a texture appears on screen this frame. The largest report of a frame is used
+     * @param handle texture
+     * @param screen_size pixels the texture spans on screen along its longest axis
+     */
+    void reportScreenSize(TextureHandle handle, float screen_size);
+
+    /**
+     * Advance to the next frame: swap in finished uploads, free images no longer in use and start new loads.
+     *  Call once per frame on the thread that submits frames, before descriptors are written for the frame
+     * @return true if any image view changed, so descriptors referencing views must be rewritten
+     */
+    bool update();
+
+    /**
+     * Get the view to sample a texture with. Valid until frames_in_flight frames after the update that
+     *  replaces it
+     */
+    VkImageView getImageView(TextureHandle handle);
+
+    /**
+     * Get the view of the 1x1 white image shown for textures that aren't resident. Valid for the streamer's life
+     */
+    VkImageView getFallbackImageView();
+
+    /**
+     * Get the finest resident level of a texture, or its mip count if none are resident
+     */
+    uint32_t getResidentMip(TextureHandle handle);
+
+    /**
+     * Set the device memory budget in bytes
+     */
+    void setBudget(VkDeviceSize budget);
+
+    /**
+     * Get the budget being enforced, after limiting it to the memory the device reports available
+     */
+    VkDeviceSize getBudget();
+
+    /**
+     * Get the device memory used by texture images
+     */
+    VkDeviceSize getUsage();
+};
@@ -0,0 +1,94 @@
+/** @file ThreadPool.cpp
+*
+* @brief Defines a fixed size pool of worker threads consuming a task queue
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/08/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include <iostream>
+#include <stdexcept>
+
+#include "ThreadPool.h"
+#include "Common.h"
+
+ThreadPool::ThreadPool(uint32_t thread_count) {
+    if (thread_count == 0) {
+        uint32_t hardware_threads = std::thread::hardware_concurrency();
+        thread_count = hardware_threads > 1 ? hardware_threads - 1 : 1;
+    }
+
+    for (uint32_t i = 0; i < thread_count; i++) {
+        workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    task_available.notify_all();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::enqueue(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        tasks.push_back(std::move(task));
+        outstanding++;
+    }
+    task_available.notify_one();
+}
+
+void ThreadPool::waitIdle() {
+    std::unique_lock<std::mutex> guard(lock);
+    idle.wait(guard, [this]() { return outstanding == 0; });
+}
+
+uint32_t ThreadPool::getThreadCount() {
+    return static_cast<uint32_t>(workers.size());
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            task_available.wait(guard, [this]() { return stopping || !tasks.empty(); });
+
+            // Drain the queue before honouring a stop request
+            if (tasks.empty()) {
+                return;
+            }
+
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+
+        try {
+            task();
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Worker task failed: " << e.what() << std::endl;
+        }
+        catch (...) {
+            // The task must still be counted as done, or waitIdle hangs
+            std::cerr << "Worker task failed" << std::endl;
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            outstanding--;
+            if (outstanding == 0) {
+                idle.notify_all();
+            }
+        }
+    }
+}
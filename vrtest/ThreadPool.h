@@ -0,0 +1,73 @@
+/** @file ThreadPool.h
+*
+* @brief Defines a fixed size pool of worker threads consuming a task queue
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/08/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+private:
+    /**
+     * Worker threads
+     */
+    std::vector<std::thread> workers;
+
+    /**
+     * Tasks waiting for a worker
+     */
+    std::deque<std::function<void()>> tasks;
+
+    /**
+     * Number of tasks queued or running
+     */
+    uint32_t outstanding = 0;
+
+    bool stopping = false;
+
+    std::mutex lock;
+    std::condition_variable task_available;
+    std::condition_variable idle;
+
+    void workerLoop();
+
+public:
+    /**
+     * Start worker threads
+     * @param thread_count number of workers, or 0 to use one less than the hardware thread count
+     */
+    ThreadPool(uint32_t thread_count);
+
+    /**
+     * Finishes queued tasks and joins all workers
+     */
+    ~ThreadPool();
+
+    /**
+     * Queue a task to run on a worker
+     * @param task function to run. Exceptions thrown by the task are caught and discarded
+     */
+    void enqueue(std::function<void()> task);
+
+    /**
+     * Block until every queued task has finished
+     */
+    void waitIdle();
+
+    /**
+     * Get the number of worker threads
+     */
+    uint32_t getThreadCount();
+};
@@ -0,0 +1,196 @@
+/** @file TransformHierarchy.cpp
+*
+* @brief Defines class that stores a hierarchy of transforms as component
+*   arrays and updates world matrices in one linear pass
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/30/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include <stdexcept>
+
+#include "TransformHierarchy.h"
+#include "Common.h"
+
+/**
+ * Allocate a component array padded to a multiple of four, filled with a value
+ */
+static float* allocateComponent(uint32_t padded, float value) {
+    float* values = new float[padded];
+    for (uint32_t i = 0; i < padded; i++) {
+        values[i] = value;
+    }
+    return values;
+}
+
+TransformHierarchy::TransformHierarchy(uint32_t capacity) {
+    this->capacity = capacity;
+    uint32_t padded = (capacity + 3) & ~3u;
+
+    parents = new int32_t[padded];
+    position_x = allocateComponent(padded, 0.0f);
+    position_y = allocateComponent(padded, 0.0f);
+    position_z = allocateComponent(padded, 0.0f);
+    rotation_x = allocateComponent(padded, 0.0f);
+    rotation_y = allocateComponent(padded, 0.0f);
+    rotation_z = allocateComponent(padded, 0.0f);
+    rotation_w = allocateComponent(padded, 1.0f);
+    scale_x = allocateComponent(padded, 1.0f);
+    scale_y = allocateComponent(padded, 1.0f);
+    scale_z = allocateComponent(padded, 1.0f);
+
+    // Room for a whole last batch, which is written before the count is checked
+    worlds = new Mat4[padded];
+}
+
+TransformHierarchy::~TransformHierarchy() {
+    delete[] parents;
+    delete[] position_x;
+    delete[] position_y;
+    delete[] position_z;
+    delete[] rotation_x;
+    delete[] rotation_y;
+    delete[] rotation_z;
+    delete[] rotation_w;
+    delete[] scale_x;
+    delete[] scale_y;
+    delete[] scale_z;
+    delete[] worlds;
+}
+
+uint32_t TransformHierarchy::addNode(int32_t parent) {
+    if (count == capacity) {
+        throw std::runtime_error("Failed to add transform: hierarchy is full");
+    }
+    if (parent >= static_cast<int32_t>(count)) {
+        throw std::runtime_error("Failed to add transform: parent does not exist");
+    }
+
+    uint32_t node = count++;
+    parents[node] = parent < 0 ? -1 : parent;
+    worlds[node] = mat4Identity();
+    return node;
+}
+
+void TransformHierarchy::setLocalPosition(uint32_t node, const Vec3& position) {
+    position_x[node] = position.x;
+    position_y[node] = position.y;
+    position_z[node] = position.z;
+}
+
+void TransformHierarchy::setLocalRotation(uint32_t node, const Quat& rotation) {
+    rotation_x[node] = float4GetLane<0>(rotation.v);
+    rotation_y[node] = float4GetLane<1>(rotation.v);
+    rotation_z[node] = float4GetLane<2>(rotation.v);
+    rotation_w[node] = float4GetLane<3>(rotation.v);
+}
+
+void TransformHierarchy::setLocalScale(uint32_t node, const Vec3& scale) {
+    scale_x[node] = scale.x;
+    scale_y[node] = scale.y;
+    scale_z[node] = scale.z;
+}
+
+Vec3 TransformHierarchy::getLocalPosition(uint32_t node) {
+    return vec3(position_x[node], position_y[node], position_z[node]);
+}
+
+int32_t TransformHierarchy::getParent(uint32_t node) {
+    return parents[node];
+}
+
+uint32_t TransformHierarchy::getNodeCount() {
+    return count;
+}
+
+const Mat4& TransformHierarchy::getWorldMatrix(uint32_t node) {
+    return worlds[node];
+}
+
+void TransformHierarchy::update(float* output) {
+    Float4 one = float4Splat(1.0f);
+    Float4 two = float4Splat(2.0f);
+    Float4 zero = float4Zero();
+
+    for (uint32_t base = 0; base < count; base += 4) {
+        // Rotation matrix terms for four nodes, one node per lane
+        Float4 qx = float4Load(rotation_x + base);
+        Float4 qy = float4Load(rotation_y + base);
+        Float4 qz = float4Load(rotation_z + base);
+        Float4 qw = float4Load(rotation_w + base);
+
+        Float4 xx = float4Mul(qx, qx);
+        Float4 yy = float4Mul(qy, qy);
+        Float4 zz = float4Mul(qz, qz);
+        Float4 xy = float4Mul(qx, qy);
+        Float4 xz = float4Mul(qx, qz);
+        Float4 yz = float4Mul(qy, qz);
+        Float4 wx = float4Mul(qw, qx);
+        Float4 wy = float4Mul(qw, qy);
+        Float4 wz = float4Mul(qw, qz);
+
+        Float4 sx = float4Load(scale_x + base);
+        Float4 sy = float4Load(scale_y + base);
+        Float4 sz = float4Load(scale_z + base);
+
+        // Each register holds one element of a local matrix for all four nodes
+        Float4 c0x = float4Mul(float4Sub(one, float4Mul(two, float4Add(yy, zz))), sx);
+        Float4 c0y = float4Mul(float4Mul(two, float4Add(xy, wz)), sx);
+        Float4 c0z = float4Mul(float4Mul(two, float4Sub(xz, wy)), sx);
+        Float4 c1x = float4Mul(float4Mul(two, float4Sub(xy, wz)), sy);
+        Float4 c1y = float4Mul(float4Sub(one, float4Mul(two, float4Add(xx, zz))), sy);
+        Float4 c1z = float4Mul(float4Mul(two, float4Add(yz, wx)), sy);
+        Float4 c2x = float4Mul(float4Mul(two, float4Add(xz, wy)), sz);
+        Float4 c2y = float4Mul(float4Mul(two, float4Sub(yz, wx)), sz);
+        Float4 c2z = float4Mul(float4Sub(one, float4Mul(two, float4Add(xx, yy))), sz);
+        Float4 c3x = float4Load(position_x + base);
+        Float4 c3y = float4Load(position_y + base);
+        Float4 c3z = float4Load(position_z + base);
+        Float4 c0w = zero;
+        Float4 c1w = zero;
+        Float4 c2w = zero;
+        Float4 c3w = one;
+
+        // Transposing turns element registers into one column per node
+        float4Transpose(c0x, c0y, c0z, c0w);
+        float4Transpose(c1x, c1y, c1z, c1w);
+        float4Transpose(c2x, c2y, c2z, c2w);
+        float4Transpose(c3x, c3y, c3z, c3w);
+
+        Mat4 locals[4];
+        locals[0].cols[0] = c0x;
+        locals[1].cols[0] = c0y;
+        locals[2].cols[0] = c0z;
+        locals[3].cols[0] = c0w;
+        locals[0].cols[1] = c1x;
+        locals[1].cols[1] = c1y;
+        locals[2].cols[1] = c1z;
+        locals[3].cols[1] = c1w;
+        locals[0].cols[2] = c2x;
+        locals[1].cols[2] = c2y;
+        locals[2].cols[2] = c2z;
+        locals[3].cols[2] = c2w;
+        locals[0].cols[3] = c3x;
+        locals[1].cols[3] = c3y;
+        locals[2].cols[3] = c3z;
+        locals[3].cols[3] = c3w;
+
+        // Parents precede children, so a parent in this batch has already been written
+        uint32_t batch_count = MIN(count - base, 4u);
+        for (uint32_t i = 0; i < batch_count; i++) {
+            uint32_t node = base + i;
+            int32_t parent = parents[node];
+            worlds[node] = parent < 0 ? locals[i] : worlds[parent] * locals[i];
+            if (output) {
+                mat4Stream(output + 16 * node, worlds[node]);
+            }
+        }
+    }
+
+    if (output) {
+        float4StreamFence();
+    }
+}
@@ -0,0 +1,92 @@
+/** @file TransformHierarchy.h
+*
+* @brief Defines class that stores a hierarchy of transforms as component
+*   arrays and updates world matrices in one linear pass
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/30/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <stdint.h>
+
+#include "VectorMath.h"
+
+/**
+ * Nodes are indexes into structure-of-arrays storage: one array per component of the local translation,
+ *  rotation and scale. Parents always come before their children, so a single front to back pass sees every
+ *  parent's world matrix before its children need it. The pass builds local matrices for four nodes at a time
+ *  straight from the component arrays, then multiplies each by its parent, and can stream the results into a
+ *  mapped buffer such as the renderer's instance buffer without a separate copy
+ */
+class TransformHierarchy {
+private:
+    uint32_t capacity;
+    uint32_t count = 0;
+
+    /**
+     * Parent of each node, or -1 for roots
+     */
+    int32_t* parents;
+
+    /**
+     * Local transform components. Arrays are padded to a multiple of four with identity transforms, so the
+     *  last batch of the update can read past the final node
+     */
+    float* position_x;
+    float* position_y;
+    float* position_z;
+    float* rotation_x;
+    float* rotation_y;
+    float* rotation_z;
+    float* rotation_w;
+    float* scale_x;
+    float* scale_y;
+    float* scale_z;
+
+    /**
+     * World matrix of each node as of the last update
+     */
+    Mat4* worlds;
+
+public:
+    /**
+     * @param capacity maximum number of nodes
+     */
+    TransformHierarchy(uint32_t capacity);
+
+    ~TransformHierarchy();
+
+    TransformHierarchy(const TransformHierarchy&) = delete;
+    TransformHierarchy& operator=(const TransformHierarchy&) = delete;
+
+    /**
+     * Add a node with an identity local transform
+     * @param parent index of an existing node, or -1 for a root
+     * @return index of the new node, which is greater than its parent's
+     */
+    uint32_t addNode(int32_t parent);
+
+    void setLocalPosition(uint32_t node, const Vec3& position);
+    void setLocalRotation(uint32_t node, const Quat& rotation);
+    void setLocalScale(uint32_t node, const Vec3& scale);
+
+    Vec3 getLocalPosition(uint32_t node);
+    int32_t getParent(uint32_t node);
+    uint32_t getNodeCount();
+
+    /**
+     * Get a node's world matrix as of the last update
+     */
+    const Mat4& getWorldMatrix(uint32_t node);
+
+    /**
+     * Recompute every world matrix from the local transforms
+     * @param output [output] destination for a copy of the world matrices in node order, 16 floats each, or
+     *  nullptr. Must be 16-byte aligned. Written with streaming stores, so it may be write-combined memory
+     */
+    void update(float* output = nullptr);
+};
@@ -0,0 +1,549 @@
+/** @file VectorMath.h
+*
+* @brief Defines vector, matrix and quaternion types with SSE, AVX and NEON
+*   implementations and a scalar fallback
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/30/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+
+// Instruction sets are picked at compile time from the target flags, e.g. /arch:AVX or -mavx. Define
+// VRTEST_NO_SIMD to build the scalar fallback instead
+#if defined(VRTEST_NO_SIMD)
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VRTEST_SIMD_SSE
+#include <emmintrin.h>
+#if defined(__AVX__)
+#define VRTEST_SIMD_AVX
+#include <immintrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define VRTEST_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+/**
+ * Four floats in one register. Everything else is built from the functions below, so a new instruction set
+ *  only needs this layer
+ */
+#if defined(VRTEST_SIMD_SSE)
+typedef __m128 Float4;
+#elif defined(VRTEST_SIMD_NEON)
+typedef float32x4_t Float4;
+#else
+struct Float4 {
+    float v[4];
+};
+#endif
+
+inline Float4 float4Set(float x, float y, float z, float w) {
+#if defined(VRTEST_SIMD_SSE)
+    return _mm_setr_ps(x, y, z, w);
+#elif defined(VRTEST_SIMD_NEON)
+    float values[4] = { x, y, z, w };
+    return vld1q_f32(values);
+#else
+    Float4 r = { { x, y, z, w } };
+    return r;
+#endif
+}
+
+inline Float4 float4Splat(float s) {
+#if defined(VRTEST_SIMD_SSE)
+    return _mm_set1_ps(s);
+#elif defined(VRTEST_SIMD_NEON)
+    return vdupq_n_f32(s);
+#else
+    Float4 r = { { s, s, s, s } };
+    return r;
+#endif
+}
+
+inline Float4 float4Zero() {
+    return float4Splat(0.0f);
+}
+
+/**
+ * Load four floats. The pointer needs no alignment
+ */
+inline Float4 float4Load(const float* p) {
+#if defined(VRTEST_SIMD_SSE)
+    return _mm_loadu_ps(p);
+#elif defined(VRTEST_SIMD_NEON)
+    return vld1q_f32(p);
+#else
+    Float4 r = { { p[0], p[1], p[2], p[3] } };
+    return r;
+#endif
+}
+
+inline void float4Store(float* p, Float4 v) {
+#if defined(VRTEST_SIMD_SSE)
+    _mm_storeu_ps(p, v);
+#elif defined(VRTEST_SIMD_NEON)
+    vst1q_f32(p, v);
+#else
+    p[0] = v.v[0];
+    p[1] = v.v[1];
+    p[2] = v.v[2];
+    p[3] = v.v[3];
+#endif
+}
+
+/**
+ * Store four floats without reading the destination into the cache, for write-only memory such as mapped
+ *  buffers the GPU reads. The pointer must be 16-byte aligned. Call float4StreamFence once all streamed
+ *  stores are done
+ */
+inline void float4Stream(float* p, Float4 v) {
+#if defined(VRTEST_SIMD_SSE)
+    _mm_stream_ps(p, v);
+#else
+    float4Store(p, v);
+#endif
+}
+
+inline void float4StreamFence() {
+#if defined(VRTEST_SIMD_SSE)
+    _mm_sfence();
+#endif
+}
+
+inline Float4 float4Add(Float4 a, Float4 b) {
+#if defined(VRTEST_SIMD_SSE)
+    return _mm_add_ps(a, b);
+#elif defined(VRTEST_SIMD_NEON)
+    return vaddq_f32(a, b);
+#else
+    return float4Set(a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]);
+#endif
+}
+
+inline Float4 float4Sub(Float4 a, Float4 b) {
+#if defined(VRTEST_SIMD_SSE)
+    return _mm_sub_ps(a, b);
+#elif defined(VRTEST_SIMD_NEON)
+    return vsubq_f32(a, b);
+#else
+    return float4Set(a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3]);
+#endif
+}
+
+inline Float4 float4Mul(Float4 a, Float4 b) {
+#if defined(VRTEST_SIMD_SSE)
+    return _mm_mul_ps(a, b);
+#elif defined(VRTEST_SIMD_NEON)
+    return vmulq_f32(a, b);
+#else
+    return float4Set(a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3]);
+#endif
+}
+
+inline Float4 float4Div(Float4 a, Float4 b) {
+#if defined(VRTEST_SIMD_SSE)
+    return _mm_div_ps(a, b);
+#elif defined(VRTEST_SIMD_NEON) && defined(__aarch64__)
+    return vdivq_f32(a, b);
+#elif defined(VRTEST_SIMD_NEON)
+    // Reciprocal estimate refined twice, close to full precision
+    float32x4_t r = vrecpeq_f32(b);
+    r = vmulq_f32(vrecpsq_f32(b, r), r);
+    r = vmulq_f32(vrecpsq_f32(b, r), r);
+    return vmulq_f32(a, r);
+#else
+    return float4Set(a.v[0] / b.v[0], a.v[1] / b.v[1], a.v[2] / b.v[2], a.v[3] / b.v[3]);
+#endif
+}
+
+inline Float4 float4Min(Float4 a, Float4 b) {
+#if defined(VRTEST_SIMD_SSE)
+    return _mm_min_ps(a, b);
+#elif defined(VRTEST_SIMD_NEON)
+    return vminq_f32(a, b);
+#else
+    return float4Set(a.v[0] < b.v[0] ? a.v[0] : b.v[0], a.v[1] < b.v[1] ? a.v[1] : b.v[1],
+        a.v[2] < b.v[2] ? a.v[2] : b.v[2], a.v[3] < b.v[3] ? a.v[3] : b.v[3]);
+#endif
+}
+
+inline Float4 float4Max(Float4 a, Float4 b) {
+#if defined(VRTEST_SIMD_SSE)
+    return _mm_max_ps(a, b);
+#elif defined(VRTEST_SIMD_NEON)
+    return vmaxq_f32(a, b);
+#else
+    return float4Set(a.v[0] > b.v[0] ? a.v[0] : b.v[0], a.v[1] > b.v[1] ? a.v[1] : b.v[1],
+        a.v[2] > b.v[2] ? a.v[2] : b.v[2], a.v[3] > b.v[3] ? a.v[3] : b.v[3]);
+#endif
+}
+
+/**
+ * a * b + c, fused where the target supports it
+ */
+inline Float4 float4MulAdd(Float4 a, Float4 b, Float4 c) {
+#if defined(VRTEST_SIMD_SSE) && defined(__FMA__)
+    return _mm_fmadd_ps(a, b, c);
+#elif defined(VRTEST_SIMD_SSE)
+    return _mm_add_ps(_mm_mul_ps(a, b), c);
+#elif defined(VRTEST_SIMD_NEON) && defined(__aarch64__)
+    return vfmaq_f32(c, a, b);
+#elif defined(VRTEST_SIMD_NEON)
+    return vmlaq_f32(c, a, b);
+#else
+    return float4Add(float4Mul(a, b), c);
+#endif
+}
+
+/**
+ * Rearrange lanes: lane i of the result is lane I of v, where I is the i-th template argument
+ */
+template <int X, int Y, int Z, int W>
+inline Float4 float4Shuffle(Float4 v) {
+#if defined(VRTEST_SIMD_SSE)
+    return _mm_shuffle_ps(v, v, _MM_SHUFFLE(W, Z, Y, X));
+#elif defined(VRTEST_SIMD_NEON)
+    float values[4];
+    vst1q_f32(values, v);
+    return float4Set(values[X], values[Y], values[Z], values[W]);
+#else
+    return float4Set(v.v[X], v.v[Y], v.v[Z], v.v[W]);
+#endif
+}
+
+/**
+ * Copy one lane to all four
+ */
+template <int I>
+inline Float4 float4SplatLane(Float4 v) {
+#if defined(VRTEST_SIMD_NEON)
+    return vdupq_n_f32(vgetq_lane_f32(v, I));
+#else
+    return float4Shuffle<I, I, I, I>(v);
+#endif
+}
+
+template <int I>
+inline float float4GetLane(Float4 v) {
+#if defined(VRTEST_SIMD_SSE)
+    return _mm_cvtss_f32(float4SplatLane<I>(v));
+#elif defined(VRTEST_SIMD_NEON)
+    return vgetq_lane_f32(v, I);
+#else
+    return v.v[I];
+#endif
+}
+
+/**
+ * Sum of the lanes of a * b
+ */
+inline float float4Dot(Float4 a, Float4 b) {
+    Float4 m = float4Mul(a, b);
+    m = float4Add(m, float4Shuffle<1, 0, 3, 2>(m));
+    m = float4Add(m, float4Shuffle<2, 3, 0, 1>(m));
+    return float4GetLane<0>(m);
+}
+
+/**
+ * Smallest and largest lane
+ */
+inline float float4ReduceMin(Float4 v) {
+    v = float4Min(v, float4Shuffle<1, 0, 3, 2>(v));
+    v = float4Min(v, float4Shuffle<2, 3, 0, 1>(v));
+    return float4GetLane<0>(v);
+}
+
+inline float float4ReduceMax(Float4 v) {
+    v = float4Max(v, float4Shuffle<1, 0, 3, 2>(v));
+    v = float4Max(v, float4Shuffle<2, 3, 0, 1>(v));
+    return float4GetLane<0>(v);
+}
+
+/**
+ * Transpose four registers as the rows of a 4x4 matrix, e.g. to turn one component of four vectors into four
+ *  whole vectors
+ */
+inline void float4Transpose(Float4& a, Float4& b, Float4& c, Float4& d) {
+#if defined(VRTEST_SIMD_SSE)
+    _MM_TRANSPOSE4_PS(a, b, c, d);
+#elif defined(VRTEST_SIMD_NEON)
+    float32x4x2_t ab = vtrnq_f32(a, b);
+    float32x4x2_t cd = vtrnq_f32(c, d);
+    a = vcombine_f32(vget_low_f32(ab.val[0]), vget_low_f32(cd.val[0]));
+    b = vcombine_f32(vget_low_f32(ab.val[1]), vget_low_f32(cd.val[1]));
+    c = vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0]));
+    d = vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1]));
+#else
+    Float4 r0 = float4Set(a.v[0], b.v[0], c.v[0], d.v[0]);
+    Float4 r1 = float4Set(a.v[1], b.v[1], c.v[1], d.v[1]);
+    Float4 r2 = float4Set(a.v[2], b.v[2], c.v[2], d.v[2]);
+    Float4 r3 = float4Set(a.v[3], b.v[3], c.v[3], d.v[3]);
+    a = r0;
+    b = r1;
+    c = r2;
+    d = r3;
+#endif
+}
+
+/**
+ * Three component vector. Kept scalar since a register would waste a lane and need masking; batches of vectors
+ *  are better stored as separate component arrays and processed four at a time
+ */
+struct Vec3 {
+    float x, y, z;
+};
+
+inline Vec3 vec3(float x, float y, float z) {
+    Vec3 r = { x, y, z };
+    return r;
+}
+
+inline Vec3 operator+(const Vec3& a, const Vec3& b) {
+    return vec3(a.x + b.x, a.y + b.y, a.z + b.z);
+}
+
+inline Vec3 operator-(const Vec3& a, const Vec3& b) {
+    return vec3(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+inline Vec3 operator*(const Vec3& a, float s) {
+    return vec3(a.x * s, a.y * s, a.z * s);
+}
+
+inline float dot(const Vec3& a, const Vec3& b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+inline Vec3 cross(const Vec3& a, const Vec3& b) {
+    return vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+inline float length(const Vec3& a) {
+    return sqrtf(dot(a, a));
+}
+
+inline Vec3 normalize(const Vec3& a) {
+    float len = length(a);
+    return len > 0.0f ? a * (1.0f / len) : a;
+}
+
+/**
+ * Four component vector in one register
+ */
+struct Vec4 {
+    Float4 v;
+
+    float x() const { return float4GetLane<0>(v); }
+    float y() const { return float4GetLane<1>(v); }
+    float z() const { return float4GetLane<2>(v); }
+    float w() const { return float4GetLane<3>(v); }
+};
+
+inline Vec4 vec4(float x, float y, float z, float w) {
+    Vec4 r = { float4Set(x, y, z, w) };
+    return r;
+}
+
+inline Vec4 vec4(const Vec3& v, float w) {
+    return vec4(v.x, v.y, v.z, w);
+}
+
+inline Vec4 operator+(const Vec4& a, const Vec4& b) {
+    Vec4 r = { float4Add(a.v, b.v) };
+    return r;
+}
+
+inline Vec4 operator-(const Vec4& a, const Vec4& b) {
+    Vec4 r = { float4Sub(a.v, b.v) };
+    return r;
+}
+
+inline Vec4 operator*(const Vec4& a, float s) {
+    Vec4 r = { float4Mul(a.v, float4Splat(s)) };
+    return r;
+}
+
+inline float dot(const Vec4& a, const Vec4& b) {
+    return float4Dot(a.v, b.v);
+}
+
+/**
+ * Rotation as a unit quaternion, lanes (x, y, z, w) like Pose::orientation
+ */
+struct Quat {
+    Float4 v;
+};
+
+inline Quat quatIdentity() {
+    Quat r = { float4Set(0.0f, 0.0f, 0.0f, 1.0f) };
+    return r;
+}
+
+inline Quat quat(float x, float y, float z, float w) {
+    Quat r = { float4Set(x, y, z, w) };
+    return r;
+}
+
+/**
+ * @param axis unit rotation axis
+ * @param angle radians, counterclockwise looking down the axis
+ */
+inline Quat quatFromAxisAngle(const Vec3& axis, float angle) {
+    float s = sinf(angle * 0.5f);
+    return quat(axis.x * s, axis.y * s, axis.z * s, cosf(angle * 0.5f));
+}
+
+/**
+ * Rotation by b followed by a
+ */
+inline Quat operator*(const Quat& a, const Quat& b) {
+    // Each row of the Hamilton product is one lane of a times a signed permutation of b
+    Float4 r = float4Mul(float4SplatLane<3>(a.v), b.v);
+    r = float4MulAdd(float4SplatLane<0>(a.v), float4Mul(float4Shuffle<3, 2, 1, 0>(b.v),
+        float4Set(1.0f, -1.0f, 1.0f, -1.0f)), r);
+    r = float4MulAdd(float4SplatLane<1>(a.v), float4Mul(float4Shuffle<2, 3, 0, 1>(b.v),
+        float4Set(1.0f, 1.0f, -1.0f, -1.0f)), r);
+    r = float4MulAdd(float4SplatLane<2>(a.v), float4Mul(float4Shuffle<1, 0, 3, 2>(b.v),
+        float4Set(-1.0f, 1.0f, 1.0f, -1.0f)), r);
+    Quat q = { r };
+    return q;
+}
+
+inline Quat normalize(const Quat& q) {
+    float len = sqrtf(float4Dot(q.v, q.v));
+    Quat r = { len > 0.0f ? float4Mul(q.v, float4Splat(1.0f / len)) : q.v };
+    return r;
+}
+
+inline Vec3 rotate(const Quat& q, const Vec3& v) {
+    Vec3 u = vec3(float4GetLane<0>(q.v), float4GetLane<1>(q.v), float4GetLane<2>(q.v));
+    float w = float4GetLane<3>(q.v);
+    Vec3 t = cross(u, v) * 2.0f;
+    return v + t * w + cross(u, t);
+}
+
+/**
+ * Column major 4x4 matrix, laid out like the matrices passed to shaders
+ */
+struct Mat4 {
+    Float4 cols[4];
+};
+
+inline Mat4 mat4Identity() {
+    Mat4 m;
+    m.cols[0] = float4Set(1.0f, 0.0f, 0.0f, 0.0f);
+    m.cols[1] = float4Set(0.0f, 1.0f, 0.0f, 0.0f);
+    m.cols[2] = float4Set(0.0f, 0.0f, 1.0f, 0.0f);
+    m.cols[3] = float4Set(0.0f, 0.0f, 0.0f, 1.0f);
+    return m;
+}
+
+/**
+ * @param values 16 floats, column major
+ */
+inline Mat4 mat4Load(const float* values) {
+    Mat4 m;
+    for (uint32_t i = 0; i < 4; i++) {
+        m.cols[i] = float4Load(values + 4 * i);
+    }
+    return m;
+}
+
+/**
+ * @param values [output] 16 floats, column major
+ */
+inline void mat4Store(float* values, const Mat4& m) {
+    for (uint32_t i = 0; i < 4; i++) {
+        float4Store(values + 4 * i, m.cols[i]);
+    }
+}
+
+/**
+ * Store with float4Stream. The destination must be 16-byte aligned
+ */
+inline void mat4Stream(float* values, const Mat4& m) {
+    for (uint32_t i = 0; i < 4; i++) {
+        float4Stream(values + 4 * i, m.cols[i]);
+    }
+}
+
+inline Vec4 operator*(const Mat4& m, const Vec4& v) {
+    Float4 r = float4Mul(m.cols[0], float4SplatLane<0>(v.v));
+    r = float4MulAdd(m.cols[1], float4SplatLane<1>(v.v), r);
+    r = float4MulAdd(m.cols[2], float4SplatLane<2>(v.v), r);
+    r = float4MulAdd(m.cols[3], float4SplatLane<3>(v.v), r);
+    Vec4 result = { r };
+    return result;
+}
+
+inline Mat4 operator*(const Mat4& a, const Mat4& b) {
+    Mat4 r;
+#if defined(VRTEST_SIMD_AVX)
+    // Two columns of the result per register: each half multiplies a by one column of b
+    __m256 a0 = _mm256_broadcast_ps(&a.cols[0]);
+    __m256 a1 = _mm256_broadcast_ps(&a.cols[1]);
+    __m256 a2 = _mm256_broadcast_ps(&a.cols[2]);
+    __m256 a3 = _mm256_broadcast_ps(&a.cols[3]);
+    for (uint32_t i = 0; i < 4; i += 2) {
+        __m256 bb = _mm256_insertf128_ps(_mm256_castps128_ps256(b.cols[i]), b.cols[i + 1], 1);
+        __m256 c = _mm256_mul_ps(a0, _mm256_permute_ps(bb, 0x00));
+        c = _mm256_add_ps(c, _mm256_mul_ps(a1, _mm256_permute_ps(bb, 0x55)));
+        c = _mm256_add_ps(c, _mm256_mul_ps(a2, _mm256_permute_ps(bb, 0xAA)));
+        c = _mm256_add_ps(c, _mm256_mul_ps(a3, _mm256_permute_ps(bb, 0xFF)));
+        r.cols[i] = _mm256_castps256_ps128(c);
+        r.cols[i + 1] = _mm256_extractf128_ps(c, 1);
+    }
+#else
+    for (uint32_t i = 0; i < 4; i++) {
+        Float4 c = float4Mul(a.cols[0], float4SplatLane<0>(b.cols[i]));
+        c = float4MulAdd(a.cols[1], float4SplatLane<1>(b.cols[i]), c);
+        c = float4MulAdd(a.cols[2], float4SplatLane<2>(b.cols[i]), c);
+        c = float4MulAdd(a.cols[3], float4SplatLane<3>(b.cols[i]), c);
+        r.cols[i] = c;
+    }
+#endif
+    return r;
+}
+
+inline Mat4 mat4Transpose(const Mat4& m) {
+    Mat4 r = m;
+    float4Transpose(r.cols[0], r.cols[1], r.cols[2], r.cols[3]);
+    return r;
+}
+
+inline Vec3 transformPoint(const Mat4& m, const Vec3& p) {
+    Vec4 r = m * vec4(p, 1.0f);
+    return vec3(r.x(), r.y(), r.z());
+}
+
+inline Mat4 mat4Translation(const Vec3& t) {
+    Mat4 m = mat4Identity();
+    m.cols[3] = float4Set(t.x, t.y, t.z, 1.0f);
+    return m;
+}
+
+/**
+ * Matrix that scales, then rotates, then translates
+ */
+inline Mat4 mat4FromTRS(const Vec3& t, const Quat& q, const Vec3& s) {
+    float x = float4GetLane<0>(q.v);
+    float y = float4GetLane<1>(q.v);
+    float z = float4GetLane<2>(q.v);
+    float w = float4GetLane<3>(q.v);
+
+    Mat4 m;
+    m.cols[0] = float4Mul(float4Set(1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + w * z),
+        2.0f * (x * z - w * y), 0.0f), float4Splat(s.x));
+    m.cols[1] = float4Mul(float4Set(2.0f * (x * y - w * z), 1.0f - 2.0f * (x * x + z * z),
+        2.0f * (y * z + w * x), 0.0f), float4Splat(s.y));
+    m.cols[2] = float4Mul(float4Set(2.0f * (x * z + w * y), 2.0f * (y * z - w * x),
+        1.0f - 2.0f * (x * x + y * y), 0.0f), float4Splat(s.z));
+    m.cols[3] = float4Set(t.x, t.y, t.z, 1.0f);
+    return m;
+}
@@ -0,0 +1,370 @@
+/** @file VertexFormat.cpp
+*
+* @brief Defines quantized vertex layouts, chosen per mesh at import, and the
+*   encoder that writes vertices in them
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			01/01/2018
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include <math.h>
+#include <string.h>
+
+#include "VertexFormat.h"
+#include "Common.h"
+
+/**
+ * Offsets of each attribute within the encoded defaults
+ */
+#define DEFAULT_NORMAL_TANGENT_OFFSET 0
+#define DEFAULT_COLOR_OFFSET 4
+#define DEFAULT_UV_OFFSET 8
+
+/**
+ * Convert to a half float, rounding to nearest even. Out of range values become infinity
+ */
+static uint16_t floatToHalf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    uint32_t exponent = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    if (exponent == 0xff) {
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+    }
+
+    int32_t half_exponent = static_cast<int32_t>(exponent) - 127 + 15;
+    if (half_exponent >= 0x1f) {
+        return sign | 0x7c00;
+    }
+
+    if (half_exponent <= 0) {
+        // Subnormal half, or zero once shifted out entirely
+        if (half_exponent < -10) {
+            return sign;
+        }
+        mantissa |= 0x800000;
+        uint32_t shift = static_cast<uint32_t>(14 - half_exponent);
+        uint32_t half_mantissa = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half_mantissa & 1))) {
+            half_mantissa++;
+        }
+        return static_cast<uint16_t>(sign | half_mantissa);
+    }
+
+    // A carry out of the mantissa correctly rounds up into the exponent
+    uint32_t half = (static_cast<uint32_t>(half_exponent) << 10) | (mantissa >> 13);
+    uint32_t remainder = mantissa & 0x1fff;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+        half++;
+    }
+    return static_cast<uint16_t>(sign | half);
+}
+
+static float halfToFloat(uint16_t half) {
+    uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+    uint32_t bits;
+
+    if (exponent == 0) {
+        float value = ldexpf(static_cast<float>(mantissa), -24);
+        return sign ? -value : value;
+    }
+    if (exponent == 0x1f) {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    }
+    else {
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static uint16_t floatToUnorm16(float value) {
+    return static_cast<uint16_t>(roundf(MIN(MAX(value, 0.0f), 1.0f) * 65535.0f));
+}
+
+static uint8_t floatToUnorm8(float value) {
+    return static_cast<uint8_t>(roundf(MIN(MAX(value, 0.0f), 1.0f) * 255.0f));
+}
+
+static int8_t floatToSnorm8(float value) {
+    return static_cast<int8_t>(roundf(MIN(MAX(value, -1.0f), 1.0f) * 127.0f));
+}
+
+/**
+ * Map a unit vector onto the octahedron and unfold it into a square, so two components cover the sphere
+ */
+static void encodeOctahedral(const float* direction, float* encoded) {
+    float length = fabsf(direction[0]) + fabsf(direction[1]) + fabsf(direction[2]);
+    if (length == 0.0f) {
+        encoded[0] = 0.0f;
+        encoded[1] = 0.0f;
+        return;
+    }
+
+    float x = direction[0] / length;
+    float y = direction[1] / length;
+    if (direction[2] < 0.0f) {
+        // Fold the lower half over the diagonals
+        float folded_x = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float folded_y = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = folded_x;
+        y = folded_y;
+    }
+    encoded[0] = x;
+    encoded[1] = y;
+}
+
+uint32_t MeshData::getVertexCount() const {
+    return static_cast<uint32_t>(positions.size() / 3);
+}
+
+void VertexFormat::getAttributes(uint32_t binding, uint32_t defaults_binding,
+    std::vector<VkVertexInputAttributeDescription>* attributes) const {
+
+    VkVertexInputAttributeDescription attribute = {};
+    attribute.binding = binding;
+    attribute.location = VERTEX_LOCATION_POSITION;
+    attribute.format = position_format;
+    attribute.offset = position_offset;
+    attributes->push_back(attribute);
+
+    attribute.location = VERTEX_LOCATION_NORMAL_TANGENT;
+    if (normal_tangent_format != VK_FORMAT_UNDEFINED) {
+        attribute.binding = binding;
+        attribute.format = normal_tangent_format;
+        attribute.offset = normal_tangent_offset;
+    }
+    else {
+        attribute.binding = defaults_binding;
+        attribute.format = VK_FORMAT_R8G8B8A8_SNORM;
+        attribute.offset = DEFAULT_NORMAL_TANGENT_OFFSET;
+    }
+    attributes->push_back(attribute);
+
+    attribute.location = VERTEX_LOCATION_COLOR;
+    if (color_format != VK_FORMAT_UNDEFINED) {
+        attribute.binding = binding;
+        attribute.format = color_format;
+        attribute.offset = color_offset;
+    }
+    else {
+        attribute.binding = defaults_binding;
+        attribute.format = VK_FORMAT_R8G8B8A8_UNORM;
+        attribute.offset = DEFAULT_COLOR_OFFSET;
+    }
+    attributes->push_back(attribute);
+
+    attribute.location = VERTEX_LOCATION_UV;
+    if (uv_format != VK_FORMAT_UNDEFINED) {
+        attribute.binding = binding;
+        attribute.format = uv_format;
+        attribute.offset = uv_offset;
+    }
+    else {
+        attribute.binding = defaults_binding;
+        attribute.format = VK_FORMAT_R16G16_SFLOAT;
+        attribute.offset = DEFAULT_UV_OFFSET;
+    }
+    attributes->push_back(attribute);
+}
+
+VertexFormat chooseVertexFormat(const MeshData& mesh, const VertexImportOptions& options) {
+    VertexFormat format;
+    uint32_t vertex_count = mesh.getVertexCount();
+
+    float bounds_min[3] = { 0.0f, 0.0f, 0.0f };
+    float bounds_max[3] = { 0.0f, 0.0f, 0.0f };
+    for (uint32_t i = 0; i < vertex_count; i++) {
+        for (uint32_t c = 0; c < 3; c++) {
+            float value = mesh.positions[i * 3 + c];
+            bounds_min[c] = i == 0 ? value : MIN(bounds_min[c], value);
+            bounds_max[c] = i == 0 ? value : MAX(bounds_max[c], value);
+        }
+    }
+
+    // Measure both 16-bit encodings on the actual vertices: UNORM16 spaces values evenly across the bounds,
+    // while half floats are finer near the center and coarser at the edges
+    float unorm_scale[3];
+    float half_center[3];
+    float half_scale[3];
+    for (uint32_t c = 0; c < 3; c++) {
+        float extent = bounds_max[c] - bounds_min[c];
+        unorm_scale[c] = extent > 0.0f ? extent : 1.0f;
+        half_center[c] = 0.5f * (bounds_min[c] + bounds_max[c]);
+        half_scale[c] = extent > 0.0f ? 0.5f * extent : 1.0f;
+    }
+
+    float unorm_error = 0.0f;
+    float half_error = 0.0f;
+    for (uint32_t i = 0; i < vertex_count * 3; i++) {
+        uint32_t c = i % 3;
+        float value = mesh.positions[i];
+
+        float unorm = floatToUnorm16((value - bounds_min[c]) / unorm_scale[c]) / 65535.0f;
+        unorm_error = MAX(unorm_error, fabsf(bounds_min[c] + unorm * unorm_scale[c] - value));
+
+        float half = halfToFloat(floatToHalf((value - half_center[c]) / half_scale[c]));
+        half_error = MAX(half_error, fabsf(half_center[c] + half * half_scale[c] - value));
+    }
+
+    format.decode_scale[3] = 1.0f;
+    format.decode_offset[3] = 0.0f;
+    if (options.full_precision || MIN(unorm_error, half_error) > options.position_tolerance) {
+        format.position_format = VK_FORMAT_R32G32B32A32_SFLOAT;
+        for (uint32_t c = 0; c < 3; c++) {
+            format.decode_scale[c] = 1.0f;
+            format.decode_offset[c] = 0.0f;
+        }
+    }
+    else if (unorm_error <= half_error) {
+        format.position_format = VK_FORMAT_R16G16B16A16_UNORM;
+        for (uint32_t c = 0; c < 3; c++) {
+            format.decode_scale[c] = unorm_scale[c];
+            format.decode_offset[c] = bounds_min[c];
+        }
+
+        // The bitangent sign is stored as 0 or 1
+        format.decode_scale[3] = 2.0f;
+        format.decode_offset[3] = -1.0f;
+    }
+    else {
+        format.position_format = VK_FORMAT_R16G16B16A16_SFLOAT;
+        for (uint32_t c = 0; c < 3; c++) {
+            format.decode_scale[c] = half_scale[c];
+            format.decode_offset[c] = half_center[c];
+        }
+    }
+    format.position_offset = 0;
+    format.stride = format.position_format == VK_FORMAT_R32G32B32A32_SFLOAT ? 16 : 8;
+
+    if (!mesh.normals.empty()) {
+        format.normal_tangent_format = VK_FORMAT_R8G8B8A8_SNORM;
+        format.normal_tangent_offset = format.stride;
+        format.stride += 4;
+    }
+
+    if (!mesh.colors.empty()) {
+        format.color_format = VK_FORMAT_R8G8B8A8_UNORM;
+        format.color_offset = format.stride;
+        format.stride += 4;
+    }
+
+    if (!mesh.uvs.empty()) {
+        float uv_error = 0.0f;
+        for (float value : mesh.uvs) {
+            uv_error = MAX(uv_error, fabsf(halfToFloat(floatToHalf(value)) - value));
+        }
+
+        bool half = !options.full_precision && uv_error <= options.uv_tolerance;
+        format.uv_format = half ? VK_FORMAT_R16G16_SFLOAT : VK_FORMAT_R32G32_SFLOAT;
+        format.uv_offset = format.stride;
+        format.stride += half ? 4 : 8;
+    }
+
+    return format;
+}
+
+void encodeVertices(const MeshData& mesh, const VertexFormat& format, void* output) {
+    uint32_t vertex_count = mesh.getVertexCount();
+    bool has_tangents = !mesh.tangents.empty();
+
+    for (uint32_t i = 0; i < vertex_count; i++) {
+        uint8_t* vertex = static_cast<uint8_t*>(output) + format.stride * i;
+        const float* position = &mesh.positions[i * 3];
+        float sign = has_tangents && mesh.tangents[i * 4 + 3] < 0.0f ? -1.0f : 1.0f;
+
+        // Invert the decode: stored = (value - offset) / scale
+        float stored[4];
+        for (uint32_t c = 0; c < 4; c++) {
+            float value = c < 3 ? position[c] : sign;
+            stored[c] = (value - format.decode_offset[c]) / format.decode_scale[c];
+        }
+
+        if (format.position_format == VK_FORMAT_R16G16B16A16_UNORM) {
+            uint16_t* out = reinterpret_cast<uint16_t*>(vertex + format.position_offset);
+            for (uint32_t c = 0; c < 4; c++) {
+                out[c] = floatToUnorm16(stored[c]);
+            }
+        }
+        else if (format.position_format == VK_FORMAT_R16G16B16A16_SFLOAT) {
+            uint16_t* out = reinterpret_cast<uint16_t*>(vertex + format.position_offset);
+            for (uint32_t c = 0; c < 4; c++) {
+                out[c] = floatToHalf(stored[c]);
+            }
+        }
+        else {
+            memcpy(vertex + format.position_offset, stored, sizeof(stored));
+        }
+
+        if (format.normal_tangent_format != VK_FORMAT_UNDEFINED) {
+            // Without tangents, any direction perpendicular to the normal will do
+            float tangent[3];
+            const float* normal = &mesh.normals[i * 3];
+            if (has_tangents) {
+                memcpy(tangent, &mesh.tangents[i * 4], sizeof(tangent));
+            }
+            else if (fabsf(normal[0]) < 0.9f) {
+                float length = sqrtf(normal[1] * normal[1] + normal[2] * normal[2]);
+                tangent[0] = 0.0f;
+                tangent[1] = normal[2] / length;
+                tangent[2] = -normal[1] / length;
+            }
+            else {
+                float length = sqrtf(normal[0] * normal[0] + normal[2] * normal[2]);
+                tangent[0] = -normal[2] / length;
+                tangent[1] = 0.0f;
+                tangent[2] = normal[0] / length;
+            }
+
+            float encoded[4];
+            encodeOctahedral(normal, encoded);
+            encodeOctahedral(tangent, encoded + 2);
+
+            int8_t* out = reinterpret_cast<int8_t*>(vertex + format.normal_tangent_offset);
+            for (uint32_t c = 0; c < 4; c++) {
+                out[c] = floatToSnorm8(encoded[c]);
+            }
+        }
+
+        if (format.color_format != VK_FORMAT_UNDEFINED) {
+            uint8_t* out = vertex + format.color_offset;
+            for (uint32_t c = 0; c < 4; c++) {
+                out[c] = floatToUnorm8(mesh.colors[i * 4 + c]);
+            }
+        }
+
+        if (format.uv_format == VK_FORMAT_R16G16_SFLOAT) {
+            uint16_t* out = reinterpret_cast<uint16_t*>(vertex + format.uv_offset);
+            out[0] = floatToHalf(mesh.uvs[i * 2]);
+            out[1] = floatToHalf(mesh.uvs[i * 2 + 1]);
+        }
+        else if (format.uv_format == VK_FORMAT_R32G32_SFLOAT) {
+            memcpy(vertex + format.uv_offset, &mesh.uvs[i * 2], sizeof(float) * 2);
+        }
+    }
+}
+
+void encodeVertexDefaults(void* output) {
+    uint8_t* defaults = static_cast<uint8_t*>(output);
+    memset(defaults, 0, VERTEX_DEFAULTS_SIZE);
+
+    // +z encodes to the center of the octahedral square, and +x to its right edge
+    int8_t normal_tangent[4] = { 0, 0, 127, 0 };
+    memcpy(defaults + DEFAULT_NORMAL_TANGENT_OFFSET, normal_tangent, sizeof(normal_tangent));
+
+    uint8_t color[4] = { 255, 255, 255, 255 };
+    memcpy(defaults + DEFAULT_COLOR_OFFSET, color, sizeof(color));
+
+    // Zero texture coordinates are zero half floats, already cleared
+}
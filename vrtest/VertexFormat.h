@@ -0,0 +1,148 @@
+/** @file VertexFormat.h
+*
+* @brief Defines quantized vertex layouts, chosen per mesh at import, and the
+*   encoder that writes vertices in them
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			01/01/2018
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Vertex shader input locations of default.vert. Locations 2 to 5 hold the per instance world matrix
+ */
+#define VERTEX_LOCATION_POSITION 0
+#define VERTEX_LOCATION_COLOR 1
+#define VERTEX_LOCATION_NORMAL_TANGENT 6
+#define VERTEX_LOCATION_UV 7
+
+/**
+ * Size of the encoded defaults read by attributes a mesh doesn't have
+ */
+#define VERTEX_DEFAULTS_SIZE 16
+
+/**
+ * Mesh as imported, before encoding. Every attribute but the position is optional: leave its array empty
+ */
+struct MeshData {
+    /**
+     * Three floats per vertex
+     */
+    std::vector<float> positions;
+
+    /**
+     * Three floats per vertex, unit length
+     */
+    std::vector<float> normals;
+
+    /**
+     * Four floats per vertex: unit length direction, and the bitangent sign in w. Only used with normals
+     */
+    std::vector<float> tangents;
+
+    /**
+     * Four floats per vertex in [0, 1]
+     */
+    std::vector<float> colors;
+
+    /**
+     * Two floats per vertex
+     */
+    std::vector<float> uvs;
+
+    /**
+     * Three per triangle
+     */
+    std::vector<uint32_t> indices;
+
+    uint32_t getVertexCount() const;
+};
+
+/**
+ * Error a mesh may pick up from quantization
+ */
+struct VertexImportOptions {
+    /**
+     * Largest position error, in mesh units. Positions fall back to 32-bit floats above it
+     */
+    float position_tolerance = 1e-4f;
+
+    /**
+     * Largest texture coordinate error. Half texels of a 1024 texture by default
+     */
+    float uv_tolerance = 1.0f / 2048.0f;
+
+    /**
+     * Keep positions and texture coordinates as 32-bit floats, e.g. to measure what quantization saves
+     */
+    bool full_precision = false;
+};
+
+/**
+ * Layout of one mesh's vertices, interleaved in one binding:
+ *  - position: R16G16B16A16_UNORM across the mesh bounds, R16G16B16A16_SFLOAT around the bounds center scaled
+ *    to [-1, 1], or R32G32B32A32_SFLOAT. Its w holds the bitangent sign
+ *  - normal and tangent: both octahedral encoded into R8G8B8A8_SNORM
+ *  - color: R8G8B8A8_UNORM
+ *  - uv: R16G16_SFLOAT, or R32G32_SFLOAT when half floats aren't precise enough
+ * The position decode is a multiply-add with per mesh constants, so the shader doesn't depend on the layout.
+ *  Attributes the mesh doesn't have are VK_FORMAT_UNDEFINED and read a default value instead
+ */
+struct VertexFormat {
+    VkFormat position_format = VK_FORMAT_UNDEFINED;
+    VkFormat normal_tangent_format = VK_FORMAT_UNDEFINED;
+    VkFormat color_format = VK_FORMAT_UNDEFINED;
+    VkFormat uv_format = VK_FORMAT_UNDEFINED;
+
+    uint32_t position_offset = 0;
+    uint32_t normal_tangent_offset = 0;
+    uint32_t color_offset = 0;
+    uint32_t uv_offset = 0;
+    uint32_t stride = 0;
+
+    /**
+     * Decoded value of the position attribute is stored * decode_scale + decode_offset: xyz is the position in
+     *  mesh units and w the bitangent sign
+     */
+    float decode_scale[4];
+    float decode_offset[4];
+
+    /**
+     * Get the vertex input state for this layout
+     * @param binding binding of the vertex buffer
+     * @param defaults_binding binding of the encoded defaults, which must have a stride of 0
+     * @param attributes [output] appended with one attribute per shader input
+     */
+    void getAttributes(uint32_t binding, uint32_t defaults_binding,
+        std::vector<VkVertexInputAttributeDescription>* attributes) const;
+};
+
+/**
+ * Choose the smallest layout that keeps a mesh within the import tolerances
+ * @param mesh mesh to encode
+ * @param options largest errors allowed
+ * @return layout with decode constants for the mesh's bounds
+ */
+VertexFormat chooseVertexFormat(const MeshData& mesh, const VertexImportOptions& options);
+
+/**
+ * Encode a mesh's vertices
+ * @param mesh mesh to encode
+ * @param format layout chosen for the mesh
+ * @param output [output] destination of format.stride * vertex count bytes
+ */
+void encodeVertices(const MeshData& mesh, const VertexFormat& format, void* output);
+
+/**
+ * Write the values read by attributes a mesh doesn't have: a +z normal with a +x tangent, opaque white and
+ *  zero texture coordinates
+ * @param output [output] destination of VERTEX_DEFAULTS_SIZE bytes
+ */
+void encodeVertexDefaults(void* output);
@@ -0,0 +1,335 @@
+/** @file WindowPresentationEngine.cpp
+*
+* @brief Defines presentation engine that displays images in a desktop window
+*   through a Vulkan swapchain
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/14/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+
+#include <stdexcept>
+#include <vector>
+#include <iostream>
+
+#include "WindowPresentationEngine.h"
+#include "Common.h"
+
+WindowPresentationEngine::WindowPresentationEngine(uint32_t resolution_x, uint32_t resolution_y,
+    VkAllocationCallbacks* p_allocs, const char* app_name)
+    : PresentationEngine(resolution_x, resolution_y, p_allocs, app_name) {
+
+    glfwInit();
+
+    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+    window = glfwCreateWindow(resolution_x, resolution_y, "VR Test", nullptr, nullptr);
+}
+
+WindowPresentationEngine::~WindowPresentationEngine() {
+    destroyImageViews();
+    for (unsigned int i = 0; i < sc_image_count; i++) {
+        vkDestroySemaphore(device, image_ready_semaphores[i], p_allocs);
+        vkDestroySemaphore(device, frame_done_semaphores[i], p_allocs);
+    }
+
+    vkDestroySwapchainKHR(device, swapchain, p_allocs);
+    vkDestroySurfaceKHR(instance, win_surface, p_allocs);
+
+    glfwDestroyWindow(window);
+    glfwTerminate();
+
+    delete[] image_ready_semaphores;
+    delete[] frame_done_semaphores;
+}
+
+bool WindowPresentationEngine::shouldExit() {
+    return glfwWindowShouldClose(window);
+}
+
+void WindowPresentationEngine::pollEvents() {
+    glfwPollEvents();
+}
+
+void WindowPresentationEngine::createSwapchain(VkPhysicalDevice physical_device, VkDevice device, int gfx_queue_family,
+    int present_queue_family) {
+    if (!win_surface) {
+        throw std::runtime_error("Surface must be created before calling createSwapchain");
+    }
+
+    this->device = device;
+
+    // Query surface for capabilities
+    VkSurfaceCapabilitiesKHR surface_caps;
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device, win_surface, &surface_caps);
+
+    uint32_t min_images;
+    if (surface_caps.maxImageCount == 0)
+        min_images = surface_caps.minImageCount + 1;
+    else
+        min_images = MIN(surface_caps.minImageCount + 1, surface_caps.maxImageCount);
+
+    sc_extent.width = MAX(surface_caps.minImageExtent.width, MIN(surface_caps.maxImageExtent.width, resolution_x));
+    sc_extent.height = MAX(surface_caps.minImageExtent.height, MIN(surface_caps.maxImageExtent.height, resolution_y));
+
+    // Query surface for supported formats
+    uint32_t format_count;
+    vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device, win_surface, &format_count, nullptr);
+    std::vector<VkSurfaceFormatKHR> available_formats(format_count);
+    vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device, win_surface, &format_count, available_formats.data());
+
+    // Choose image format for presentation, default is first
+    sc_format = available_formats[0].format;
+    sc_color_space = available_formats[0].colorSpace;
+    for (const auto& format : available_formats) {
+        // try to choose an sRGB format
+        if (format.format == VK_FORMAT_R8G8B8A8_SRGB ||
+            format.format == VK_FORMAT_R8G8B8_SRGB ||
+            format.format == VK_FORMAT_B8G8R8A8_SRGB ||
+            format.format == VK_FORMAT_B8G8R8_SRGB) {
+
+            sc_format = format.format;
+            sc_color_space = format.colorSpace;
+            sc_is_srgb = true;
+        }
+    }
+
+    // Query the surface for supported presentation modes
+    uint32_t mode_count;
+    vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, win_surface, &mode_count, nullptr);
+    std::vector<VkPresentModeKHR> available_modes(mode_count);
+    vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, win_surface, &mode_count, available_modes.data());
+
+    // Choose presentation mode, default is first
+    VkPresentModeKHR sc_present_mode = VK_PRESENT_MODE_FIFO_KHR;
+    for (const auto& mode : available_modes) {
+        if (mode == VK_PRESENT_MODE_MAILBOX_KHR)
+            sc_present_mode = mode;
+    }
+    // Allow copying from the images where supported, so frames can be captured
+    sc_usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+        (surface_caps.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+
+    // Define parameters for swapchain creation
+    VkSwapchainCreateInfoKHR swapchain_ci = {};
+    swapchain_ci.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+    swapchain_ci.flags = 0;
+    swapchain_ci.surface = win_surface;
+    swapchain_ci.minImageCount = min_images;
+    swapchain_ci.imageFormat = sc_format;
+    swapchain_ci.imageColorSpace = sc_color_space;
+    swapchain_ci.imageExtent = sc_extent;
+    swapchain_ci.imageArrayLayers = 1;
+    swapchain_ci.imageUsage = sc_usage;
+    swapchain_ci.preTransform = surface_caps.currentTransform;
+    swapchain_ci.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+    swapchain_ci.presentMode = sc_present_mode;
+    swapchain_ci.clipped = VK_TRUE;
+    swapchain_ci.oldSwapchain = VK_NULL_HANDLE;
+
+    // Swapchain queue ownership properties
+    if (gfx_queue_family == present_queue_family) {
+        swapchain_ci.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        swapchain_ci.queueFamilyIndexCount = 0;
+        swapchain_ci.pQueueFamilyIndices = nullptr;
+    }
+    else {
+        uint32_t families[2];
+        families[0] = static_cast<uint32_t>(gfx_queue_family);
+        families[1] = static_cast<uint32_t>(present_queue_family);
+        swapchain_ci.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+        swapchain_ci.queueFamilyIndexCount = 2;
+        swapchain_ci.pQueueFamilyIndices = families;
+    }
+
+    // Create the swapchain
+    if (vkCreateSwapchainKHR(device, &swapchain_ci, p_allocs, &swapchain) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create swapchain");
+    }
+
+#ifdef VK_GOOGLE_display_timing
+    if (display_timing) {
+        get_past_timing = (PFN_vkGetPastPresentationTimingGOOGLE)vkGetDeviceProcAddr(device,
+            "vkGetPastPresentationTimingGOOGLE");
+        get_refresh_duration = (PFN_vkGetRefreshCycleDurationGOOGLE)vkGetDeviceProcAddr(device,
+            "vkGetRefreshCycleDurationGOOGLE");
+        display_timing = get_past_timing != nullptr && get_refresh_duration != nullptr;
+    }
+#endif
+
+    // Get the array of swapchain images
+    vkGetSwapchainImagesKHR(device, swapchain, &sc_image_count, nullptr);
+    sc_images = new VkImage[sc_image_count];
+    vkGetSwapchainImagesKHR(device, swapchain, &sc_image_count, sc_images);
+
+    std::cout << "Swapchain created" << std::endl;
+    std::cout << "\tImage count: " << sc_image_count << std::endl;
+    std::cout << "\tExtent: " << sc_extent.width << " x " << sc_extent.height << std::endl;
+    std::cout << "\tFormat: " << sc_format << std::endl;
+    std::cout << "\tColor space: " << sc_color_space << std::endl;
+
+    createImageViews();
+
+    // Create semaphores and fences used for swapchain/application synchronization
+    VkSemaphoreCreateInfo semaphore_ci = {};
+    semaphore_ci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphore_ci.flags = 0;
+
+    image_ready_semaphores = new VkSemaphore[sc_image_count];
+    frame_done_semaphores = new VkSemaphore[sc_image_count];
+    for (uint32_t i = 0; i < sc_image_count; i++) {
+        if (vkCreateSemaphore(device, &semaphore_ci, p_allocs, &(image_ready_semaphores[i])) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create sephamore");
+        }
+        if (vkCreateSemaphore(device, &semaphore_ci, p_allocs, &(frame_done_semaphores[i])) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create sephamore");
+        }
+    }
+}
+
+int WindowPresentationEngine::getNextSwapchainImage(VkSemaphore** wait_sem, VkSemaphore** signal_sem) {
+    // Get image from swapchain to use in framebuffer
+    uint32_t sc_index;
+    VkResult sc_result = vkAcquireNextImageKHR(device, swapchain, 0, image_ready_semaphores[acquire_sem_index],
+        VK_NULL_HANDLE, &sc_index);
+    if (sc_result == VK_NOT_READY) {
+        // Image not ready, exit early
+        return -1;
+    }
+    else if (sc_result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to acquire next image from swapchain");
+    }
+
+    *wait_sem = &(image_ready_semaphores[acquire_sem_index]);
+    *signal_sem = &(frame_done_semaphores[acquire_sem_index]);
+
+    // Images are presented in the order they are acquired, so presents use the pairs in the same order
+    acquire_sem_index++;
+    if (acquire_sem_index == sc_image_count) {
+        acquire_sem_index = 0;
+    }
+    return static_cast<int>(sc_index);
+}
+
+void WindowPresentationEngine::presentSwapchainImage(int image_index, VkQueue present_queue)
+{
+    uint32_t sc_index = static_cast<uint32_t>(image_index);
+
+    // Present image back to swapchain
+    VkPresentInfoKHR present_info = {};
+    present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    present_info.waitSemaphoreCount = 1;
+    present_info.pWaitSemaphores = &(frame_done_semaphores[present_sem_index]);
+    present_info.swapchainCount = 1;
+    present_info.pSwapchains = &swapchain;
+    present_info.pImageIndices = &sc_index;
+    present_info.pResults = nullptr;
+
+#ifdef VK_GOOGLE_display_timing
+    // Tag the present so its display time is reported. No desired time: frames are paced on the CPU
+    VkPresentTimeGOOGLE present_time = {};
+    present_time.presentID = next_present_id++;
+    present_time.desiredPresentTime = 0;
+
+    VkPresentTimesInfoGOOGLE present_times = {};
+    present_times.sType = VK_STRUCTURE_TYPE_PRESENT_TIMES_INFO_GOOGLE;
+    present_times.swapchainCount = 1;
+    present_times.pTimes = &present_time;
+
+    if (display_timing) {
+        present_info.pNext = &present_times;
+    }
+#endif
+
+    if (vkQueuePresentKHR(present_queue, &present_info) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to present swapchain image");
+    }
+
+    // Cycle to next semaphore set
+    present_sem_index++;
+    if (present_sem_index == sc_image_count) {
+        present_sem_index = 0;
+    }
+}
+
+void WindowPresentationEngine::enableDisplayTiming() {
+#ifdef VK_GOOGLE_display_timing
+    display_timing = true;
+#endif
+}
+
+uint32_t WindowPresentationEngine::getPastPresentTimes(double* times, uint32_t max_count) {
+#ifdef VK_GOOGLE_display_timing
+    if (!display_timing) {
+        return 0;
+    }
+
+    VkPastPresentationTimingGOOGLE timings[16];
+    uint32_t count = MIN(max_count, 16u);
+    VkResult result = get_past_timing(device, swapchain, &count, timings);
+    if (result != VK_SUCCESS && result != VK_INCOMPLETE) {
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        times[i] = timings[i].actualPresentTime / 1000000000.0;
+    }
+    return count;
+#else
+    return 0;
+#endif
+}
+
+double WindowPresentationEngine::getRefreshInterval() {
+#ifdef VK_GOOGLE_display_timing
+    if (display_timing) {
+        VkRefreshCycleDurationGOOGLE refresh;
+        if (get_refresh_duration(device, swapchain, &refresh) == VK_SUCCESS && refresh.refreshDuration > 0) {
+            return refresh.refreshDuration / 1000000000.0;
+        }
+    }
+#endif
+
+    // The window isn't fullscreen, so assume it is on the primary monitor
+    GLFWmonitor* monitor = glfwGetPrimaryMonitor();
+    const GLFWvidmode* mode = monitor ? glfwGetVideoMode(monitor) : nullptr;
+    if (mode && mode->refreshRate > 0) {
+        return 1.0 / mode->refreshRate;
+    }
+
+    return 1.0 / 60.0;
+}
+
+VkSurfaceKHR WindowPresentationEngine::getPresentSurface(VkInstance instance) {
+    if (win_surface)
+        return win_surface;
+
+    this->instance = instance;
+
+    if (glfwCreateWindowSurface(instance, window, p_allocs, &win_surface) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create window surface");
+    }
+
+    return win_surface;
+}
+
+const char** WindowPresentationEngine::getRequiredExtensions(uint32_t* extension_count) {
+    const char** glfw_extensions;
+    glfw_extensions = glfwGetRequiredInstanceExtensions(extension_count);
+
+    return glfw_extensions;
+}
+
+
+const char** WindowPresentationEngine::getRequiredDeviceExtensions(uint32_t* extension_count) {
+    static const char* device_extensions[] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+
+    *extension_count = 1;
+    return device_extensions;
+}
+
+VkImageLayout WindowPresentationEngine::getPresentLayout() {
+    return VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+}
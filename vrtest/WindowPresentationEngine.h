@@ -0,0 +1,118 @@
+/** @file WindowPresentationEngine.h
+*
+* @brief Defines presentation engine that displays images in a desktop window
+*   through a Vulkan swapchain
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/14/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <vulkan/vulkan.h>
+#include <stdint.h>
+
+#include "PresentationEngine.h"
+
+class WindowPresentationEngine : public PresentationEngine {
+private:
+    /**
+     * Window handle
+     */
+    GLFWwindow* window = nullptr;
+
+    /**
+     * Vulkan surface handle of the presentation engine
+     */
+    VkSurfaceKHR win_surface = nullptr;
+
+    /**
+     * Whether the swapchain format is sRGB
+     */
+    bool sc_is_srgb;
+
+    /**
+     * Color space of swapchain images
+     */
+    VkColorSpaceKHR sc_color_space;
+
+    /**
+     * Vulkan swapchain handle
+     */
+    VkSwapchainKHR swapchain;
+
+    /**
+    * Semaphores signaled when the swapchain image has been released by the
+    * presentation engine
+    */
+    VkSemaphore* image_ready_semaphores;
+
+    /**
+    * Semephores to signal when rendering to a swapchain image is complete
+    */
+    VkSemaphore* frame_done_semaphores;
+
+    /**
+    * Index of the semaphore pair given to the next acquire, and of the pair the next present waits on. They differ
+    * when the next frame's image is acquired before the current one is presented
+    */
+    uint32_t acquire_sem_index = 0;
+    uint32_t present_sem_index = 0;
+
+    /**
+     * Whether presents are tagged so their actual display times can be queried through VK_GOOGLE_display_timing
+     */
+    bool display_timing = false;
+
+    /**
+     * ID given to the next present when display timing is enabled
+     */
+    uint32_t next_present_id = 1;
+
+#ifdef VK_GOOGLE_display_timing
+    /**
+     * Display timing entry points, loaded when the swapchain is created
+     */
+    PFN_vkGetPastPresentationTimingGOOGLE get_past_timing = nullptr;
+    PFN_vkGetRefreshCycleDurationGOOGLE get_refresh_duration = nullptr;
+#endif
+
+public:
+    /**
+     * Open a window to present to
+     * @param resolution_x: Requested resolution in x dimension. Actual resolution may vary.
+     * @param resolution_y: Requested resolution in y dimension. Actual resolution may vary.
+     * @param p_allocs: Allocation callbacks used for Vulkan calls, or nullptr
+     * @param app_name: Name of the application to display
+     */
+    WindowPresentationEngine(uint32_t resolution_x, uint32_t resolution_y, VkAllocationCallbacks* p_allocs,
+        const char* app_name);
+
+    /**
+     * Destructor
+     */
+    ~WindowPresentationEngine();
+
+    bool shouldExit();
+    void pollEvents();
+    void createSwapchain(VkPhysicalDevice physical_device, VkDevice device, int gfx_queue_family,
+        int present_queue_family);
+    int getNextSwapchainImage(VkSemaphore** wait_sem, VkSemaphore** signal_sem);
+    void presentSwapchainImage(int image_index, VkQueue present_queue);
+    VkSurfaceKHR getPresentSurface(VkInstance instance);
+    const char** getRequiredExtensions(uint32_t* extension_count);
+    const char** getRequiredDeviceExtensions(uint32_t* extension_count);
+    VkImageLayout getPresentLayout();
+    void enableDisplayTiming();
+    uint32_t getPastPresentTimes(double* times, uint32_t max_count);
+
+    /**
+     * Get the refresh interval from display timing if enabled, or from the monitor's video mode
+     * @return refresh interval in seconds
+     */
+    double getRefreshInterval();
+};
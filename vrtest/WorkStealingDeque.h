@@ -0,0 +1,136 @@
+/** @file WorkStealingDeque.h
+*
+* @brief Defines a bounded lock-free deque that one owner thread pushes and
+*   pops at the bottom while other threads steal from the top
+*
+* Copyright 2017, Stewart Hall
+*
+* @author		Stewart Hall (www.stewartghall.com)
+* @date			12/26/2017
+* @copyright	Copyright 2017, Stewart Hall
+*/
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+#include "Common.h"
+
+/**
+ * Chase-Lev deque with a fixed power of two capacity. The owner works LIFO at the bottom, which keeps recently
+ *  pushed work hot in its cache, while thieves take the oldest entries from the top. Only a steal racing the owner
+ *  for the last entry needs a compare and swap. Values must be trivially copyable, e.g. pointers. The indexes are
+ *  padded onto cache lines of their own rather than aligned, so the deque can be allocated with plain new before
+ *  C++17
+ */
+template <typename T>
+class WorkStealingDeque {
+private:
+    std::atomic<T>* slots;
+    int64_t mask;
+    char top_padding[CACHE_LINE_SIZE];
+
+    /**
+     * Next entry to steal, advanced by thieves and by the owner taking the last entry
+     */
+    std::atomic<int64_t> top;
+    char bottom_padding[CACHE_LINE_SIZE];
+
+    /**
+     * One past the newest entry, written only by the owner
+     */
+    std::atomic<int64_t> bottom;
+    char end_padding[CACHE_LINE_SIZE];
+
+public:
+    /**
+     * @param capacity maximum number of entries, rounded up to a power of two
+     */
+    explicit WorkStealingDeque(uint32_t capacity) : top(0), bottom(0) {
+        int64_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        slots = new std::atomic<T>[static_cast<size_t>(size)];
+        mask = size - 1;
+    }
+
+    ~WorkStealingDeque() {
+        delete[] slots;
+    }
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    /**
+     * Push a value at the bottom. Owner thread only
+     * @return false if the deque is full
+     */
+    bool push(T value) {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        if (b - t > mask) {
+            return false;
+        }
+
+        slots[b & mask].store(value, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * Pop the newest value. Owner thread only
+     * @param value [output] popped value
+     * @return false if the deque is empty or a thief took the last value
+     */
+    bool pop(T* value) {
+        // Reserve the bottom entry before looking at top, so a concurrent steal sees the reservation
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        *value = slots[b & mask].load(std::memory_order_relaxed);
+        if (t == b) {
+            // Last entry: race thieves for it through top
+            bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    /**
+     * Take the oldest value. Any thread
+     * @param value [output] stolen value
+     * @return false if the deque is empty or another thread won the entry
+     */
+    bool steal(T* value) {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b) {
+            return false;
+        }
+
+        T stolen = slots[t & mask].load(std::memory_order_relaxed);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return false;
+        }
+        *value = stolen;
+        return true;
+    }
+
+    /**
+     * Check whether the deque is empty. Only a hint when other threads are pushing or stealing
+     */
+    bool empty() const {
+        return top.load(std::memory_order_acquire) >= bottom.load(std::memory_order_acquire);
+    }
+};
@@ -1,10 +1,47 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
+// 0: vertex color, 1: grayscale. Set per pipeline variant
+layout(constant_id = 0) const uint color_mode = 0;
+
+// Size of the material table's texture array, see MaterialTable.h
+layout(constant_id = 1) const uint texture_capacity = 16;
+
+const uint NO_TEXTURE = 0xffffffff;
+
+struct Material {
+    vec4 base_color;
+    uint base_color_texture;
+    uint padding[3];
+};
+
+// Every material's textures and parameters, indexed by the draw's material
+layout(set = 1, binding = 0) uniform sampler2D textures[texture_capacity];
+layout(set = 1, binding = 1, std430) readonly buffer Materials {
+    Material materials[];
+} table;
+
+layout(push_constant) uniform Scene {
+    vec4 position_scale;
+    vec4 position_offset;
+    uint eye;
+    uint material;
+} scene;
+
 layout(location = 0) in vec3 frag_color;
+layout(location = 3) in vec2 frag_uv;
 
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    outColor = vec4(frag_color, 1.0);
+    Material material = table.materials[scene.material];
+    vec3 color = frag_color * material.base_color.rgb;
+    if (material.base_color_texture != NO_TEXTURE) {
+        color *= texture(textures[material.base_color_texture], frag_uv).rgb;
+    }
+
+    if (color_mode == 1) {
+        color = vec3(dot(color, vec3(0.2126, 0.7152, 0.0722)));
+    }
+    outColor = vec4(color, 1.0);
 }
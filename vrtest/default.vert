@@ -1,16 +1,54 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(location = 0) in vec3 in_position;
-layout(location = 1) in vec3 in_color;
+// Quantized per mesh, see VertexFormat.h. Position w holds the bitangent sign
+layout(location = 0) in vec4 in_position;
+layout(location = 1) in vec4 in_color;
+
+// World matrix per instance, written by the transform hierarchy each frame
+layout(location = 2) in mat4 in_model;
+
+// Octahedral normal in xy and tangent in zw
+layout(location = 6) in vec4 in_normal_tangent;
+layout(location = 7) in vec2 in_uv;
+
+// View-projection per eye, written by the CPU just before submission
+layout(set = 0, binding = 0) uniform LateLatch {
+    mat4 view_proj[2];
+} latch;
+
+// Position decode of the mesh's vertex format, the eye being drawn and the draw's material
+layout(push_constant) uniform Scene {
+    vec4 position_scale;
+    vec4 position_offset;
+    uint eye;
+    uint material;
+} scene;
 
 layout(location = 0) out vec3 frag_color;
+layout(location = 1) out vec3 frag_normal;
+layout(location = 2) out vec4 frag_tangent;
+layout(location = 3) out vec2 frag_uv;
 
 out gl_PerVertex {
     vec4 gl_Position;
 };
 
+vec3 decodeOctahedral(vec2 e) {
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (v.z < 0.0) {
+        v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(v);
+}
+
 void main() {
-    gl_Position = vec4(in_position, 1.0);
-	frag_color = in_color;
+    vec4 decoded = in_position * scene.position_scale + scene.position_offset;
+    gl_Position = latch.view_proj[scene.eye] * in_model * vec4(decoded.xyz, 1.0);
+
+    mat3 normal_matrix = mat3(in_model);
+    frag_color = in_color.rgb;
+    frag_normal = normal_matrix * decodeOctahedral(in_normal_tangent.xy);
+    frag_tangent = vec4(normal_matrix * decodeOctahedral(in_normal_tangent.zw), decoded.w);
+    frag_uv = in_uv;
 }
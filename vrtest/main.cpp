@@ -3,14 +3,60 @@
 #include <vulkan/vulkan.h>
 
 #include <iostream>
+#include <fstream>
 #include <stdexcept>
+#include <future>
+#include <string.h>
 
-#include "PresentationEngine.h"
+#include "WindowPresentationEngine.h"
 #include "GraphicsDevice.h"
 #include "Renderer.h"
+#include "HostAllocator.h"
+#include "StartupProfiler.h"
+#include "Pose.h"
+#include "FramePacer.h"
+#include "RenderThread.h"
+#ifdef VRTEST_FRAME_EXPORT
+#include "ExportPresentationEngine.h"
+#endif
+
+// Where shader sources are watched from and what compiles them. CMake points these at the source tree and the
+// SDK's compiler; the Visual Studio project runs in the source directory with the SDK on the path
+#ifndef VRTEST_SHADER_SOURCE_DIR
+#define VRTEST_SHADER_SOURCE_DIR "."
+#endif
+#ifndef VRTEST_SHADER_COMPILER
+#define VRTEST_SHADER_COMPILER "glslangValidator"
+#endif
 
 class VRTestApp {
 public:
+    /**
+     * Print Vulkan extension/layer/device enumeration during startup
+     */
+    bool verbose = false;
+
+    /**
+     * File to write the startup timing report to, or nullptr for stdout
+     */
+    const char* startup_report = nullptr;
+
+    /**
+     * Directory to write captured frames to, or nullptr to disable capture
+     */
+    const char* capture_directory = nullptr;
+    ImageFileFormat capture_format = ImageFileFormat::Png;
+
+    /**
+     * Shared memory object to export frames to instead of showing a window, or nullptr
+     */
+    const char* export_name = nullptr;
+
+    /**
+     * Recompile and reload the scene shaders when their sources are saved
+     */
+    bool watch_shaders = false;
+
     void run() {
         init();
         mainLoop();
@@ -18,36 +64,165 @@ public:
     }
 
 private:
+    StartupProfiler profiler;
+    HostAllocator* host_allocator = nullptr;
     PresentationEngine* present = nullptr;
     GraphicsDevice* graphics_device = nullptr;
     Renderer* renderer = nullptr;
 
+    /**
+     * No HMD runtime is integrated yet, so drive the view with synthetic head motion
+     */
+    SyntheticPoseSource pose_source;
+
+    /**
+     * Schedules frame starts against the display's vsync
+     */
+    FramePacer* frame_pacer = nullptr;
+
+    /**
+     * Records frames and hands them to the submit thread while this thread handles events and simulation
+     */
+    RenderThread* render_thread = nullptr;
+
+    /**
+     * Scene state the simulation hands to the render thread each frame
+     */
+    uint32_t color_mode = 0;
+
     void init() {
-        present = new PresentationEngine(1024, 768, nullptr, "vrtest");
-        graphics_device = new GraphicsDevice(present, nullptr);
-        renderer = new Renderer(graphics_device, present, nullptr);
+        uint32_t init_phase = profiler.beginPhase("init");
+
+        host_allocator = new HostAllocator(2);
+        VkAllocationCallbacks* p_allocs = host_allocator->getCallbacks();
+
+        {
+            ScopedPhase phase(&profiler, "window creation");
+#ifdef VRTEST_FRAME_EXPORT
+            if (export_name) {
+                present = new ExportPresentationEngine(1024, 768, 3, 3, p_allocs, "vrtest", export_name);
+            }
+#endif
+            if (!present) {
+                present = new WindowPresentationEngine(1024, 768, p_allocs, "vrtest");
+            }
+        }
+
+        // Shader code doesn't depend on the device, so load it (or copy it out of the binary) while the device is
+        // being created
+        auto read_shader = [this](const char* filename) {
+            ScopedPhase phase(&profiler, "shader file load");
+            return GraphicsDevice::getShaderCode(filename);
+        };
+        std::future<std::vector<char>> vert_code = std::async(std::launch::async, read_shader, "vert.spv");
+        std::future<std::vector<char>> frag_code = std::async(std::launch::async, read_shader, "frag.spv");
+
+        graphics_device = new GraphicsDevice(present, p_allocs, verbose, &profiler);
+        renderer = new Renderer(graphics_device, present, p_allocs, &profiler);
+        renderer->setShaderCode(vert_code.get(), frag_code.get());
+        renderer->setPoseSource(&pose_source);
+
+        frame_pacer = new FramePacer(present->getRefreshInterval());
+        renderer->setFramePacer(frame_pacer);
+
+        if (capture_directory) {
+            renderer->enableCapture(capture_directory, capture_format);
+        }
+
         renderer->createCommandBuffer();
+
+        if (watch_shaders) {
+            renderer->enableShaderReload(VRTEST_SHADER_SOURCE_DIR, VRTEST_SHADER_COMPILER);
+        }
+
+        profiler.endPhase(init_phase);
     }
  
     void mainLoop() {
+        bool first_frame = true;
+        uint64_t frame = 0;
+
+        // The render thread owns the renderer and presentation engine from here until it is deleted
+        render_thread = new RenderThread(renderer, graphics_device->getSubmitQueue(), frame_pacer, host_allocator);
+
         while (!present->shouldExit()) {
             present->pollEvents();
-            renderer->drawFrame();
+
+            // Waits while the render thread is two frames behind, which bounds latency from input to display
+            RenderPacket* packet = render_thread->acquirePacket();
+            packet->frame = ++frame;
+            packet->sim_time = getPoseTime();
+            packet->color_mode = color_mode;
+            render_thread->submitPacket(packet);
+
+            if (first_frame && render_thread->getSubmittedFrameCount() > 0) {
+                first_frame = false;
+                profiler.mark("first frame submitted");
+                writeStartupReport();
+            }
         }
 
+        delete render_thread;
+        render_thread = nullptr;
+
         vkDeviceWaitIdle(graphics_device->device());
     }
 
+    void writeStartupReport() {
+        if (startup_report) {
+            std::ofstream report(startup_report);
+            profiler.writeReport(report);
+        }
+        else {
+            profiler.writeReport(std::cout);
+        }
+    }
+
     void cleanup() {
+        delete render_thread;
         delete renderer;
+        delete frame_pacer;
         delete present;
+        graphics_device->getMemoryTelemetry()->printStats(std::cout);
         delete graphics_device;
+
+        host_allocator->printStats(std::cout);
+        delete host_allocator;
     }
 };
 
-int main() {
+int main(int argc, char** argv) {
     VRTestApp app;
 
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--verbose") == 0) {
+            app.verbose = true;
+        }
+        else if (strcmp(argv[i], "--watch-shaders") == 0) {
+            app.watch_shaders = true;
+        }
+        else if (strcmp(argv[i], "--startup-report") == 0 && i + 1 < argc) {
+            app.startup_report = argv[++i];
+        }
+        else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            app.capture_directory = argv[++i];
+        }
+        else if (strcmp(argv[i], "--export") == 0 && i + 1 < argc) {
+#ifdef VRTEST_FRAME_EXPORT
+            app.export_name = argv[++i];
+#else
+            std::cerr << "Frame export is not supported on this platform" << std::endl;
+            return EXIT_FAILURE;
+#endif
+        }
+        else if (strcmp(argv[i], "--capture-format") == 0 && i + 1 < argc) {
+            if (!parseImageFileFormat(argv[++i], &app.capture_format)) {
+                std::cerr << "Unknown capture format " << argv[i] << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
     try {
         app.run();
     }
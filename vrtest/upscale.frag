@@ -0,0 +1,59 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Foveation rings from the inset outwards. Unused entries alias ring 0
+layout(set = 0, binding = 0) uniform sampler2D rings[3];
+
+layout(push_constant) uniform Upscale {
+    // xy: outer radius of rings 0 and 1, w: blend band width. In units of eye height
+    vec4 ring_radius;
+    // Ring centers of the left (xy) and right (zw) eye in eye-local coordinates
+    vec4 centers;
+    // Fraction of each ring target that was rendered to on each axis
+    float scale;
+    // Eye width over height
+    float aspect;
+    uint ring_count;
+} upscale;
+
+layout(location = 0) in vec2 in_uv;
+
+layout(location = 0) out vec4 outColor;
+
+vec4 sampleRing(sampler2D ring, float eye_start) {
+    // Eyes are packed side by side, so keep bilinear taps from crossing into the other eye
+    vec2 texel = 1.0 / vec2(textureSize(ring, 0));
+    float eye_width = 0.5 * upscale.scale;
+    float start = eye_start * upscale.scale;
+
+    vec2 uv = in_uv * upscale.scale;
+    uv.x = clamp(uv.x, start + 0.5 * texel.x, start + eye_width - 0.5 * texel.x);
+    uv.y = min(uv.y, upscale.scale - 0.5 * texel.y);
+
+    return textureLod(ring, uv, 0.0);
+}
+
+void main() {
+    float eye_start = in_uv.x < 0.5 ? 0.0 : 0.5;
+    vec2 eye_uv = vec2((in_uv.x - eye_start) * 2.0, in_uv.y);
+    vec2 center = in_uv.x < 0.5 ? upscale.centers.xy : upscale.centers.zw;
+    float dist = length((eye_uv - center) * vec2(upscale.aspect, 1.0));
+    float blend = upscale.ring_radius.w;
+
+    // Each ring fades into the next just inside its outer radius, where both were rendered
+    vec4 color = sampleRing(rings[0], eye_start);
+    if (upscale.ring_count > 1) {
+        float t = smoothstep(upscale.ring_radius.x - blend, upscale.ring_radius.x, dist);
+        if (t > 0.0) {
+            color = mix(color, sampleRing(rings[1], eye_start), t);
+        }
+    }
+    if (upscale.ring_count > 2) {
+        float t = smoothstep(upscale.ring_radius.y - blend, upscale.ring_radius.y, dist);
+        if (t > 0.0) {
+            color = mix(color, sampleRing(rings[2], eye_start), t);
+        }
+    }
+
+    outColor = color;
+}
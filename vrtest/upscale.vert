@@ -0,0 +1,14 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) out vec2 out_uv;
+
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+// Single triangle covering the screen, no vertex buffer needed
+void main() {
+    out_uv = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+    gl_Position = vec4(out_uv * 2.0 - 1.0, 0.0, 1.0);
+}